@@ -14,6 +14,12 @@ android {
         ndk {
             abiFilters += arrayOf("arm64-v8a", "armeabi-v7a", "x86_64", "x86")
         }
+        externalNativeBuild {
+            cmake {
+                arguments += "-DTAGLIB_EXT_ALLOC_STATS=${findProperty("taglib.allocStats") ?: "OFF"}"
+                arguments += "-DTAGLIB_EXT_FORMATS=${findProperty("taglib.formats") ?: "ALL"}"
+            }
+        }
 
         testInstrumentationRunner = "androidx.test.runner.AndroidJUnitRunner"
     }
@@ -3,12 +3,18 @@ import android.graphics.Bitmap
 import android.graphics.BitmapFactory
 import android.os.ParcelFileDescriptor
 import androidx.test.platform.app.InstrumentationRegistry
+import com.kyant.taglib.LibraryChangeType
+import com.kyant.taglib.LibraryWatcher
+import com.kyant.taglib.ParseStats
 import com.kyant.taglib.Picture
+import com.kyant.taglib.PictureSource
+import com.kyant.taglib.TagIndex
 import com.kyant.taglib.TagLib
 import org.junit.Assert
 import org.junit.Test
 import java.io.ByteArrayOutputStream
 import java.io.File
+import java.nio.ByteBuffer
 import java.nio.charset.Charset
 
 class Tests {
@@ -21,6 +27,18 @@ class Tests {
         read_flac_multiple_pictures()
         ensure_utf8()
         bad_encoding()
+        collect_stats()
+        save_picture_sources_flac()
+        export_pictures()
+        reuse_mp4_atom_index()
+        skip_flac_pictures()
+        defer_mp3_frames()
+        keep_mp3_picture_order()
+        hash_audio_data()
+        intern_property_strings()
+        detection_order()
+        watch_library()
+        index_tags()
     }
 
     private fun read_and_write_m4a() {
@@ -30,6 +48,8 @@ class Tests {
 
             val audioProperties = TagLib.getAudioProperties(fd.dup().detachFd())!!
             Assert.assertEquals(39936, audioProperties.length)
+            Assert.assertFalse(audioProperties.isLengthEstimated)
+            Assert.assertEquals(1f, audioProperties.lengthConfidence)
 
             // Read metadata
 
@@ -153,6 +173,378 @@ class Tests {
         }
     }
 
+    private fun collect_stats() {
+        getFdFromAssets(context, "Sample_BeeMoved_48kHz16bit.m4a").use { fd ->
+            TagLib.setStatsEnabled(true)
+            TagLib.resetAggregatedStats()
+
+            TagLib.getMetadata(fd.dup().detachFd())!!
+            val stats = TagLib.getLastStats()!!
+            Assert.assertEquals("MP4", stats.format)
+            Assert.assertEquals(1L, stats.calls)
+            Assert.assertTrue(stats.bytesRead > 0)
+            Assert.assertTrue(stats.readCalls > 0)
+            if (TagLib.isAllocationStatsAvailable()) {
+                Assert.assertTrue(stats.allocations > 0)
+                Assert.assertTrue(stats.peakLiveBytes > 0)
+            }
+
+            TagLib.getAudioProperties(fd.dup().detachFd())!!
+            val aggregated = TagLib.getAggregatedStats().reduce(ParseStats::plus)
+            Assert.assertEquals(2L, aggregated.calls)
+            Assert.assertTrue(aggregated.bytesRead > stats.bytesRead)
+
+            TagLib.setStatsEnabled(false)
+        }
+    }
+
+    private fun save_picture_sources_flac() {
+        getFdFromAssets(context, "multiple_album_art.flac").use { fd ->
+            val picture = TagLib.getPictures(fd.dup().detachFd())[2]
+
+            // Save from a direct buffer, the picture data preceded by unrelated bytes
+
+            val buffer = ByteBuffer.allocateDirect(picture.data.size + 16)
+            buffer.position(16)
+            buffer.put(picture.data)
+            buffer.position(16)
+            val fromBuffer = PictureSource.fromBuffer(
+                buffer = buffer,
+                description = picture.description,
+                pictureType = picture.pictureType,
+                mimeType = picture.mimeType,
+            )
+            Assert.assertTrue(TagLib.savePictureSources(fd.dup().detachFd(), arrayOf(fromBuffer)))
+            Assert.assertEquals(16, buffer.position())
+            Assert.assertEquals(picture, TagLib.getPictures(fd.dup().detachFd()).single())
+
+            // Save from a range of another file
+
+            val file = File(context.cacheDir, "picture_source.bin").apply {
+                writeBytes(ByteArray(16) + picture.data)
+            }
+            ParcelFileDescriptor.open(file, ParcelFileDescriptor.MODE_READ_ONLY).use { source ->
+                val fromFd = PictureSource.fromFd(
+                    fd = source.fd,
+                    offset = 16,
+                    length = picture.data.size.toLong(),
+                    description = "Back Cover",
+                    pictureType = "Back Cover",
+                    mimeType = picture.mimeType,
+                )
+                Assert.assertTrue(TagLib.savePictureSources(fd.dup().detachFd(), arrayOf(fromBuffer, fromFd)))
+            }
+            val pictures = TagLib.getPictures(fd.dup().detachFd())
+            Assert.assertEquals(2, pictures.size)
+            Assert.assertArrayEquals(picture.data, pictures[1].data)
+            Assert.assertEquals("Back Cover", pictures[1].pictureType)
+
+            // A range past the end of the source cannot be read, the file is left as is
+
+            ParcelFileDescriptor.open(file, ParcelFileDescriptor.MODE_READ_ONLY).use { source ->
+                val outOfRange = PictureSource.fromFd(
+                    fd = source.fd,
+                    offset = file.length(),
+                    length = 1,
+                    description = "",
+                    pictureType = "Front Cover",
+                    mimeType = picture.mimeType,
+                )
+                Assert.assertFalse(TagLib.savePictureSources(fd.dup().detachFd(), arrayOf(outOfRange)))
+            }
+            Assert.assertEquals(2, TagLib.getPictures(fd.dup().detachFd()).size)
+        }
+    }
+
+    private fun export_pictures() {
+        val output = File(context.cacheDir, "exported_picture.bin")
+
+        // Stored as is in FLAC and MP4, copied from the file
+
+        getFdFromAssets(context, "multiple_album_art.flac").use { fd ->
+            val frontCover = TagLib.getFrontCover(fd.dup().detachFd())!!
+            val exported = ParcelFileDescriptor.open(
+                output,
+                ParcelFileDescriptor.MODE_WRITE_ONLY or ParcelFileDescriptor.MODE_CREATE or
+                        ParcelFileDescriptor.MODE_TRUNCATE,
+            ).use { out ->
+                TagLib.exportPicture(fd.dup().detachFd(), out.fd)!!
+            }
+            Assert.assertEquals(frontCover.mimeType, exported.mimeType)
+            Assert.assertEquals(frontCover.pictureType, exported.pictureType)
+            Assert.assertEquals(frontCover.data.size.toLong(), exported.size)
+            Assert.assertArrayEquals(frontCover.data, output.readBytes())
+        }
+
+        getFdFromAssets(context, "Sample_BeeMoved_48kHz16bit.m4a").use { fd ->
+            val picture = TagLib.getPictures(fd.dup().detachFd()).single()
+            val exported = ParcelFileDescriptor.open(
+                output,
+                ParcelFileDescriptor.MODE_WRITE_ONLY or ParcelFileDescriptor.MODE_CREATE or
+                        ParcelFileDescriptor.MODE_TRUNCATE,
+            ).use { out ->
+                TagLib.exportPicture(fd.dup().detachFd(), out.fd)!!
+            }
+            Assert.assertEquals(picture.mimeType, exported.mimeType)
+            Assert.assertArrayEquals(picture.data, output.readBytes())
+        }
+
+        // No pictures
+
+        getFdFromAssets(context, "bladeenc.mp3").use { fd ->
+            ParcelFileDescriptor.open(output, ParcelFileDescriptor.MODE_WRITE_ONLY).use { out ->
+                Assert.assertNull(TagLib.exportPicture(fd.dup().detachFd(), out.fd))
+            }
+        }
+    }
+
+    private fun reuse_mp4_atom_index() {
+        getFdFromAssets(context, "Sample_BeeMoved_48kHz16bit.m4a").use { fd ->
+            TagLib.setStatsEnabled(true)
+
+            // The second read finds the atom index built by the first one
+
+            TagLib.getMetadata(fd.dup().detachFd())!!
+            val first = TagLib.getLastStats()!!
+            val metadata = TagLib.getMetadata(fd.dup().detachFd())!!
+            val second = TagLib.getLastStats()!!
+            Assert.assertTrue(second.readCalls < first.readCalls)
+            Assert.assertTrue(second.bytesRead < first.bytesRead)
+
+            // Saving drops it, the next read sees the new tag
+
+            val newPropertyMap = metadata.propertyMap.apply {
+                this["ALBUM"] = arrayOf("Indexed")
+            }
+            Assert.assertTrue(TagLib.savePropertyMap(fd.dup().detachFd(), newPropertyMap))
+            val newMetadata = TagLib.getMetadata(fd.dup().detachFd())!!
+            Assert.assertEquals("Indexed", newMetadata.propertyMap["ALBUM"]!!.single())
+            Assert.assertEquals(58336, newMetadata.pictures.single().data.size)
+
+            TagLib.setStatsEnabled(false)
+        }
+    }
+
+    private fun skip_flac_pictures() {
+        getFdFromAssets(context, "multiple_album_art.flac").use { fd ->
+            TagLib.setStatsEnabled(true)
+
+            // Without pictures, the PICTURE blocks are not read at all
+
+            val metadata = TagLib.getMetadata(fd.dup().detachFd(), readPictures = false)!!
+            val withoutPictures = TagLib.getLastStats()!!
+            val metadataWithPictures = TagLib.getMetadata(fd.dup().detachFd(), readPictures = true)!!
+            val withPictures = TagLib.getLastStats()!!
+            Assert.assertTrue(withoutPictures.bytesRead + 29766L < withPictures.bytesRead)
+            Assert.assertEquals(metadataWithPictures.propertyMap.keys, metadata.propertyMap.keys)
+            Assert.assertEquals(3, metadataWithPictures.pictures.size)
+            Assert.assertEquals(29766, metadataWithPictures.pictures[2].data.size)
+
+            TagLib.setStatsEnabled(false)
+        }
+    }
+
+    private fun defer_mp3_frames() {
+        val picture = getFdFromAssets(context, "multiple_album_art.flac").use { fd ->
+            TagLib.getPictures(fd.dup().detachFd())[2]
+        }
+        getFdFromAssets(context, "bladeenc.mp3").use { fd ->
+            val lyrics = "La la la\n".repeat(200)
+            val propertyMap = TagLib.getMetadata(fd.dup().detachFd())!!.propertyMap.apply {
+                this["LYRICS"] = arrayOf(lyrics)
+            }
+            Assert.assertTrue(TagLib.savePropertyMap(fd.dup().detachFd(), propertyMap))
+            Assert.assertTrue(TagLib.savePictures(fd.dup().detachFd(), arrayOf(picture)))
+
+            // The picture and lyrics frames are decoded only when they are read
+
+            Assert.assertArrayEquals(arrayOf("Test"), TagLib.getMetadataPropertyValues(fd.dup().detachFd(), "TITLE"))
+            Assert.assertArrayEquals(arrayOf(lyrics), TagLib.getMetadataPropertyValues(fd.dup().detachFd(), "LYRICS"))
+            val metadata = TagLib.getMetadata(fd.dup().detachFd(), readPictures = false)!!
+            Assert.assertEquals(lyrics, metadata.propertyMap["LYRICS"]!!.single())
+            Assert.assertEquals(picture, TagLib.getPictures(fd.dup().detachFd()).single())
+        }
+    }
+
+    private fun keep_mp3_picture_order() {
+        val icon = Picture(ByteArray(100) { it.toByte() }, "Icon", "File Icon", "image/png")
+        val backCover = getFdFromAssets(context, "multiple_album_art.flac").use { fd ->
+            TagLib.getPictures(fd.dup().detachFd())[2].copy(pictureType = "Back Cover")
+        }
+        getFdFromAssets(context, "bladeenc.mp3").use { fd ->
+            Assert.assertTrue(TagLib.savePictures(fd.dup().detachFd(), arrayOf(icon, backCover)))
+
+            // The small icon is decoded at once and the large cover on demand, in their order in the tag
+
+            Assert.assertArrayEquals(arrayOf(icon, backCover), TagLib.getPictures(fd.dup().detachFd()))
+            Assert.assertEquals(icon, TagLib.getFrontCover(fd.dup().detachFd()))
+            val output = File(context.cacheDir, "exported_icon.bin")
+            ParcelFileDescriptor.open(
+                output,
+                ParcelFileDescriptor.MODE_WRITE_ONLY or ParcelFileDescriptor.MODE_CREATE or
+                        ParcelFileDescriptor.MODE_TRUNCATE,
+            ).use { out ->
+                Assert.assertEquals("File Icon", TagLib.exportPicture(fd.dup().detachFd(), out.fd)!!.pictureType)
+            }
+            Assert.assertArrayEquals(icon.data, output.readBytes())
+        }
+    }
+
+    private fun hash_audio_data() {
+        val picture = getFdFromAssets(context, "multiple_album_art.flac").use { fd ->
+            TagLib.getPictures(fd.dup().detachFd())[2]
+        }
+        for (fileName in listOf("Sample_BeeMoved_48kHz16bit.m4a", "multiple_album_art.flac", "bladeenc.mp3")) {
+            getFdFromAssets(context, fileName).use { fd ->
+                val hash = TagLib.getAudioHash(fd.dup().detachFd())!!
+                Assert.assertEquals(16, hash.length)
+                Assert.assertEquals(hash, TagLib.getAudioHash(fd.dup().detachFd(), threads = 4))
+
+                // Editing the tags and pictures leaves the audio data as is
+
+                val propertyMap = TagLib.getMetadata(fd.dup().detachFd())!!.propertyMap.apply {
+                    this["COMMENT"] = arrayOf("x".repeat(10000))
+                }
+                Assert.assertTrue(TagLib.savePropertyMap(fd.dup().detachFd(), propertyMap))
+                Assert.assertTrue(TagLib.savePictures(fd.dup().detachFd(), arrayOf(picture)))
+                Assert.assertEquals(hash, TagLib.getAudioHash(fd.dup().detachFd()))
+            }
+        }
+    }
+
+    private fun intern_property_strings() {
+        getFdFromAssets(context, "Sample_BeeMoved_48kHz16bit.m4a").use { fd ->
+            val propertyMap = TagLib.getMetadata(fd.dup().detachFd())!!.propertyMap
+            Assert.assertSame("TITLE", propertyMap.keys.single { it == "TITLE" })
+
+            TagLib.setValueInterningEnabled(true)
+            val first = TagLib.getMetadata(fd.dup().detachFd())!!.propertyMap
+            val second = TagLib.getMetadata(fd.dup().detachFd())!!.propertyMap
+            Assert.assertSame(first["ARTIST"]!!.single(), second["ARTIST"]!!.single())
+            Assert.assertSame(
+                first["ARTIST"]!!.single(),
+                TagLib.getMetadataPropertyValues(fd.dup().detachFd(), "ARTIST")!!.single(),
+            )
+            Assert.assertNotSame(first["TITLE"]!!.single(), second["TITLE"]!!.single())
+            TagLib.setValueInterningEnabled(false)
+
+            val third = TagLib.getMetadata(fd.dup().detachFd())!!.propertyMap
+            Assert.assertNotSame(first["ARTIST"]!!.single(), third["ARTIST"]!!.single())
+            Assert.assertEquals(first["ARTIST"]!!.single(), third["ARTIST"]!!.single())
+        }
+    }
+
+    private fun detection_order() {
+        val formats = TagLib.getFormats()
+        TagLib.setDetectionOrder(arrayOf("FLAC", "MP4", "Unknown"))
+        Assert.assertArrayEquals(
+            arrayOf("FLAC", "MP4") + formats.filter { it != "FLAC" && it != "MP4" },
+            TagLib.getFormats(),
+        )
+
+        getFdFromAssets(context, "Sample_BeeMoved_48kHz16bit.m4a").use { fd ->
+            val metadata = TagLib.getMetadata(fd.dup().detachFd())!!
+            Assert.assertEquals("Bee Moved", metadata.propertyMap["TITLE"]!!.single())
+        }
+
+        TagLib.setDetectionOrder(formats)
+        Assert.assertArrayEquals(formats, TagLib.getFormats())
+    }
+
+    private fun watch_library() {
+        val root = File(context.cacheDir, "library").apply {
+            deleteRecursively()
+            mkdirs()
+        }
+        LibraryWatcher(quietMillis = 100).use { watcher ->
+            Assert.assertTrue(watcher.addRoot(root.path))
+            Assert.assertEquals(0, watcher.waitForChanges(timeoutMillis = 100).size)
+
+            // Copy an album, writing the track several times and adding a file that is not audio
+            val album = File(root, "album").apply { mkdirs() }
+            val track = File(album, "track.m4a")
+            repeat(3) {
+                getFileFromAssets(context, "Sample_BeeMoved_48kHz16bit.m4a").copyTo(track, overwrite = true)
+            }
+            File(album, "notes.txt").writeText("notes")
+            val changed = watcher.waitForChanges(timeoutMillis = 5000).single()
+            Assert.assertEquals(LibraryChangeType.Changed, changed.type)
+            Assert.assertEquals(track.path, changed.path)
+            Assert.assertEquals("Bee Moved", changed.propertyMap!!["TITLE"]!!.single())
+            Assert.assertEquals(39936, changed.length)
+
+            album.deleteRecursively()
+            val removed = watcher.waitForChanges(timeoutMillis = 5000).single()
+            Assert.assertEquals(LibraryChangeType.Removed, removed.type)
+            Assert.assertEquals(album.path, removed.path)
+            Assert.assertTrue(removed.isDirectory)
+
+            val thread = Thread { watcher.wakeUp() }
+            thread.start()
+            Assert.assertEquals(0, watcher.waitForChanges().size)
+            thread.join()
+        }
+        root.deleteRecursively()
+
+        // Closing from another thread ends a waitForChanges() in progress
+        val waiting = LibraryWatcher()
+        val waiter = Thread { runCatching { waiting.waitForChanges() } }
+        waiter.start()
+        Thread.sleep(100)
+        waiting.close()
+        waiter.join(5000)
+        Assert.assertFalse(waiter.isAlive)
+
+        // A late wakeUp() does nothing, the other calls fail
+        val closed = LibraryWatcher().apply { close() }
+        closed.wakeUp()
+        Assert.assertThrows(IllegalStateException::class.java) { closed.waitForChanges(timeoutMillis = 0) }
+    }
+
+    private fun index_tags() {
+        TagIndex(arrayOf("ARTIST", "ALBUM", "TITLE")).use { index ->
+            val m4a = getFdFromAssets(context, "Sample_BeeMoved_48kHz16bit.m4a").use { fd ->
+                index.add(fd.dup().detachFd())
+            }
+            val flac = getFdFromAssets(context, "是什么让我遇见这样的你 - 白安.flac").use { fd ->
+                index.add(fd.dup().detachFd())
+            }
+            Assert.assertEquals(2, index.size)
+            Assert.assertTrue(index.memoryUsage > 0)
+
+            Assert.assertArrayEquals(intArrayOf(m4a), index.prefixSearch("TITLE", "mov"))
+            Assert.assertArrayEquals(intArrayOf(m4a), index.search("TITLE", "EE MO"))
+            Assert.assertArrayEquals(intArrayOf(flac), index.search("TITLE", "遇见"))
+            Assert.assertEquals(0, index.search("TITLE", "not there").size)
+            Assert.assertEquals(0, index.search("GENRE", "bee").size)
+            Assert.assertEquals("Bee Moved", index.getValue("TITLE", m4a))
+
+            val titles = index.groups("TITLE")
+            Assert.assertEquals(2, titles.size)
+            Assert.assertEquals("Bee Moved", index.getValue("TITLE", titles.first()))
+            Assert.assertArrayEquals(intArrayOf(m4a), index.groupRows("TITLE", m4a))
+            Assert.assertArrayEquals(intArrayOf(m4a), index.groups("TITLE", "TITLE", m4a))
+
+            Assert.assertTrue(index.remove(m4a))
+            Assert.assertEquals(0, index.search("TITLE", "bee").size)
+            Assert.assertNull(index.getValue("TITLE", m4a))
+
+            // The properties read by a scan are added without parsing the file again
+            val metadata = getFdFromAssets(context, "Sample_BeeMoved_48kHz16bit.m4a").use { fd ->
+                TagLib.getMetadata(fd.dup().detachFd(), readPictures = false)
+            }
+            val scanned = index.add(metadata!!.propertyMap)
+            Assert.assertEquals(3, index.size)
+            Assert.assertArrayEquals(intArrayOf(scanned), index.search("TITLE", "bee"))
+            Assert.assertEquals("Bee Moved", index.getValue("TITLE", scanned))
+        }
+
+        // Calls after close() fail instead of using the destroyed index
+        val closed = TagIndex(arrayOf("TITLE")).apply { close() }
+        Assert.assertThrows(IllegalStateException::class.java) { closed.search("TITLE", "bee") }
+        closed.close()
+    }
+
     private fun getFdFromAssets(context: Context, fileName: String): ParcelFileDescriptor {
         val file = getFileFromAssets(context, fileName)
         return ParcelFileDescriptor.open(file, ParcelFileDescriptor.MODE_READ_WRITE)
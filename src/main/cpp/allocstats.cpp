@@ -0,0 +1,117 @@
+#include "allocstats.h"
+
+#ifdef TAGLIB_EXT_ALLOC_STATS
+
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+namespace {
+    // Plain old data, so that it is usable from operator new and delete during
+    // thread start up and tear down.
+    thread_local TagLibExt::AllocationCounters counters;
+
+    void *allocate(std::size_t size) noexcept {
+        void *ptr = std::malloc(size == 0 ? 1 : size);
+        if (ptr) {
+            const auto usable = static_cast<int64_t>(malloc_usable_size(ptr));
+            counters.allocations++;
+            counters.bytes += usable;
+            counters.liveBytes += usable;
+            if (counters.liveBytes > counters.peakLiveBytes) {
+                counters.peakLiveBytes = counters.liveBytes;
+            }
+        }
+        return ptr;
+    }
+
+    void deallocate(void *ptr) noexcept {
+        if (ptr) {
+            counters.liveBytes -= static_cast<int64_t>(malloc_usable_size(ptr));
+            std::free(ptr);
+        }
+    }
+}
+
+void *operator new(std::size_t size) {
+    void *ptr = allocate(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](std::size_t size) {
+    void *ptr = allocate(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    deallocate(ptr);
+}
+
+namespace TagLibExt {
+
+    bool allocationStatsAvailable() {
+        return true;
+    }
+
+    AllocationCounters threadAllocationCounters() {
+        return counters;
+    }
+
+    void resetThreadPeakLiveBytes() {
+        counters.peakLiveBytes = counters.liveBytes;
+    }
+
+} // namespace TagLibExt
+
+#else
+
+namespace TagLibExt {
+
+    bool allocationStatsAvailable() {
+        return false;
+    }
+
+    AllocationCounters threadAllocationCounters() {
+        return {};
+    }
+
+    void resetThreadPeakLiveBytes() {
+    }
+
+} // namespace TagLibExt
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TAGLIB_EXT_ALLOCSTATS_H
+#define TAGLIB_EXT_ALLOCSTATS_H
+
+#include <cstdint>
+
+namespace TagLibExt {
+
+    //! Heap allocation counters of the calling thread.
+
+    struct AllocationCounters {
+        //! Number of allocations made through operator new
+        uint64_t allocations{0};
+        //! Total bytes of these allocations
+        uint64_t bytes{0};
+        //! Bytes currently allocated and not freed yet
+        int64_t liveBytes{0};
+        //! Highest value liveBytes has reached since the last resetThreadPeakLiveBytes()
+        int64_t peakLiveBytes{0};
+    };
+
+    /*!
+     * Returns \c true if the library was built with TAGLIB_EXT_ALLOC_STATS, which
+     * replaces the global operator new and delete with counting versions.
+     * Otherwise all counters stay zero.
+     */
+    bool allocationStatsAvailable();
+
+    /*!
+     * Returns the counters of the calling thread.  Memory freed on another thread
+     * than it was allocated on is subtracted from that other thread's live bytes.
+     */
+    AllocationCounters threadAllocationCounters();
+
+    //! Resets the peak live bytes of the calling thread to its current live bytes.
+    void resetThreadPeakLiveBytes();
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_ALLOCSTATS_H
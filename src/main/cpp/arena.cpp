@@ -0,0 +1,112 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+namespace TagLibExt {
+    namespace {
+        thread_local int scopeDepth = 0;
+
+        uintptr_t alignUp(uintptr_t value, size_t alignment) {
+            return (value + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+        }
+    }
+
+    Arena::Arena(size_t blockSize, size_t retainedSize) :
+            blockSize(blockSize), retainedSize(retainedSize) {
+    }
+
+    Arena::~Arena() {
+        while (head) {
+            Block *next = head->next;
+            ::operator delete(head);
+            head = next;
+        }
+    }
+
+    void *Arena::allocate(size_t size, size_t alignment) {
+        uintptr_t aligned = alignUp(reinterpret_cast<uintptr_t>(cursor), alignment);
+        if (!cursor || aligned + size > reinterpret_cast<uintptr_t>(limit)) {
+            nextBlock(size, alignment);
+            aligned = alignUp(reinterpret_cast<uintptr_t>(cursor), alignment);
+        }
+        cursor = reinterpret_cast<char *>(aligned + size);
+        return reinterpret_cast<void *>(aligned);
+    }
+
+    void Arena::reset() {
+        size_t retained = 0;
+        Block **link = &head;
+        while (*link) {
+            Block *block = *link;
+            if (retained + block->size > retainedSize) {
+                *link = block->next;
+                ::operator delete(block);
+                continue;
+            }
+            retained += block->size;
+            link = &block->next;
+        }
+
+        current = head;
+        cursor = current ? begin(current) : nullptr;
+        limit = current ? end(current) : nullptr;
+    }
+
+    size_t Arena::capacity() const {
+        size_t size = 0;
+        for (const Block *block = head; block; block = block->next) {
+            size += block->size;
+        }
+        return size;
+    }
+
+    void Arena::nextBlock(size_t size, size_t alignment) {
+        const size_t required = size + alignment;
+
+        // Reuse the following retained block if it is large enough, otherwise
+        // insert a new block after the current one.
+        Block *next = current ? current->next : head;
+        if (!next || next->size < required) {
+            const size_t dataSize = std::max(blockSize, required);
+            auto *block = static_cast<Block *>(::operator new(sizeof(Block) + dataSize));
+            block->size = dataSize;
+            block->next = next;
+            if (current) {
+                current->next = block;
+            } else {
+                head = block;
+            }
+            next = block;
+        }
+
+        current = next;
+        cursor = begin(current);
+        limit = end(current);
+    }
+
+    char *Arena::begin(Block *block) {
+        return reinterpret_cast<char *>(block) + sizeof(Block);
+    }
+
+    char *Arena::end(Block *block) {
+        return begin(block) + block->size;
+    }
+
+    Arena &threadArena() {
+        thread_local Arena arena;
+        return arena;
+    }
+
+    ArenaScope::ArenaScope() {
+        scopeDepth++;
+    }
+
+    ArenaScope::~ArenaScope() {
+        if (--scopeDepth == 0) {
+            threadArena().reset();
+        }
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,81 @@
+#ifndef TAGLIB_EXT_ARENA_H
+#define TAGLIB_EXT_ARENA_H
+
+#include <cstddef>
+
+namespace TagLibExt {
+
+    /*!
+     * A monotonic allocator for short-lived scratch data: allocations are bumped
+     * out of large blocks and are never freed individually, reset() frees them
+     * all at once.  Blocks up to the retained size are kept for reuse, so that a
+     * reused arena stops allocating from the heap once it is warm.
+     */
+    class Arena {
+    public:
+        static constexpr size_t DefaultBlockSize = 64 * 1024;
+        static constexpr size_t DefaultRetainedSize = 1024 * 1024;
+
+        explicit Arena(size_t blockSize = DefaultBlockSize, size_t retainedSize = DefaultRetainedSize);
+
+        ~Arena();
+
+        Arena(const Arena &) = delete;
+
+        Arena &operator=(const Arena &) = delete;
+
+        void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        template<class T>
+        T *allocate(size_t count) {
+            return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+        }
+
+        //! Frees all allocations, keeping blocks up to the retained size.
+        void reset();
+
+        //! Total size of the blocks currently owned by the arena.
+        [[nodiscard]] size_t capacity() const;
+
+    private:
+        struct Block {
+            Block *next;
+            size_t size;
+        };
+
+        void nextBlock(size_t size, size_t alignment);
+
+        static char *begin(Block *block);
+
+        static char *end(Block *block);
+
+        Block *head{nullptr};
+        Block *current{nullptr};
+        char *cursor{nullptr};
+        char *limit{nullptr};
+        size_t blockSize;
+        size_t retainedSize;
+    };
+
+    //! Returns the arena of the calling thread, shared by all calls made on it.
+    Arena &threadArena();
+
+    /*!
+     * Marks the lifetime of the scratch data of one native call.  The thread
+     * arena is reset when the outermost scope on the thread ends, so nested
+     * calls, e.g. in batch modes, keep their scratch data until the batch ends.
+     */
+    class ArenaScope {
+    public:
+        ArenaScope();
+
+        ~ArenaScope();
+
+        ArenaScope(const ArenaScope &) = delete;
+
+        ArenaScope &operator=(const ArenaScope &) = delete;
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_ARENA_H
@@ -0,0 +1,537 @@
+#include "audio_hash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "apefile.h"
+#include "asffile.h"
+#include "aifffile.h"
+#include "dsdifffile.h"
+#include "dsffile.h"
+#include "flacfile.h"
+#include "matroskafile.h"
+#include "mp4file.h"
+#include "mpegfile.h"
+#include "oggfile.h"
+#include "wavfile.h"
+#include "wavpackfile.h"
+
+#include "fdio.h"
+#include "flac_index.h"
+#include "hash.h"
+#include "mkv_index.h"
+#include "mp4_index.h"
+#include "mpeg_length.h"
+
+namespace TagLibExt {
+    namespace {
+        // Read at once when hashing Ogg pages
+        constexpr size_t oggWindow = ChunkedHash::ChunkSize;
+
+        ByteVector readAt(IOStream *stream, offset_t offset, size_t length) {
+            stream->seek(offset);
+            return stream->readBlock(length);
+        }
+
+        void addReads(ParseStats *stats, uint64_t bytes, uint64_t calls) {
+            if (stats) {
+                stats->bytesRead += bytes;
+                stats->readCalls += calls;
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Tags around the audio data
+        ////////////////////////////////////////////////////////////////////////////////
+
+        // End of the ID3v2 tag at the start of the file, 0 if there is none.
+        offset_t id3v2End(IOStream *stream) {
+            const ByteVector header = readAt(stream, 0, 10);
+            if (header.size() < 10 || !header.startsWith("ID3")) {
+                return 0;
+            }
+            offset_t size = 0;
+            for (unsigned int i = 6; i < 10; i++) {
+                size = (size << 7) | (static_cast<unsigned char>(header[i]) & 0x7f);
+            }
+            const bool hasFooter = static_cast<unsigned char>(header[5]) & 0x10;
+            return 10 + size + (hasFooter ? 10 : 0);
+        }
+
+        // Start of the ID3v1 and APE tags that end at end, in any order, end if there are none.
+        offset_t trailingTagsStart(IOStream *stream, offset_t begin, offset_t end) {
+            while (true) {
+                if (end - 128 >= begin && readAt(stream, end - 128, 3) == "TAG") {
+                    end -= 128;
+                    continue;
+                }
+                if (end - 32 >= begin) {
+                    const ByteVector footer = readAt(stream, end - 32, 32);
+                    if (footer.size() == 32 && footer.startsWith("APETAGEX")) {
+                        // The size covers the items and the footer, the header comes on top if there is one.
+                        const bool hasHeader = footer.toUInt(20, false) & 0x80000000U;
+                        const offset_t size = static_cast<offset_t>(footer.toUInt(12, false)) + (hasHeader ? 32 : 0);
+                        if (size < 32 || end - size < begin) {
+                            return end;
+                        }
+                        end -= size;
+                        continue;
+                    }
+                }
+                return end;
+            }
+        }
+
+        bool addRange(offset_t begin, offset_t end, AudioData &audio) {
+            if (end <= begin) {
+                return false;
+            }
+            audio.ranges.push_back({begin, end - begin});
+            return true;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Formats
+        ////////////////////////////////////////////////////////////////////////////////
+
+        // From the first frame to the end of the last one, which TagLib finds past the tags.
+        bool locateMpeg(MPEG::File *file, IOStream *stream, AudioData &audio) {
+            const offset_t begin = file->firstFrameOffset();
+            const offset_t last = file->lastFrameOffset();
+            if (begin < 0 || last < begin) {
+                return false;
+            }
+            const ByteVector lastFrame = readAt(stream, last, 4);
+            MpegFrameHeader header{};
+            if (lastFrame.size() < 4 || !parseMpegFrameHeader(lastFrame.data(), header)) {
+                return false;
+            }
+            return addRange(begin, std::min(last + header.length, stream->length()), audio);
+        }
+
+        bool locateFlac(IOStream *stream, const FlacBlockIndex &index, AudioData &audio) {
+            const offset_t begin = index.streamStart();
+            return addRange(begin, trailingTagsStart(stream, begin, stream->length()), audio);
+        }
+
+        bool locateMp4(FileName path, IOStream *stream, int fd, AudioData &audio) {
+            const std::shared_ptr<const Mp4AtomIndex> index = mp4AtomIndex(path, stream, fd);
+            if (!index) {
+                return false;
+            }
+            for (const Mp4Atom *atom: index->children(nullptr)) {
+                if (atom->name == "mdat") {
+                    addRange(atom->offset + atom->headerLength, atom->offset + atom->length, audio);
+                }
+            }
+            return !audio.ranges.empty();
+        }
+
+        // The layout of the chunks of a RIFF like container.
+        struct ChunkLayout {
+            //! Offset of the first chunk
+            offset_t start;
+            //! 4 or 8
+            unsigned int sizeLength;
+            bool bigEndian;
+            //! Whether the chunk size counts the chunk header
+            bool sizeIncludesHeader;
+            //! Whether chunks are padded to an even length
+            bool padded;
+        };
+
+        // Finds the first chunk named id or otherId at the top level.
+        bool locateChunk(IOStream *stream, const ChunkLayout &layout, const char *id, const char *otherId,
+                         AudioData &audio) {
+            const offset_t end = stream->length();
+            const unsigned int headerLength = 4 + layout.sizeLength;
+            offset_t offset = layout.start;
+            while (offset + headerLength <= end) {
+                const ByteVector header = readAt(stream, offset, headerLength);
+                if (header.size() < headerLength) {
+                    return false;
+                }
+                offset_t size = layout.sizeLength == 8
+                                ? header.toLongLong(4, layout.bigEndian)
+                                : static_cast<offset_t>(header.toUInt(4, layout.bigEndian));
+                if (layout.sizeIncludesHeader) {
+                    size -= headerLength;
+                }
+                if (size < 0 || offset + headerLength + size > end) {
+                    return false;
+                }
+                const ByteVector name = header.mid(0, 4);
+                if (name == id || (otherId && name == otherId)) {
+                    return addRange(offset + headerLength, offset + headerLength + size, audio);
+                }
+                offset += headerLength + size + (layout.padded ? (size & 1) : 0);
+            }
+            return false;
+        }
+
+        // The packets of the data object follow its 50 byte header, after the header object.
+        bool locateAsf(IOStream *stream, AudioData &audio) {
+            static const char dataObjectGuid[] = "\x36\x26\xB2\x75\x8E\x66\xCF\x11\xA6\xD9\x00\xAA\x00\x62\xCE\x6C";
+
+            const ByteVector header = readAt(stream, 0, 24);
+            if (header.size() < 24) {
+                return false;
+            }
+            const offset_t dataObject = header.toLongLong(16, false);
+            const ByteVector data = readAt(stream, dataObject, 24);
+            if (dataObject <= 0 || data.size() < 24 || data.mid(0, 16) != ByteVector(dataObjectGuid, 16)) {
+                return false;
+            }
+            const offset_t size = data.toLongLong(16, false);
+            return addRange(dataObject + 50, std::min(dataObject + size, stream->length()), audio);
+        }
+
+        // Reads an EBML element ID, or size if isSize, at data; returns its length, 0 if it is invalid.
+        unsigned int readVint(const ByteVector &data, unsigned int offset, bool isSize, uint64_t &value) {
+            if (offset >= data.size()) {
+                return 0;
+            }
+            const auto first = static_cast<unsigned char>(data[offset]);
+            unsigned int length = 1;
+            while (length <= 8 && !(first & (0x80 >> (length - 1)))) {
+                length++;
+            }
+            if (length > (isSize ? 8U : 4U) || offset + length > data.size()) {
+                return 0;
+            }
+            value = isSize ? first & (0xFF >> length) : first;
+            bool allOnes = value == (0xFFU >> length);
+            for (unsigned int i = 1; i < length; i++) {
+                const auto byte = static_cast<unsigned char>(data[offset + i]);
+                value = (value << 8) | byte;
+                allOnes = allOnes && byte == 0xFF;
+            }
+            if (isSize && allOnes) {
+                // Unknown size
+                value = UINT64_MAX;
+            }
+            return length;
+        }
+
+        // Reads the header of the element at offset, returns the offset of its data, -1 if it is invalid.
+        offset_t readElementHeader(IOStream *stream, offset_t offset, uint32_t &id, uint64_t &size) {
+            const ByteVector header = readAt(stream, offset, 12);
+            uint64_t value = 0;
+            const unsigned int idLength = readVint(header, 0, false, value);
+            if (idLength == 0) {
+                return -1;
+            }
+            id = static_cast<uint32_t>(value);
+            const unsigned int sizeLength = readVint(header, idLength, true, size);
+            if (sizeLength == 0) {
+                return -1;
+            }
+            return offset + idLength + sizeLength;
+        }
+
+        // The Clusters of the segment, each read as a whole.
+        bool locateMatroska(IOStream *stream, AudioData &audio) {
+            const offset_t length = stream->length();
+            uint32_t id = 0;
+            uint64_t size = 0;
+            offset_t data = readElementHeader(stream, 0, id, size);
+            if (data < 0 || id != MkvSegmentIndex::EBMLHeader || size == UINT64_MAX) {
+                return false;
+            }
+            data = readElementHeader(stream, data + static_cast<offset_t>(size), id, size);
+            if (data < 0 || id != MkvSegmentIndex::Segment) {
+                return false;
+            }
+            const offset_t segmentEnd = size == UINT64_MAX ? length
+                                                           : std::min(length, data + static_cast<offset_t>(size));
+            offset_t offset = data;
+            while (offset < segmentEnd) {
+                data = readElementHeader(stream, offset, id, size);
+                if (data < 0 || size == UINT64_MAX || static_cast<offset_t>(size) > segmentEnd - data) {
+                    return false;
+                }
+                const offset_t end = data + static_cast<offset_t>(size);
+                if (id == MkvSegmentIndex::Cluster) {
+                    addRange(offset, end, audio);
+                }
+                offset = end;
+            }
+            return !audio.ranges.empty();
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Ogg
+        ////////////////////////////////////////////////////////////////////////////////
+
+        // Reads a file in windows through its fd, so that the pages within a window take a single read.
+
+        class FdReader {
+        public:
+            FdReader(int fd, offset_t end, ParseStats *stats) :
+                    fd(fd), end(end), stats(stats), window(oggWindow) {
+            }
+
+            // The length bytes at offset, or a null pointer if they extend past the end or cannot be read.
+            const char *at(offset_t offset, size_t length) {
+                if (offset < 0 || offset + static_cast<offset_t>(length) > end) {
+                    return nullptr;
+                }
+                if (offset < start || offset + static_cast<offset_t>(length) > start + static_cast<offset_t>(filled)) {
+                    filled = static_cast<size_t>(std::min<offset_t>(static_cast<offset_t>(window.size()),
+                                                                    end - offset));
+                    start = offset;
+                    addReads(stats, filled, 1);
+                    if (!readFully(fd, offset, window.data(), filled)) {
+                        filled = 0;
+                        return nullptr;
+                    }
+                }
+                return window.data() + (offset - start);
+            }
+
+        private:
+            int fd;
+            offset_t end;
+            ParseStats *stats;
+            std::vector<char> window;
+            offset_t start{0};
+            size_t filled{0};
+        };
+
+        // The number of header packets of the logical stream whose first packet is at data.
+        unsigned int oggHeaderPackets(const char *data, size_t length) {
+            if (length >= 7 && std::memcmp(data, "\x01vorbis", 7) == 0) {
+                return 3;
+            }
+            if (length >= 8 && std::memcmp(data, "OpusHead", 8) == 0) {
+                return 2;
+            }
+            if (length >= 9 && std::memcmp(data, "\x7F" "FLAC", 5) == 0) {
+                const unsigned int count = (static_cast<unsigned char>(data[7]) << 8) |
+                                           static_cast<unsigned char>(data[8]);
+                return count > 0 ? 1 + count : 0;
+            }
+            return 0;
+        }
+
+        /*
+         * Hashes the payloads of the pages of the first logical stream that follow
+         * its header packets.  The codecs start the audio data on a fresh page, so
+         * the pages of the headers, which a tag edit rewrites, are skipped as a whole.
+         */
+        bool hashOggPages(int fd, offset_t end, uint64_t &hash, ParseStats *stats) {
+            FdReader reader(fd, end, stats);
+            ChunkedHash pages;
+            uint32_t serial = 0;
+            unsigned int headerPackets = 0;
+            unsigned int packets = 0;
+            bool first = true;
+            offset_t offset = 0;
+            while (offset + 27 <= end) {
+                // Anything else than pages, e.g. a trailing tag, ends the stream.
+                const char *header = reader.at(offset, 27);
+                if (!header || std::memcmp(header, "OggS", 4) != 0) {
+                    break;
+                }
+                uint32_t pageSerial;
+                std::memcpy(&pageSerial, header + 14, 4);
+                const auto segmentCount = static_cast<unsigned char>(header[26]);
+                const char *page = reader.at(offset, 27 + segmentCount);
+                if (!page) {
+                    return false;
+                }
+                size_t payloadLength = 0;
+                unsigned int completed = 0;
+                for (unsigned int i = 0; i < segmentCount; i++) {
+                    const auto lacing = static_cast<unsigned char>(page[27 + i]);
+                    payloadLength += lacing;
+                    completed += lacing < 255 ? 1 : 0;
+                }
+                const offset_t payloadOffset = offset + 27 + segmentCount;
+                const char *payload = reader.at(payloadOffset, payloadLength);
+                if (!payload) {
+                    return false;
+                }
+
+                if (first) {
+                    serial = pageSerial;
+                    headerPackets = oggHeaderPackets(payload, payloadLength);
+                    if (headerPackets == 0) {
+                        return false;
+                    }
+                    first = false;
+                }
+                if (pageSerial == serial) {
+                    if (packets >= headerPackets) {
+                        pages.update(payload, payloadLength);
+                    }
+                    packets += completed;
+                }
+                offset = payloadOffset + static_cast<offset_t>(payloadLength);
+            }
+            if (packets <= headerPackets) {
+                return false;
+            }
+            hash = pages.digest();
+            return true;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // Ranges
+        ////////////////////////////////////////////////////////////////////////////////
+
+        /*
+         * Hashes the ranges as one input with the chunking of ChunkedHash, each chunk
+         * taken by the next free thread.  A chunk may span several ranges.
+         */
+        bool hashRanges(int fd, const std::vector<AudioRange> &ranges, unsigned int threads, uint64_t &hash,
+                        ParseStats *stats) {
+            // Offset of each range in the input
+            std::vector<offset_t> starts;
+            offset_t total = 0;
+            for (const AudioRange &range: ranges) {
+                starts.push_back(total);
+                total += range.length;
+            }
+            if (total == 0) {
+                return false;
+            }
+            const auto chunkSize = static_cast<offset_t>(ChunkedHash::ChunkSize);
+            const auto chunkCount = static_cast<size_t>((total + chunkSize - 1) / chunkSize);
+            std::vector<uint64_t> chunkHashes(chunkCount);
+
+            const unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1U);
+            const auto threadCount = static_cast<unsigned int>(std::min<size_t>(
+                    threads == 0 ? hardwareThreads : std::min(threads, hardwareThreads), chunkCount));
+            std::vector<uint64_t> bytesRead(threadCount);
+            std::vector<uint64_t> readCalls(threadCount);
+            std::atomic<size_t> nextChunk{0};
+            std::atomic<bool> failed{false};
+
+            const auto worker = [&](unsigned int index) {
+                std::vector<char> buffer(ChunkedHash::ChunkSize);
+                for (size_t chunk = nextChunk++; chunk < chunkCount && !failed; chunk = nextChunk++) {
+                    offset_t position = static_cast<offset_t>(chunk) * chunkSize;
+                    offset_t remaining = std::min(chunkSize, total - position);
+                    size_t range = std::upper_bound(starts.begin(), starts.end(), position) - starts.begin() - 1;
+                    StripeHash chunkHash;
+                    while (remaining > 0) {
+                        const offset_t inRange = position - starts[range];
+                        const auto length = static_cast<size_t>(
+                                std::min(remaining, ranges[range].length - inRange));
+                        if (!readFully(fd, ranges[range].offset + inRange, buffer.data(), length)) {
+                            failed = true;
+                            return;
+                        }
+                        bytesRead[index] += length;
+                        readCalls[index]++;
+                        chunkHash.update(buffer.data(), length);
+                        position += static_cast<offset_t>(length);
+                        remaining -= static_cast<offset_t>(length);
+                        range++;
+                    }
+                    chunkHashes[chunk] = chunkHash.digest();
+                }
+            };
+
+            std::vector<std::thread> workers;
+            for (unsigned int i = 1; i < threadCount; i++) {
+                workers.emplace_back(worker, i);
+            }
+            worker(0);
+            for (std::thread &thread: workers) {
+                thread.join();
+            }
+
+            for (unsigned int i = 0; i < threadCount; i++) {
+                addReads(stats, bytesRead[i], readCalls[i]);
+            }
+            if (failed) {
+                return false;
+            }
+            hash = ChunkedHash::combine(chunkHashes, static_cast<uint64_t>(total));
+            return true;
+        }
+    }
+
+    bool locateAudioData([[maybe_unused]] FileName path, const FileRef &f, IOStream *stream, [[maybe_unused]] int fd,
+                         AudioData &audio) {
+        audio = AudioData();
+        File *file = f.file();
+#ifndef TAGLIB_EXT_WITHOUT_MPEG
+        if (const auto mpeg = dynamic_cast<MPEG::File *>(file))
+            return locateMpeg(mpeg, stream, audio);
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_FLAC
+        if (const auto flac = dynamic_cast<FlacIndexedFile *>(file))
+            return locateFlac(stream, flac->blockIndex(), audio);
+        if (dynamic_cast<FLAC::File *>(file)) {
+            FlacBlockIndex index;
+            return index.build(stream, id3v2End(stream)) && locateFlac(stream, index, audio);
+        }
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_MP4
+        if (dynamic_cast<MP4::File *>(file))
+            return locateMp4(path, stream, fd, audio);
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_WAV
+        if (dynamic_cast<RIFF::WAV::File *>(file))
+            return locateChunk(stream, {12, 4, false, false, true}, "data", nullptr, audio);
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_AIFF
+        if (dynamic_cast<RIFF::AIFF::File *>(file))
+            return locateChunk(stream, {12, 4, true, false, true}, "SSND", nullptr, audio);
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_DSDIFF
+        if (dynamic_cast<DSDIFF::File *>(file))
+            return locateChunk(stream, {16, 8, true, false, true}, "DSD ", "DST ", audio);
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_DSF
+        if (dynamic_cast<DSF::File *>(file))
+            return locateChunk(stream, {0, 8, false, true, false}, "data", nullptr, audio);
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_ASF
+        if (dynamic_cast<ASF::File *>(file))
+            return locateAsf(stream, audio);
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_MATROSKA
+        if (dynamic_cast<Matroska::File *>(file))
+            return locateMatroska(stream, audio);
+#endif
+        if (dynamic_cast<Ogg::File *>(file)) {
+            audio.oggPages = true;
+            return addRange(0, stream->length(), audio);
+        }
+#ifndef TAGLIB_EXT_WITHOUT_APE
+        if (dynamic_cast<APE::File *>(file)) {
+            const offset_t begin = id3v2End(stream);
+            return addRange(begin, trailingTagsStart(stream, begin, stream->length()), audio);
+        }
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_WAVPACK
+        if (dynamic_cast<WavPack::File *>(file)) {
+            const offset_t begin = id3v2End(stream);
+            return addRange(begin, trailingTagsStart(stream, begin, stream->length()), audio);
+        }
+#endif
+        return false;
+    }
+
+    bool audioHash(FileName path, IOStream *stream, int fd, unsigned int threads, uint64_t &hash,
+                   ParseStats *stats) {
+        AudioData audio;
+        {
+            const FileRef f(path, stream, false, AudioProperties::Average, stats, fd);
+            if (f.isNull() || !locateAudioData(path, f, stream, fd, audio)) {
+                return false;
+            }
+        }
+        if (audio.oggPages) {
+            return hashOggPages(fd, audio.ranges.front().offset + audio.ranges.front().length, hash, stats);
+        }
+        return hashRanges(fd, audio.ranges, threads, hash, stats);
+    }
+
+} // namespace TagLibExt
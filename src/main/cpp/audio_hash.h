@@ -0,0 +1,64 @@
+#ifndef TAGLIB_EXT_AUDIO_HASH_H
+#define TAGLIB_EXT_AUDIO_HASH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "fileref_ext.h"
+#include "stats.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! A contiguous range of a file.
+
+    struct AudioRange {
+        offset_t offset;
+        offset_t length;
+    };
+
+    //! Where the audio data of a file is stored.
+
+    struct AudioData {
+        //! The ranges holding the audio data, in file order
+        std::vector<AudioRange> ranges;
+        //! Whether the single range is a run of Ogg pages, of which only the payloads are audio data
+        bool oggPages{false};
+    };
+
+    /*!
+     * Finds the audio data of the file opened by \a f on \a stream, leaving out
+     * everything a tag edit can change: the frames of MPEG files, the frames
+     * following the metadata blocks of FLAC, the mdat atoms of MP4, the data,
+     * SSND or DSD chunks of WAV, AIFF, DSF and DSDIFF, the data object of ASF, the
+     * Clusters of Matroska and the pages following the header packets of Ogg
+     * Vorbis, Opus and FLAC.  APE and WavPack files are taken without their
+     * leading ID3v2 and trailing ID3v1 and APE tags.
+     *
+     * MP4 files are looked up in the atom index of the file open as \a fd, or at
+     * \a path if \a fd is -1, see mp4AtomIndex().
+     *
+     * Returns \c false if the format is not one of these or its layout is not
+     * understood.
+     */
+    bool locateAudioData(FileName path, const FileRef &f, IOStream *stream, int fd, AudioData &audio);
+
+    /*!
+     * Computes a hash of the audio data of the file at \a path, which \a stream
+     * reads as \a fd, so that it stays the same when the tags of the file are
+     * edited.  The data located by locateAudioData() is read from \a fd in 1 MiB
+     * chunks, hashed with StripeHash by up to \a threads threads, and the chunk
+     * hashes combined as by ChunkedHash; the result does not depend on the number
+     * of threads.  Ogg pages are hashed one after another by their payloads alone,
+     * as their headers change when the pages are renumbered.
+     *
+     * The reads from \a fd are added to \a stats, if any.  Returns \c false if
+     * the audio data cannot be located or read.
+     */
+    bool audioHash(FileName path, IOStream *stream, int fd, unsigned int threads, uint64_t &hash,
+                   ParseStats *stats = nullptr);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_AUDIO_HASH_H
@@ -0,0 +1,804 @@
+/*
+ * Host benchmark of the native read and save paths.
+ *
+ * Usage: taglib_benchmark [options]
+ *   --corpus DIR       Use the files in DIR, generating the corpus there if DIR is empty
+ *   --duration SECONDS Length of the generated audio, 30 by default
+ *   --sparse-mkv MIB   Add a sparse Matroska file of MIB MiB to the generated corpus
+ *   --iterations N     Number of measured runs per file and operation, 5 by default
+ *   --index-tracks N   Also build a TagIndex of N tracks and measure its size and queries
+ *   --operations LIST  Comma separated operations to run, all by default
+ *   --kernels SET      Use the scan, hash and conversion kernels of SET, e.g. scalar, the widest by default
+ *   --threads LIST     Also run the read operations from each comma separated number of threads, e.g. 1,2,4,8
+ *   --csv              Write CSV instead of JSON
+ *   --output FILE      Write the results to FILE instead of stdout
+ *   --keep             Keep the generated corpus in the temporary directory
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <ftw.h>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "arena.h"
+#include "audio_hash.h"
+#include "convert.h"
+#include "corpus.h"
+#include "cpu_features.h"
+#include "file_lock.h"
+#include "fileref_ext.h"
+#include "id3v2_lazy.h"
+#include "library_watcher.h"
+#include "picture_export.h"
+#include "property_keys.h"
+#include "stats.h"
+#include "tag_index.h"
+#include "tfilestream.h"
+#include "tpropertymap.h"
+#include "tvariant.h"
+
+namespace TagLibExt::Benchmark {
+    namespace {
+
+        enum class Operation {
+            ReadAudioProperties,
+            ReadAudioPropertiesAccurate,
+            ReadMetadata,
+            ReadMetadataWithPictures,
+            ReadPropertyValues,
+            ReadPictures,
+            ExportPicture,
+            AudioHash,
+            WaitForChanges,
+            SavePropertyMap,
+            SavePictures
+        };
+
+        struct OperationInfo {
+            Operation operation;
+            const char *name;
+            bool writes;
+        };
+
+        // Named after the TagLib functions they correspond to.
+        constexpr OperationInfo operations[] = {
+                {Operation::ReadAudioProperties,         "getAudioProperties",         false},
+                {Operation::ReadAudioPropertiesAccurate, "getAudioPropertiesAccurate", false},
+                {Operation::ReadMetadata,                "getMetadata",                false},
+                {Operation::ReadMetadataWithPictures,    "getMetadataWithPictures",    false},
+                {Operation::ReadPropertyValues,          "getMetadataPropertyValues",  false},
+                {Operation::ReadPictures,                "getPictures",                false},
+                {Operation::ExportPicture,               "exportPicture",              false},
+                {Operation::AudioHash,                   "getAudioHash",               false},
+                {Operation::WaitForChanges,              "waitForChanges",             false},
+                {Operation::SavePropertyMap,             "savePropertyMap",            true},
+                {Operation::SavePictures,                "savePictures",               true},
+        };
+
+        struct Options {
+            std::string corpus;
+            CorpusOptions corpusOptions;
+            int iterations{5};
+            size_t indexTracks{0};
+            std::vector<const OperationInfo *> operations;
+            std::vector<int> threadCounts;
+            bool csv{false};
+            std::string output;
+            bool keep{false};
+        };
+
+        // The conversions below mirror the native part of the JNI helpers in utils.h,
+        // i.e. everything but the calls into the JVM.
+
+        size_t convertString(const String &str) {
+            return toUtf16(str, threadArena()).length * sizeof(uint16_t);
+        }
+
+        size_t convertStringList(const StringList &stringList) {
+            size_t bytes = 0;
+            for (const auto &str: stringList) {
+                bytes += convertString(str);
+            }
+            return bytes;
+        }
+
+        // Standard keys are not converted, the JNI layer has them as Java strings.
+        size_t convertPropertyMap(const PropertyMap &propertyMap) {
+            size_t bytes = 0;
+            for (const auto &property: propertyMap) {
+                if (findStandardPropertyKey(property.first) < 0) {
+                    bytes += convertString(property.first);
+                }
+                bytes += convertStringList(property.second);
+            }
+            return bytes;
+        }
+
+        size_t convertPictures(const List<VariantMap> &pictureList) {
+            size_t bytes = 0;
+            for (const auto &picture: pictureList) {
+                const ByteVector pictureData = picture["data"].toByteVector();
+                std::vector<char> copy(pictureData.begin(), pictureData.end());
+                bytes += copy.size();
+                bytes += convertString(picture["description"].toString());
+                bytes += convertString(picture["pictureType"].toString());
+                bytes += convertString(picture["mimeType"].toString());
+            }
+            return bytes;
+        }
+
+        bool copyFile(const std::string &from, const std::string &to) {
+            FILE *in = std::fopen(from.c_str(), "rb");
+            if (!in) {
+                return false;
+            }
+            FILE *out = std::fopen(to.c_str(), "wb");
+            if (!out) {
+                std::fclose(in);
+                return false;
+            }
+            char buffer[64 * 1024];
+            size_t n;
+            bool ok = true;
+            while ((n = std::fread(buffer, 1, sizeof(buffer), in)) > 0) {
+                ok = ok && std::fwrite(buffer, 1, n, out) == n;
+            }
+            std::fclose(in);
+            return std::fclose(out) == 0 && ok;
+        }
+
+        struct Measurement {
+            bool ok{false};
+            uint64_t nanos{0};
+            ParseStats stats;
+        };
+
+        // Runs one operation the way the corresponding JNI function does.
+        Measurement measure(const OperationInfo &info, const std::string &path, const std::string &scratchDirectory) {
+            Measurement m;
+            const auto start = std::chrono::steady_clock::now();
+            if (info.operation == Operation::ExportPicture) {
+                StatsCollector stats;
+                ArenaScope scratch;
+                FILE *output = std::tmpfile();
+                const int fd = open(path.c_str(), O_RDONLY);
+                if (output && fd >= 0) {
+                    const FileLock lock(fd, FileLock::Mode::Read);
+                    FileStream stream(fd, true);
+                    ExportedPicture exported;
+                    m.ok = exportPicture(path.c_str(), stats.wrap(&stream), fd, fileno(output), "Front Cover",
+                                         exported, stats.get());
+                } else if (fd >= 0) {
+                    close(fd);
+                }
+                if (output) {
+                    std::fclose(output);
+                }
+            } else if (info.operation == Operation::AudioHash) {
+                StatsCollector stats;
+                ArenaScope scratch;
+                const int fd = open(path.c_str(), O_RDONLY);
+                if (fd >= 0) {
+                    const FileLock lock(fd, FileLock::Mode::Read);
+                    FileStream stream(fd, true);
+                    uint64_t hash;
+                    m.ok = audioHash(path.c_str(), stats.wrap(&stream), fd, 1, hash, stats.get());
+                }
+            } else if (info.operation == Operation::WaitForChanges) {
+                // From copying the file into a watched directory to its change being reported
+                const std::string directory = scratchDirectory + "/watched";
+                const std::string copy = directory + "/track" + path.substr(path.rfind('.'));
+                mkdir(directory.c_str(), 0755);
+                LibraryWatcher watcher(0);
+                std::vector<LibraryChange> changes;
+                if (watcher.addRoot(directory) && copyFile(path, copy)) {
+                    m.ok = watcher.waitForChanges(10000, changes) && changes.size() == 1 &&
+                           changes[0].type == LibraryChange::Type::Changed;
+                }
+                unlink(copy.c_str());
+            } else {
+                StatsCollector stats;
+                ArenaScope scratch;
+                const FileLock lock(path.c_str(), info.writes ? FileLock::Mode::Write : FileLock::Mode::Read);
+                FileStream stream(path.c_str(), !info.writes);
+                const bool accurate = info.operation == Operation::ReadAudioPropertiesAccurate;
+                FileRef f(path.c_str(), stats.wrap(&stream),
+                          info.operation == Operation::ReadAudioProperties || accurate,
+                          accurate ? AudioProperties::Accurate : AudioProperties::Average, stats.get());
+
+                m.ok = !f.isNull();
+                if (m.ok) {
+                    switch (info.operation) {
+                        case Operation::ReadAudioProperties:
+                        case Operation::ReadAudioPropertiesAccurate: {
+                            PhaseTimer timer(stats.get(), Phase::Conversion);
+                            const AudioProperties *audioProperties = f.audioProperties();
+                            m.ok = audioProperties && audioProperties->lengthInMilliseconds() > 0;
+                            break;
+                        }
+                        case Operation::ReadMetadata:
+                        case Operation::ReadMetadataWithPictures: {
+                            PropertyMap propertyMap;
+                            {
+                                PhaseTimer timer(stats.get(), Phase::Properties);
+                                propertyMap = f.properties();
+                            }
+                            {
+                                PhaseTimer timer(stats.get(), Phase::Conversion);
+                                convertPropertyMap(propertyMap);
+                            }
+                            if (info.operation == Operation::ReadMetadataWithPictures) {
+                                List<VariantMap> pictureList;
+                                {
+                                    PhaseTimer timer(stats.get(), Phase::Pictures);
+                                    pictureList = f.complexProperties("PICTURE");
+                                }
+                                PhaseTimer timer(stats.get(), Phase::Conversion);
+                                convertPictures(pictureList);
+                            }
+                            break;
+                        }
+                        case Operation::ReadPropertyValues: {
+                            PropertyMap propertyMap;
+                            {
+                                PhaseTimer timer(stats.get(), Phase::Properties);
+                                PropertyKeyScope key("TITLE");
+                                propertyMap = f.properties();
+                            }
+                            PhaseTimer timer(stats.get(), Phase::Conversion);
+                            const auto valueList = propertyMap.find("TITLE");
+                            if (valueList != propertyMap.end()) {
+                                convertStringList(valueList->second);
+                            }
+                            break;
+                        }
+                        case Operation::ReadPictures: {
+                            List<VariantMap> pictureList;
+                            {
+                                PhaseTimer timer(stats.get(), Phase::Pictures);
+                                pictureList = f.complexProperties("PICTURE");
+                            }
+                            PhaseTimer timer(stats.get(), Phase::Conversion);
+                            convertPictures(pictureList);
+                            break;
+                        }
+                        case Operation::SavePropertyMap: {
+                            const PropertyMap propertyMap = f.properties();
+                            PhaseTimer timer(stats.get(), Phase::Save);
+                            f.setProperties(propertyMap);
+                            m.ok = f.save();
+                            break;
+                        }
+                        case Operation::SavePictures: {
+                            const List<VariantMap> pictureList = f.complexProperties("PICTURE");
+                            PhaseTimer timer(stats.get(), Phase::Save);
+                            f.setComplexProperties("PICTURE", pictureList);
+                            m.ok = f.save();
+                            break;
+                        }
+                        case Operation::ExportPicture:
+                        case Operation::AudioHash:
+                        case Operation::WaitForChanges:
+                            break;
+                    }
+                }
+            }
+            m.nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+            lastCallStats(m.stats);
+            return m;
+        }
+
+        struct Result {
+            std::string operation;
+            std::string kind;
+            std::string format;
+            uint64_t failures{0};
+            uint64_t fileBytes{0};
+            uint64_t nanos{0};
+            std::vector<uint64_t> latencies;
+            ParseStats stats;
+        };
+
+        uint64_t percentile(std::vector<uint64_t> values, double p) {
+            if (values.empty()) {
+                return 0;
+            }
+            std::sort(values.begin(), values.end());
+            const auto index = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+            return values[index];
+        }
+
+        std::vector<Result> run(const Options &options, const std::vector<CorpusFile> &corpus,
+                                const std::string &scratchDirectory) {
+            std::vector<Result> results;
+            std::map<std::pair<std::string, std::string>, size_t> index;
+
+            for (const OperationInfo *info: options.operations) {
+                for (const auto &file: corpus) {
+                    if (info->operation == Operation::ExportPicture && file.pictures == "none") {
+                        continue;
+                    }
+                    // The sparse file is there to measure skipping its media data, which hashing and
+                    // copying read.
+                    if ((info->writes || info->operation == Operation::AudioHash ||
+                         info->operation == Operation::WaitForChanges) && file.sparse) {
+                        continue;
+                    }
+                    const auto key = std::make_pair(std::string(info->name), file.kind);
+                    if (index.find(key) == index.end()) {
+                        index[key] = results.size();
+                        results.emplace_back();
+                        results.back().operation = info->name;
+                        results.back().kind = file.kind;
+                    }
+                    Result &result = results[index[key]];
+
+                    // One warm up run, so that the file is in the page cache.
+                    for (int i = -1; i < options.iterations; i++) {
+                        std::string path = file.path;
+                        if (info->writes) {
+                            path = scratchDirectory + "/save." + file.kind;
+                            if (!copyFile(file.path, path)) {
+                                result.failures++;
+                                continue;
+                            }
+                        }
+                        const Measurement m = measure(*info, path, scratchDirectory);
+                        if (i < 0) {
+                            continue;
+                        }
+                        if (!m.ok) {
+                            result.failures++;
+                        }
+                        if (m.stats.format[0] != '\0') {
+                            result.format = m.stats.format;
+                        }
+                        result.fileBytes += file.size;
+                        result.nanos += m.nanos;
+                        result.latencies.push_back(m.nanos);
+                        result.stats += m.stats;
+                    }
+                }
+            }
+            return results;
+        }
+
+        // Alternately adds a property with a large value to path and removes it, so that every save
+        // moves the audio data.
+        bool toggleLargeProperty(const std::string &path) {
+            ArenaScope scratch;
+            const FileLock lock(path.c_str(), FileLock::Mode::Write);
+            FileStream stream(path.c_str(), false);
+            FileRef f(path.c_str(), &stream, false);
+            if (f.isNull()) {
+                return false;
+            }
+            PropertyMap propertyMap = f.properties();
+            if (propertyMap.contains("BENCHMARK")) {
+                propertyMap.erase("BENCHMARK");
+            } else {
+                propertyMap.replace("BENCHMARK", String(std::string(64 * 1024, 'x')));
+            }
+            f.setProperties(propertyMap);
+            return f.save();
+        }
+
+        /*
+         * Runs the read operations of options.operations over the corpus from each number of threads in
+         * options.threadCounts, every thread going through the files from its own offset, as
+         * "parallelRead".  Then runs them again on copies of the files, which one more thread keeps
+         * saving with a tag growing and shrinking, as "parallelReadWrite": the file locks make the reads
+         * wait for the saves, so that none fails.  The seconds of these results are wall clock time, so
+         * their files per second are the throughput of all threads together.
+         */
+        std::vector<Result> runScaling(const Options &options, const std::vector<CorpusFile> &corpus,
+                                       const std::string &scratchDirectory) {
+            std::vector<const OperationInfo *> reads;
+            for (const OperationInfo *info: options.operations) {
+                if (!info->writes && info->operation != Operation::WaitForChanges) {
+                    reads.push_back(info);
+                }
+            }
+            std::vector<const CorpusFile *> files;
+            std::vector<std::string> copies;
+            for (const auto &file: corpus) {
+                if (!file.sparse) {
+                    const std::string copy = scratchDirectory + "/shared-" + std::to_string(files.size()) + "." +
+                                             file.kind;
+                    if (copyFile(file.path, copy)) {
+                        files.push_back(&file);
+                        copies.push_back(copy);
+                    }
+                }
+            }
+            std::vector<Result> results;
+            if (options.threadCounts.empty() || reads.empty() || files.empty()) {
+                return results;
+            }
+
+            for (const bool withWriter: {false, true}) {
+                for (const int threadCount: options.threadCounts) {
+                    std::vector<Result> threadResults(threadCount);
+                    std::atomic<bool> readersDone{false};
+                    uint64_t writeFailures = 0;
+                    const auto start = std::chrono::steady_clock::now();
+
+                    std::vector<std::thread> threads;
+                    for (int t = 0; t < threadCount; t++) {
+                        threads.emplace_back([&, t] {
+                            Result &result = threadResults[t];
+                            const size_t offset = files.size() * t / threadCount;
+                            for (int i = 0; i < options.iterations; i++) {
+                                for (size_t j = 0; j < files.size(); j++) {
+                                    const size_t n = (offset + j) % files.size();
+                                    const std::string &path = withWriter ? copies[n] : files[n]->path;
+                                    for (const OperationInfo *info: reads) {
+                                        if (info->operation == Operation::ExportPicture &&
+                                            files[n]->pictures == "none") {
+                                            continue;
+                                        }
+                                        const Measurement m = measure(*info, path, scratchDirectory);
+                                        if (!m.ok) {
+                                            result.failures++;
+                                        }
+                                        result.fileBytes += files[n]->size;
+                                        result.latencies.push_back(m.nanos);
+                                        result.stats += m.stats;
+                                    }
+                                }
+                            }
+                        });
+                    }
+                    std::thread writer;
+                    if (withWriter) {
+                        writer = std::thread([&] {
+                            for (size_t n = 0; !readersDone; n = (n + 1) % copies.size()) {
+                                if (!toggleLargeProperty(copies[n])) {
+                                    writeFailures++;
+                                }
+                            }
+                        });
+                    }
+                    for (std::thread &thread: threads) {
+                        thread.join();
+                    }
+                    readersDone = true;
+                    const auto end = std::chrono::steady_clock::now();
+                    if (writer.joinable()) {
+                        writer.join();
+                    }
+
+                    Result result;
+                    result.operation = withWriter ? "parallelReadWrite" : "parallelRead";
+                    result.kind = "threads-" + std::to_string(threadCount);
+                    result.nanos = static_cast<uint64_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+                    result.failures = writeFailures;
+                    for (Result &threadResult: threadResults) {
+                        result.failures += threadResult.failures;
+                        result.fileBytes += threadResult.fileBytes;
+                        result.stats += threadResult.stats;
+                        result.latencies.insert(result.latencies.end(), threadResult.latencies.begin(),
+                                                threadResult.latencies.end());
+                    }
+                    results.push_back(std::move(result));
+                }
+            }
+            return results;
+        }
+
+        struct IndexSize {
+            size_t tracks{0};
+            size_t bytes{0};
+        };
+
+        // Times one call of f as a latency of result.
+        template<class F>
+        void timeCall(Result &result, F f) {
+            const auto start = std::chrono::steady_clock::now();
+            f();
+            const auto nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+            result.nanos += nanos;
+            result.latencies.push_back(nanos);
+            result.stats.calls++;
+        }
+
+        /*
+         * Builds a TagIndex of options.indexTracks tracks, with the tags of the corpus files made
+         * unique per track: 12 tracks per album, 100 per artist, a title of two common words and a
+         * number.  Then measures prefix and substring searches and the browsing queries.
+         */
+        std::vector<Result> runIndex(const Options &options, const std::vector<CorpusFile> &corpus,
+                                     IndexSize &size) {
+            std::vector<PropertyMap> tags;
+            for (const auto &file: corpus) {
+                FileStream stream(file.path.c_str(), true);
+                const FileRef f(file.path.c_str(), &stream, false);
+                if (!f.isNull()) {
+                    tags.push_back(f.properties());
+                }
+            }
+            if (tags.empty()) {
+                return {};
+            }
+
+            const char *const words[] = {"love", "night", "blue", "river", "fire", "heart", "dream", "light",
+                                         "rain", "gold", "summer", "road", "home", "star", "city", "song"};
+            const char *const genres[] = {"Rock", "Pop", "Jazz", "Classical", "Electronic", "Hip Hop", "Folk",
+                                          "Blues", "Metal", "Soul", "Reggae", "Country"};
+            const std::string kind = "index-" + std::to_string(options.indexTracks);
+            std::vector<Result> results(7);
+            const char *const names[] = {"TagIndex.add", "TagIndex.prefixSearch", "TagIndex.search",
+                                         "TagIndex.groups", "TagIndex.groupsWithin", "TagIndex.groupRows",
+                                         "TagIndex.getValue"};
+            for (size_t i = 0; i < results.size(); i++) {
+                results[i].operation = names[i];
+                results[i].kind = kind;
+            }
+
+            TagIndex index({"ARTIST", "ALBUM", "TITLE", "GENRE"});
+            for (size_t i = 0; i < options.indexTracks; i++) {
+                PropertyMap properties = tags[i % tags.size()];
+                properties.replace("ARTIST", String("Artist " + std::to_string(i / 100)));
+                properties.replace("ALBUM", String("Album " + std::to_string(i / 12)));
+                properties.replace("TITLE", String(std::string(words[i % 16]) + " " + words[i / 16 % 16] + " " +
+                                                   std::to_string(i)));
+                properties.replace("GENRE", String(genres[i / 100 % 12]));
+                timeCall(results[0], [&] { index.add(properties); });
+            }
+            size.tracks = options.indexTracks;
+            size.bytes = index.memoryUsage();
+
+            const int artist = index.fieldIndex("ARTIST");
+            const int album = index.fieldIndex("ALBUM");
+            const int title = index.fieldIndex("TITLE");
+            const auto rows = static_cast<uint32_t>(index.rowCount());
+            for (int i = 0; i < options.iterations; i++) {
+                for (const char *prefix: {"d", "dr", "dre", "dream", "dream l", "12"}) {
+                    timeCall(results[1], [&] { index.prefixSearch(title, prefix, 100); });
+                }
+                const std::pair<int, const char *> searches[] = {
+                        {title, "ream"}, {title, "ight ri"}, {title, "99"}, {title, "1234"}, {artist, "tist 42"}};
+                for (const auto &search: searches) {
+                    timeCall(results[2], [&] { index.search(search.first, search.second, 100); });
+                }
+                timeCall(results[3], [&] { index.groups(album); });
+                timeCall(results[3], [&] { index.groups(artist); });
+                for (uint32_t row = i; row < rows; row += rows / 16 + 1) {
+                    timeCall(results[4], [&] { index.groups(album, artist, row); });
+                    timeCall(results[5], [&] { index.groupRows(album, row); });
+                    std::string value;
+                    timeCall(results[6], [&] { index.value(title, row, value); });
+                }
+            }
+            return results;
+        }
+
+        double perCall(uint64_t value, const ParseStats &stats) {
+            return stats.calls == 0 ? 0 : static_cast<double>(value) / static_cast<double>(stats.calls);
+        }
+
+        const char *const phaseNames[] = {"detect", "parse", "properties", "pictures", "conversion", "save"};
+
+        void writeJson(FILE *out, const Options &options, const std::vector<Result> &results,
+                       const IndexSize &indexSize) {
+            std::fprintf(out, "{\n  \"schema\": 1,\n  \"iterations\": %d,\n  \"allocationStats\": %s,\n"
+                              "  \"kernels\": \"%s\",\n",
+                         options.iterations, allocationStatsAvailable() ? "true" : "false",
+                         kernelSetName(kernelSet()));
+            if (indexSize.tracks > 0) {
+                std::fprintf(out, "  \"index\": {\"tracks\": %zu, \"bytes\": %zu, \"bytesPerTrack\": %.1f},\n",
+                             indexSize.tracks, indexSize.bytes,
+                             static_cast<double>(indexSize.bytes) / static_cast<double>(indexSize.tracks));
+            }
+            std::fprintf(out, "  \"results\": [");
+            for (size_t i = 0; i < results.size(); i++) {
+                const Result &r = results[i];
+                const double seconds = static_cast<double>(r.nanos) / 1e9;
+                std::fprintf(out, "%s\n    {\"operation\": \"%s\", \"kind\": \"%s\", \"format\": \"%s\", "
+                                  "\"calls\": %llu, \"failures\": %llu, \"fileBytes\": %llu, \"seconds\": %.6f, "
+                                  "\"filesPerSecond\": %.2f, \"mbPerSecond\": %.2f,\n",
+                             i == 0 ? "" : ",", r.operation.c_str(), r.kind.c_str(), r.format.c_str(),
+                             static_cast<unsigned long long>(r.stats.calls),
+                             static_cast<unsigned long long>(r.failures),
+                             static_cast<unsigned long long>(r.fileBytes), seconds,
+                             seconds > 0 ? static_cast<double>(r.stats.calls) / seconds : 0,
+                             seconds > 0 ? static_cast<double>(r.fileBytes) / 1e6 / seconds : 0);
+                std::fprintf(out, "     \"latencyNanos\": {\"p50\": %llu, \"p95\": %llu, \"max\": %llu},\n",
+                             static_cast<unsigned long long>(percentile(r.latencies, 0.5)),
+                             static_cast<unsigned long long>(percentile(r.latencies, 0.95)),
+                             static_cast<unsigned long long>(percentile(r.latencies, 1)));
+                std::fprintf(out, "     \"meanPhaseNanos\": {");
+                for (size_t phase = 0; phase < static_cast<size_t>(Phase::Count); phase++) {
+                    std::fprintf(out, "%s\"%s\": %.0f", phase == 0 ? "" : ", ", phaseNames[phase],
+                                 perCall(r.stats.nanos[phase], r.stats));
+                }
+                std::fprintf(out, "},\n     \"meanIo\": {\"bytesRead\": %.0f, \"readCalls\": %.1f, "
+                                  "\"seekCalls\": %.1f, \"bytesWritten\": %.0f, \"writeCalls\": %.1f, "
+                                  "\"detectionAttempts\": %.1f},\n",
+                             perCall(r.stats.bytesRead, r.stats), perCall(r.stats.readCalls, r.stats),
+                             perCall(r.stats.seekCalls, r.stats), perCall(r.stats.bytesWritten, r.stats),
+                             perCall(r.stats.writeCalls, r.stats), perCall(r.stats.detectionAttempts, r.stats));
+                std::fprintf(out, "     \"meanAllocations\": {\"count\": %.1f, \"bytes\": %.0f}, "
+                                  "\"peakLiveBytes\": %llu}",
+                             perCall(r.stats.allocations, r.stats), perCall(r.stats.allocatedBytes, r.stats),
+                             static_cast<unsigned long long>(r.stats.peakLiveBytes));
+            }
+            std::fprintf(out, "\n  ]\n}\n");
+        }
+
+        void writeCsv(FILE *out, const std::vector<Result> &results) {
+            std::fprintf(out, "operation,kind,format,calls,failures,file_bytes,seconds,files_per_second,"
+                              "mb_per_second,p50_nanos,p95_nanos,max_nanos");
+            for (const char *phase: phaseNames) {
+                std::fprintf(out, ",mean_%s_nanos", phase);
+            }
+            std::fprintf(out, ",mean_bytes_read,mean_read_calls,mean_seek_calls,mean_bytes_written,"
+                              "mean_write_calls,mean_detection_attempts,mean_allocations,"
+                              "mean_allocated_bytes,peak_live_bytes\n");
+            for (const Result &r: results) {
+                const double seconds = static_cast<double>(r.nanos) / 1e9;
+                std::fprintf(out, "%s,%s,%s,%llu,%llu,%llu,%.6f,%.2f,%.2f,%llu,%llu,%llu",
+                             r.operation.c_str(), r.kind.c_str(), r.format.c_str(),
+                             static_cast<unsigned long long>(r.stats.calls),
+                             static_cast<unsigned long long>(r.failures),
+                             static_cast<unsigned long long>(r.fileBytes), seconds,
+                             seconds > 0 ? static_cast<double>(r.stats.calls) / seconds : 0,
+                             seconds > 0 ? static_cast<double>(r.fileBytes) / 1e6 / seconds : 0,
+                             static_cast<unsigned long long>(percentile(r.latencies, 0.5)),
+                             static_cast<unsigned long long>(percentile(r.latencies, 0.95)),
+                             static_cast<unsigned long long>(percentile(r.latencies, 1)));
+                for (size_t phase = 0; phase < static_cast<size_t>(Phase::Count); phase++) {
+                    std::fprintf(out, ",%.0f", perCall(r.stats.nanos[phase], r.stats));
+                }
+                std::fprintf(out, ",%.0f,%.1f,%.1f,%.0f,%.1f,%.1f,%.1f,%.0f,%llu\n",
+                             perCall(r.stats.bytesRead, r.stats), perCall(r.stats.readCalls, r.stats),
+                             perCall(r.stats.seekCalls, r.stats), perCall(r.stats.bytesWritten, r.stats),
+                             perCall(r.stats.writeCalls, r.stats), perCall(r.stats.detectionAttempts, r.stats),
+                             perCall(r.stats.allocations, r.stats), perCall(r.stats.allocatedBytes, r.stats),
+                             static_cast<unsigned long long>(r.stats.peakLiveBytes));
+            }
+        }
+
+        bool parseOptions(int argc, char **argv, Options &options) {
+            std::string operationList;
+            for (int i = 1; i < argc; i++) {
+                const std::string arg = argv[i];
+                const bool hasValue = i + 1 < argc;
+                if (arg == "--corpus" && hasValue)
+                    options.corpus = argv[++i];
+                else if (arg == "--duration" && hasValue)
+                    options.corpusOptions.duration = std::atof(argv[++i]);
+                else if (arg == "--sparse-mkv" && hasValue)
+                    options.corpusOptions.sparseMatroskaSize = std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+                else if (arg == "--iterations" && hasValue)
+                    options.iterations = std::atoi(argv[++i]);
+                else if (arg == "--index-tracks" && hasValue)
+                    options.indexTracks = std::strtoull(argv[++i], nullptr, 10);
+                else if (arg == "--operations" && hasValue)
+                    operationList = argv[++i];
+                else if (arg == "--threads" && hasValue) {
+                    const std::string list = std::string(argv[++i]) + ",";
+                    for (size_t begin = 0, end; (end = list.find(',', begin)) != std::string::npos; begin = end + 1) {
+                        const int count = std::atoi(list.substr(begin, end - begin).c_str());
+                        if (count <= 0) {
+                            std::fprintf(stderr, "Invalid thread count in %s\n", argv[i]);
+                            return false;
+                        }
+                        options.threadCounts.push_back(count);
+                    }
+                } else if (arg == "--kernels" && hasValue) {
+                    const char *name = argv[++i];
+                    if (!setKernelSet(findKernelSet(name))) {
+                        std::fprintf(stderr, "Kernel set %s is not supported\n", name);
+                        return false;
+                    }
+                }
+                else if (arg == "--csv")
+                    options.csv = true;
+                else if (arg == "--output" && hasValue)
+                    options.output = argv[++i];
+                else if (arg == "--keep")
+                    options.keep = true;
+                else {
+                    std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+                    return false;
+                }
+            }
+
+            for (const auto &info: operations) {
+                if (operationList.empty() || ("," + operationList + ",").find(
+                        std::string(",") + info.name + ",") != std::string::npos) {
+                    options.operations.push_back(&info);
+                }
+            }
+            return !options.operations.empty() && options.iterations > 0;
+        }
+
+        int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+            return std::remove(path);
+        }
+    }
+} // namespace TagLibExt::Benchmark
+
+int main(int argc, char **argv) {
+    using namespace TagLibExt::Benchmark;
+
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: %s [--corpus DIR] [--duration SECONDS] [--sparse-mkv MIB] [--iterations N] "
+                             "[--index-tracks N] [--operations LIST] [--kernels SET] [--threads LIST] [--csv] "
+                             "[--output FILE] [--keep]\n", argv[0]);
+        return 2;
+    }
+
+    char scratchTemplate[] = "/tmp/taglib-benchmark-XXXXXX";
+    const char *scratch = mkdtemp(scratchTemplate);
+    if (!scratch) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+
+    std::vector<CorpusFile> corpus;
+    if (!options.corpus.empty()) {
+        corpus = scanCorpus(options.corpus);
+        if (corpus.empty()) {
+            corpus = generateCorpus(options.corpus, options.corpusOptions);
+        }
+    } else {
+        const std::string corpusDirectory = std::string(scratch) + "/corpus";
+        mkdir(corpusDirectory.c_str(), 0755);
+        corpus = generateCorpus(corpusDirectory, options.corpusOptions);
+    }
+    if (corpus.empty()) {
+        std::fprintf(stderr, "The corpus is empty\n");
+        return 1;
+    }
+
+    TagLibExt::setStatsEnabled(true);
+    std::vector<Result> results = run(options, corpus, scratch);
+    for (Result &result: runScaling(options, corpus, scratch)) {
+        results.push_back(std::move(result));
+    }
+    IndexSize indexSize;
+    if (options.indexTracks > 0) {
+        for (Result &result: runIndex(options, corpus, indexSize)) {
+            results.push_back(std::move(result));
+        }
+    }
+
+    FILE *out = options.output.empty() ? stdout : std::fopen(options.output.c_str(), "w");
+    if (!out) {
+        std::perror(options.output.c_str());
+        return 1;
+    }
+    if (options.csv) {
+        writeCsv(out, results);
+        if (indexSize.tracks > 0) {
+            std::fprintf(stderr, "TagIndex of %zu tracks: %zu bytes, %.1f bytes per track\n", indexSize.tracks,
+                         indexSize.bytes, static_cast<double>(indexSize.bytes) / static_cast<double>(indexSize.tracks));
+        }
+    } else {
+        writeJson(out, options, results, indexSize);
+    }
+    if (out != stdout) {
+        std::fclose(out);
+    }
+
+    if (options.keep) {
+        std::fprintf(stderr, "Kept %s\n", scratch);
+    } else {
+        nftw(scratch, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    return 0;
+}
@@ -0,0 +1,1082 @@
+#include "corpus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "fileref_ext.h"
+#include "tfilestream.h"
+#include "tpropertymap.h"
+#include "tvariant.h"
+
+namespace TagLibExt::Benchmark {
+    namespace {
+
+        // Deterministic pseudo-random bytes, so that the corpus is the same on every run.
+
+        class Random {
+        public:
+            explicit Random(uint64_t seed) : state(seed) {
+            }
+
+            uint64_t next() {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                return state;
+            }
+
+            // Never returns 0xFF, so that the payload contains no MPEG or FLAC frame sync.
+            uint8_t payloadByte() {
+                return static_cast<uint8_t>(next() % 0xFF);
+            }
+
+        private:
+            uint64_t state;
+        };
+
+        class Writer {
+        public:
+            std::vector<uint8_t> data;
+
+            [[nodiscard]] size_t size() const {
+                return data.size();
+            }
+
+            void u8(uint8_t value) {
+                data.push_back(value);
+            }
+
+            void be16(uint16_t value) {
+                u8(value >> 8);
+                u8(value);
+            }
+
+            void be24(uint32_t value) {
+                u8(value >> 16);
+                be16(value);
+            }
+
+            void be32(uint32_t value) {
+                be16(value >> 16);
+                be16(value);
+            }
+
+            void be64(uint64_t value) {
+                be32(value >> 32);
+                be32(value);
+            }
+
+            void le16(uint16_t value) {
+                u8(value);
+                u8(value >> 8);
+            }
+
+            void le32(uint32_t value) {
+                le16(value);
+                le16(value >> 16);
+            }
+
+            void le64(uint64_t value) {
+                le32(value);
+                le32(value >> 32);
+            }
+
+            void bytes(const void *bytes, size_t length) {
+                const auto *p = static_cast<const uint8_t *>(bytes);
+                data.insert(data.end(), p, p + length);
+            }
+
+            void str(const char *s) {
+                bytes(s, std::strlen(s));
+            }
+
+            void zeros(size_t length) {
+                data.insert(data.end(), length, 0);
+            }
+
+            void payload(Random &random, size_t length) {
+                for (size_t i = 0; i < length; i++) {
+                    u8(random.payloadByte());
+                }
+            }
+
+            void patchBe32(size_t offset, uint32_t value) {
+                data[offset] = value >> 24;
+                data[offset + 1] = value >> 16;
+                data[offset + 2] = value >> 8;
+                data[offset + 3] = value;
+            }
+
+            void patchLe32(size_t offset, uint32_t value) {
+                data[offset] = value;
+                data[offset + 1] = value >> 8;
+                data[offset + 2] = value >> 16;
+                data[offset + 3] = value >> 24;
+            }
+
+            // MP4 atoms: begin() writes the header with a placeholder size, end() patches it.
+
+            void begin(const char *type) {
+                atoms.push_back(size());
+                be32(0);
+                str(type);
+            }
+
+            void end() {
+                const size_t start = atoms.back();
+                atoms.pop_back();
+                patchBe32(start, static_cast<uint32_t>(size() - start));
+            }
+
+        private:
+            std::vector<size_t> atoms;
+        };
+
+        bool writeFile(const std::string &path, const std::vector<uint8_t> &data) {
+            FILE *file = std::fopen(path.c_str(), "wb");
+            if (!file) {
+                return false;
+            }
+            const bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+            return std::fclose(file) == 0 && ok;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        // MPEG
+        ////////////////////////////////////////////////////////////////////////////
+
+        enum class MpegMode {
+            CBR,
+            VBR,
+            VBRWithXing,
+            // VBR with 3 s of silence coded at the lowest bitrate at each end, as LAME does
+            VBRWithSilence
+        };
+
+        // MPEG-1 Layer III, 44.1 kHz, stereo.
+        std::vector<uint8_t> mpeg(double duration, MpegMode mode, Random &random) {
+            static constexpr int bitrates[] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
+            const auto frameCount = static_cast<uint32_t>(duration * 44100 / 1152);
+
+            auto frameSize = [](int bitrateIndex) {
+                return static_cast<uint32_t>(144 * bitrates[bitrateIndex] * 1000 / 44100);
+            };
+            auto header = [](Writer &w, int bitrateIndex) {
+                w.u8(0xFF);
+                w.u8(0xFB);
+                w.u8(static_cast<uint8_t>(bitrateIndex << 4));
+                w.u8(0x00);
+            };
+
+            std::vector<int> indices(frameCount, 9);
+            if (mode != MpegMode::CBR) {
+                for (auto &index: indices) {
+                    index = 5 + static_cast<int>(random.next() % 10);
+                }
+            }
+            if (mode == MpegMode::VBRWithSilence) {
+                const auto silenceCount = std::min<size_t>(static_cast<size_t>(3 * 44100 / 1152), frameCount / 4);
+                std::fill_n(indices.begin(), silenceCount, 1);
+                std::fill_n(indices.end() - static_cast<std::ptrdiff_t>(silenceCount), silenceCount, 1);
+            }
+
+            Writer w;
+            if (mode == MpegMode::VBRWithXing) {
+                uint32_t streamBytes = frameSize(9);
+                for (const int index: indices) {
+                    streamBytes += frameSize(index);
+                }
+                header(w, 9);
+                w.zeros(32);
+                w.str("Xing");
+                w.be32(0x03);
+                w.be32(frameCount);
+                w.be32(streamBytes);
+                w.zeros(frameSize(9) - 4 - 32 - 16);
+            }
+            for (const int index: indices) {
+                header(w, index);
+                w.payload(random, frameSize(index) - 4);
+            }
+            return w.data;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        // FLAC
+        ////////////////////////////////////////////////////////////////////////////
+
+        // 44.1 kHz, stereo, 16 bit, with blocks of 4096 samples.
+        std::vector<uint8_t> flac(double duration, Random &random) {
+            const auto totalSamples = static_cast<uint64_t>(duration * 44100);
+            const uint64_t blockCount = (totalSamples + 4095) / 4096;
+
+            Writer w;
+            w.str("fLaC");
+            w.u8(0x80);  // last metadata block, STREAMINFO
+            w.be24(34);
+            w.be16(4096);
+            w.be16(4096);
+            w.be24(0);
+            w.be24(0);
+            w.be64((static_cast<uint64_t>(44100) << 44) | (static_cast<uint64_t>(1) << 41) |
+                   (static_cast<uint64_t>(15) << 36) | totalSamples);
+            w.zeros(16);
+
+            // Frames of about 60% of the PCM size, with a valid header but random content.
+            for (uint64_t i = 0; i < blockCount; i++) {
+                w.be16(0xFFF8);
+                w.u8(0xC9);
+                w.u8(0x18);
+                w.u8(static_cast<uint8_t>(i & 0x7F));
+                w.u8(0);
+                w.payload(random, 4096 * 4 * 6 / 10);
+            }
+            return w.data;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        // RIFF WAVE
+        ////////////////////////////////////////////////////////////////////////////
+
+        std::vector<uint8_t> wav(double duration, Random &random) {
+            const auto dataSize = static_cast<uint32_t>(duration * 44100) * 4;
+
+            Writer w;
+            w.str("RIFF");
+            w.le32(4 + 8 + 16 + 8 + dataSize);
+            w.str("WAVE");
+            w.str("fmt ");
+            w.le32(16);
+            w.le16(1);
+            w.le16(2);
+            w.le32(44100);
+            w.le32(44100 * 4);
+            w.le16(4);
+            w.le16(16);
+            w.str("data");
+            w.le32(dataSize);
+            w.payload(random, dataSize);
+            return w.data;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        // MP4
+        ////////////////////////////////////////////////////////////////////////////
+
+        // AAC-LC, 44.1 kHz, stereo, 128 kbps in constant size samples.
+        std::vector<uint8_t> mp4(double duration, bool moovLast, Random &random) {
+            const auto sampleCount = static_cast<uint32_t>(duration * 44100 / 1024);
+            const uint32_t sampleSize = 372;
+            const uint32_t mdatSize = 8 + sampleCount * sampleSize;
+
+            Writer w;
+            w.begin("ftyp");
+            w.str("M4A ");
+            w.be32(0x200);
+            w.str("M4A mp42isom");
+            w.end();
+            const size_t ftypSize = w.size();
+
+            if (moovLast) {
+                w.be32(mdatSize);
+                w.str("mdat");
+                w.payload(random, mdatSize - 8);
+            }
+
+            size_t chunkOffset = 0;
+            w.begin("moov");
+            {
+                w.begin("mvhd");
+                w.be32(0);
+                w.be32(0);
+                w.be32(0);
+                w.be32(1000);
+                w.be32(static_cast<uint32_t>(duration * 1000));
+                w.be32(0x00010000);
+                w.be16(0x0100);
+                w.zeros(10);
+                w.be32(0x00010000);
+                w.zeros(12);
+                w.be32(0x00010000);
+                w.zeros(12);
+                w.be32(0x40000000);
+                w.zeros(24);
+                w.be32(2);
+                w.end();
+
+                w.begin("trak");
+                w.begin("tkhd");
+                w.be32(0x00000007);
+                w.be32(0);
+                w.be32(0);
+                w.be32(1);
+                w.be32(0);
+                w.be32(static_cast<uint32_t>(duration * 1000));
+                w.zeros(8);
+                w.be16(0);
+                w.be16(0);
+                w.be16(0x0100);
+                w.be16(0);
+                w.be32(0x00010000);
+                w.zeros(12);
+                w.be32(0x00010000);
+                w.zeros(12);
+                w.be32(0x40000000);
+                w.be32(0);
+                w.be32(0);
+                w.end();
+
+                w.begin("mdia");
+                w.begin("mdhd");
+                w.be32(0);
+                w.be32(0);
+                w.be32(0);
+                w.be32(44100);
+                w.be32(sampleCount * 1024);
+                w.be16(0x55C4);
+                w.be16(0);
+                w.end();
+
+                w.begin("hdlr");
+                w.be32(0);
+                w.be32(0);
+                w.str("soun");
+                w.zeros(12);
+                w.str("SoundHandler");
+                w.u8(0);
+                w.end();
+
+                w.begin("minf");
+                w.begin("smhd");
+                w.be32(0);
+                w.be32(0);
+                w.end();
+
+                w.begin("dinf");
+                w.begin("dref");
+                w.be32(0);
+                w.be32(1);
+                w.begin("url ");
+                w.be32(1);
+                w.end();
+                w.end();
+                w.end();
+
+                w.begin("stbl");
+                w.begin("stsd");
+                w.be32(0);
+                w.be32(1);
+                w.begin("mp4a");
+                w.zeros(6);
+                w.be16(1);
+                w.be16(0);
+                w.be16(0);
+                w.be32(0);
+                w.be16(2);
+                w.be16(16);
+                w.be16(0);
+                w.be16(0);
+                w.be32(44100 << 16);
+                w.begin("esds");
+                w.be32(0);
+                w.u8(0x03);
+                w.bytes("\x80\x80\x80", 3);
+                w.u8(34);
+                w.be16(1);
+                w.u8(0);
+                w.u8(0x04);
+                w.bytes("\x80\x80\x80", 3);
+                w.u8(20);
+                w.u8(0x40);
+                w.u8(0x15);
+                w.be24(sampleSize * 2);
+                w.be32(128000);
+                w.be32(128000);
+                w.u8(0x05);
+                w.bytes("\x80\x80\x80", 3);
+                w.u8(2);
+                w.u8(0x12);
+                w.u8(0x10);
+                w.u8(0x06);
+                w.bytes("\x80\x80\x80", 3);
+                w.u8(1);
+                w.u8(0x02);
+                w.end();
+                w.end();
+                w.end();
+
+                w.begin("stts");
+                w.be32(0);
+                w.be32(1);
+                w.be32(sampleCount);
+                w.be32(1024);
+                w.end();
+
+                w.begin("stsc");
+                w.be32(0);
+                w.be32(1);
+                w.be32(1);
+                w.be32(sampleCount);
+                w.be32(1);
+                w.end();
+
+                w.begin("stsz");
+                w.be32(0);
+                w.be32(sampleSize);
+                w.be32(sampleCount);
+                w.end();
+
+                w.begin("stco");
+                w.be32(0);
+                w.be32(1);
+                chunkOffset = w.size();
+                w.be32(0);
+                w.end();
+
+                w.end();  // stbl
+                w.end();  // minf
+                w.end();  // mdia
+                w.end();  // trak
+            }
+            w.end();
+
+            if (moovLast) {
+                w.patchBe32(chunkOffset, static_cast<uint32_t>(ftypSize + 8));
+            } else {
+                w.patchBe32(chunkOffset, static_cast<uint32_t>(w.size() + 8));
+                w.be32(mdatSize);
+                w.str("mdat");
+                w.payload(random, mdatSize - 8);
+            }
+            return w.data;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        // Ogg
+        ////////////////////////////////////////////////////////////////////////////
+
+        uint32_t oggCrc(const uint8_t *data, size_t length) {
+            static uint32_t table[256];
+            static bool initialized = false;
+            if (!initialized) {
+                for (uint32_t i = 0; i < 256; i++) {
+                    uint32_t r = i << 24;
+                    for (int j = 0; j < 8; j++) {
+                        r = (r & 0x80000000) ? (r << 1) ^ 0x04C11DB7 : r << 1;
+                    }
+                    table[i] = r;
+                }
+                initialized = true;
+            }
+            uint32_t crc = 0;
+            for (size_t i = 0; i < length; i++) {
+                crc = (crc << 8) ^ table[((crc >> 24) & 0xFF) ^ data[i]];
+            }
+            return crc;
+        }
+
+        class OggWriter {
+        public:
+            Writer w;
+
+            // Writes one page holding complete packets, each at most 255 * 255 bytes.
+            void page(const std::vector<std::vector<uint8_t>> &packets, uint64_t granule, uint8_t flags) {
+                const size_t start = w.size();
+                w.str("OggS");
+                w.u8(0);
+                w.u8(flags);
+                w.le64(granule);
+                w.le32(0x54414721);
+                w.le32(sequence++);
+                w.le32(0);
+
+                std::vector<uint8_t> segments;
+                for (const auto &packet: packets) {
+                    size_t remaining = packet.size();
+                    while (remaining >= 255) {
+                        segments.push_back(255);
+                        remaining -= 255;
+                    }
+                    segments.push_back(static_cast<uint8_t>(remaining));
+                }
+                w.u8(static_cast<uint8_t>(segments.size()));
+                w.bytes(segments.data(), segments.size());
+                for (const auto &packet: packets) {
+                    w.bytes(packet.data(), packet.size());
+                }
+
+                w.patchLe32(start + 22, oggCrc(w.data.data() + start, w.size() - start));
+            }
+
+            // Writes pages of \a packetsPerPage random packets of \a packetSize bytes,
+            // each worth \a packetSamples in granule position.
+            void audio(Random &random, uint64_t packetCount, size_t packetSize, uint64_t packetSamples,
+                       uint64_t granuleStart) {
+                const uint64_t packetsPerPage = 16;
+                uint64_t granule = granuleStart;
+                for (uint64_t i = 0; i < packetCount; i += packetsPerPage) {
+                    std::vector<std::vector<uint8_t>> packets;
+                    for (uint64_t j = i; j < packetCount && j < i + packetsPerPage; j++) {
+                        std::vector<uint8_t> packet(packetSize);
+                        for (auto &byte: packet) {
+                            byte = random.payloadByte();
+                        }
+                        packets.push_back(std::move(packet));
+                        granule += packetSamples;
+                    }
+                    page(packets, granule, i + packetsPerPage >= packetCount ? 0x04 : 0x00);
+                }
+            }
+
+        private:
+            uint32_t sequence{0};
+        };
+
+        std::vector<uint8_t> vendor(const char *header) {
+            Writer w;
+            w.str(header);
+            w.le32(static_cast<uint32_t>(std::strlen("taglib benchmark")));
+            w.str("taglib benchmark");
+            w.le32(0);
+            return w.data;
+        }
+
+        // Vorbis, 44.1 kHz, stereo, about 128 kbps.
+        std::vector<uint8_t> vorbis(double duration, Random &random) {
+            Writer identification;
+            identification.str("\x01vorbis");
+            identification.le32(0);
+            identification.u8(2);
+            identification.le32(44100);
+            identification.le32(0);
+            identification.le32(128000);
+            identification.le32(0);
+            identification.u8(0xB8);
+            identification.u8(1);
+
+            std::vector<uint8_t> comment = vendor("\x03vorbis");
+            comment.push_back(1);
+
+            Writer setup;
+            setup.str("\x05vorbis");
+            setup.payload(random, 64);
+
+            OggWriter ogg;
+            ogg.page({identification.data}, 0, 0x02);
+            ogg.page({comment, setup.data}, 0, 0x00);
+            ogg.audio(random, static_cast<uint64_t>(duration * 44100 / 1024), 372, 1024, 0);
+            return ogg.w.data;
+        }
+
+        // Opus, 48 kHz, stereo, 20 ms packets at about 96 kbps.
+        std::vector<uint8_t> opus(double duration, Random &random) {
+            const uint16_t preSkip = 312;
+
+            Writer head;
+            head.str("OpusHead");
+            head.u8(1);
+            head.u8(2);
+            head.le16(preSkip);
+            head.le32(48000);
+            head.le16(0);
+            head.u8(0);
+
+            OggWriter ogg;
+            ogg.page({head.data}, 0, 0x02);
+            ogg.page({vendor("OpusTags")}, 0, 0x00);
+            ogg.audio(random, static_cast<uint64_t>(duration * 50), 240, 960, preSkip);
+            return ogg.w.data;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        // Matroska
+        ////////////////////////////////////////////////////////////////////////////
+
+        class EbmlWriter {
+        public:
+            Writer w;
+
+            void id(uint32_t value) {
+                if (value > 0xFFFFFF)
+                    w.u8(value >> 24);
+                if (value > 0xFFFF)
+                    w.u8(value >> 16);
+                if (value > 0xFF)
+                    w.u8(value >> 8);
+                w.u8(value);
+            }
+
+            // Master elements get an 8 byte size, patched by end().
+            void begin(uint32_t elementId) {
+                id(elementId);
+                masters.push_back(w.size());
+                w.be64(0x0100000000000000ULL);
+            }
+
+            void end() {
+                const size_t start = masters.back();
+                masters.pop_back();
+                const uint64_t size = w.size() - start - 8;
+                for (int i = 0; i < 7; i++) {
+                    w.data[start + 7 - i] = static_cast<uint8_t>(size >> (8 * i));
+                }
+            }
+
+            void uinteger(uint32_t elementId, uint64_t value) {
+                id(elementId);
+                w.u8(0x88);
+                w.be64(value);
+            }
+
+            void floating(uint32_t elementId, double value) {
+                uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                id(elementId);
+                w.u8(0x88);
+                w.be64(bits);
+            }
+
+            void string(uint32_t elementId, const char *value) {
+                id(elementId);
+                w.u8(static_cast<uint8_t>(0x80 | std::strlen(value)));
+                w.str(value);
+            }
+
+            void binary(uint32_t elementId, const std::vector<uint8_t> &value) {
+                id(elementId);
+                w.be64(0x0100000000000000ULL | value.size());
+                w.bytes(value.data(), value.size());
+            }
+
+        private:
+            std::vector<size_t> masters;
+        };
+
+        void ebmlHeader(EbmlWriter &e) {
+            e.begin(0x1A45DFA3);
+            e.uinteger(0x4286, 1);
+            e.uinteger(0x42F7, 1);
+            e.uinteger(0x42F2, 4);
+            e.uinteger(0x42F3, 8);
+            e.string(0x4282, "matroska");
+            e.uinteger(0x4287, 4);
+            e.uinteger(0x4285, 2);
+            e.end();
+        }
+
+        // One PCM track, 44.1 kHz, stereo, 16 bit.
+        void pcmTrack(EbmlWriter &e) {
+            e.begin(0x1654AE6B);
+            e.begin(0xAE);
+            e.uinteger(0xD7, 1);
+            e.uinteger(0x73C5, 1);
+            e.uinteger(0x83, 2);
+            e.string(0x86, "A_PCM/INT/LIT");
+            e.begin(0xE1);
+            e.floating(0xB5, 44100);
+            e.uinteger(0x9F, 2);
+            e.uinteger(0x6264, 16);
+            e.end();
+            e.end();
+            e.end();
+        }
+
+        // A SeekHead with fixed size entries for targets.  Returns the offsets of the
+        // positions, to be patched by patchSeekPositions().
+        std::vector<size_t> seekHead(EbmlWriter &e, std::initializer_list<uint32_t> targets) {
+            std::vector<size_t> seekPositions;
+            e.begin(0x114D9B74);
+            for (const uint32_t target: targets) {
+                e.begin(0x4DBB);
+                std::vector<uint8_t> targetId = {static_cast<uint8_t>(target >> 24), static_cast<uint8_t>(target >> 16),
+                                                 static_cast<uint8_t>(target >> 8), static_cast<uint8_t>(target)};
+                e.binary(0x53AB, targetId);
+                e.uinteger(0x53AC, 0);
+                seekPositions.push_back(e.w.size() - 8);
+                e.end();
+            }
+            e.end();
+            return seekPositions;
+        }
+
+        void patchSeekPositions(EbmlWriter &e, const std::vector<size_t> &seekPositions,
+                                const std::vector<uint64_t> &positions) {
+            for (size_t i = 0; i < seekPositions.size(); i++) {
+                for (int j = 0; j < 8; j++) {
+                    e.w.data[seekPositions[i] + 7 - j] = static_cast<uint8_t>(positions[i] >> (8 * j));
+                }
+            }
+        }
+
+        // PCM in one cluster per second.
+        std::vector<uint8_t> matroska(double duration, Random &random) {
+            EbmlWriter e;
+            ebmlHeader(e);
+
+            e.begin(0x18538067);
+            const size_t segmentStart = e.w.size();
+
+            const std::vector<size_t> seekPositions = seekHead(e, {0x1549A966u, 0x1654AE6Bu});
+
+            const size_t infoPosition = e.w.size() - segmentStart;
+            e.begin(0x1549A966);
+            e.uinteger(0x2AD7B1, 1000000);
+            e.floating(0x4489, duration * 1000);
+            e.string(0x4D80, "taglib benchmark");
+            e.string(0x5741, "taglib benchmark");
+            e.end();
+
+            const size_t tracksPosition = e.w.size() - segmentStart;
+            pcmTrack(e);
+
+            const auto seconds = static_cast<uint64_t>(duration);
+            for (uint64_t second = 0; second < seconds; second++) {
+                e.begin(0x1F43B675);
+                e.uinteger(0xE7, second * 1000);
+                for (int block = 0; block < 10; block++) {
+                    const int timestamp = block * 100;
+                    std::vector<uint8_t> simpleBlock = {0x81, static_cast<uint8_t>(timestamp >> 8),
+                                                        static_cast<uint8_t>(timestamp), 0x80};
+                    for (int i = 0; i < 4410 * 4; i++) {
+                        simpleBlock.push_back(random.payloadByte());
+                    }
+                    e.binary(0xA3, simpleBlock);
+                }
+                e.end();
+            }
+            e.end();
+
+            patchSeekPositions(e, seekPositions, {infoPosition, tracksPosition});
+            return e.w.data;
+        }
+
+        // Writes a Matroska file of about size bytes that is mostly holes: the media
+        // is one Cluster per MiB of which only the headers are written, followed by
+        // Cues, Tags and a cover attachment that only the SeekHead points to.
+        bool sparseMatroska(const std::string &path, uint64_t size, const PropertyMap &properties,
+                            const List<VariantMap> &pictures) {
+            constexpr uint64_t clusterLength = 1024 * 1024;
+            // Milliseconds of 44.1 kHz, stereo, 16 bit PCM in a cluster
+            constexpr uint64_t clusterMillis = clusterLength * 1000 / (44100 * 4);
+
+            // Everything before the Clusters, positions relative to the segment data
+            EbmlWriter segment;
+            const std::vector<size_t> seekPositions =
+                    seekHead(segment, {0x1549A966u, 0x1654AE6Bu, 0x1C53BB6Bu, 0x1254C367u, 0x1941A469u});
+            const uint64_t infoPosition = segment.w.size();
+            const uint64_t mediaBegin = segment.w.size() + 256;
+            const uint64_t clusters = std::max<uint64_t>(1, (size - std::min(size, mediaBegin)) / clusterLength);
+            segment.begin(0x1549A966);
+            segment.uinteger(0x2AD7B1, 1000000);
+            segment.floating(0x4489, static_cast<double>(clusters * clusterMillis));
+            segment.string(0x4D80, "taglib benchmark");
+            segment.string(0x5741, "taglib benchmark");
+            segment.end();
+            const uint64_t tracksPosition = segment.w.size();
+            pcmTrack(segment);
+            if (segment.w.size() + 9 > mediaBegin) {
+                return false;
+            }
+            // Pad up to mediaBegin with a Void element.
+            segment.binary(0xEC, std::vector<uint8_t>(mediaBegin - segment.w.size() - 9));
+
+            // Everything after them
+            const uint64_t cuesPosition = mediaBegin + clusters * clusterLength;
+            EbmlWriter tail;
+            tail.begin(0x1C53BB6B);
+            for (uint64_t cluster = 0; cluster < clusters; cluster++) {
+                tail.begin(0xBB);
+                tail.uinteger(0xB3, cluster * clusterMillis);
+                tail.begin(0xB7);
+                tail.uinteger(0xF7, 1);
+                tail.uinteger(0xF1, mediaBegin + cluster * clusterLength);
+                tail.end();
+                tail.end();
+            }
+            tail.end();
+
+            const uint64_t tagsPosition = cuesPosition + tail.w.size();
+            tail.begin(0x1254C367);
+            tail.begin(0x7373);
+            tail.begin(0x63C0);
+            tail.uinteger(0x68CA, 50);
+            tail.end();
+            for (const auto &property: properties) {
+                for (const auto &value: property.second) {
+                    const std::string text = value.to8Bit(true);
+                    tail.begin(0x67C8);
+                    tail.string(0x45A3, property.first.toCString());
+                    tail.binary(0x4487, std::vector<uint8_t>(text.begin(), text.end()));
+                    tail.end();
+                }
+            }
+            tail.end();
+            tail.end();
+
+            const uint64_t attachmentsPosition = cuesPosition + tail.w.size();
+            tail.begin(0x1941A469);
+            for (const auto &picture: pictures) {
+                const ByteVector data = picture["data"].toByteVector();
+                tail.begin(0x61A7);
+                tail.string(0x466E, "cover.jpg");
+                tail.string(0x4660, "image/jpeg");
+                tail.binary(0x465C, std::vector<uint8_t>(data.begin(), data.end()));
+                tail.uinteger(0x46AE, 1);
+                tail.end();
+            }
+            tail.end();
+
+            patchSeekPositions(segment, seekPositions,
+                               {infoPosition, tracksPosition, cuesPosition, tagsPosition, attachmentsPosition});
+
+            EbmlWriter head;
+            ebmlHeader(head);
+            head.id(0x18538067);
+            head.w.be64(0x0100000000000000ULL | (cuesPosition + tail.w.size()));
+            const uint64_t segmentBegin = head.w.size();
+
+            FILE *file = std::fopen(path.c_str(), "wb");
+            if (!file) {
+                return false;
+            }
+            bool ok = std::fwrite(head.w.data.data(), 1, head.w.size(), file) == head.w.size() &&
+                      std::fwrite(segment.w.data.data(), 1, segment.w.size(), file) == segment.w.size();
+            for (uint64_t cluster = 0; ok && cluster < clusters; cluster++) {
+                // Cluster, Timestamp and the header of a SimpleBlock filling the rest
+                EbmlWriter header;
+                header.id(0x1F43B675);
+                header.w.be64(0x0100000000000000ULL | (clusterLength - 12));
+                header.uinteger(0xE7, cluster * clusterMillis);
+                header.id(0xA3);
+                header.w.be64(0x0100000000000000ULL | (clusterLength - header.w.size() - 8));
+                header.w.u8(0x81);
+                header.w.be16(0);
+                header.w.u8(0x80);
+                ok = fseeko(file, static_cast<off_t>(segmentBegin + mediaBegin + cluster * clusterLength),
+                            SEEK_SET) == 0 &&
+                     std::fwrite(header.w.data.data(), 1, header.w.size(), file) == header.w.size();
+            }
+            ok = ok && fseeko(file, static_cast<off_t>(segmentBegin + cuesPosition), SEEK_SET) == 0 &&
+                 std::fwrite(tail.w.data.data(), 1, tail.w.size(), file) == tail.w.size();
+            return std::fclose(file) == 0 && ok;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////
+        // Tags
+        ////////////////////////////////////////////////////////////////////////////
+
+        PropertyMap tagProfile(const std::string &profile, Random &random) {
+            PropertyMap properties;
+            properties["TITLE"] = String("Benchmark Track");
+            properties["ARTIST"] = String("Benchmark Artist");
+            properties["ALBUM"] = String("Benchmark Album");
+            properties["DATE"] = String("2025");
+            properties["TRACKNUMBER"] = String("7");
+            properties["GENRE"] = String("Electronic");
+            if (profile == "large") {
+                properties["ALBUMARTIST"] = String("Benchmark Album Artist");
+                properties["COMPOSER"] = String("Benchmark Composer");
+                properties["DISCNUMBER"] = String("1");
+                properties["BPM"] = String("128");
+                properties["COPYRIGHT"] = String("(C) Benchmark");
+                properties["ARTISTS"] = StringList{"Artist One", "Artist Two", "Artist Three"};
+                std::string comment;
+                std::string lyrics;
+                for (int i = 0; i < 2 * 1024; i++) {
+                    comment += static_cast<char>('a' + random.next() % 26);
+                }
+                for (int i = 0; i < 16 * 1024; i++) {
+                    lyrics += (i % 64 == 63) ? '\n' : static_cast<char>('a' + random.next() % 26);
+                }
+                properties["COMMENT"] = String(comment);
+                properties["LYRICS"] = String(lyrics);
+                for (int i = 0; i < 20; i++) {
+                    properties["CUSTOM" + String::number(i)] = String("Value " + String::number(i));
+                }
+            }
+            return properties;
+        }
+
+        List<VariantMap> pictureProfile(const std::string &profile, Random &random) {
+            List<VariantMap> pictures;
+            if (profile == "none") {
+                return pictures;
+            }
+
+            // Random bytes between the JPEG start and end markers.
+            const unsigned int size = profile == "large" ? 1024 * 1024 : 32 * 1024;
+            ByteVector data(size, 0);
+            for (unsigned int i = 0; i < size; i++) {
+                data[static_cast<int>(i)] = static_cast<char>(random.payloadByte());
+            }
+            data[0] = '\xFF';
+            data[1] = '\xD8';
+            data[static_cast<int>(size - 2)] = '\xFF';
+            data[static_cast<int>(size - 1)] = '\xD9';
+
+            VariantMap picture;
+            picture["data"] = data;
+            picture["description"] = String("Cover");
+            picture["pictureType"] = String("Front Cover");
+            picture["mimeType"] = String("image/jpeg");
+            pictures.append(picture);
+            return pictures;
+        }
+
+        bool writeTags(const std::string &path, const PropertyMap &properties, const List<VariantMap> &pictures) {
+            FileStream stream(path.c_str(), false);
+            TagLibExt::FileRef f(path.c_str(), &stream, false);
+            if (f.isNull()) {
+                return false;
+            }
+            f.setProperties(properties);
+            if (!pictures.isEmpty()) {
+                f.setComplexProperties("PICTURE", pictures);
+            }
+            return f.save();
+        }
+
+        std::vector<uint8_t> audioOf(const std::string &kind, double duration, Random &random) {
+            if (kind == "mp3-cbr")
+                return mpeg(duration, MpegMode::CBR, random);
+            if (kind == "mp3-vbr")
+                return mpeg(duration, MpegMode::VBR, random);
+            if (kind == "mp3-vbr-xing")
+                return mpeg(duration, MpegMode::VBRWithXing, random);
+            if (kind == "mp3-vbr-silence")
+                return mpeg(duration, MpegMode::VBRWithSilence, random);
+            if (kind == "flac")
+                return flac(duration, random);
+            if (kind == "mp4")
+                return mp4(duration, false, random);
+            if (kind == "mp4-moov-last")
+                return mp4(duration, true, random);
+            if (kind == "ogg-vorbis")
+                return vorbis(duration, random);
+            if (kind == "opus")
+                return opus(duration, random);
+            if (kind == "opus-junk") {
+                // 1 MiB after the last page, out of reach of a bounded search for it
+                std::vector<uint8_t> audio = opus(duration, random);
+                for (int i = 0; i < 1024 * 1024; i++) {
+                    audio.push_back(random.payloadByte());
+                }
+                return audio;
+            }
+            if (kind == "wav")
+                return wav(duration, random);
+            if (kind == "matroska")
+                return matroska(duration, random);
+            return {};
+        }
+
+        uint64_t fileSize(const std::string &path) {
+            struct stat st{};
+            if (stat(path.c_str(), &st) != 0) {
+                return 0;
+            }
+            return static_cast<uint64_t>(st.st_size);
+        }
+    }
+
+    std::vector<CorpusFile> generateCorpus(const std::string &directory, const CorpusOptions &options) {
+        struct Kind {
+            const char *name;
+            const char *extension;
+        };
+        static constexpr Kind kinds[] = {
+                {"mp3-cbr",         "mp3"},
+                {"mp3-vbr",         "mp3"},
+                {"mp3-vbr-xing",    "mp3"},
+                {"mp3-vbr-silence", "mp3"},
+                {"flac",            "flac"},
+                {"mp4",             "m4a"},
+                {"mp4-moov-last",   "m4a"},
+                {"ogg-vorbis",      "ogg"},
+                {"opus",            "opus"},
+                {"opus-junk",       "opus"},
+                {"wav",             "wav"},
+                {"matroska",        "mka"},
+        };
+
+        std::vector<CorpusFile> corpus;
+        Random random(0x7461676C6962ULL);
+        for (const auto &kind: kinds) {
+            for (const char *tags: {"small", "large"}) {
+                for (const char *pictures: {"none", "small", "large"}) {
+                    const std::string name = kind.name;
+                    const std::vector<uint8_t> audio = audioOf(name, options.duration, random);
+
+                    CorpusFile file;
+                    file.path = directory + "/" + name + "_tags-" + tags + "_pictures-" + pictures + "." +
+                                kind.extension;
+                    file.kind = name;
+                    file.tags = tags;
+                    file.pictures = pictures;
+
+                    if (!writeFile(file.path, audio)) {
+                        std::fprintf(stderr, "Failed to write %s\n", file.path.c_str());
+                        continue;
+                    }
+                    if (!writeTags(file.path, tagProfile(tags, random), pictureProfile(pictures, random))) {
+                        std::fprintf(stderr, "Failed to tag %s\n", file.path.c_str());
+                    }
+                    file.size = fileSize(file.path);
+                    corpus.push_back(file);
+                }
+            }
+        }
+
+        if (options.sparseMatroskaSize > 0) {
+            CorpusFile file;
+            file.path = directory + "/matroska-sparse_tags-small_pictures-small.mkv";
+            file.kind = "matroska-sparse";
+            file.tags = "small";
+            file.pictures = "small";
+            file.sparse = true;
+            if (sparseMatroska(file.path, options.sparseMatroskaSize, tagProfile("small", random),
+                               pictureProfile("small", random))) {
+                file.size = fileSize(file.path);
+                corpus.push_back(file);
+            } else {
+                std::fprintf(stderr, "Failed to write %s\n", file.path.c_str());
+            }
+        }
+        return corpus;
+    }
+
+    bool writeAudioFile(const std::string &path, const std::string &kind, double duration, uint64_t seed) {
+        Random random(seed);
+        const std::vector<uint8_t> audio = audioOf(kind, duration, random);
+        return !audio.empty() && writeFile(path, audio);
+    }
+
+    std::vector<CorpusFile> scanCorpus(const std::string &directory) {
+        std::vector<CorpusFile> corpus;
+        DIR *dir = opendir(directory.c_str());
+        if (!dir) {
+            return corpus;
+        }
+        while (const dirent *entry = readdir(dir)) {
+            CorpusFile file;
+            file.path = directory + "/" + entry->d_name;
+            struct stat st{};
+            if (stat(file.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            const std::string name = entry->d_name;
+            const size_t dot = name.rfind('.');
+            file.kind = dot == std::string::npos ? "" : name.substr(dot + 1);
+            file.size = static_cast<uint64_t>(st.st_size);
+            file.sparse = static_cast<uint64_t>(st.st_blocks) * 512 < file.size / 2;
+            corpus.push_back(file);
+        }
+        closedir(dir);
+        return corpus;
+    }
+
+} // namespace TagLibExt::Benchmark
@@ -0,0 +1,52 @@
+#ifndef TAGLIB_EXT_BENCHMARK_CORPUS_H
+#define TAGLIB_EXT_BENCHMARK_CORPUS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TagLibExt::Benchmark {
+
+    //! A file of the benchmark corpus.
+
+    struct CorpusFile {
+        std::string path;
+        //! Container and encoding variant, e.g. "mp3-vbr", "mp4-moov-last"
+        std::string kind;
+        //! Tag profile, "small" or "large", empty for files not generated by us
+        std::string tags;
+        //! Picture profile, "none", "small" or "large", empty for files not generated by us
+        std::string pictures;
+        uint64_t size{0};
+        //! Whether the file is mostly holes, too large to be copied for the save operations
+        bool sparse{false};
+    };
+
+    struct CorpusOptions {
+        //! Length of the generated audio in seconds
+        double duration{30};
+        //! Size of a sparse Matroska file with Tags and an attachment after the media, none if 0
+        uint64_t sparseMatroskaSize{0};
+    };
+
+    /*!
+     * Writes synthetic files of every supported kind into \a directory, one per
+     * combination of tag profile and picture profile.  The audio payload is
+     * random, but the container structure is valid, and the tags are written
+     * with TagLib, except in the sparse Matroska file, which is written at once.
+     */
+    std::vector<CorpusFile> generateCorpus(const std::string &directory, const CorpusOptions &options);
+
+    /*!
+     * Writes untagged audio of \a kind, one of the kinds of generateCorpus(), to
+     * \a path, with the payload drawn from \a seed.  Returns \c false if the kind
+     * is unknown or the file could not be written.
+     */
+    bool writeAudioFile(const std::string &path, const std::string &kind, double duration, uint64_t seed);
+
+    //! Lists the regular files in \a directory as a corpus, with their extension as kind.
+    std::vector<CorpusFile> scanCorpus(const std::string &directory);
+
+} // namespace TagLibExt::Benchmark
+
+#endif //TAGLIB_EXT_BENCHMARK_CORPUS_H
@@ -0,0 +1,141 @@
+#include "convert.h"
+
+#include "cpu_features.h"
+
+#if defined(TAGLIB_EXT_AVX2)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace TagLibExt {
+    namespace {
+        // String stores UTF-16 code units in wchar_t, whatever the width of wchar_t.  The
+        // vector kernels handle a 32 bit wchar_t and keep the low 16 bits like the casts.
+        constexpr bool wideWchar = sizeof(wchar_t) == sizeof(uint32_t);
+
+        template<class From, class To>
+        void convertScalar(const From *source, To *target, size_t length) {
+            for (size_t i = 0; i < length; i++) {
+                target[i] = static_cast<To>(source[i]);
+            }
+        }
+
+#if defined(TAGLIB_EXT_VECTOR128)
+        void narrow128(const uint32_t *source, uint16_t *target, size_t length) {
+            size_t i = 0;
+            for (; i + 8 <= length; i += 8) {
+#if defined(__SSE2__)
+                // The packing saturates signed values, so the low halves are sign extended first
+                const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+                const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i + 4));
+                const __m128i units = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(low, 16), 16),
+                                                      _mm_srai_epi32(_mm_slli_epi32(high, 16), 16));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i), units);
+#else
+                vst1q_u16(target + i, vcombine_u16(vmovn_u32(vld1q_u32(source + i)),
+                                                   vmovn_u32(vld1q_u32(source + i + 4))));
+#endif
+            }
+            convertScalar(source + i, target + i, length - i);
+        }
+
+        void widen128(const uint16_t *source, uint32_t *target, size_t length) {
+            size_t i = 0;
+            for (; i + 8 <= length; i += 8) {
+#if defined(__SSE2__)
+                const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+                const __m128i zero = _mm_setzero_si128();
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i), _mm_unpacklo_epi16(units, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(target + i + 4), _mm_unpackhi_epi16(units, zero));
+#else
+                const uint16x8_t units = vld1q_u16(source + i);
+                vst1q_u32(target + i, vmovl_u16(vget_low_u16(units)));
+                vst1q_u32(target + i + 4, vmovl_u16(vget_high_u16(units)));
+#endif
+            }
+            convertScalar(source + i, target + i, length - i);
+        }
+#endif
+
+#if defined(TAGLIB_EXT_AVX2)
+        TAGLIB_EXT_TARGET_AVX2 void narrowAvx2(const uint32_t *source, uint16_t *target, size_t length) {
+            size_t i = 0;
+            for (; i + 16 <= length; i += 16) {
+                const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+                const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i + 8));
+                // Packed per 128 bit lane, the quarters are put back in order after
+                const __m256i units = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(low, 16), 16),
+                                                         _mm256_srai_epi32(_mm256_slli_epi32(high, 16), 16));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(target + i),
+                                    _mm256_permute4x64_epi64(units, _MM_SHUFFLE(3, 1, 2, 0)));
+            }
+            convertScalar(source + i, target + i, length - i);
+        }
+
+        TAGLIB_EXT_TARGET_AVX2 void widenAvx2(const uint16_t *source, uint32_t *target, size_t length) {
+            size_t i = 0;
+            for (; i + 8 <= length; i += 8) {
+                const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(target + i), _mm256_cvtepu16_epi32(units));
+            }
+            convertScalar(source + i, target + i, length - i);
+        }
+#endif
+
+        void narrow(const wchar_t *source, uint16_t *target, size_t length) {
+            if constexpr (wideWchar) {
+                const auto *wide = reinterpret_cast<const uint32_t *>(source);
+                switch (kernelSet()) {
+#if defined(TAGLIB_EXT_AVX2)
+                    case KernelSet::Avx2:
+                        return narrowAvx2(wide, target, length);
+#endif
+#if defined(TAGLIB_EXT_VECTOR128)
+                    case KernelSet::Vector128:
+                        return narrow128(wide, target, length);
+#endif
+                    default:
+                        break;
+                }
+            }
+            convertScalar(source, target, length);
+        }
+
+        void widen(const uint16_t *source, wchar_t *target, size_t length) {
+            if constexpr (wideWchar) {
+                auto *wide = reinterpret_cast<uint32_t *>(target);
+                switch (kernelSet()) {
+#if defined(TAGLIB_EXT_AVX2)
+                    case KernelSet::Avx2:
+                        return widenAvx2(source, wide, length);
+#endif
+#if defined(TAGLIB_EXT_VECTOR128)
+                    case KernelSet::Vector128:
+                        return widen128(source, wide, length);
+#endif
+                    default:
+                        break;
+                }
+            }
+            convertScalar(source, target, length);
+        }
+    }
+
+    Utf16View toUtf16(const String &str, Arena &arena) {
+        const size_t length = str.size();
+        auto *data = arena.allocate<uint16_t>(length);
+        narrow(str.toCWString(), data, length);
+        return {data, length};
+    }
+
+    String fromUtf16(const uint16_t *data, size_t length, Arena &arena) {
+        auto *buffer = arena.allocate<wchar_t>(length + 1);
+        widen(data, buffer, length);
+        buffer[length] = L'\0';
+        return {buffer};
+    }
+
+} // namespace TagLibExt
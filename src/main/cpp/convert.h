@@ -0,0 +1,33 @@
+#ifndef TAGLIB_EXT_CONVERT_H
+#define TAGLIB_EXT_CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "arena.h"
+#include "tstring.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! UTF-16 code units of a string, owned by an arena.
+
+    struct Utf16View {
+        const uint16_t *data;
+        size_t length;
+    };
+
+    /*!
+     * Returns the UTF-16 code units of \a str, copied into \a arena.  This is the
+     * layout of a Java string, so the result can be handed to NewString() without
+     * the UTF-8 round trip and the heap allocation of String::toCString().
+     */
+    Utf16View toUtf16(const String &str, Arena &arena);
+
+    //! Builds a String from \a length UTF-16 code units, using \a arena for the intermediate buffer.
+    String fromUtf16(const uint16_t *data, size_t length, Arena &arena);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_CONVERT_H
@@ -0,0 +1,82 @@
+#include "cpu_features.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace TagLibExt {
+    namespace {
+
+        const char *const kernelSetNames[] = {
+                "scalar",
+#if defined(__ARM_NEON) && defined(__aarch64__)
+                "neon",
+#else
+                "sse2",
+#endif
+                "avx2"
+        };
+
+        KernelSet widestSupportedKernelSet() {
+            for (int set = static_cast<int>(KernelSet::Count) - 1; set > 0; set--) {
+                if (isKernelSetSupported(static_cast<KernelSet>(set))) {
+                    return static_cast<KernelSet>(set);
+                }
+            }
+            return KernelSet::Scalar;
+        }
+
+        // Initialized when the library is loaded; kernels running in static initializers
+        // before that find it zero initialized, i.e. Scalar.
+        std::atomic<KernelSet> currentKernelSet{widestSupportedKernelSet()};
+
+    } // namespace
+
+    const char *kernelSetName(KernelSet set) {
+        return set < KernelSet::Count ? kernelSetNames[static_cast<int>(set)] : "";
+    }
+
+    KernelSet findKernelSet(const char *name) {
+        for (int set = 0; set < static_cast<int>(KernelSet::Count); set++) {
+            if (std::strcmp(name, kernelSetNames[set]) == 0) {
+                return static_cast<KernelSet>(set);
+            }
+        }
+        return KernelSet::Count;
+    }
+
+    bool isKernelSetSupported(KernelSet set) {
+        switch (set) {
+            case KernelSet::Scalar:
+                return true;
+            case KernelSet::Vector128:
+#if defined(TAGLIB_EXT_VECTOR128)
+                return true;
+#else
+                return false;
+#endif
+            case KernelSet::Avx2:
+#if defined(TAGLIB_EXT_AVX2)
+                // Also checks that the OS saves the AVX registers
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2");
+#else
+                return false;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    KernelSet kernelSet() {
+        return currentKernelSet.load(std::memory_order_relaxed);
+    }
+
+    bool setKernelSet(KernelSet set) {
+        if (!isKernelSetSupported(set)) {
+            return false;
+        }
+        currentKernelSet.store(set, std::memory_order_relaxed);
+        return true;
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,55 @@
+#ifndef TAGLIB_EXT_CPU_FEATURES_H
+#define TAGLIB_EXT_CPU_FEATURES_H
+
+// Instruction sets the kernels have variants for in this build: 16 byte vectors
+// where they are part of the baseline of the ABI, and AVX2 on x86, compiled per
+// function with TAGLIB_EXT_TARGET_AVX2 and only called if the CPU supports it.
+
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+#define TAGLIB_EXT_VECTOR128
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TAGLIB_EXT_AVX2
+#define TAGLIB_EXT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace TagLibExt {
+
+    /*!
+     * The sets of kernels for byte scanning, see scan.h, hashing, see hash.h, and
+     * UTF-16 conversion, see convert.h.  The native library is built once per ABI
+     * for its baseline, so the wider sets are selected when the library is loaded
+     * by CPU feature detection.  All sets compute the same results.
+     */
+    enum class KernelSet {
+        //! Portable C++
+        Scalar,
+        //! 16 bytes at a time, with SSE2 on x86 or NEON on AArch64
+        Vector128,
+        //! 32 bytes at a time, with AVX2 on x86
+        Avx2,
+        Count
+    };
+
+    //! Returns the name of \a set, e.g. "avx2".
+    const char *kernelSetName(KernelSet set);
+
+    //! Returns the set named \a name, or KernelSet::Count if there is none.
+    KernelSet findKernelSet(const char *name);
+
+    //! Returns \c true if \a set is compiled in and supported by the CPU.
+    bool isKernelSetSupported(KernelSet set);
+
+    //! Returns the set the kernels use, by default the widest supported one.
+    KernelSet kernelSet();
+
+    /*!
+     * Makes the kernels use \a set, e.g. to compare the sets in tests.  Returns
+     * \c false and keeps the current set if \a set is not supported.
+     */
+    bool setKernelSet(KernelSet set);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_CPU_FEATURES_H
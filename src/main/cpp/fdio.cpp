@@ -0,0 +1,86 @@
+#include "fdio.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace TagLibExt {
+
+    bool readFully(int fd, int64_t offset, char *data, size_t length) {
+        while (length > 0) {
+            const ssize_t n = pread64(fd, data, length, offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            offset += n;
+            length -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool writeFully(int fd, const char *data, size_t length) {
+        while (length > 0) {
+            const ssize_t n = write(fd, data, length);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool copyRange(int inFd, int64_t offset, size_t length, int outFd) {
+#ifdef __NR_copy_file_range
+        // Called through syscall() as the libc wrapper is missing from older Android API levels.
+        // Fails with EXDEV, EINVAL or ENOSYS when the kernel cannot copy between the two files.
+        while (length > 0) {
+            auto in = static_cast<loff_t>(offset);
+            const auto n = static_cast<ssize_t>(
+                    syscall(__NR_copy_file_range, inFd, &in, outFd, nullptr, length, 0U));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            offset += n;
+            length -= static_cast<size_t>(n);
+        }
+#endif
+
+        while (length > 0) {
+            auto in = static_cast<off64_t>(offset);
+            const ssize_t n = sendfile64(outFd, inFd, &in, length);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            offset += n;
+            length -= static_cast<size_t>(n);
+        }
+
+        char buffer[64 * 1024];
+        while (length > 0) {
+            const size_t n = std::min(length, sizeof(buffer));
+            if (!readFully(inFd, offset, buffer, n) || !writeFully(outFd, buffer, n)) {
+                return false;
+            }
+            offset += static_cast<int64_t>(n);
+            length -= n;
+        }
+        return true;
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,25 @@
+#ifndef TAGLIB_EXT_FDIO_H
+#define TAGLIB_EXT_FDIO_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace TagLibExt {
+
+    //! Reads exactly \a length bytes at \a offset of \a fd into \a data, retrying short reads.
+    bool readFully(int fd, int64_t offset, char *data, size_t length);
+
+    //! Writes all \a length bytes of \a data at the current offset of \a fd, retrying short writes.
+    bool writeFully(int fd, const char *data, size_t length);
+
+    /*!
+     * Copies \a length bytes at \a offset of \a inFd to the current offset of \a outFd
+     * without the data passing through user space where possible: copy_file_range()
+     * if the kernel supports it for the two files, else sendfile(), else a buffered
+     * read and write loop.
+     */
+    bool copyRange(int inFd, int64_t offset, size_t length, int outFd);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_FDIO_H
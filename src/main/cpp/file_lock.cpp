@@ -0,0 +1,82 @@
+#include "file_lock.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <sys/stat.h>
+
+namespace TagLibExt {
+
+    // A readers-writer lock preferring writers, which std::shared_mutex does not promise
+    struct FileLock::Stripe {
+        std::mutex mutex;
+        std::condition_variable changed;
+        int readers{0};
+        int waitingWriters{0};
+        bool writing{false};
+    };
+
+    namespace {
+
+        constexpr size_t StripeCount = 64;
+
+        size_t stripeIndex(const struct stat &st) {
+            // Mixed like splitmix64, inodes of a directory are often consecutive
+            uint64_t key = static_cast<uint64_t>(st.st_dev) * 0x9E3779B97F4A7C15ULL ^ static_cast<uint64_t>(st.st_ino);
+            key ^= key >> 30;
+            key *= 0xBF58476D1CE4E5B9ULL;
+            key ^= key >> 31;
+            return key % StripeCount;
+        }
+
+    } // namespace
+
+    FileLock::FileLock(int fd, Mode mode) :
+            mode(mode) {
+        struct stat st{};
+        if (fstat(fd, &st) == 0) {
+            lock(&stripes()[stripeIndex(st)]);
+        }
+    }
+
+    FileLock::FileLock(const char *path, Mode mode) :
+            mode(mode) {
+        struct stat st{};
+        if (stat(path, &st) == 0) {
+            lock(&stripes()[stripeIndex(st)]);
+        }
+    }
+
+    FileLock::~FileLock() {
+        if (locked == nullptr) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(locked->mutex);
+        if (mode == Mode::Write) {
+            locked->writing = false;
+            locked->changed.notify_all();
+        } else if (--locked->readers == 0) {
+            locked->changed.notify_all();
+        }
+    }
+
+    FileLock::Stripe *FileLock::stripes() {
+        static Stripe table[StripeCount];
+        return table;
+    }
+
+    void FileLock::lock(Stripe *stripe) {
+        locked = stripe;
+        std::unique_lock<std::mutex> guard(stripe->mutex);
+        if (mode == Mode::Write) {
+            stripe->waitingWriters++;
+            stripe->changed.wait(guard, [stripe] { return !stripe->writing && stripe->readers == 0; });
+            stripe->waitingWriters--;
+            stripe->writing = true;
+        } else {
+            stripe->changed.wait(guard, [stripe] { return !stripe->writing && stripe->waitingWriters == 0; });
+            stripe->readers++;
+        }
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,52 @@
+#ifndef TAGLIB_EXT_FILE_LOCK_H
+#define TAGLIB_EXT_FILE_LOCK_H
+
+namespace TagLibExt {
+
+    /*!
+     * Holds the lock of a file for its scope: reads of a file run concurrently,
+     * a write waits for them and keeps the other reads and writes of the file
+     * waiting until it is done, so that no read sees a tag half rewritten.  A
+     * waiting write goes before the reads that come after it, so that a steady
+     * stream of reads cannot hold it off.
+     *
+     * Files are told apart by device and inode, so the descriptors and paths of
+     * a file share its lock.  The locks are striped over a fixed table, so two
+     * files may share one, which at worst makes a write wait for the reads of
+     * the other file.  Only the callers in this process are serialized.  A
+     * thread must not take a second lock while holding one.
+     */
+
+    class FileLock {
+    public:
+        enum class Mode {
+            Read,
+            Write
+        };
+
+        //! Locks the file open as \a fd; nothing is locked if it cannot be stat'ed.
+        FileLock(int fd, Mode mode);
+
+        //! Locks the file at \a path; nothing is locked if it cannot be stat'ed.
+        FileLock(const char *path, Mode mode);
+
+        ~FileLock();
+
+        FileLock(const FileLock &) = delete;
+
+        FileLock &operator=(const FileLock &) = delete;
+
+    private:
+        struct Stripe;
+
+        static Stripe *stripes();
+
+        void lock(Stripe *stripe);
+
+        Mode mode;
+        Stripe *locked{nullptr};
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_FILE_LOCK_H
@@ -29,35 +29,58 @@
 
 #include "fileref_ext.h"
 
-#include <cstring>
+#include <algorithm>
 #include <utility>
 
 #include "tfilestream.h"
 #include "tpropertymap.h"
 #include "tstringlist.h"
 #include "tvariant.h"
-#include "aifffile.h"
-#include "apefile.h"
-#include "asffile.h"
-#include "flacfile.h"
-#include "mp4file.h"
-#include "mpegfile.h"
-#include "oggflacfile.h"
-#include "opusfile.h"
-#include "vorbisfile.h"
-#include "wavfile.h"
-#include "wavpackfile.h"
-#include "dsffile.h"
-#include "dsdifffile.h"
-#include "matroskafile.h"
+
+#include "format_registry.h"
+#include "stream_properties.h"
 
 using namespace TagLib;
 
 namespace TagLibExt {
+    namespace {
+        // Constructs a File of the format on the stream.  The construction is timed as
+        // parsing if the file turns out valid and as detection otherwise.  Returns
+        // a null pointer if the file is not valid.
+
+        File *create(const Format &format, FileName fileName, IOStream *stream, int fd, bool readAudioProperties,
+                     AudioProperties::ReadStyle audioPropertiesStyle, ParseStats *stats) {
+            PhaseTimer timer(stats, Phase::Detect);
+            if (stats)
+                stats->detectionAttempts++;
+
+            File *file = format.create(fileName, stream, fd, readAudioProperties, audioPropertiesStyle);
+            if (!file->isValid()) {
+                delete file;
+                return nullptr;
+            }
+
+            timer.setPhase(Phase::Parse);
+            if (stats)
+                stats->format = format.name;
+            return file;
+        }
+
+        // Quick check whether the stream is of the format, timed as detection.
+
+        bool isSupported(const Format &format, IOStream *stream, ParseStats *stats) {
+            PhaseTimer timer(stats, Phase::Detect);
+            if (stats)
+                stats->detectionAttempts++;
+
+            return format.isSupported(stream);
+        }
+    }
+
     // Detect the file type based on the file extension.
 
-    File *detectByExtension(FileName *fileName, IOStream *stream, bool readAudioProperties,
-                            AudioProperties::ReadStyle audioPropertiesStyle) {
+    File *detectByExtension(FileName *fileName, IOStream *stream, int fd, bool readAudioProperties,
+                            AudioProperties::ReadStyle audioPropertiesStyle, ParseStats *stats) {
         FileName path = stream->name();
         if (fileName != nullptr) {
             path = *fileName;
@@ -68,104 +91,41 @@ namespace TagLibExt {
         if (const int pos = s.rfind("."); pos != -1)
             ext = s.substr(pos + 1).upper();
 
-        // If this list is updated, the method defaultFileExtensions() should also be
-        // updated.  However at some point that list should be created at the same time
-        // that a default file type resolver is created.
-
         if (ext.isEmpty())
             return nullptr;
 
-        // .oga can be any audio in the Ogg container. So leave it to content-based detection.
-
-        File *file = nullptr;
-
-        if (ext == "MP3" || ext == "MP2" || ext == "AAC")
-            file = new MPEG::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "OGG")
-            file = new Ogg::Vorbis::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "OGA") {
-            /* .oga can be any audio in the Ogg container. First try FLAC, then Vorbis. */
-            file = new Ogg::FLAC::File(stream, readAudioProperties, audioPropertiesStyle);
-            if (!file->isValid()) {
-                delete file;
-                file = new Ogg::Vorbis::File(stream, readAudioProperties, audioPropertiesStyle);
+        // Formats sharing an extension are tried first if it is their first extension,
+        // then if it is a further one, each in detection order, so that .oga is tried
+        // as Ogg FLAC before Ogg Vorbis, as TagLib does.
+
+        const auto order = detectionOrder();
+        for (const bool primary: {true, false}) {
+            for (const Format *format: *order) {
+                const auto &extensions = format->extensions;
+                const auto match = std::find_if(extensions.begin(), extensions.end(), [&](const char *e) {
+                    return ext == e;
+                });
+                if (match == extensions.end() || (match == extensions.begin()) != primary)
+                    continue;
+                if (File *file = create(*format, path, stream, fd, readAudioProperties, audioPropertiesStyle, stats))
+                    return file;
             }
-        } else if (ext == "FLAC")
-            file = new FLAC::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "WV")
-            file = new WavPack::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "OPUS")
-            file = new Ogg::Opus::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "M4A" || ext == "M4R" || ext == "M4B" || ext == "M4P" || ext == "MP4" || ext == "3G2" ||
-                 ext == "M4V")
-            file = new MP4::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "WMA" || ext == "ASF")
-            file = new ASF::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "AIF" || ext == "AIFF" || ext == "AFC" || ext == "AIFC")
-            file = new RIFF::AIFF::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "WAV")
-            file = new RIFF::WAV::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "APE")
-            file = new APE::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "DSF")
-            file = new DSF::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ext == "DFF" || ext == "DSDIFF")
-            file = new DSDIFF::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if(ext == "MKA" || ext == "MKV" || ext == "WEBM")
-            file = new Matroska::File(stream, readAudioProperties, audioPropertiesStyle);
-
-        // if file is not valid, leave it to content-based detection.
-
-        if (file) {
-            if (file->isValid())
-                return file;
-            delete file;
         }
 
+        // if file is not valid, create() has deleted it, leave it to content-based detection.
+
         return nullptr;
     }
 
     // Detect the file type based on the actual content of the stream.
 
-    File *detectByContent(IOStream *stream, bool readAudioProperties,
-                          AudioProperties::ReadStyle audioPropertiesStyle) {
-        File *file = nullptr;
-
-        if (MPEG::File::isSupported(stream))
-            file = new MPEG::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (Ogg::Vorbis::File::isSupported(stream))
-            file = new Ogg::Vorbis::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (Ogg::FLAC::File::isSupported(stream))
-            file = new Ogg::FLAC::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (FLAC::File::isSupported(stream))
-            file = new FLAC::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (WavPack::File::isSupported(stream))
-            file = new WavPack::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (Ogg::Opus::File::isSupported(stream))
-            file = new Ogg::Opus::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (MP4::File::isSupported(stream))
-            file = new MP4::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (ASF::File::isSupported(stream))
-            file = new ASF::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (RIFF::AIFF::File::isSupported(stream))
-            file = new RIFF::AIFF::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (RIFF::WAV::File::isSupported(stream))
-            file = new RIFF::WAV::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (APE::File::isSupported(stream))
-            file = new APE::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (DSF::File::isSupported(stream))
-            file = new DSF::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if (DSDIFF::File::isSupported(stream))
-            file = new DSDIFF::File(stream, readAudioProperties, audioPropertiesStyle);
-        else if(Matroska::File::isSupported(stream))
-            file = new Matroska::File(stream, readAudioProperties, audioPropertiesStyle);
-
-        // isSupported() only does a quick check, so double check the file here.
-
-        if (file) {
-            if (file->isValid())
-                return file;
-            delete file;
+    File *detectByContent(FileName fileName, IOStream *stream, int fd, bool readAudioProperties,
+                          AudioProperties::ReadStyle audioPropertiesStyle, ParseStats *stats) {
+        // isSupported() only does a quick check, so create() double checks the file.
+
+        for (const Format *format: *detectionOrder()) {
+            if (isSupported(*format, stream, stats))
+                return create(*format, fileName, stream, fd, readAudioProperties, audioPropertiesStyle, stats);
         }
 
         return nullptr;
@@ -199,9 +159,9 @@ namespace TagLibExt {
     }
 
     FileRef::FileRef(FileName fileName, IOStream *stream, bool readAudioProperties,
-                     AudioProperties::ReadStyle audioPropertiesStyle) :
+                     AudioProperties::ReadStyle audioPropertiesStyle, ParseStats *stats, int fd) :
             d(std::make_shared<FileRefPrivate>()) {
-        parse(fileName, stream, readAudioProperties, audioPropertiesStyle);
+        parse(fileName, stream, readAudioProperties, audioPropertiesStyle, stats, fd);
     }
 
     FileRef::FileRef(File *file) :
@@ -266,6 +226,11 @@ namespace TagLibExt {
         if (d->isNull()) {
             return nullptr;
         }
+        if (const auto source = dynamic_cast<const StreamPropertiesSource *>(d->file)) {
+            if (AudioProperties *properties = source->streamProperties()) {
+                return properties;
+            }
+        }
         return d->file->audioProperties();
     }
 
@@ -307,16 +272,18 @@ namespace TagLibExt {
     void FileRef::parse(FileName fileName,
                         IOStream *stream,
                         bool readAudioProperties,
-                        AudioProperties::ReadStyle audioPropertiesStyle) {
+                        AudioProperties::ReadStyle audioPropertiesStyle,
+                        ParseStats *stats,
+                        int fd) {
         // Try to resolve file types based on the file extension.
 
-        d->file = detectByExtension(&fileName, stream, readAudioProperties, audioPropertiesStyle);
+        d->file = detectByExtension(&fileName, stream, fd, readAudioProperties, audioPropertiesStyle, stats);
         if (d->file)
             return;
 
         // At last, try to resolve file types based on the actual content.
 
-        d->file = detectByContent(stream, readAudioProperties, audioPropertiesStyle);
+        d->file = detectByContent(fileName, stream, fd, readAudioProperties, audioPropertiesStyle, stats);
     }
 
 }  // namespace
@@ -31,6 +31,7 @@
 
 #include "taglib_export.h"
 #include "audioproperties.h"
+#include "stats.h"
 
 using namespace TagLib;
 
@@ -69,6 +70,13 @@ namespace TagLibExt {
          * \a readAudioProperties is \c false then \a audioPropertiesStyle will be
          * ignored.
          *
+         * If \a stats is not null, the detection attempts, the detected format and
+         * the time spent detecting and parsing are added to it.
+         *
+         * \a fd is the descriptor \a stream reads, if there is one.  Caches keyed by
+         * the file, such as the MP4 atom index, then identify it with fstat(), as
+         * \a fileName may name another file by now.
+         *
          * Also see the note in the class documentation about why you may not want to
          * use this method in your application.
          */
@@ -76,7 +84,9 @@ namespace TagLibExt {
                          IOStream *stream,
                          bool readAudioProperties = true,
                          AudioProperties::ReadStyle
-                         audioPropertiesStyle = AudioProperties::Average);
+                         audioPropertiesStyle = AudioProperties::Average,
+                         ParseStats *stats = nullptr,
+                         int fd = -1);
 
         /*!
          * Construct a FileRef using \a file.  The FileRef now takes ownership of the
@@ -188,6 +198,9 @@ namespace TagLibExt {
         /*!
          * Returns the audio properties for this FileRef.  If no audio properties
          * were read then this will return a null pointer.
+         *
+         * \note These are the StreamProperties of the file if it computes its own,
+         * which file()->audioProperties() does not return.
          */
         AudioProperties *audioProperties() const;
 
@@ -241,7 +254,7 @@ namespace TagLibExt {
 
     private:
         void parse(FileName fileName, IOStream *stream, bool readAudioProperties,
-                   AudioProperties::ReadStyle audioPropertiesStyle);
+                   AudioProperties::ReadStyle audioPropertiesStyle, ParseStats *stats, int fd);
 
         class FileRefPrivate;
 
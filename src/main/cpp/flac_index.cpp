@@ -0,0 +1,201 @@
+#include "flac_index.h"
+
+#include <algorithm>
+
+#include "flacpicture.h"
+#include "picture_locator.h"
+
+namespace TagLibExt {
+    namespace {
+        constexpr size_t windowLength = 4 * 1024;
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// FlacBlockIndex
+////////////////////////////////////////////////////////////////////////////////
+
+    bool FlacBlockIndex::build(IOStream *stream, offset_t flacStart) {
+        blockList.clear();
+        const offset_t fileLength = stream->length();
+
+        stream->seek(flacStart);
+        window = stream->readBlock(windowLength);
+        windowOffset = flacStart;
+        if (!window.startsWith("fLaC")) {
+            return false;
+        }
+
+        offset_t position = flacStart + 4;
+        while (true) {
+            ByteVector header;
+            if (position + 4 <= windowOffset + static_cast<offset_t>(window.size())) {
+                header = window.mid(static_cast<unsigned int>(position - windowOffset), 4);
+            } else {
+                stream->seek(position);
+                header = stream->readBlock(4);
+            }
+            if (header.size() < 4) {
+                return false;
+            }
+
+            const unsigned int type = static_cast<unsigned char>(header[0]) & 0x7f;
+            const bool last = static_cast<unsigned char>(header[0]) & 0x80;
+            const unsigned int length = header.toUInt(1U, 3U);
+
+            // The same checks as FLAC::File
+            if (blockList.empty() && type != StreamInfo) {
+                return false;
+            }
+            if (length == 0 && type != Padding && type != SeekTable) {
+                return false;
+            }
+            if (position + 4 + length > fileLength) {
+                return false;
+            }
+
+            blockList.push_back({type, position + 4, length});
+            position += 4 + length;
+            if (last) {
+                break;
+            }
+        }
+
+        audioStart = position;
+        return true;
+    }
+
+    const std::vector<FlacBlock> &FlacBlockIndex::blocks() const {
+        return blockList;
+    }
+
+    const FlacBlock *FlacBlockIndex::find(unsigned int type) const {
+        const auto block = std::find_if(blockList.begin(), blockList.end(), [&](const FlacBlock &b) {
+            return b.type == type;
+        });
+        return block != blockList.end() ? &*block : nullptr;
+    }
+
+    offset_t FlacBlockIndex::streamStart() const {
+        return audioStart;
+    }
+
+    ByteVector FlacBlockIndex::read(IOStream *stream, const FlacBlock &block) const {
+        if (block.offset >= windowOffset &&
+            block.offset + block.length <= windowOffset + static_cast<offset_t>(window.size())) {
+            return window.mid(static_cast<unsigned int>(block.offset - windowOffset), block.length);
+        }
+        stream->seek(block.offset);
+        return stream->readBlock(block.length);
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// FlacIndexedFile
+////////////////////////////////////////////////////////////////////////////////
+
+    FlacIndexedFile::FlacIndexedFile(IOStream *stream, bool readProperties,
+                                     AudioProperties::ReadStyle propertiesStyle) :
+            File(stream),
+            source(stream) {
+        if (isOpen()) {
+            read(readProperties, propertiesStyle);
+        }
+    }
+
+    FlacIndexedFile::~FlacIndexedFile() = default;
+
+    Tag *FlacIndexedFile::tag() const {
+        return comment.get();
+    }
+
+    PropertyMap FlacIndexedFile::properties() const {
+        return comment ? comment->properties() : PropertyMap();
+    }
+
+    PropertyMap FlacIndexedFile::setProperties(const PropertyMap &properties) {
+        return properties;
+    }
+
+    StringList FlacIndexedFile::complexPropertyKeys() const {
+        StringList keys = comment ? comment->complexPropertyKeys() : StringList();
+        if (index.find(FlacBlockIndex::Picture) && !keys.contains("PICTURE")) {
+            keys.append("PICTURE");
+        }
+        return keys;
+    }
+
+    List<VariantMap> FlacIndexedFile::complexProperties(const String &key) const {
+        if (key.upper() != "PICTURE") {
+            return comment ? comment->complexProperties(key) : List<VariantMap>();
+        }
+
+        if (!pictures) {
+            pictures = std::make_unique<List<VariantMap>>();
+            for (const auto &block: index.blocks()) {
+                if (block.type != FlacBlockIndex::Picture) {
+                    continue;
+                }
+                FLAC::Picture picture;
+                if (!picture.parse(index.read(source, block))) {
+                    continue;
+                }
+                VariantMap property;
+                property.insert("data", picture.data());
+                property.insert("mimeType", picture.mimeType());
+                property.insert("description", picture.description());
+                property.insert("pictureType", pictureTypeName(picture.type()));
+                property.insert("width", picture.width());
+                property.insert("height", picture.height());
+                property.insert("numColors", picture.numColors());
+                property.insert("colorDepth", picture.colorDepth());
+                pictures->append(property);
+            }
+        }
+        return *pictures;
+    }
+
+    bool FlacIndexedFile::setComplexProperties(const String &, const List<VariantMap> &) {
+        return false;
+    }
+
+    AudioProperties *FlacIndexedFile::audioProperties() const {
+        return streamProperties.get();
+    }
+
+    bool FlacIndexedFile::save() {
+        return false;
+    }
+
+    const FlacBlockIndex &FlacIndexedFile::blockIndex() const {
+        return index;
+    }
+
+    void FlacIndexedFile::read(bool readProperties, AudioProperties::ReadStyle propertiesStyle) {
+        const offset_t fileLength = length();
+
+        // An ID3v1 tag is merged into the tag by FLAC::File, so leave such files to it.
+        if (fileLength >= 128) {
+            source->seek(-128, IOStream::End);
+            if (source->readBlock(3) == "TAG") {
+                setValid(false);
+                return;
+            }
+        }
+
+        // So are files with an ID3v2 tag, which would precede the "fLaC" marker.
+        if (!index.build(source, 0)) {
+            setValid(false);
+            return;
+        }
+
+        const FlacBlock *vorbisComment = index.find(FlacBlockIndex::VorbisComment);
+        comment = vorbisComment ? std::make_unique<Ogg::XiphComment>(index.read(source, *vorbisComment))
+                                : std::make_unique<Ogg::XiphComment>();
+
+        if (readProperties) {
+            const FlacBlock &streamInfo = index.blocks().front();
+            streamProperties = std::make_unique<FLAC::Properties>(
+                    index.read(source, streamInfo), fileLength - index.streamStart(), propertiesStyle);
+        }
+    }
+
+} // namespace TagLibExt
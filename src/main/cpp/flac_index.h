@@ -0,0 +1,113 @@
+#ifndef TAGLIB_EXT_FLAC_INDEX_H
+#define TAGLIB_EXT_FLAC_INDEX_H
+
+#include <memory>
+#include <vector>
+
+#include "tfile.h"
+#include "flacproperties.h"
+#include "xiphcomment.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! A metadata block of a FLAC stream.
+
+    struct FlacBlock {
+        unsigned int type;
+        //! Offset of the block data, i.e. past the 4 byte block header
+        offset_t offset;
+        unsigned int length;
+    };
+
+    /*!
+     * The metadata blocks of a FLAC stream, found by reading the block headers
+     * alone.  The first 4 KiB of the stream are read at once, which usually
+     * covers STREAMINFO, SEEKTABLE and often VORBIS_COMMENT; past them only the
+     * 4 byte headers are read, so large PICTURE and PADDING blocks are jumped over.
+     */
+    class FlacBlockIndex {
+    public:
+        enum BlockType {
+            StreamInfo = 0,
+            Padding = 1,
+            SeekTable = 3,
+            VorbisComment = 4,
+            Picture = 6
+        };
+
+        /*!
+         * Reads the block headers following the "fLaC" marker at \a flacStart.
+         * Returns \c false if the stream is not FLAC or its metadata is malformed
+         * the way TagLib's FLAC::File rejects it.
+         */
+        bool build(IOStream *stream, offset_t flacStart);
+
+        [[nodiscard]] const std::vector<FlacBlock> &blocks() const;
+
+        //! Returns the first block of \a type, or a null pointer.
+        [[nodiscard]] const FlacBlock *find(unsigned int type) const;
+
+        //! Offset of the first audio frame.
+        [[nodiscard]] offset_t streamStart() const;
+
+        //! Returns the data of \a block, read from \a stream unless it was read while building the index.
+        ByteVector read(IOStream *stream, const FlacBlock &block) const;
+
+    private:
+        std::vector<FlacBlock> blockList;
+        offset_t audioStart{0};
+        ByteVector window;
+        offset_t windowOffset{0};
+    };
+
+    /*!
+     * A read only FLAC file built on a FlacBlockIndex: only STREAMINFO and
+     * VORBIS_COMMENT are read and decoded when the file is opened, PICTURE blocks
+     * are read on the first request for the PICTURE complex property, and padding
+     * is never read.  Tags and properties are those of FLAC::File.
+     *
+     * Files with an ID3v2 or ID3v1 tag, which FLAC::File merges with the Xiph
+     * comment, are reported as invalid so that the caller falls back to FLAC::File.
+     * save() always fails.
+     */
+    class FlacIndexedFile : public File {
+    public:
+        FlacIndexedFile(IOStream *stream, bool readProperties = true,
+                        AudioProperties::ReadStyle propertiesStyle = AudioProperties::Average);
+
+        ~FlacIndexedFile() override;
+
+        Tag *tag() const override;
+
+        PropertyMap properties() const override;
+
+        //! Nothing can be saved, so all \a properties are returned as unsupported.
+        PropertyMap setProperties(const PropertyMap &properties) override;
+
+        StringList complexPropertyKeys() const override;
+
+        List<VariantMap> complexProperties(const String &key) const override;
+
+        bool setComplexProperties(const String &key, const List<VariantMap> &value) override;
+
+        AudioProperties *audioProperties() const override;
+
+        bool save() override;
+
+        [[nodiscard]] const FlacBlockIndex &blockIndex() const;
+
+    private:
+        void read(bool readProperties, AudioProperties::ReadStyle propertiesStyle);
+
+        IOStream *source;
+        FlacBlockIndex index;
+        std::unique_ptr<Ogg::XiphComment> comment;
+        std::unique_ptr<FLAC::Properties> streamProperties;
+        mutable std::unique_ptr<List<VariantMap>> pictures;
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_FLAC_INDEX_H
@@ -0,0 +1,310 @@
+#include "format_registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include "aifffile.h"
+#include "apefile.h"
+#include "asffile.h"
+#include "flacfile.h"
+#include "mp4file.h"
+#include "mpegfile.h"
+#include "oggflacfile.h"
+#include "opusfile.h"
+#include "vorbisfile.h"
+#include "wavfile.h"
+#include "wavpackfile.h"
+#include "dsffile.h"
+#include "dsdifffile.h"
+#include "matroskafile.h"
+
+#include "flac_index.h"
+#include "id3v2_lazy.h"
+#include "mkv_index.h"
+#include "mp4_index.h"
+#include "mpeg_length.h"
+#include "ogg_length.h"
+#include "stream_properties.h"
+
+namespace TagLibExt {
+    namespace {
+        // Holds the stream an IndexedMP4File reads through.  It is a base class so
+        // that it is constructed before and destroyed after the MP4::File.
+
+        class IndexedStreamHolder {
+        protected:
+            IndexedStreamHolder(FileName fileName, IOStream *stream, int fd) :
+                    indexedStream(fileName, stream, fd, mp4AtomIndex(fileName, stream, fd)) {
+            }
+
+            Mp4IndexedStream indexedStream;
+        };
+
+        // An MP4::File whose atom walk and small atom reads are served by the atom
+        // index of the file, built once per file and shared by later calls.
+
+        class IndexedMP4File : private IndexedStreamHolder, public MP4::File {
+        public:
+            IndexedMP4File(FileName fileName, IOStream *stream, int fd, bool readAudioProperties,
+                           AudioProperties::ReadStyle audioPropertiesStyle) :
+                    IndexedStreamHolder(fileName, stream, fd),
+                    MP4::File(&indexedStream, readAudioProperties, audioPropertiesStyle) {
+            }
+        };
+
+        // Holds the view an IndexedMatroskaFile reads through, constructed before
+        // and destroyed after the Matroska::File like IndexedStreamHolder.
+
+        class MkvStreamHolder {
+        protected:
+            MkvStreamHolder(IOStream *stream, MkvSegmentIndex index) :
+                    indexedStream(stream, std::move(index)) {
+            }
+
+            MkvIndexedStream indexedStream;
+        };
+
+        // A Matroska::File that sees the Clusters and Cues as Void elements, so that
+        // reading it takes a few header reads besides the metadata itself.
+
+        class IndexedMatroskaFile : private MkvStreamHolder, public Matroska::File {
+        public:
+            IndexedMatroskaFile(IOStream *stream, MkvSegmentIndex index, bool readAudioProperties,
+                                AudioProperties::ReadStyle audioPropertiesStyle) :
+                    MkvStreamHolder(stream, std::move(index)),
+                    Matroska::File(&indexedStream, readAudioProperties, audioPropertiesStyle) {
+            }
+        };
+
+        // A Vorbis or Opus file whose length is found by a bounded backward search
+        // for the last page instead of TagLib's search through the whole file.
+
+        template<class T>
+        class BoundedOggFile : public T, public StreamPropertiesSource {
+        public:
+            BoundedOggFile(IOStream *stream, bool readAudioProperties,
+                           AudioProperties::ReadStyle audioPropertiesStyle) :
+                    T(stream, false, audioPropertiesStyle) {
+                if (readAudioProperties && this->isValid())
+                    properties = oggStreamProperties(this, audioPropertiesStyle);
+            }
+
+            StreamProperties *streamProperties() const override {
+                return properties.get();
+            }
+
+        private:
+            std::unique_ptr<StreamProperties> properties;
+        };
+
+        // An MPEG::File whose large ID3v2 frames are decoded when they are first
+        // needed, so that reading the text properties leaves pictures and other
+        // binary frames undecoded.  The length of streams without a Xing or VBRI
+        // header is found from their frames.
+
+        class LazyMPEGFile : public MPEG::File, public StreamPropertiesSource {
+        public:
+            LazyMPEGFile(IOStream *stream, bool readAudioProperties, AudioProperties::ReadStyle audioPropertiesStyle) :
+                    MPEG::File(stream, readAudioProperties, audioPropertiesStyle, LazyFrameFactory::instance()) {
+                if (readAudioProperties && isValid())
+                    properties = mpegStreamProperties(this, audioPropertiesStyle);
+            }
+
+            StreamProperties *streamProperties() const override {
+                return properties.get();
+            }
+
+            // ID3v2::Tag reads the complex properties from the TagLib frame classes.
+
+            List<VariantMap> complexProperties(const String &key) const override {
+                if (const auto self = const_cast<LazyMPEGFile *>(this); self->hasID3v2Tag())
+                    decodeDeferredFrames(self->ID3v2Tag());
+                return MPEG::File::complexProperties(key);
+            }
+
+        private:
+            std::unique_ptr<StreamProperties> properties;
+        };
+
+        template<class T>
+        File *newFile(FileName, IOStream *stream, int, bool readAudioProperties,
+                      AudioProperties::ReadStyle audioPropertiesStyle) {
+            return new T(stream, readAudioProperties, audioPropertiesStyle);
+        }
+
+        template<>
+        File *newFile<MP4::File>(FileName fileName, IOStream *stream, int fd, bool readAudioProperties,
+                                 AudioProperties::ReadStyle audioPropertiesStyle) {
+            return new IndexedMP4File(fileName, stream, fd, readAudioProperties, audioPropertiesStyle);
+        }
+
+        // Deferred frames cannot be rendered into a tag of another ID3v2 version, as
+        // saving may do, so the lazy frame factory is used for read only files alone.
+
+        template<>
+        File *newFile<MPEG::File>(FileName, IOStream *stream, int, bool readAudioProperties,
+                                  AudioProperties::ReadStyle audioPropertiesStyle) {
+            if (stream->readOnly())
+                return new LazyMPEGFile(stream, readAudioProperties, audioPropertiesStyle);
+            return new MPEG::File(stream, readAudioProperties, audioPropertiesStyle);
+        }
+
+        // Read only FLAC files are opened on their block index, which leaves the
+        // pictures unread until they are asked for.  Files the index reader does not
+        // handle, e.g. ones with ID3 tags, are parsed by FLAC::File as before.
+
+        template<>
+        File *newFile<FLAC::File>(FileName, IOStream *stream, int, bool readAudioProperties,
+                                  AudioProperties::ReadStyle audioPropertiesStyle) {
+            if (stream->readOnly()) {
+                File *file = new FlacIndexedFile(stream, readAudioProperties, audioPropertiesStyle);
+                if (file->isValid())
+                    return file;
+                delete file;
+            }
+            return new FLAC::File(stream, readAudioProperties, audioPropertiesStyle);
+        }
+
+        template<>
+        File *newFile<Ogg::Vorbis::File>(FileName, IOStream *stream, int, bool readAudioProperties,
+                                         AudioProperties::ReadStyle audioPropertiesStyle) {
+            return new BoundedOggFile<Ogg::Vorbis::File>(stream, readAudioProperties, audioPropertiesStyle);
+        }
+
+        template<>
+        File *newFile<Ogg::Opus::File>(FileName, IOStream *stream, int, bool readAudioProperties,
+                                       AudioProperties::ReadStyle audioPropertiesStyle) {
+            return new BoundedOggFile<Ogg::Opus::File>(stream, readAudioProperties, audioPropertiesStyle);
+        }
+
+        // Likewise read only Matroska files are opened on their segment index, which
+        // follows the SeekHead past the media data.
+
+        template<>
+        File *newFile<Matroska::File>(FileName, IOStream *stream, int, bool readAudioProperties,
+                                      AudioProperties::ReadStyle audioPropertiesStyle) {
+            if (stream->readOnly()) {
+                MkvSegmentIndex index;
+                if (index.build(stream)) {
+                    File *file = new IndexedMatroskaFile(stream, std::move(index), readAudioProperties,
+                                                         audioPropertiesStyle);
+                    if (file->isValid())
+                        return file;
+                    delete file;
+                }
+            }
+            return new Matroska::File(stream, readAudioProperties, audioPropertiesStyle);
+        }
+
+
+        template<class T>
+        bool isSupported(IOStream *stream) {
+            return T::isSupported(stream);
+        }
+
+        // The default order is the one of TagLib's FileRef.  If this list is updated, the
+        // list of all formats in CMakeLists.txt should also be updated.
+
+        const std::vector<Format> formats = {
+#ifndef TAGLIB_EXT_WITHOUT_MPEG
+                {"MPEG",       {"MP3", "MP2", "AAC"},
+                        isSupported<MPEG::File>,        newFile<MPEG::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_OGG_VORBIS
+                // .oga can be any audio in the Ogg container, it is tried as Ogg FLAC first.
+                {"Ogg Vorbis", {"OGG", "OGA"},
+                        isSupported<Ogg::Vorbis::File>, newFile<Ogg::Vorbis::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_OGG_FLAC
+                {"Ogg FLAC",   {"OGA"},
+                        isSupported<Ogg::FLAC::File>,   newFile<Ogg::FLAC::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_FLAC
+                {"FLAC",       {"FLAC"},
+                        isSupported<FLAC::File>,        newFile<FLAC::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_WAVPACK
+                {"WavPack",    {"WV"},
+                        isSupported<WavPack::File>,     newFile<WavPack::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_OGG_OPUS
+                {"Ogg Opus",   {"OPUS"},
+                        isSupported<Ogg::Opus::File>,   newFile<Ogg::Opus::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_MP4
+                {"MP4",        {"M4A", "M4R", "M4B", "M4P", "MP4", "3G2", "M4V"},
+                        isSupported<MP4::File>,         newFile<MP4::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_ASF
+                {"ASF",        {"WMA", "ASF"},
+                        isSupported<ASF::File>,         newFile<ASF::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_AIFF
+                {"AIFF",       {"AIF", "AIFF", "AFC", "AIFC"},
+                        isSupported<RIFF::AIFF::File>,  newFile<RIFF::AIFF::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_WAV
+                {"WAV",        {"WAV"},
+                        isSupported<RIFF::WAV::File>,   newFile<RIFF::WAV::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_APE
+                {"APE",        {"APE"},
+                        isSupported<APE::File>,         newFile<APE::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_DSF
+                {"DSF",        {"DSF"},
+                        isSupported<DSF::File>,         newFile<DSF::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_DSDIFF
+                {"DSDIFF",     {"DFF", "DSDIFF"},
+                        isSupported<DSDIFF::File>,      newFile<DSDIFF::File>},
+#endif
+#ifndef TAGLIB_EXT_WITHOUT_MATROSKA
+                {"Matroska",   {"MKA", "MKV", "WEBM"},
+                        isSupported<Matroska::File>,    newFile<Matroska::File>},
+#endif
+        };
+
+        std::vector<const Format *> defaultOrder() {
+            std::vector<const Format *> order;
+            for (const Format &format: formats) {
+                order.push_back(&format);
+            }
+            return order;
+        }
+
+        // Replaced as a whole by setDetectionOrder(), read with std::atomic_load().
+        std::shared_ptr<const std::vector<const Format *>> order =
+                std::make_shared<const std::vector<const Format *>>(defaultOrder());
+    }
+
+    const std::vector<Format> &builtInFormats() {
+        return formats;
+    }
+
+    std::shared_ptr<const std::vector<const Format *>> detectionOrder() {
+        return std::atomic_load(&order);
+    }
+
+    void setDetectionOrder(const StringList &names) {
+        std::vector<const Format *> newOrder;
+        for (const String &name: names) {
+            const auto format = std::find_if(formats.begin(), formats.end(), [&](const Format &f) {
+                return name == f.name;
+            });
+            if (format != formats.end() &&
+                std::find(newOrder.begin(), newOrder.end(), &*format) == newOrder.end()) {
+                newOrder.push_back(&*format);
+            }
+        }
+        for (const Format &format: formats) {
+            if (std::find(newOrder.begin(), newOrder.end(), &format) == newOrder.end()) {
+                newOrder.push_back(&format);
+            }
+        }
+        std::atomic_store(&order, std::shared_ptr<const std::vector<const Format *>>(
+                std::make_shared<const std::vector<const Format *>>(std::move(newOrder))));
+    }
+
+} // namespace TagLibExt
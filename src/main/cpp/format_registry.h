@@ -0,0 +1,54 @@
+#ifndef TAGLIB_EXT_FORMAT_REGISTRY_H
+#define TAGLIB_EXT_FORMAT_REGISTRY_H
+
+#include <memory>
+#include <vector>
+
+#include "audioproperties.h"
+#include "tfile.h"
+#include "tstringlist.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! A file format FileRef can detect and open.
+
+    struct Format {
+        //! Name of the format, as reported in ParseStats::format, e.g. "Ogg Vorbis"
+        const char *name;
+        //! Upper case file extensions of the format; a file is tried first as the formats whose first one it has
+        std::vector<const char *> extensions;
+        //! Quick check whether a stream is of this format, see e.g. MPEG::File::isSupported()
+        bool (*isSupported)(IOStream *stream);
+        /*!
+         * Opens a stream as a File of this format, which is not valid if the stream
+         * is not of this format.  \a fd is the descriptor the stream reads, -1 if
+         * unknown, see FileRef.
+         */
+        File *(*create)(FileName fileName, IOStream *stream, int fd, bool readAudioProperties,
+                        AudioProperties::ReadStyle audioPropertiesStyle);
+    };
+
+    /*!
+     * Returns the formats compiled in, in the default detection order.  Formats
+     * are compiled out with the CMake option TAGLIB_EXT_FORMATS, which defines
+     * TAGLIB_EXT_WITHOUT_<FORMAT> for the formats left out, so that their TagLib
+     * code is dropped by the linker.
+     */
+    const std::vector<Format> &builtInFormats();
+
+    //! Returns the formats in the order detection tries them.
+    std::shared_ptr<const std::vector<const Format *>> detectionOrder();
+
+    /*!
+     * Makes detection try the formats named in \a names first, in that order,
+     * then the other formats in their default order, e.g. to try the most common
+     * formats of a library first.  Names of formats that are not compiled in are
+     * ignored.  Calls may run concurrently with detection.
+     */
+    void setDetectionOrder(const StringList &names);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_FORMAT_REGISTRY_H
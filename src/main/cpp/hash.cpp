@@ -0,0 +1,316 @@
+#include "hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cpu_features.h"
+
+#if defined(TAGLIB_EXT_AVX2)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace TagLibExt {
+    namespace {
+        constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+        constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+        constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+        constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+        constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+        constexpr uint32_t scramblePrime = 0x9E3779B1U;
+        constexpr size_t StripeSize = 64;
+        constexpr size_t StripesPerBlock = 16;
+
+        // Mixed into the stripes and the accumulators when scrambling them, from splitmix64.
+        alignas(32) constexpr uint64_t stripeSecret[8] = {
+                0xE220A8397B1DCDAFULL, 0x6E789E6AA1B965F4ULL, 0x06C45D188009454FULL, 0xF88BB8A8724C81ECULL,
+                0x1B39896A51A8749BULL, 0x53CB9F0C747EA2EAULL, 0x2C829ABE1F4532E1ULL, 0xC584133AC916AB3CULL
+        };
+        alignas(32) constexpr uint64_t scrambleSecret[8] = {
+                0x3EE5789041C98AC3ULL, 0xF3B8488C368CB0A6ULL, 0x657EECDD3CB13D09ULL, 0xC2D326E0055BDEF6ULL,
+                0x8621A03FE0BBDB7BULL, 0x8E1F7555983AA92FULL, 0xB54E0F1600CC4D19ULL, 0x84BB3F97971D80ABULL
+        };
+
+        uint64_t load64(const char *p) {
+            uint64_t value;
+            std::memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            value = __builtin_bswap64(value);
+#endif
+            return value;
+        }
+
+        uint32_t load32(const char *p) {
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            value = __builtin_bswap32(value);
+#endif
+            return value;
+        }
+
+        uint64_t rotl(uint64_t value, int bits) {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        uint64_t round(uint64_t value) {
+            return rotl(value * prime2, 31) * prime1;
+        }
+
+        // Lane i takes the product of the halves of stripe lane i keyed with the
+        // secret, and lane i ^ 1 the stripe lane itself.
+        void accumulateScalar(uint64_t *accumulators, const char *stripe) {
+            for (int i = 0; i < 8; i++) {
+                const uint64_t data = load64(stripe + 8 * i);
+                const uint64_t key = data ^ stripeSecret[i];
+                accumulators[i ^ 1] += data;
+                accumulators[i] += (key & 0xFFFFFFFFULL) * (key >> 32);
+            }
+        }
+
+        void scrambleScalar(uint64_t *accumulators) {
+            for (int i = 0; i < 8; i++) {
+                uint64_t value = accumulators[i];
+                value ^= value >> 47;
+                value ^= scrambleSecret[i];
+                accumulators[i] = value * scramblePrime;
+            }
+        }
+
+#if defined(TAGLIB_EXT_VECTOR128)
+        void accumulate128(uint64_t *accumulators, const char *stripe) {
+#if defined(__SSE2__)
+            auto *acc = reinterpret_cast<__m128i *>(accumulators);
+            for (int i = 0; i < 4; i++) {
+                const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(stripe) + i);
+                const __m128i key = _mm_xor_si128(data, _mm_load_si128(reinterpret_cast<const __m128i *>(stripeSecret) + i));
+                const __m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+                const __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+            }
+#else
+            for (int i = 0; i < 4; i++) {
+                const uint64x2_t data = vreinterpretq_u64_u8(vld1q_u8(reinterpret_cast<const uint8_t *>(stripe) + 16 * i));
+                const uint64x2_t key = veorq_u64(data, vld1q_u64(stripeSecret + 2 * i));
+                const uint64x2_t product = vmull_u32(vmovn_u64(key), vshrn_n_u64(key, 32));
+                const uint64x2_t swapped = vextq_u64(data, data, 1);
+                vst1q_u64(accumulators + 2 * i,
+                          vaddq_u64(vld1q_u64(accumulators + 2 * i), vaddq_u64(product, swapped)));
+            }
+#endif
+        }
+
+        void scramble128(uint64_t *accumulators) {
+#if defined(__SSE2__)
+            auto *acc = reinterpret_cast<__m128i *>(accumulators);
+            const __m128i prime = _mm_set1_epi32(static_cast<int>(scramblePrime));
+            for (int i = 0; i < 4; i++) {
+                __m128i value = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+                value = _mm_xor_si128(value, _mm_load_si128(reinterpret_cast<const __m128i *>(scrambleSecret) + i));
+                const __m128i low = _mm_mul_epu32(value, prime);
+                const __m128i high = _mm_mul_epu32(_mm_srli_epi64(value, 32), prime);
+                acc[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+            }
+#else
+            const uint32x2_t prime = vdup_n_u32(scramblePrime);
+            for (int i = 0; i < 4; i++) {
+                uint64x2_t value = vld1q_u64(accumulators + 2 * i);
+                value = veorq_u64(value, vshrq_n_u64(value, 47));
+                value = veorq_u64(value, vld1q_u64(scrambleSecret + 2 * i));
+                const uint64x2_t low = vmull_u32(vmovn_u64(value), prime);
+                const uint64x2_t high = vmull_u32(vshrn_n_u64(value, 32), prime);
+                vst1q_u64(accumulators + 2 * i, vaddq_u64(low, vshlq_n_u64(high, 32)));
+            }
+#endif
+        }
+#endif
+
+#if defined(TAGLIB_EXT_AVX2)
+        // The 128 bit lanes of AVX2 shuffle and multiply like the SSE2 registers.
+        TAGLIB_EXT_TARGET_AVX2 void accumulateAvx2(uint64_t *accumulators, const char *stripe) {
+            auto *acc = reinterpret_cast<__m256i *>(accumulators);
+            for (int i = 0; i < 2; i++) {
+                const __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(stripe) + i);
+                const __m256i key = _mm256_xor_si256(
+                        data, _mm256_load_si256(reinterpret_cast<const __m256i *>(stripeSecret) + i));
+                const __m256i product = _mm256_mul_epu32(key, _mm256_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+                const __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                acc[i] = _mm256_add_epi64(acc[i], _mm256_add_epi64(product, swapped));
+            }
+        }
+
+        TAGLIB_EXT_TARGET_AVX2 void scrambleAvx2(uint64_t *accumulators) {
+            auto *acc = reinterpret_cast<__m256i *>(accumulators);
+            const __m256i prime = _mm256_set1_epi32(static_cast<int>(scramblePrime));
+            for (int i = 0; i < 2; i++) {
+                __m256i value = _mm256_xor_si256(acc[i], _mm256_srli_epi64(acc[i], 47));
+                value = _mm256_xor_si256(
+                        value, _mm256_load_si256(reinterpret_cast<const __m256i *>(scrambleSecret) + i));
+                const __m256i low = _mm256_mul_epu32(value, prime);
+                const __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(value, 32), prime);
+                acc[i] = _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+            }
+        }
+#endif
+
+        // Accumulates the stripes and scrambles after each block of them.  Inlined
+        // into one function per kernel set, so that the AVX2 set is compiled for AVX2.
+        template<void (*accumulate)(uint64_t *, const char *), void (*scramble)(uint64_t *)>
+        [[gnu::always_inline]] inline void hashStripesWith(uint64_t *accumulators, const char *data, size_t stripes) {
+            for (size_t i = 1; i <= stripes; i++, data += StripeSize) {
+                accumulate(accumulators, data);
+                if (i % StripesPerBlock == 0) {
+                    scramble(accumulators);
+                }
+            }
+        }
+
+        void hashStripesScalar(uint64_t *accumulators, const char *data, size_t stripes) {
+            hashStripesWith<accumulateScalar, scrambleScalar>(accumulators, data, stripes);
+        }
+
+#if defined(TAGLIB_EXT_VECTOR128)
+        void hashStripes128(uint64_t *accumulators, const char *data, size_t stripes) {
+            hashStripesWith<accumulate128, scramble128>(accumulators, data, stripes);
+        }
+#endif
+
+#if defined(TAGLIB_EXT_AVX2)
+        TAGLIB_EXT_TARGET_AVX2 void hashStripesAvx2(uint64_t *accumulators, const char *data, size_t stripes) {
+            hashStripesWith<accumulateAvx2, scrambleAvx2>(accumulators, data, stripes);
+        }
+#endif
+
+        // The accumulators must be aligned to 32 bytes.
+        void hashStripes(uint64_t *accumulators, const char *data, size_t stripes) {
+            switch (kernelSet()) {
+#if defined(TAGLIB_EXT_AVX2)
+                case KernelSet::Avx2:
+                    hashStripesAvx2(accumulators, data, stripes);
+                    break;
+#endif
+#if defined(TAGLIB_EXT_VECTOR128)
+                case KernelSet::Vector128:
+                    hashStripes128(accumulators, data, stripes);
+                    break;
+#endif
+                default:
+                    hashStripesScalar(accumulators, data, stripes);
+                    break;
+            }
+        }
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// StripeHash
+////////////////////////////////////////////////////////////////////////////////
+
+    StripeHash::StripeHash() :
+            accumulators{prime3, prime1, prime2, prime4, prime5, prime3 ^ prime1, prime2 ^ prime4, prime5 ^ prime1} {
+    }
+
+    void StripeHash::update(const char *data, size_t length) {
+        totalLength += length;
+        if (buffered > 0) {
+            const size_t n = std::min(length, BlockSize - buffered);
+            std::memcpy(buffer + buffered, data, n);
+            buffered += n;
+            data += n;
+            length -= n;
+            if (buffered < BlockSize) {
+                return;
+            }
+            hashStripes(accumulators, buffer, StripesPerBlock);
+            buffered = 0;
+        }
+        const size_t blocks = length / BlockSize;
+        hashStripes(accumulators, data, blocks * StripesPerBlock);
+        data += blocks * BlockSize;
+        length -= blocks * BlockSize;
+        std::memcpy(buffer, data, length);
+        buffered = length;
+    }
+
+    uint64_t StripeHash::digest() const {
+        alignas(32) uint64_t acc[8];
+        std::memcpy(acc, accumulators, sizeof(acc));
+        size_t offset = buffered / StripeSize * StripeSize;
+        hashStripes(acc, buffer, buffered / StripeSize);
+
+        // Finished like XXH64: the accumulators, then the remaining bytes, then an avalanche.
+
+        uint64_t hash = totalLength * prime5;
+        for (const uint64_t value: acc) {
+            hash ^= round(value);
+            hash = hash * prime1 + prime4;
+        }
+        for (; offset + 8 <= buffered; offset += 8) {
+            hash ^= round(load64(buffer + offset));
+            hash = rotl(hash, 27) * prime1 + prime4;
+        }
+        if (offset + 4 <= buffered) {
+            hash ^= load32(buffer + offset) * prime1;
+            hash = rotl(hash, 23) * prime2 + prime3;
+            offset += 4;
+        }
+        for (; offset < buffered; offset++) {
+            hash ^= static_cast<unsigned char>(buffer[offset]) * prime5;
+            hash = rotl(hash, 11) * prime1;
+        }
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        hash *= prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// ChunkedHash
+////////////////////////////////////////////////////////////////////////////////
+
+    void ChunkedHash::update(const char *data, size_t length) {
+        totalLength += length;
+        while (length > 0) {
+            const size_t n = std::min(length, ChunkSize - chunkLength);
+            chunk.update(data, n);
+            chunkLength += n;
+            data += n;
+            length -= n;
+            if (chunkLength == ChunkSize) {
+                chunkHashes.push_back(chunk.digest());
+                chunk = StripeHash();
+                chunkLength = 0;
+            }
+        }
+    }
+
+    uint64_t ChunkedHash::digest() const {
+        if (chunkLength == 0) {
+            return combine(chunkHashes, totalLength);
+        }
+        std::vector<uint64_t> hashes = chunkHashes;
+        hashes.push_back(chunk.digest());
+        return combine(hashes, totalLength);
+    }
+
+    uint64_t ChunkedHash::combine(const std::vector<uint64_t> &chunkHashes, uint64_t length) {
+        StripeHash hash;
+        char bytes[8];
+        for (int i = 0; i < 8; i++) {
+            bytes[i] = static_cast<char>(length >> (8 * i));
+        }
+        hash.update(bytes, sizeof(bytes));
+        for (const uint64_t chunkHash: chunkHashes) {
+            for (int i = 0; i < 8; i++) {
+                bytes[i] = static_cast<char>(chunkHash >> (8 * i));
+            }
+            hash.update(bytes, sizeof(bytes));
+        }
+        return hash.digest();
+    }
+
+} // namespace TagLibExt
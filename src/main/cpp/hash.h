@@ -0,0 +1,61 @@
+#ifndef TAGLIB_EXT_HASH_H
+#define TAGLIB_EXT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace TagLibExt {
+
+    /*!
+     * A fast 64 bit non-cryptographic hash for large inputs.  The input is read
+     * in stripes of 64 bytes, each multiplied into 8 accumulators, which are
+     * scrambled after every 1 KiB; the stripes are processed with SSE2, AArch64
+     * NEON or AVX2, depending on kernelSet().  The result depends on the input
+     * alone, not on the instruction set nor on how the input is split between
+     * calls to update().
+     */
+    class StripeHash {
+    public:
+        StripeHash();
+
+        void update(const char *data, size_t length);
+
+        //! The hash of the input so far.
+        [[nodiscard]] uint64_t digest() const;
+
+    private:
+        static constexpr size_t BlockSize = 1024;
+
+        alignas(32) uint64_t accumulators[8];
+        char buffer[BlockSize];
+        size_t buffered{0};
+        uint64_t totalLength{0};
+    };
+
+    /*!
+     * A hash of inputs of any size that can be computed in parallel: the input is
+     * split into chunks of ChunkSize bytes, each hashed with StripeHash, and the
+     * chunk hashes are hashed together with the input length by combine().
+     */
+    class ChunkedHash {
+    public:
+        static constexpr size_t ChunkSize = 1024 * 1024;
+
+        void update(const char *data, size_t length);
+
+        [[nodiscard]] uint64_t digest() const;
+
+        //! The hash of an input of \a length bytes whose chunks hash to \a chunkHashes.
+        static uint64_t combine(const std::vector<uint64_t> &chunkHashes, uint64_t length);
+
+    private:
+        StripeHash chunk;
+        size_t chunkLength{0};
+        std::vector<uint64_t> chunkHashes;
+        uint64_t totalLength{0};
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_HASH_H
@@ -0,0 +1,152 @@
+#include "id3v2_lazy.h"
+
+#include "id3v2header.h"
+#include "id3v2synchdata.h"
+
+namespace TagLibExt {
+    namespace {
+        thread_local const PropertyKeyScope *currentScope = nullptr;
+
+        // A tag header carrying what the frame factory looks at besides the frame
+        // itself: the version, and for ID3v2.4 the unsynchronisation flag, which
+        // tells it that the frame data is unsynchronised.
+
+        ByteVector tagHeaderFields(const ID3v2::Header *tagHeader) {
+            ByteVector data("ID3");
+            data.append(static_cast<char>(tagHeader->majorVersion()));
+            data.append('\0');
+            data.append(static_cast<char>(tagHeader->unsynchronisation() ? 0x80 : 0));
+            data.append(ByteVector(4U, '\0'));
+            return data;
+        }
+
+        bool isDeferredFrameID(const ByteVector &id) {
+            return id == "APIC" || id == "GEOB" || id == "PRIV" || id == "USLT";
+        }
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// DeferredFrame
+////////////////////////////////////////////////////////////////////////////////
+
+    DeferredFrame::DeferredFrame(const ByteVector &data, const ID3v2::Header *tagHeader) :
+            Frame(new Header(data, tagHeader->majorVersion())),
+            tagHeaderData(tagHeaderFields(tagHeader)) {
+        frameData = data.mid(0, header()->size() + header()->frameSize());
+    }
+
+    DeferredFrame::~DeferredFrame() = default;
+
+    String DeferredFrame::toString() const {
+        const Frame *frame = decoded();
+        return frame ? frame->toString() : String();
+    }
+
+    PropertyMap DeferredFrame::asProperties() const {
+        // Lyrics are the only deferred frames with a property, pictures and
+        // objects are complex properties and private frames have none.
+
+        if (frameID() == "USLT") {
+            if (!PropertyKeyScope::wants("LYRICS"))
+                return {};
+            const Frame *frame = decoded();
+            return frame ? frame->asProperties() : PropertyMap();
+        }
+        return Frame::asProperties();
+    }
+
+    ID3v2::Frame *DeferredFrame::releaseDecoded() {
+        decoded();
+        return decodedFrame.release();
+    }
+
+    void DeferredFrame::parseFields(const ByteVector &) {
+    }
+
+    ByteVector DeferredFrame::renderFields() const {
+        // Deferred frames are only created for reading, but the frame data is
+        // rendered as read should the tag be saved anyway.
+
+        return frameData.mid(header()->size(), header()->frameSize());
+    }
+
+    const ID3v2::Frame *DeferredFrame::decoded() const {
+        if (!decodeTried) {
+            decodeTried = true;
+            const ID3v2::Header tagHeader(tagHeaderData);
+            decodedFrame.reset(ID3v2::FrameFactory::instance()->createFrame(frameData, &tagHeader));
+        }
+        return decodedFrame.get();
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// LazyFrameFactory
+////////////////////////////////////////////////////////////////////////////////
+
+    LazyFrameFactory *LazyFrameFactory::instance() {
+        static LazyFrameFactory factory;
+        return &factory;
+    }
+
+    ID3v2::Frame *LazyFrameFactory::createFrame(const ByteVector &data, const ID3v2::Header *tagHeader) const {
+        // ID3v2.2 frames are converted to ID3v2.3 frames while being created, leave
+        // them and encrypted frames, which are not decoded anyway, to TagLib.
+
+        const unsigned int version = tagHeader->majorVersion();
+        if (version >= 3 && data.size() >= 10 && isDeferredFrameID(data.mid(0, 4))) {
+            const ID3v2::Frame::Header header(data, version);
+
+            // The header of an ID3v2.4 frame whose size is not a synchsafe integer,
+            // as written by some encoders, is only recognized with the next frame.
+
+            const bool synchsafeSize = version < 4 || header.frameSize() == ID3v2::SynchData::toUInt(data.mid(4, 4));
+            if (header.frameSize() >= MinDeferredSize && !header.encryption() && synchsafeSize &&
+                header.size() + header.frameSize() <= data.size())
+                return new DeferredFrame(data, tagHeader);
+        }
+        return FrameFactory::createFrame(data, tagHeader);
+    }
+
+    void decodeDeferredFrames(ID3v2::Tag *tag) {
+        // Frames are appended when added, so the frames from the first deferred
+        // one on are all taken out and added back in their order, the deferred
+        // ones replaced by their decoded frames, which keeps the order of the
+        // frames in the tag and among those with the same ID.
+
+        const ID3v2::FrameList frames = tag->frameList();
+        auto it = frames.begin();
+        while (it != frames.end() && !dynamic_cast<DeferredFrame *>(*it)) {
+            ++it;
+        }
+        for (; it != frames.end(); ++it) {
+            if (auto deferred = dynamic_cast<DeferredFrame *>(*it)) {
+                ID3v2::Frame *decoded = deferred->releaseDecoded();
+                tag->removeFrame(deferred);
+                if (decoded)
+                    tag->addFrame(decoded);
+            } else {
+                tag->removeFrame(*it, false);
+                tag->addFrame(*it);
+            }
+        }
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// PropertyKeyScope
+////////////////////////////////////////////////////////////////////////////////
+
+    PropertyKeyScope::PropertyKeyScope(const String &key) :
+            key(key.upper()),
+            previous(currentScope) {
+        currentScope = this;
+    }
+
+    PropertyKeyScope::~PropertyKeyScope() {
+        currentScope = previous;
+    }
+
+    bool PropertyKeyScope::wants(const String &key) {
+        return !currentScope || currentScope->key == key || currentScope->key.startsWith(key + ":");
+    }
+
+} // namespace TagLibExt
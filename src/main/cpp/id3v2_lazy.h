@@ -0,0 +1,107 @@
+#ifndef TAGLIB_EXT_ID3V2_LAZY_H
+#define TAGLIB_EXT_ID3V2_LAZY_H
+
+#include <memory>
+
+#include "id3v2frame.h"
+#include "id3v2framefactory.h"
+#include "id3v2tag.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    /*!
+     * An ID3v2 frame of which only the header has been parsed.  The frame data is
+     * kept as read from the tag and decoded by the TagLib frame factory the first
+     * time it is needed, with the frame level unsynchronisation, compression and
+     * data length indicator handled as usual.
+     *
+     * Picture, object and private frames report their ID as unsupported data in
+     * asProperties() without being decoded; lyrics frames are decoded unless the
+     * current PropertyKeyScope asks for another key.  Deferred frames are meant
+     * for reading: decodeDeferredFrames() replaces them by the decoded frames
+     * before the tag is used through APIs that expect the TagLib frame classes.
+     */
+    class DeferredFrame : public ID3v2::Frame {
+    public:
+        DeferredFrame(const ByteVector &data, const ID3v2::Header *tagHeader);
+
+        ~DeferredFrame() override;
+
+        String toString() const override;
+
+        PropertyMap asProperties() const override;
+
+        //! Returns the decoded frame, owned by the caller, or a null pointer if the frame data is invalid.
+        [[nodiscard]] ID3v2::Frame *releaseDecoded();
+
+    protected:
+        void parseFields(const ByteVector &data) override;
+
+        ByteVector renderFields() const override;
+
+    private:
+        const ID3v2::Frame *decoded() const;
+
+        //! The frame, header included, as stored in the tag
+        ByteVector frameData;
+        //! A tag header with the version and unsynchronisation flag of the tag
+        ByteVector tagHeaderData;
+        mutable std::unique_ptr<ID3v2::Frame> decodedFrame;
+        mutable bool decodeTried{false};
+    };
+
+    /*!
+     * A frame factory that leaves large APIC, GEOB, PRIV and USLT frames of
+     * ID3v2.3 and ID3v2.4 tags as DeferredFrame, and creates all other frames
+     * like the TagLib factory.
+     */
+    class LazyFrameFactory : public ID3v2::FrameFactory {
+    public:
+        //! Frames with less data than this are decoded at once.
+        static constexpr unsigned int MinDeferredSize = 1024;
+
+        static LazyFrameFactory *instance();
+
+        ID3v2::Frame *createFrame(const ByteVector &data, const ID3v2::Header *tagHeader) const override;
+
+    protected:
+        LazyFrameFactory() = default;
+
+        ~LazyFrameFactory() override = default;
+    };
+
+    //! Replaces the deferred frames of \a tag by their decoded frames, keeping their order.
+    void decodeDeferredFrames(ID3v2::Tag *tag);
+
+    /*!
+     * Marks a read of the values of a single property on the calling thread, so
+     * that deferred frames which cannot hold it are left undecoded by
+     * asProperties().  The property map then lacks their keys.
+     */
+    class PropertyKeyScope {
+    public:
+        explicit PropertyKeyScope(const String &key);
+
+        ~PropertyKeyScope();
+
+        PropertyKeyScope(const PropertyKeyScope &) = delete;
+
+        PropertyKeyScope &operator=(const PropertyKeyScope &) = delete;
+
+        /*!
+         * Whether the property read on the calling thread may be \a key or a key
+         * made of \a key, a colon and a description, like "LYRICS:ENGLISH".
+         * Always \c true outside of a scope.
+         */
+        static bool wants(const String &key);
+
+    private:
+        String key;
+        const PropertyKeyScope *previous;
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_ID3V2_LAZY_H
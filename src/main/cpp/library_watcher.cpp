@@ -0,0 +1,322 @@
+#include "library_watcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_lock.h"
+#include "fileref_ext.h"
+#include "format_registry.h"
+#include "stats.h"
+#include "tfilestream.h"
+
+namespace TagLibExt {
+    namespace {
+
+        // Files are picked up once written and closed, or moved in complete.
+        constexpr uint32_t watchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE |
+                                       IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+        bool hasFormatExtension(const std::string &path) {
+            const size_t dot = path.rfind('.');
+            const size_t slash = path.rfind('/');
+            if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+                return false;
+            }
+            const String extension = String(path.substr(dot + 1), String::UTF8).upper();
+            return std::any_of(builtInFormats().begin(), builtInFormats().end(), [&](const Format &format) {
+                return std::any_of(format.extensions.begin(), format.extensions.end(), [&](const char *e) {
+                    return extension == e;
+                });
+            });
+        }
+
+        bool isBelow(const std::string &path, const std::string &directory) {
+            return path.size() > directory.size() && path[directory.size()] == '/' &&
+                   path.compare(0, directory.size(), directory) == 0;
+        }
+
+    } // namespace
+
+    LibraryWatcher::LibraryWatcher(int quietMillis, int maxDelayMillis) :
+            inotifyFd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+            wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+            quiet(std::max(quietMillis, 0)),
+            maxDelay(std::max(maxDelayMillis, quietMillis)) {
+    }
+
+    LibraryWatcher::~LibraryWatcher() {
+        if (inotifyFd >= 0) {
+            close(inotifyFd);
+        }
+        if (wakeFd >= 0) {
+            close(wakeFd);
+        }
+    }
+
+    bool LibraryWatcher::isValid() const {
+        return inotifyFd >= 0 && wakeFd >= 0;
+    }
+
+    bool LibraryWatcher::addRoot(const std::string &path) {
+        std::string root = path;
+        while (root.size() > 1 && root.back() == '/') {
+            root.pop_back();
+        }
+        if (!isValid() || !watchTree(root, false)) {
+            return false;
+        }
+        if (std::find(roots.begin(), roots.end(), root) == roots.end()) {
+            roots.push_back(root);
+        }
+        return true;
+    }
+
+    bool LibraryWatcher::waitForChanges(int timeoutMillis, std::vector<LibraryChange> &changes) {
+        if (!isValid()) {
+            return false;
+        }
+        const Clock::time_point deadline = timeoutMillis >= 0
+                                           ? Clock::now() + std::chrono::milliseconds(timeoutMillis)
+                                           : Clock::time_point::max();
+        for (;;) {
+            const Clock::time_point now = Clock::now();
+            const bool waiting = !pending.empty() || overflow;
+            if (waiting && (now - lastEvent >= quiet || now - firstEvent >= maxDelay)) {
+                const size_t count = changes.size();
+                flush(changes);
+                if (changes.size() > count) {
+                    return true;
+                }
+                continue;
+            }
+            if (now >= deadline) {
+                return false;
+            }
+
+            // Sleep until the batch settles or the timeout expires, or without a timeout if neither is due
+            Clock::time_point wakeAt = deadline;
+            if (waiting) {
+                wakeAt = std::min({wakeAt, lastEvent + quiet, firstEvent + maxDelay});
+            }
+            int pollTimeout = -1;
+            if (wakeAt != Clock::time_point::max()) {
+                const auto millis = std::chrono::ceil<std::chrono::milliseconds>(wakeAt - now).count();
+                pollTimeout = static_cast<int>(std::min<decltype(millis)>(millis, INT_MAX));
+            }
+
+            pollfd fds[2] = {{inotifyFd, POLLIN, 0},
+                             {wakeFd,    POLLIN, 0}};
+            if (poll(fds, 2, pollTimeout) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            if (fds[1].revents & POLLIN) {
+                uint64_t count;
+                while (read(wakeFd, &count, sizeof(count)) < 0 && errno == EINTR) {
+                }
+                return false;
+            }
+            if (fds[0].revents & POLLIN) {
+                readEvents();
+            } else if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                return false;
+            }
+        }
+    }
+
+    void LibraryWatcher::wakeUp() {
+        const uint64_t one = 1;
+        while (write(wakeFd, &one, sizeof(one)) < 0 && errno == EINTR) {
+        }
+    }
+
+    bool LibraryWatcher::watchTree(const std::string &path, bool reportFiles) {
+        const int wd = inotify_add_watch(inotifyFd, path.c_str(), watchMask);
+        if (wd < 0) {
+            return false;
+        }
+        watches[wd] = path;
+        watchedDirectories[path] = wd;
+
+        // Listed after the watch is added, so that no file falls in between
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            return true;
+        }
+        while (const dirent *entry = readdir(dir)) {
+            const std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            const std::string child = path + "/" + name;
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st{};
+                if (lstat(child.c_str(), &st) == 0) {
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+                }
+            }
+            // Symbolic links are not followed, so that the trees cannot contain cycles
+            if (type == DT_DIR) {
+                watchTree(child, reportFiles);
+            } else if (type == DT_REG && reportFiles) {
+                addPending(child, false, false);
+            }
+        }
+        closedir(dir);
+        return true;
+    }
+
+    void LibraryWatcher::unwatchTree(const std::string &path) {
+        for (auto directory = watchedDirectories.begin(); directory != watchedDirectories.end();) {
+            if (directory->first == path || isBelow(directory->first, path)) {
+                inotify_rm_watch(inotifyFd, directory->second);
+                watches.erase(directory->second);
+                directory = watchedDirectories.erase(directory);
+            } else {
+                ++directory;
+            }
+        }
+    }
+
+    void LibraryWatcher::addPending(const std::string &path, bool directory, bool removed) {
+        if (!directory && !hasFormatExtension(path)) {
+            return;
+        }
+        const Clock::time_point now = Clock::now();
+        if (pending.empty() && !overflow) {
+            firstEvent = now;
+        }
+        lastEvent = now;
+        if (directory && removed) {
+            // The removal of the directory covers the changes below it
+            auto below = pending.lower_bound(path + "/");
+            while (below != pending.end() && isBelow(below->first, path)) {
+                below = pending.erase(below);
+            }
+        }
+        pending[path] = {directory, removed};
+    }
+
+    void LibraryWatcher::readEvents() {
+        alignas(inotify_event) char buffer[16 * 1024];
+        for (;;) {
+            const ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+            if (length < 0 && errno == EINTR) {
+                continue;
+            }
+            if (length <= 0) {
+                return;
+            }
+            for (const char *p = buffer; p < buffer + length;) {
+                const auto *event = reinterpret_cast<const inotify_event *>(p);
+                p += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    if (pending.empty() && !overflow) {
+                        firstEvent = Clock::now();
+                    }
+                    lastEvent = Clock::now();
+                    overflow = true;
+                    continue;
+                }
+                const auto watch = watches.find(event->wd);
+                if (watch == watches.end()) {
+                    continue;
+                }
+                const std::string directory = watch->second;
+                if (event->mask & IN_IGNORED) {
+                    watches.erase(watch);
+                    if (const auto d = watchedDirectories.find(directory);
+                            d != watchedDirectories.end() && d->second == event->wd) {
+                        watchedDirectories.erase(d);
+                    }
+                    continue;
+                }
+                if (event->len == 0) {
+                    // The directory itself went away; below a root its parent reports that too
+                    if ((event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) &&
+                        std::find(roots.begin(), roots.end(), directory) != roots.end()) {
+                        unwatchTree(directory);
+                        addPending(directory, true, true);
+                    }
+                    continue;
+                }
+
+                const std::string path = directory + "/" + event->name;
+                const bool isDirectory = event->mask & IN_ISDIR;
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    if (isDirectory) {
+                        unwatchTree(path);
+                    }
+                    addPending(path, isDirectory, true);
+                } else if (isDirectory && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                    watchTree(path, true);
+                } else if (!isDirectory && (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) {
+                    addPending(path, false, false);
+                }
+            }
+        }
+    }
+
+    void LibraryWatcher::flush(std::vector<LibraryChange> &changes) {
+        if (overflow) {
+            // Watch the directories created while events were lost, and have the roots scanned again
+            for (const std::string &root: roots) {
+                watchTree(root, false);
+                LibraryChange change;
+                change.type = LibraryChange::Type::Overflow;
+                change.path = root;
+                change.directory = true;
+                changes.push_back(std::move(change));
+            }
+            overflow = false;
+        }
+
+        for (const auto &entry: pending) {
+            const std::string &path = entry.first;
+            LibraryChange change;
+            change.path = path;
+            change.directory = entry.second.directory;
+
+            struct stat st{};
+            if (entry.second.removed || lstat(path.c_str(), &st) != 0) {
+                change.type = LibraryChange::Type::Removed;
+                changes.push_back(std::move(change));
+                continue;
+            }
+            if (!S_ISREG(st.st_mode)) {
+                continue;
+            }
+
+            // Each parse counts as a call in the stats, like the JNI functions
+            StatsCollector stats;
+            const FileLock lock(path.c_str(), FileLock::Mode::Read);
+            FileStream stream(path.c_str(), true);
+            if (!stream.isOpen()) {
+                continue;
+            }
+            const FileRef f(path.c_str(), stats.wrap(&stream), true, AudioProperties::Fast, stats.get());
+            if (f.isNull()) {
+                continue;
+            }
+            change.type = LibraryChange::Type::Changed;
+            change.properties = f.properties();
+            if (const AudioProperties *audioProperties = f.audioProperties()) {
+                change.lengthInMilliseconds = audioProperties->lengthInMilliseconds();
+            }
+            changes.push_back(std::move(change));
+        }
+        pending.clear();
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,119 @@
+#ifndef TAGLIB_EXT_LIBRARY_WATCHER_H
+#define TAGLIB_EXT_LIBRARY_WATCHER_H
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tpropertymap.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! A change below a root watched by LibraryWatcher.
+
+    struct LibraryChange {
+        enum class Type {
+            //! The file was added or written, and parsed again
+            Changed,
+            //! The file or directory was deleted or moved away
+            Removed,
+            //! Events were lost, the root has to be scanned again
+            Overflow
+        };
+
+        Type type{Type::Changed};
+        //! Path of the file or directory, or of the root for Overflow
+        std::string path;
+        //! Whether \a path is a directory; a removed directory stands for everything below it
+        bool directory{false};
+        //! Tags of a changed file
+        PropertyMap properties;
+        //! Length of a changed file, read with AudioProperties::Fast
+        int lengthInMilliseconds{0};
+    };
+
+    /*!
+     * Watches directory trees with inotify and parses the audio files that are
+     * written, copied or moved into them, so that a library only has to be
+     * scanned once rather than periodically.
+     *
+     * Events are coalesced until none arrived for \a quietMillis, or for at
+     * most \a maxDelayMillis after the first one, so that copying an album
+     * yields one batch with one change per file.  A file is parsed once per
+     * batch however often it was written.  Files are picked up when closed
+     * after writing, not while being written.  Files without the extension of
+     * a compiled in format, see builtInFormats(), are ignored.
+     *
+     * waitForChanges() blocks in poll() without a timer while nothing happens,
+     * so an idle watcher costs no CPU.  All methods but wakeUp() must be called
+     * from one thread at a time.
+     */
+
+    class LibraryWatcher {
+    public:
+        explicit LibraryWatcher(int quietMillis = 500, int maxDelayMillis = 5000);
+
+        ~LibraryWatcher();
+
+        LibraryWatcher(const LibraryWatcher &) = delete;
+
+        LibraryWatcher &operator=(const LibraryWatcher &) = delete;
+
+        //! Returns \c false if inotify is not available.
+        bool isValid() const;
+
+        /*!
+         * Watches \a path and every directory below it.  Files already there are
+         * not reported.  Returns \c false if \a path could not be watched, e.g.
+         * because it is not a directory or the inotify watch limit was reached.
+         */
+        bool addRoot(const std::string &path);
+
+        /*!
+         * Waits up to \a timeoutMillis, or forever if it is negative, for the
+         * next batch of changes and appends it to \a changes.  Returns \c false
+         * if the timeout expired, wakeUp() was called or inotify failed first.
+         */
+        bool waitForChanges(int timeoutMillis, std::vector<LibraryChange> &changes);
+
+        //! Makes a waitForChanges() call on another thread return.  Thread safe.
+        void wakeUp();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct PendingChange {
+            bool directory{false};
+            bool removed{false};
+        };
+
+        bool watchTree(const std::string &path, bool reportFiles);
+
+        void unwatchTree(const std::string &path);
+
+        void addPending(const std::string &path, bool directory, bool removed);
+
+        void readEvents();
+
+        void flush(std::vector<LibraryChange> &changes);
+
+        int inotifyFd;
+        int wakeFd;
+        std::chrono::milliseconds quiet;
+        std::chrono::milliseconds maxDelay;
+        std::vector<std::string> roots;
+        std::unordered_map<int, std::string> watches;
+        std::unordered_map<std::string, int> watchedDirectories;
+        std::map<std::string, PendingChange> pending;
+        bool overflow{false};
+        Clock::time_point firstEvent;
+        Clock::time_point lastEvent;
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_LIBRARY_WATCHER_H
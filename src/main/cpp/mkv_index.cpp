@@ -0,0 +1,425 @@
+#include "mkv_index.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace TagLibExt {
+    namespace {
+        // Read at the start of the file, usually covering everything up to the first Cluster
+        constexpr size_t headLength = 16 * 1024;
+        // Longest element header: 4 byte ID and 8 byte size
+        constexpr size_t maxHeaderLength = 12;
+        // Length of the Void element header written over a hidden range: ID and an 8 byte size
+        constexpr offset_t voidHeaderLength = 9;
+        constexpr offset_t maxSeekHeadLength = 64 * 1024;
+
+        struct Header {
+            uint32_t id{0};
+            unsigned int length{0};
+            offset_t dataSize{0};
+            bool unknownSize{false};
+        };
+
+        // Parses the EBML ID and size at offset of data.
+        bool parseHeader(const ByteVector &data, unsigned int offset, Header &header) {
+            if (offset >= data.size()) {
+                return false;
+            }
+            const auto first = static_cast<unsigned char>(data[offset]);
+            unsigned int idLength = 1;
+            while (idLength <= 4 && !(first & (0x80 >> (idLength - 1)))) {
+                idLength++;
+            }
+            if (idLength > 4 || offset + idLength >= data.size()) {
+                return false;
+            }
+            header.id = data.toUInt(offset, idLength);
+
+            const auto sizeFirst = static_cast<unsigned char>(data[offset + idLength]);
+            unsigned int sizeLength = 1;
+            while (sizeLength <= 8 && !(sizeFirst & (0x80 >> (sizeLength - 1)))) {
+                sizeLength++;
+            }
+            if (sizeLength > 8 || offset + idLength + sizeLength > data.size()) {
+                return false;
+            }
+            uint64_t size = sizeFirst & (0xFF >> sizeLength);
+            bool allOnes = size == (0xFFu >> sizeLength);
+            for (unsigned int i = 1; i < sizeLength; i++) {
+                const auto byte = static_cast<unsigned char>(data[offset + idLength + i]);
+                size = size << 8 | byte;
+                allOnes = allOnes && byte == 0xFF;
+            }
+            header.length = idLength + sizeLength;
+            header.dataSize = static_cast<offset_t>(size);
+            header.unknownSize = allOnes;
+            return true;
+        }
+
+        // Reads an unsigned integer or an ID stored big endian in up to 8 bytes.
+        uint64_t parseUnsigned(const ByteVector &data, unsigned int offset, unsigned int length) {
+            uint64_t value = 0;
+            for (unsigned int i = 0; i < length && offset + i < data.size(); i++) {
+                value = value << 8 | static_cast<unsigned char>(data[offset + i]);
+            }
+            return value;
+        }
+    }
+
+    class MkvSegmentIndex::Builder {
+    public:
+        Builder(IOStream *stream, MkvSegmentIndex &index) :
+                stream(stream), index(index) {
+        }
+
+        bool build() {
+            index.length = stream->length();
+
+            Header header;
+            if (!readHeader(0, header) || header.id != EBMLHeader || header.unknownSize) {
+                return false;
+            }
+            const offset_t segmentOffset = header.length + header.dataSize;
+            if (!readHeader(segmentOffset, header) || header.id != Segment) {
+                return false;
+            }
+            segmentBegin = segmentOffset + header.length;
+            segmentEnd = header.unknownSize ? index.length : segmentBegin + header.dataSize;
+            if (segmentEnd > index.length) {
+                return false;
+            }
+
+            // Up to the first Cluster, then to the elements the SeekHeads point to,
+            // each followed up to the next Cluster.
+            offset_t mediaBegin = segmentEnd;
+            if (!walk(segmentBegin, mediaBegin)) {
+                return false;
+            }
+            if (mediaBegin == segmentEnd) {
+                return true;
+            }
+            if (!seekHeadFound) {
+                return false;
+            }
+            for (size_t i = 0; i < targets.size(); i++) {
+                const auto [id, offset] = targets[i];
+                if (offset < mediaBegin || known(offset)) {
+                    continue;
+                }
+                if (!readHeader(offset, header) || header.id != id) {
+                    return false;
+                }
+                offset_t cluster;
+                if (!walk(offset, cluster)) {
+                    return false;
+                }
+            }
+            // A muxer indexing its Tags or Attachments indexes all of them, so the
+            // Clusters are only stepped over if the SeekHeads list neither.
+            if (!listed(Tags) && !listed(Attachments) && !walkTail(mediaBegin)) {
+                return false;
+            }
+
+            std::sort(index.elementList.begin(), index.elementList.end(), [](const auto &a, const auto &b) {
+                return a.offset < b.offset;
+            });
+            hide(mediaBegin);
+
+            // The media data must be read as hidden from now on
+            if (index.head.size() > mediaBegin) {
+                index.head.resize(static_cast<unsigned int>(mediaBegin));
+            }
+            return true;
+        }
+
+    private:
+        // Adds the elements from offset on, up to the first Cluster, an element
+        // already added or the end of the segment.  Sets cluster to the offset the
+        // walk stopped at.
+        bool walk(offset_t offset, offset_t &cluster) {
+            while (offset < segmentEnd && !known(offset)) {
+                Header header;
+                if (!readHeader(offset, header)) {
+                    return false;
+                }
+                if (header.id == Cluster) {
+                    break;
+                }
+                const offset_t length = header.length + header.dataSize;
+                if (header.unknownSize || length > segmentEnd - offset) {
+                    return false;
+                }
+                index.elementList.push_back({header.id, offset, length});
+                if (header.id == SeekHead && !readSeekHead(offset, header)) {
+                    return false;
+                }
+                offset += length;
+            }
+            cluster = offset;
+            return true;
+        }
+
+        // Adds the elements after the last one found that neither a SeekHead nor
+        // a walk reached, stepping over the Clusters up to the end of the segment
+        // like Matroska::File does.  Nothing is read if the last element found
+        // ends the segment, as it does when the Cues or the Tags come last.
+        bool walkTail(offset_t mediaBegin) {
+            offset_t offset = mediaBegin;
+            for (const auto &element: index.elementList) {
+                offset = std::max(offset, element.offset + element.length);
+            }
+            while (offset < segmentEnd) {
+                Header header;
+                if (!readHeader(offset, header)) {
+                    return false;
+                }
+                const offset_t length = header.length + header.dataSize;
+                if (header.unknownSize || length > segmentEnd - offset) {
+                    return false;
+                }
+                if (header.id != Cluster && header.id != Void && !known(offset)) {
+                    index.elementList.push_back({header.id, offset, length});
+                }
+                offset += length;
+            }
+            return true;
+        }
+
+        // Queues the positions of the Seek entries of the SeekHead at offset.
+        bool readSeekHead(offset_t offset, const Header &header) {
+            if (header.dataSize > maxSeekHeadLength) {
+                return false;
+            }
+            seekHeadFound = true;
+            const ByteVector data = read(offset + header.length, static_cast<size_t>(header.dataSize));
+            unsigned int position = 0;
+            while (position < data.size()) {
+                Header seek;
+                if (!parseHeader(data, position, seek) || position + seek.length + seek.dataSize > data.size()) {
+                    return false;
+                }
+                if (seek.id == Seek) {
+                    const unsigned int end = position + seek.length + static_cast<unsigned int>(seek.dataSize);
+                    uint32_t id = 0;
+                    offset_t target = -1;
+                    unsigned int child = position + seek.length;
+                    while (child < end) {
+                        Header field;
+                        if (!parseHeader(data, child, field) || child + field.length + field.dataSize > end ||
+                            field.dataSize > 8) {
+                            return false;
+                        }
+                        const auto fieldSize = static_cast<unsigned int>(field.dataSize);
+                        if (field.id == SeekID) {
+                            id = static_cast<uint32_t>(parseUnsigned(data, child + field.length, fieldSize));
+                        } else if (field.id == SeekPosition) {
+                            target = segmentBegin +
+                                     static_cast<offset_t>(parseUnsigned(data, child + field.length, fieldSize));
+                        }
+                        child += field.length + fieldSize;
+                    }
+                    if (id != 0 && target >= segmentBegin && target < segmentEnd) {
+                        targets.emplace_back(id, target);
+                    }
+                }
+                position += seek.length + static_cast<unsigned int>(seek.dataSize);
+            }
+            return true;
+        }
+
+        // Hides everything after mediaBegin that is not an element TagLib reads.
+        void hide(offset_t mediaBegin) {
+            offset_t position = mediaBegin;
+            const auto hideUpTo = [&](offset_t end) {
+                if (end - position >= voidHeaderLength) {
+                    index.hiddenList.push_back({Void, position, end - position});
+                }
+            };
+            for (const auto &element: index.elementList) {
+                if (element.offset < mediaBegin || element.id == Cues) {
+                    continue;
+                }
+                hideUpTo(element.offset);
+                position = element.offset + element.length;
+            }
+            hideUpTo(segmentEnd);
+        }
+
+        bool listed(uint32_t id) const {
+            return std::any_of(targets.begin(), targets.end(), [&](const auto &target) {
+                return target.first == id;
+            });
+        }
+
+        bool known(offset_t offset) const {
+            return std::any_of(index.elementList.begin(), index.elementList.end(), [&](const auto &e) {
+                return e.offset == offset;
+            });
+        }
+
+        bool readHeader(offset_t offset, Header &header) {
+            const ByteVector data = read(offset, maxHeaderLength);
+            return parseHeader(data, 0, header);
+        }
+
+        ByteVector read(offset_t offset, size_t length) {
+            if (index.head.isEmpty() && offset == 0) {
+                stream->seek(0);
+                index.head = stream->readBlock(std::max(length, headLength));
+            }
+            ByteVector cached;
+            if (index.cachedBytes(offset, length, cached)) {
+                return cached;
+            }
+            stream->seek(offset);
+            return stream->readBlock(length);
+        }
+
+        IOStream *stream;
+        MkvSegmentIndex &index;
+        offset_t segmentBegin{0};
+        offset_t segmentEnd{0};
+        bool seekHeadFound{false};
+        std::vector<std::pair<uint32_t, offset_t>> targets;
+    };
+
+////////////////////////////////////////////////////////////////////////////////
+// MkvSegmentIndex
+////////////////////////////////////////////////////////////////////////////////
+
+    bool MkvSegmentIndex::build(IOStream *stream) {
+        elementList.clear();
+        hiddenList.clear();
+        head.clear();
+        return Builder(stream, *this).build();
+    }
+
+    const std::vector<MkvElement> &MkvSegmentIndex::elements() const {
+        return elementList;
+    }
+
+    const std::vector<MkvElement> &MkvSegmentIndex::hidden() const {
+        return hiddenList;
+    }
+
+    offset_t MkvSegmentIndex::fileLength() const {
+        return length;
+    }
+
+    bool MkvSegmentIndex::cachedBytes(offset_t offset, size_t length, ByteVector &data) const {
+        if (offset < 0 || offset + static_cast<offset_t>(length) > static_cast<offset_t>(head.size())) {
+            return false;
+        }
+        data = head.mid(static_cast<unsigned int>(offset), static_cast<unsigned int>(length));
+        return true;
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// MkvIndexedStream
+////////////////////////////////////////////////////////////////////////////////
+
+    MkvIndexedStream::MkvIndexedStream(IOStream *stream, MkvSegmentIndex index) :
+            stream(stream), index(std::move(index)) {
+    }
+
+    FileName MkvIndexedStream::name() const {
+        return stream->name();
+    }
+
+    ByteVector MkvIndexedStream::readBlock(size_t length) {
+        const offset_t end = std::min(position + static_cast<offset_t>(length), index.fileLength());
+        if (position >= end) {
+            return {};
+        }
+        ByteVector data;
+        if (index.cachedBytes(position, static_cast<size_t>(end - position), data)) {
+            position = end;
+            return data;
+        }
+
+        const auto &hidden = index.hidden();
+        while (position < end) {
+            // The first hidden range ending after position
+            const auto range = std::upper_bound(hidden.begin(), hidden.end(), position, [](offset_t o, const auto &h) {
+                return o < h.offset + h.length;
+            });
+            if (range != hidden.end() && range->offset <= position) {
+                // A Void element header, then zeros
+                const offset_t rangeEnd = std::min(end, range->offset + range->length);
+                ByteVector filler(static_cast<unsigned int>(rangeEnd - position), 0);
+                const uint64_t voidSize = range->length - voidHeaderLength;
+                for (offset_t i = position; i < rangeEnd && i < range->offset + voidHeaderLength; i++) {
+                    const offset_t headerIndex = i - range->offset;
+                    const char byte = headerIndex == 0 ? static_cast<char>(MkvSegmentIndex::Void) :
+                                      headerIndex == 1 ? '\x01' :
+                                      static_cast<char>(voidSize >> (8 * (voidHeaderLength - 1 - headerIndex)));
+                    filler[static_cast<unsigned int>(i - position)] = byte;
+                }
+                data.append(filler);
+                position = rangeEnd;
+            } else {
+                const offset_t chunkEnd = range != hidden.end() ? std::min(end, range->offset) : end;
+                stream->seek(position);
+                const ByteVector chunk = stream->readBlock(static_cast<size_t>(chunkEnd - position));
+                data.append(chunk);
+                position += chunk.size();
+                if (position < chunkEnd) {
+                    break;
+                }
+            }
+        }
+        return data;
+    }
+
+    void MkvIndexedStream::writeBlock(const ByteVector &data) {
+        stream->seek(position);
+        stream->writeBlock(data);
+    }
+
+    void MkvIndexedStream::insert(const ByteVector &data, offset_t start, size_t replace) {
+        stream->insert(data, start, replace);
+    }
+
+    void MkvIndexedStream::removeBlock(offset_t start, size_t length) {
+        stream->removeBlock(start, length);
+    }
+
+    bool MkvIndexedStream::readOnly() const {
+        return stream->readOnly();
+    }
+
+    bool MkvIndexedStream::isOpen() const {
+        return stream->isOpen();
+    }
+
+    void MkvIndexedStream::seek(offset_t offset, Position p) {
+        switch (p) {
+            case Beginning:
+                position = offset;
+                break;
+            case Current:
+                position += offset;
+                break;
+            case End:
+                position = index.fileLength() + offset;
+                break;
+        }
+    }
+
+    void MkvIndexedStream::clear() {
+        stream->clear();
+    }
+
+    offset_t MkvIndexedStream::tell() const {
+        return position;
+    }
+
+    offset_t MkvIndexedStream::length() {
+        return index.fileLength();
+    }
+
+    void MkvIndexedStream::truncate(offset_t length) {
+        stream->truncate(length);
+    }
+
+} // namespace TagLibExt
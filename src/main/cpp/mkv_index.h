@@ -0,0 +1,134 @@
+#ifndef TAGLIB_EXT_MKV_INDEX_H
+#define TAGLIB_EXT_MKV_INDEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include "tiostream.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! A top level element of a Matroska segment.
+
+    struct MkvElement {
+        uint32_t id;
+        //! Offset of the element ID
+        offset_t offset;
+        //! Length of the element, header included
+        offset_t length;
+    };
+
+    /*!
+     * The top level layout of a Matroska or WebM file, found without reading the
+     * media data: the elements before the first Cluster are walked header by
+     * header, those after it are reached through the positions in the SeekHead,
+     * and past the Cues, which the SeekHead also points to, the walk goes on up to
+     * the next Cluster to find the trailing Tags and Attachments muxers write
+     * without indexing them.  If the SeekHead lists neither Tags nor Attachments
+     * and the last element found does not end the segment, the Cluster headers
+     * after it are stepped over up to the end, so that the elements after the
+     * last Cluster are found wherever they are.
+     *
+     * The rest of the segment, the Clusters and Cues, is what MkvIndexedStream
+     * hides from TagLib.
+     */
+    class MkvSegmentIndex {
+    public:
+        enum ElementId : uint32_t {
+            EBMLHeader = 0x1A45DFA3,
+            Segment = 0x18538067,
+            SeekHead = 0x114D9B74,
+            Seek = 0x4DBB,
+            SeekID = 0x53AB,
+            SeekPosition = 0x53AC,
+            Info = 0x1549A966,
+            Tracks = 0x1654AE6B,
+            Tags = 0x1254C367,
+            Attachments = 0x1941A469,
+            Chapters = 0x1043A770,
+            Cues = 0x1C53BB6B,
+            Cluster = 0x1F43B675,
+            Void = 0xEC
+        };
+
+        /*!
+         * Reads the layout of the file of \a stream.  Returns \c false if it is not
+         * a Matroska file, has no SeekHead before its first Cluster, or a SeekHead
+         * entry does not point to the element it names; the file has to be read
+         * from start to end by TagLib then.
+         */
+        bool build(IOStream *stream);
+
+        //! The elements found, in file order.
+        [[nodiscard]] const std::vector<MkvElement> &elements() const;
+
+        /*!
+         * The ranges of the segment that hold no element TagLib needs for reading,
+         * in file order.  Each is at least 9 bytes long, enough for a Void element
+         * header spanning all of it.
+         */
+        [[nodiscard]] const std::vector<MkvElement> &hidden() const;
+
+        [[nodiscard]] offset_t fileLength() const;
+
+        //! Returns \c true and sets \a data if the \a length bytes at \a offset were read with the start of the file.
+        bool cachedBytes(offset_t offset, size_t length, ByteVector &data) const;
+
+    private:
+        class Builder;
+
+        std::vector<MkvElement> elementList;
+        std::vector<MkvElement> hiddenList;
+        ByteVector head;
+        offset_t length{0};
+    };
+
+    /*!
+     * A read only view of a Matroska file in which the hidden ranges of its
+     * MkvSegmentIndex read as Void elements, so that a Matroska::File walking the
+     * segment jumps from the last element before the media data to the Tags and
+     * Attachments after it with a single header read.  The view has the same
+     * length and element offsets as the file.
+     *
+     * It is meant for reading only: writes are passed through to the stream, which
+     * is expected to refuse them.
+     */
+    class MkvIndexedStream : public IOStream {
+    public:
+        MkvIndexedStream(IOStream *stream, MkvSegmentIndex index);
+
+        FileName name() const override;
+
+        ByteVector readBlock(size_t length) override;
+
+        void writeBlock(const ByteVector &data) override;
+
+        void insert(const ByteVector &data, offset_t start = 0, size_t replace = 0) override;
+
+        void removeBlock(offset_t start = 0, size_t length = 0) override;
+
+        bool readOnly() const override;
+
+        bool isOpen() const override;
+
+        void seek(offset_t offset, Position p = Beginning) override;
+
+        void clear() override;
+
+        offset_t tell() const override;
+
+        offset_t length() override;
+
+        void truncate(offset_t length) override;
+
+    private:
+        IOStream *stream;
+        MkvSegmentIndex index;
+        offset_t position{0};
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_MKV_INDEX_H
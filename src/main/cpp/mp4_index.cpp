@@ -0,0 +1,370 @@
+#include "mp4_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <sys/stat.h>
+
+namespace TagLibExt {
+    namespace {
+        // The atoms TagLib descends into, plus covr whose data atoms locate the pictures
+        const char *const containers[] = {
+                "moov", "udta", "mdia", "meta", "ilst", "stbl", "minf", "moof", "traf", "trak", "stsd", "covr"
+        };
+
+        // Children of a meta atom that is not a full atom, as recognised by TagLib
+        const char *const metaChildren[] = {"hdlr", "ilst", "mhdr", "ctry", "lang"};
+
+        constexpr size_t windowLength = 16 * 1024;
+        // Atoms up to this length are kept whole if they were read on the way
+        constexpr offset_t smallAtomLength = 1024;
+        // Limit of the bytes kept per index, headers excluded
+        constexpr size_t keptBytesLimit = 64 * 1024;
+        constexpr int maxDepth = 16;
+        constexpr size_t cacheCapacity = 32;
+
+        bool isOneOf(const ByteVector &name, const char *const *names, size_t count) {
+            return std::any_of(names, names + count, [&](const char *n) { return name == n; });
+        }
+
+        struct CacheKey {
+            dev_t device;
+            ino_t inode;
+            off_t size;
+            time_t modifiedSeconds;
+            long modifiedNanos;
+
+            bool operator==(const CacheKey &other) const {
+                return device == other.device && inode == other.inode && size == other.size &&
+                       modifiedSeconds == other.modifiedSeconds && modifiedNanos == other.modifiedNanos;
+            }
+        };
+
+        // The file open as fd, or at path if there is no descriptor, which may have
+        // been replaced by another file since the stream was opened.
+        bool cacheKey(FileName path, int fd, CacheKey &key) {
+            struct stat st{};
+            if (fd >= 0 ? fstat(fd, &st) != 0 : !path || path[0] == '\0' || stat(path, &st) != 0) {
+                return false;
+            }
+            key = {st.st_dev, st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+            return true;
+        }
+
+        std::mutex cacheMutex;
+        // Most recently used first
+        std::list<std::pair<CacheKey, std::shared_ptr<const Mp4AtomIndex>>> cache;
+    }
+
+    class Mp4AtomIndex::Builder {
+    public:
+        Builder(IOStream *stream, Mp4AtomIndex &index) :
+                stream(stream), index(index) {
+        }
+
+        // Adds the atoms between begin and end.  Inside a top level atom the headers
+        // are read in windows that never extend past the parent.
+        void walk(offset_t begin, offset_t end, int parent, int depth) {
+            const bool windowed = depth > 0;
+            offset_t position = begin;
+            while (position + 8 <= end) {
+                const ByteVector header = read(position, static_cast<size_t>(std::min<offset_t>(16, end - position)),
+                                               end, windowed);
+                if (header.size() < 8) {
+                    return;
+                }
+
+                offset_t length = header.toUInt(0U);
+                unsigned int headerLength = 8;
+                if (length == 1) {
+                    if (header.size() < 16) {
+                        return;
+                    }
+                    length = header.toLongLong(8U);
+                    headerLength = 16;
+                } else if (length == 0) {
+                    length = end - position;
+                }
+                if (length < headerLength || length > end - position) {
+                    return;
+                }
+
+                const auto atomIndex = static_cast<int>(index.atomList.size());
+                const ByteVector name = header.mid(4, 4);
+                index.atomList.push_back({position, length, headerLength, name, parent});
+
+                const bool container = depth < maxDepth && isOneOf(name, containers, std::size(containers));
+                if (container) {
+                    offset_t childBegin = position + headerLength;
+                    if (name == "meta") {
+                        // meta is a full atom unless it is directly followed by one of its children
+                        const ByteVector next = read(childBegin, 8, end, windowed);
+                        keep(position, read(position, headerLength + next.size(), end, windowed), true);
+                        if (next.size() < 8 || !isOneOf(next.mid(4, 4), metaChildren, std::size(metaChildren))) {
+                            childBegin += 4;
+                        }
+                    } else {
+                        keep(position, header.mid(0, headerLength), true);
+                        if (name == "stsd") {
+                            childBegin += 8;
+                        }
+                    }
+                    walk(childBegin, position + length, atomIndex, depth + 1);
+                } else if (length <= smallAtomLength && inWindow(position, length)) {
+                    keep(position, read(position, static_cast<size_t>(length), end, windowed), false);
+                } else {
+                    keep(position, header.mid(0, headerLength), true);
+                }
+                position += length;
+            }
+        }
+
+    private:
+        bool inWindow(offset_t offset, offset_t length) const {
+            return windowOffset >= 0 && offset >= windowOffset &&
+                   offset + length <= windowOffset + static_cast<offset_t>(window.size());
+        }
+
+        ByteVector read(offset_t offset, size_t length, offset_t limit, bool windowed) {
+            if (!inWindow(offset, static_cast<offset_t>(length))) {
+                const offset_t size = std::min<offset_t>(
+                        windowed ? static_cast<offset_t>(std::max(length, windowLength)) : static_cast<offset_t>(length),
+                        limit - offset);
+                stream->seek(offset);
+                window = stream->readBlock(static_cast<size_t>(size));
+                windowOffset = offset;
+            }
+            return window.mid(static_cast<unsigned int>(offset - windowOffset), static_cast<unsigned int>(length));
+        }
+
+        void keep(offset_t offset, const ByteVector &data, bool header) {
+            if (!header) {
+                if (keptBytes + data.size() > keptBytesLimit) {
+                    return;
+                }
+                keptBytes += data.size();
+            }
+            index.spans.push_back({offset, data});
+        }
+
+        IOStream *stream;
+        Mp4AtomIndex &index;
+        ByteVector window;
+        offset_t windowOffset{-1};
+        size_t keptBytes{0};
+    };
+
+////////////////////////////////////////////////////////////////////////////////
+// Mp4AtomIndex
+////////////////////////////////////////////////////////////////////////////////
+
+    std::shared_ptr<const Mp4AtomIndex> Mp4AtomIndex::build(IOStream *stream) {
+        auto index = std::make_shared<Mp4AtomIndex>();
+        index->length = stream->length();
+        Builder(stream, *index).walk(0, index->length, -1, 0);
+        if (index->atomList.empty()) {
+            return nullptr;
+        }
+        return index;
+    }
+
+    const std::vector<Mp4Atom> &Mp4AtomIndex::atoms() const {
+        return atomList;
+    }
+
+    const Mp4Atom *Mp4AtomIndex::find(const char *path) const {
+        const Mp4Atom *atom = nullptr;
+        while (*path) {
+            const char *separator = std::strchr(path, '/');
+            const size_t nameLength = separator ? static_cast<size_t>(separator - path) : std::strlen(path);
+            const ByteVector name(path, static_cast<unsigned int>(nameLength));
+
+            const Mp4Atom *child = nullptr;
+            for (const Mp4Atom *candidate: children(atom)) {
+                if (candidate->name == name) {
+                    child = candidate;
+                    break;
+                }
+            }
+            if (!child) {
+                return nullptr;
+            }
+            atom = child;
+            path += separator ? nameLength + 1 : nameLength;
+        }
+        return atom;
+    }
+
+    std::vector<const Mp4Atom *> Mp4AtomIndex::children(const Mp4Atom *atom) const {
+        const int parent = atom ? static_cast<int>(atom - atomList.data()) : -1;
+        std::vector<const Mp4Atom *> result;
+        for (const auto &candidate: atomList) {
+            if (candidate.parent == parent) {
+                result.push_back(&candidate);
+            }
+        }
+        return result;
+    }
+
+    offset_t Mp4AtomIndex::fileLength() const {
+        return length;
+    }
+
+    bool Mp4AtomIndex::cachedBytes(offset_t offset, size_t length, ByteVector &data) const {
+        // The last span starting at or before offset; spans are sorted by offset.
+        auto span = std::upper_bound(spans.begin(), spans.end(), offset, [](offset_t o, const Span &s) {
+            return o < s.offset;
+        });
+        if (span == spans.begin()) {
+            return false;
+        }
+        --span;
+        if (offset + static_cast<offset_t>(length) > span->offset + static_cast<offset_t>(span->data.size())) {
+            return false;
+        }
+        data = span->data.mid(static_cast<unsigned int>(offset - span->offset), static_cast<unsigned int>(length));
+        return true;
+    }
+
+    std::shared_ptr<const Mp4AtomIndex> mp4AtomIndex(FileName path, IOStream *stream, int fd) {
+        CacheKey key{};
+        if (!cacheKey(path, fd, key)) {
+            return Mp4AtomIndex::build(stream);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            const auto entry = std::find_if(cache.begin(), cache.end(), [&](const auto &e) {
+                return e.first == key;
+            });
+            if (entry != cache.end()) {
+                cache.splice(cache.begin(), cache, entry);
+                return entry->second;
+            }
+        }
+
+        std::shared_ptr<const Mp4AtomIndex> index = Mp4AtomIndex::build(stream);
+        if (index && index->fileLength() == key.size) {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            cache.emplace_front(key, index);
+            if (cache.size() > cacheCapacity) {
+                cache.pop_back();
+            }
+        }
+        return index;
+    }
+
+    void invalidateMp4AtomIndex(FileName path, int fd) {
+        CacheKey key{};
+        if (!cacheKey(path, fd, key)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cache.remove_if([&](const auto &e) { return e.first == key; });
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// Mp4IndexedStream
+////////////////////////////////////////////////////////////////////////////////
+
+    Mp4IndexedStream::Mp4IndexedStream(FileName path, IOStream *stream, int fd,
+                                       std::shared_ptr<const Mp4AtomIndex> index) :
+            path(path ? path : ""), stream(stream), fd(fd), index(std::move(index)) {
+    }
+
+    FileName Mp4IndexedStream::name() const {
+        return stream->name();
+    }
+
+    ByteVector Mp4IndexedStream::readBlock(size_t length) {
+        if (!index) {
+            return stream->readBlock(length);
+        }
+        ByteVector data;
+        if (!index->cachedBytes(position, length, data)) {
+            sync();
+            data = stream->readBlock(length);
+        } else {
+            inSync = false;
+        }
+        position += data.size();
+        return data;
+    }
+
+    void Mp4IndexedStream::writeBlock(const ByteVector &data) {
+        detach();
+        stream->writeBlock(data);
+    }
+
+    void Mp4IndexedStream::insert(const ByteVector &data, offset_t start, size_t replace) {
+        detach();
+        stream->insert(data, start, replace);
+    }
+
+    void Mp4IndexedStream::removeBlock(offset_t start, size_t length) {
+        detach();
+        stream->removeBlock(start, length);
+    }
+
+    bool Mp4IndexedStream::readOnly() const {
+        return stream->readOnly();
+    }
+
+    bool Mp4IndexedStream::isOpen() const {
+        return stream->isOpen();
+    }
+
+    void Mp4IndexedStream::seek(offset_t offset, Position p) {
+        if (!index) {
+            stream->seek(offset, p);
+            return;
+        }
+        switch (p) {
+            case Beginning:
+                position = offset;
+                break;
+            case Current:
+                position += offset;
+                break;
+            case End:
+                position = index->fileLength() + offset;
+                break;
+        }
+        inSync = false;
+    }
+
+    void Mp4IndexedStream::clear() {
+        stream->clear();
+    }
+
+    offset_t Mp4IndexedStream::tell() const {
+        return index ? position : stream->tell();
+    }
+
+    offset_t Mp4IndexedStream::length() {
+        return index ? index->fileLength() : stream->length();
+    }
+
+    void Mp4IndexedStream::truncate(offset_t length) {
+        detach();
+        stream->truncate(length);
+    }
+
+    void Mp4IndexedStream::sync() {
+        if (!inSync) {
+            stream->seek(position);
+            inSync = true;
+        }
+    }
+
+    // Leaves the index behind before the file is modified, from now on every call is forwarded.
+    void Mp4IndexedStream::detach() {
+        if (index) {
+            sync();
+            index.reset();
+            invalidateMp4AtomIndex(path.c_str(), fd);
+        }
+    }
+
+} // namespace TagLibExt
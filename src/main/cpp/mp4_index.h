@@ -0,0 +1,133 @@
+#ifndef TAGLIB_EXT_MP4_INDEX_H
+#define TAGLIB_EXT_MP4_INDEX_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tiostream.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! An atom of an MP4 file, as found by walking the atom headers.
+
+    struct Mp4Atom {
+        offset_t offset;
+        offset_t length;
+        //! 8, or 16 for atoms with a 64 bit size
+        unsigned int headerLength;
+        ByteVector name;
+        //! Index of the parent in Mp4AtomIndex::atoms(), -1 for top level atoms
+        int parent;
+    };
+
+    /*!
+     * The atom tree of an MP4 file, built from the atom headers alone.  Atoms that
+     * are not containers, mdat in particular, are jumped over without being read.
+     * Top level headers are read one by one; inside moov, where the headers are
+     * dense, they are read in windows of 16 KiB, so that a typical file takes a
+     * handful of reads whether moov is before or after mdat.
+     *
+     * The index keeps the bytes of the headers and of small atoms (e.g. mvhd, mdhd,
+     * hdlr and the text items of ilst) that were read on the way, so that TagLib's
+     * own walk of the file and most of its tag and property parsing can be served
+     * from memory, see Mp4IndexedStream.
+     */
+    class Mp4AtomIndex {
+    public:
+        //! Builds the index of the file of \a stream, returns a null pointer if it is not an MP4 file.
+        static std::shared_ptr<const Mp4AtomIndex> build(IOStream *stream);
+
+        //! The atoms in file order, parents before their children.
+        [[nodiscard]] const std::vector<Mp4Atom> &atoms() const;
+
+        //! Returns the first atom at \a path, e.g. "moov/udta/meta/ilst", or a null pointer.
+        [[nodiscard]] const Mp4Atom *find(const char *path) const;
+
+        //! Returns the children of \a atom, or the top level atoms if \a atom is null.
+        [[nodiscard]] std::vector<const Mp4Atom *> children(const Mp4Atom *atom) const;
+
+        [[nodiscard]] offset_t fileLength() const;
+
+        //! Returns \c true and sets \a data if the \a length bytes at \a offset were kept.
+        bool cachedBytes(offset_t offset, size_t length, ByteVector &data) const;
+
+    private:
+        struct Span {
+            offset_t offset;
+            ByteVector data;
+        };
+
+        class Builder;
+
+        std::vector<Mp4Atom> atomList;
+        std::vector<Span> spans;
+        offset_t length{0};
+    };
+
+    /*!
+     * Returns the index of the MP4 file of \a stream, reusing the one built by an
+     * earlier call for the same, unmodified file: entries are keyed by device,
+     * inode, size and modification time.  The file is identified with fstat() on
+     * \a fd, the descriptor \a stream reads, so that a file replaced at \a path
+     * since it was opened is not taken for the one read.  \a path is stat'ed only
+     * if \a fd is -1.  If neither can be stat'ed the index is built without being
+     * cached.  Returns a null pointer if the file of \a stream is not an MP4 file.
+     */
+    std::shared_ptr<const Mp4AtomIndex> mp4AtomIndex(FileName path, IOStream *stream, int fd = -1);
+
+    //! Drops the cached index of the file open as \a fd, or at \a path if \a fd is -1, e.g. before it is modified.
+    void invalidateMp4AtomIndex(FileName path, int fd = -1);
+
+    /*!
+     * An IOStream that serves the reads covered by an Mp4AtomIndex from memory and
+     * forwards the others to \a stream.  The first write turns it into a plain
+     * forwarding stream and invalidates the cached index of the file, identified
+     * by \a fd and \a path like in mp4AtomIndex().
+     */
+    class Mp4IndexedStream : public IOStream {
+    public:
+        Mp4IndexedStream(FileName path, IOStream *stream, int fd, std::shared_ptr<const Mp4AtomIndex> index);
+
+        FileName name() const override;
+
+        ByteVector readBlock(size_t length) override;
+
+        void writeBlock(const ByteVector &data) override;
+
+        void insert(const ByteVector &data, offset_t start = 0, size_t replace = 0) override;
+
+        void removeBlock(offset_t start = 0, size_t length = 0) override;
+
+        bool readOnly() const override;
+
+        bool isOpen() const override;
+
+        void seek(offset_t offset, Position p = Beginning) override;
+
+        void clear() override;
+
+        offset_t tell() const override;
+
+        offset_t length() override;
+
+        void truncate(offset_t length) override;
+
+    private:
+        void sync();
+
+        void detach();
+
+        std::string path;
+        IOStream *stream;
+        int fd;
+        std::shared_ptr<const Mp4AtomIndex> index;
+        offset_t position{0};
+        bool inSync{false};
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_MP4_INDEX_H
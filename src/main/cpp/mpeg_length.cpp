@@ -0,0 +1,321 @@
+#include "mpeg_length.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "mpegproperties.h"
+#include "xingheader.h"
+
+#include "scan.h"
+
+namespace TagLibExt {
+    namespace {
+        // Read at once when walking all frames
+        constexpr offset_t walkWindow = 64 * 1024;
+        // Sampled at each of the sampled ranges
+        constexpr offset_t sampleWindow = 8 * 1024;
+        constexpr int sampleCount = 16;
+        // Larger than any frame, so that the frame after the last one of a range can be checked
+        constexpr offset_t maxFrameLength = 2048;
+
+        // Bitrates in kbps by MPEG-1 or MPEG-2 and 2.5, layer and bitrate index.
+        constexpr int bitrates[2][3][16] = {
+                {
+                        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+                        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+                        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}
+                },
+                {
+                        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+                        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+                        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}
+                }
+        };
+
+        constexpr int sampleRates[3][3] = {
+                {44100, 48000, 32000},
+                {22050, 24000, 16000},
+                {11025, 12000, 8000}
+        };
+
+        // Reads the stream in windows, so that the frames within a window take a single read.
+
+        class WindowReader {
+        public:
+            WindowReader(File *file, offset_t end, offset_t windowLength) :
+                    file(file), end(end), windowLength(windowLength) {
+            }
+
+            // The bytes at offset, at least length of them, or a null pointer if they extend past the end.
+            const char *at(offset_t offset, offset_t length) {
+                if (offset < 0 || offset + length > end) {
+                    return nullptr;
+                }
+                if (offset < start || offset + length > start + window.size()) {
+                    file->seek(offset);
+                    window = file->readBlock(static_cast<size_t>(std::min(windowLength, end - offset)));
+                    start = offset;
+                    if (window.size() < length) {
+                        return nullptr;
+                    }
+                }
+                return window.data() + (offset - start);
+            }
+
+            // The number of bytes available at offset after a successful call to at().
+            [[nodiscard]] offset_t available(offset_t offset) const {
+                return start + window.size() - offset;
+            }
+
+            [[nodiscard]] offset_t streamEnd() const {
+                return end;
+            }
+
+        private:
+            File *file;
+            offset_t end;
+            offset_t windowLength;
+            ByteVector window;
+            offset_t start{0};
+        };
+
+        // The frames of a range of the stream.
+        struct Range {
+            offset_t bytes{0};
+            long long samples{0};
+            int minBitrate{0};
+            int maxBitrate{0};
+        };
+
+        // Whether a frame of the stream of reference starts at offset, followed by
+        // another one of the same stream unless it is the last frame.
+        bool isFrame(WindowReader &reader, offset_t offset, const MpegFrameHeader &reference,
+                     MpegFrameHeader &header) {
+            const char *data = reader.at(offset, 4);
+            if (!data || !parseMpegFrameHeader(data, header) || !reference.isSameStream(header)) {
+                return false;
+            }
+            const offset_t next = offset + header.length;
+            if (next + 4 > reader.streamEnd()) {
+                return true;
+            }
+            MpegFrameHeader nextHeader{};
+            data = reader.at(next, 4);
+            return data && parseMpegFrameHeader(data, nextHeader) && header.isSameStream(nextHeader);
+        }
+
+        // The offset of the first frame starting in [offset, limit), -1 if there is none.
+        offset_t findFrame(WindowReader &reader, offset_t offset, offset_t limit, const MpegFrameHeader &reference,
+                           MpegFrameHeader &header) {
+            while (offset < limit) {
+                const char *data = reader.at(offset, std::min<offset_t>(4, reader.streamEnd() - offset));
+                if (!data) {
+                    return -1;
+                }
+                const offset_t length = std::min(reader.available(offset), limit + 1 - offset);
+                const char *sync = findFrameSync(data, data + length);
+                if (!sync) {
+                    // A sync may start at the last byte.
+                    offset += std::max<offset_t>(length - 1, 1);
+                    continue;
+                }
+                const offset_t candidate = offset + (sync - data);
+                if (isFrame(reader, candidate, reference, header)) {
+                    return candidate;
+                }
+                offset = candidate + 1;
+            }
+            return -1;
+        }
+
+        // Adds up the frames that lie entirely within [begin, limit), skipping junk between them.
+        Range walkFrames(WindowReader &reader, offset_t begin, offset_t limit, const MpegFrameHeader &reference) {
+            Range range;
+            MpegFrameHeader header{};
+            offset_t offset = findFrame(reader, begin, limit, reference, header);
+            while (offset >= 0 && offset + header.length <= limit) {
+                range.bytes += header.length;
+                range.samples += header.samples;
+                range.minBitrate = range.minBitrate ? std::min(range.minBitrate, header.bitrate) : header.bitrate;
+                range.maxBitrate = std::max(range.maxBitrate, header.bitrate);
+
+                offset += header.length;
+                const char *data = reader.at(offset, 4);
+                if (!data || !parseMpegFrameHeader(data, header) || !reference.isSameStream(header)) {
+                    offset = findFrame(reader, offset, limit, reference, header);
+                }
+            }
+            return range;
+        }
+
+        std::unique_ptr<StreamProperties> walkedProperties(File *file, offset_t begin, offset_t end,
+                                                           const MpegFrameHeader &reference, int channels) {
+            WindowReader reader(file, end, walkWindow);
+            const Range range = walkFrames(reader, begin, end, reference);
+            if (range.samples == 0) {
+                return nullptr;
+            }
+            const double lengthInMilliseconds = static_cast<double>(range.samples) * 1000.0 / reference.sampleRate;
+            return std::make_unique<StreamProperties>(
+                    static_cast<int>(lengthInMilliseconds + 0.5),
+                    static_cast<int>(static_cast<double>(range.bytes) * 8.0 / lengthInMilliseconds + 0.5),
+                    reference.sampleRate, channels, false);
+        }
+
+        std::unique_ptr<StreamProperties> sampledProperties(File *file, offset_t begin, offset_t end,
+                                                            const MpegFrameHeader &reference,
+                                                            const MpegFrameHeader &last, int channels) {
+            WindowReader reader(file, end, sampleWindow + maxFrameLength);
+            const auto sampleRange = [&](int i) {
+                // One range in each of sampleCount equal parts of the stream, at
+                // varying places within them so as not to follow a periodic pattern,
+                // but away from their ends, so that no range is at the very start or
+                // end of the stream, where encoders code silence at a low bitrate.
+                const double position = (i + 0.25 + 0.5 * std::fmod(i * 0.6180339887, 1.0)) / sampleCount;
+                const offset_t rangeBegin = begin + static_cast<offset_t>(static_cast<double>(end - begin) * position);
+                return walkFrames(reader, rangeBegin, std::min(end, rangeBegin + sampleWindow), reference);
+            };
+
+            // The ranges at the start and in the middle of the stream are read
+            // first: if their frames and the last one all have the same bitrate,
+            // the stream is taken as CBR without reading the other ranges.  Not at
+            // the lowest bitrate though, which VBR encoders code silence at, so
+            // that a VBR stream starting and ending with silence is sampled.
+            const int lowestBitrate = bitrates[reference.version == 1 ? 0 : 1][reference.layer - 1][1];
+            const auto isConstant = [&](const Range &range) {
+                return range.samples > 0 && range.minBitrate == range.maxBitrate && range.minBitrate == last.bitrate &&
+                       last.bitrate > lowestBitrate;
+            };
+            std::vector<Range> ranges;
+            const auto addRange = [&](int i) {
+                const Range range = sampleRange(i);
+                if (range.samples > 0) {
+                    ranges.push_back(range);
+                }
+                return range;
+            };
+            const bool middleRead = isConstant(addRange(0));
+            if (middleRead && isConstant(addRange(sampleCount / 2))) {
+                return nullptr;
+            }
+            for (int i = 1; i < sampleCount; i++) {
+                if (i != sampleCount / 2 || !middleRead) {
+                    addRange(i);
+                }
+            }
+            if (ranges.size() < 2) {
+                return nullptr;
+            }
+
+            // Constant bitrate streams are measured as well by TagLib.
+
+            offset_t bytes = 0;
+            long long samples = 0;
+            int minBitrate = ranges.front().minBitrate;
+            int maxBitrate = ranges.front().maxBitrate;
+            for (const Range &range: ranges) {
+                bytes += range.bytes;
+                samples += range.samples;
+                minBitrate = std::min(minBitrate, range.minBitrate);
+                maxBitrate = std::max(maxBitrate, range.maxBitrate);
+            }
+            if (minBitrate == maxBitrate) {
+                return nullptr;
+            }
+
+            // The ranges are taken as independent samples of the bytes per audio
+            // sample, whose mean has a standard error of their deviation / sqrt(n).
+
+            const double bytesPerSample = static_cast<double>(bytes) / static_cast<double>(samples);
+            double mean = 0;
+            for (const Range &range: ranges) {
+                mean += static_cast<double>(range.bytes) / static_cast<double>(range.samples);
+            }
+            mean /= static_cast<double>(ranges.size());
+            double variance = 0;
+            for (const Range &range: ranges) {
+                const double deviation = static_cast<double>(range.bytes) / static_cast<double>(range.samples) - mean;
+                variance += deviation * deviation;
+            }
+            variance /= static_cast<double>(ranges.size() - 1);
+            const double standardError = std::sqrt(variance / static_cast<double>(ranges.size()));
+            const double confidence = std::clamp(1.0 - 1.96 * standardError / mean, 0.0, 1.0);
+
+            const double lengthInMilliseconds = static_cast<double>(end - begin) / bytesPerSample * 1000.0 /
+                                                reference.sampleRate;
+            return std::make_unique<StreamProperties>(
+                    static_cast<int>(lengthInMilliseconds + 0.5),
+                    static_cast<int>(bytesPerSample * reference.sampleRate * 8.0 / 1000.0 + 0.5),
+                    reference.sampleRate, channels, true, confidence);
+        }
+    }
+
+    bool MpegFrameHeader::isSameStream(const MpegFrameHeader &other) const {
+        return version == other.version && layer == other.layer && sampleRate == other.sampleRate;
+    }
+
+    bool parseMpegFrameHeader(const char *data, MpegFrameHeader &header) {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+        if (bytes[0] != 0xFF || (bytes[1] & 0xE0) != 0xE0) {
+            return false;
+        }
+        const int versionBits = (bytes[1] >> 3) & 0x03;
+        const int layerBits = (bytes[1] >> 1) & 0x03;
+        const int bitrateIndex = bytes[2] >> 4;
+        const int sampleRateIndex = (bytes[2] >> 2) & 0x03;
+        if (versionBits == 1 || layerBits == 0 || sampleRateIndex == 3) {
+            return false;
+        }
+        header.version = versionBits == 3 ? 1 : versionBits == 2 ? 2 : 3;
+        header.layer = 4 - layerBits;
+        // Free format streams have no bitrate index to find the frame length with.
+        header.bitrate = bitrates[header.version == 1 ? 0 : 1][header.layer - 1][bitrateIndex];
+        if (header.bitrate == 0) {
+            return false;
+        }
+        header.sampleRate = sampleRates[header.version - 1][sampleRateIndex];
+        const int padding = (bytes[2] >> 1) & 0x01;
+        if (header.layer == 1) {
+            header.samples = 384;
+            header.length = (12 * header.bitrate * 1000 / header.sampleRate + padding) * 4;
+        } else {
+            header.samples = header.layer == 3 && header.version != 1 ? 576 : 1152;
+            header.length = header.samples / 8 * header.bitrate * 1000 / header.sampleRate + padding;
+        }
+        return true;
+    }
+
+    std::unique_ptr<StreamProperties> mpegStreamProperties(MPEG::File *file, AudioProperties::ReadStyle style) {
+        const MPEG::Properties *properties = file->audioProperties();
+        if (style == AudioProperties::Fast || !properties ||
+            (properties->xingHeader() && properties->xingHeader()->totalFrames() > 0)) {
+            return nullptr;
+        }
+
+        // The stream bounds TagLib computes the length of constant bitrate streams from.
+
+        const offset_t begin = file->firstFrameOffset();
+        const offset_t last = file->lastFrameOffset();
+        if (begin < 0 || last < begin) {
+            return nullptr;
+        }
+        file->seek(begin);
+        const ByteVector first = file->readBlock(4);
+        file->seek(last);
+        const ByteVector lastFrame = file->readBlock(4);
+        MpegFrameHeader reference{};
+        MpegFrameHeader lastHeader{};
+        if (first.size() < 4 || lastFrame.size() < 4 || !parseMpegFrameHeader(first.data(), reference) ||
+            !parseMpegFrameHeader(lastFrame.data(), lastHeader)) {
+            return nullptr;
+        }
+        const offset_t end = std::min(last + lastHeader.length, file->length());
+
+        if (style == AudioProperties::Accurate || end - begin <= 2 * sampleCount * sampleWindow) {
+            return walkedProperties(file, begin, end, reference, properties->channels());
+        }
+        return sampledProperties(file, begin, end, reference, lastHeader, properties->channels());
+    }
+
+} // namespace TagLibExt
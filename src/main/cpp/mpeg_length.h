@@ -0,0 +1,56 @@
+#ifndef TAGLIB_EXT_MPEG_LENGTH_H
+#define TAGLIB_EXT_MPEG_LENGTH_H
+
+#include <memory>
+
+#include "mpegfile.h"
+
+#include "stream_properties.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! The fields of an MPEG audio frame header that tell where the next frame starts.
+
+    struct MpegFrameHeader {
+        //! 1 for MPEG-1, 2 for MPEG-2, 3 for MPEG-2.5
+        int version;
+        int layer;
+        //! Bitrate in kbps
+        int bitrate;
+        int sampleRate;
+        //! Length of the frame, header included
+        int length;
+        int samples;
+
+        //! Whether \a other can be the next frame of the same stream.
+        [[nodiscard]] bool isSameStream(const MpegFrameHeader &other) const;
+    };
+
+    //! Parses the 4 byte frame header at \a data, returns \c false if it is not a valid one.
+    bool parseMpegFrameHeader(const char *data, MpegFrameHeader &header);
+
+    /*!
+     * Returns the properties of \a file, whose TagLib properties have been read,
+     * with a length found by walking its frames, or a null pointer if TagLib's
+     * are as good.  That is the case for files with a Xing or VBRI header, which
+     * has the number of frames, and for the Fast read style.
+     *
+     * With the Accurate read style every frame is visited, its sync found with
+     * findFrameSync() after junk.  With the Average style, 16 ranges of 8 KiB
+     * spread over the stream are read, none at its very start or end.  If the
+     * frames of the first and the middle range have the bitrate of the last
+     * frame, the file is taken as CBR and TagLib's length kept, which costs CBR
+     * files two reads.  Not at the lowest bitrate of the MPEG version though,
+     * which VBR encoders code silence at.  Otherwise, unless all the frames of the
+     * ranges have the same bitrate, the length is estimated from the average
+     * frame size and flagged, with a confidence taken from how much the frame
+     * sizes of the ranges vary.  Streams too short for sampling to pay off are
+     * walked in full.
+     */
+    std::unique_ptr<StreamProperties> mpegStreamProperties(MPEG::File *file, AudioProperties::ReadStyle style);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_MPEG_LENGTH_H
@@ -0,0 +1,180 @@
+#include "ogg_length.h"
+
+#include <algorithm>
+
+#include "scan.h"
+
+namespace TagLibExt {
+    namespace {
+        // Twice the largest possible page
+        constexpr offset_t searchWindow = 128 * 1024;
+        constexpr offset_t firstSearchLength = 8 * 1024;
+        // Read by each probe when the end has to be searched for past junk
+        constexpr offset_t probeLength = 64 * 1024;
+        constexpr unsigned int pageHeaderLength = 27;
+        constexpr unsigned int maxPageHeaderLength = pageHeaderLength + 255;
+
+        struct Page {
+            long long granule;
+            unsigned int serial;
+            //! Length of the page, header included
+            offset_t length;
+        };
+
+        // Parses the page header at data, which has to be complete in the available bytes.
+        bool parsePage(const ByteVector &data, unsigned int offset, Page &page) {
+            if (offset + pageHeaderLength > data.size() || !data.containsAt("OggS", offset) || data[offset + 4] != 0) {
+                return false;
+            }
+            const auto segments = static_cast<unsigned char>(data[offset + 26]);
+            if (offset + pageHeaderLength + segments > data.size()) {
+                return false;
+            }
+            page.granule = data.toLongLong(offset + 6, false);
+            page.serial = data.toUInt(offset + 14, false);
+            page.length = pageHeaderLength + segments;
+            for (unsigned int i = 0; i < segments; i++) {
+                page.length += static_cast<unsigned char>(data[offset + pageHeaderLength + i]);
+            }
+            return true;
+        }
+
+        ByteVector readAt(File *file, offset_t offset, size_t length) {
+            file->seek(offset);
+            return file->readBlock(length);
+        }
+
+        // The last granule position of the pages of serial within [begin, end), -1 if there is none.
+        long long findLastGranule(File *file, offset_t begin, offset_t end, unsigned int serial) {
+            const offset_t fileLength = file->length();
+            // Also read the header of a page starting right before end.
+            const ByteVector data = readAt(file, begin, static_cast<size_t>(
+                    std::min(fileLength, end + maxPageHeaderLength) - begin));
+            const char *searchEnd = data.data() + std::min<offset_t>(end - begin + 3, data.size());
+            while (const char *capture = findLastCapturePattern(data.data(), searchEnd)) {
+                const auto offset = static_cast<unsigned int>(capture - data.data());
+                Page page{};
+                if (parsePage(data, offset, page) && page.serial == serial && page.granule >= 0 &&
+                    begin + offset + page.length <= fileLength) {
+                    return page.granule;
+                }
+                searchEnd = capture + 3;
+            }
+            return -1;
+        }
+
+        // Finds the last page of serial starting before end, the pages after it being known to be
+        // junk.  Pages are at most 65307 bytes long, so any probeLength bytes of the stream hold the
+        // start of one: probes go backwards in doubling steps until one is in the stream, then
+        // bisect between it and the junk.
+        long long searchLastGranule(File *file, unsigned int serial, offset_t end) {
+            offset_t low = 0;
+            offset_t high = end;
+            for (offset_t step = searchWindow; high - step > 0; step *= 2) {
+                const offset_t probe = high - step;
+                if (findLastGranule(file, probe, probe + probeLength, serial) >= 0) {
+                    low = probe;
+                    break;
+                }
+                high = probe;
+            }
+            while (high - low > probeLength) {
+                const offset_t probe = low + (high - low) / 2;
+                if (findLastGranule(file, probe, probe + probeLength, serial) >= 0) {
+                    low = probe;
+                } else {
+                    high = probe;
+                }
+            }
+            return findLastGranule(file, low, high, serial);
+        }
+
+        // Length and bitrate as computed by TagLib from the granule positions, leaving out the header packets.
+        std::unique_ptr<StreamProperties> streamProperties(Ogg::File *file, const OggStreamEnd &end,
+                                                           long long frameCount, double sampleRate,
+                                                           unsigned int headerPackets, int sampleRateValue,
+                                                           int channels, int fallbackBitrate) {
+            int length = 0;
+            int bitrate = 0;
+            if (end.firstGranule >= 0 && end.lastGranule >= 0 && sampleRate > 0 && frameCount > 0) {
+                const double lengthInMilliseconds = static_cast<double>(frameCount) * 1000.0 / sampleRate;
+                offset_t streamLength = file->length();
+                for (unsigned int i = 0; i < headerPackets; i++) {
+                    streamLength -= file->packet(i).size();
+                }
+                length = static_cast<int>(lengthInMilliseconds + 0.5);
+                bitrate = static_cast<int>(static_cast<double>(streamLength) * 8.0 / lengthInMilliseconds + 0.5);
+            }
+            if (bitrate == 0) {
+                bitrate = fallbackBitrate;
+            }
+            return std::make_unique<StreamProperties>(length, bitrate, sampleRateValue, channels,
+                                                      end.estimated && length > 0);
+        }
+    }
+
+    bool findOggStreamEnd(File *file, bool exact, OggStreamEnd &end) {
+        const ByteVector head = readAt(file, 0, maxPageHeaderLength);
+        Page first{};
+        if (!parsePage(head, 0, first)) {
+            return false;
+        }
+        end.firstGranule = first.granule;
+
+        // The last page is usually short, so start small and double up to the window.
+        const offset_t fileLength = file->length();
+        offset_t windowEnd = fileLength;
+        offset_t windowLength = firstSearchLength;
+        do {
+            if (!exact) {
+                windowLength = std::min(windowLength, searchWindow - (fileLength - windowEnd));
+            }
+            const offset_t windowBegin = std::max<offset_t>(0, windowEnd - windowLength);
+            end.lastGranule = findLastGranule(file, windowBegin, windowEnd, first.serial);
+            if (end.lastGranule >= 0) {
+                return true;
+            }
+            windowEnd = windowBegin;
+            windowLength = std::min(windowLength * 2, searchWindow);
+        } while (windowEnd > 0 && (exact || fileLength - windowEnd < searchWindow));
+
+        if (!exact && windowEnd > 0) {
+            end.lastGranule = searchLastGranule(file, first.serial, windowEnd);
+            end.estimated = end.lastGranule >= 0;
+        }
+        return true;
+    }
+
+    std::unique_ptr<StreamProperties> oggStreamProperties(Ogg::Vorbis::File *file,
+                                                          AudioProperties::ReadStyle style) {
+        // The identification header: "\x01vorbis", version, channels, sample rate and bitrates.
+        const ByteVector data = file->packet(0);
+        OggStreamEnd end;
+        if (data.size() < 28 || !data.startsWith("\x01vorbis") ||
+            !findOggStreamEnd(file, style == AudioProperties::Accurate, end)) {
+            return std::make_unique<StreamProperties>(0, 0, 0, 0, false);
+        }
+        const int channels = static_cast<unsigned char>(data[11]);
+        const unsigned int sampleRate = data.toUInt(12U, false);
+        const unsigned int bitrateNominal = data.toUInt(20U, false);
+        return streamProperties(file, end, end.lastGranule - end.firstGranule, sampleRate, 3,
+                                static_cast<int>(sampleRate), channels,
+                                static_cast<int>(bitrateNominal / 1000.0 + 0.5));
+    }
+
+    std::unique_ptr<StreamProperties> oggStreamProperties(Ogg::Opus::File *file,
+                                                          AudioProperties::ReadStyle style) {
+        // The identification header: "OpusHead", version, channels, pre-skip and input sample rate.
+        const ByteVector data = file->packet(0);
+        OggStreamEnd end;
+        if (data.size() < 19 || !data.startsWith("OpusHead") ||
+            !findOggStreamEnd(file, style == AudioProperties::Accurate, end)) {
+            return std::make_unique<StreamProperties>(0, 0, 48000, 0, false);
+        }
+        const int channels = static_cast<unsigned char>(data[9]);
+        const unsigned short preSkip = data.toUShort(10U, false);
+        return streamProperties(file, end, end.lastGranule - end.firstGranule - preSkip, 48000.0, 2,
+                                48000, channels, 0);
+    }
+
+} // namespace TagLibExt
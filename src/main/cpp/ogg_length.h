@@ -0,0 +1,55 @@
+#ifndef TAGLIB_EXT_OGG_LENGTH_H
+#define TAGLIB_EXT_OGG_LENGTH_H
+
+#include <memory>
+
+#include "tfile.h"
+#include "opusfile.h"
+#include "vorbisfile.h"
+
+#include "stream_properties.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! The granule positions that bound an Ogg logical stream.
+
+    struct OggStreamEnd {
+        //! Absolute granule position of the first page
+        long long firstGranule{-1};
+        //! Absolute granule position of the last page, or an estimate of it, -1 if unknown
+        long long lastGranule{-1};
+        bool estimated{false};
+    };
+
+    /*!
+     * Finds the granule position of the last page of the Ogg stream in \a file,
+     * the one whose serial number is that of the first page, by scanning the
+     * last 128 KiB backwards for the capture pattern.  128 KiB hold any page in
+     * full, so only trailing junk can push the last page out of this window.
+     *
+     * If the last page is not within the window and \a exact is \c true, the search
+     * goes on towards the start of the file, like TagLib does.  Otherwise the last
+     * page before the junk is searched for with 64 KiB probes, going backwards in
+     * doubling steps and then bisecting, and the end is flagged as estimated, since
+     * pages after a run of junk longer than a probe would be missed.
+     *
+     * Returns \c false if \a file does not start with an Ogg page.
+     */
+    bool findOggStreamEnd(File *file, bool exact, OggStreamEnd &end);
+
+    /*!
+     * Returns the properties TagLib computes for \a file, with the length taken
+     * from findOggStreamEnd(), exact for the Accurate read style only.
+     */
+    std::unique_ptr<StreamProperties> oggStreamProperties(Ogg::Vorbis::File *file,
+                                                          AudioProperties::ReadStyle style);
+
+    //! \copydoc oggStreamProperties(Ogg::Vorbis::File *, AudioProperties::ReadStyle)
+    std::unique_ptr<StreamProperties> oggStreamProperties(Ogg::Opus::File *file,
+                                                          AudioProperties::ReadStyle style);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_OGG_LENGTH_H
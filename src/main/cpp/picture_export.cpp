@@ -0,0 +1,68 @@
+#include "picture_export.h"
+
+#include <algorithm>
+
+#include "fdio.h"
+#include "fileref_ext.h"
+#include "picture_locator.h"
+#include "tvariant.h"
+
+namespace TagLibExt {
+
+    bool exportPicture(FileName path, IOStream *stream, int fd, int outFd, const String &pictureType,
+                       ExportedPicture &exported, ParseStats *stats) {
+        // Copy the picture data straight from the file if it is stored as is
+        std::vector<PictureLocation> locations;
+        {
+            PhaseTimer timer(stats, Phase::Pictures);
+            if (!locatePictures(path, stream, fd, locations)) {
+                locations.clear();
+            }
+        }
+        if (!locations.empty()) {
+            auto location = std::find_if(locations.begin(), locations.end(), [&](const auto &l) {
+                return l.pictureType == pictureType;
+            });
+            if (location == locations.end()) {
+                location = locations.begin();
+            }
+
+            PhaseTimer timer(stats, Phase::Pictures);
+            if (!copyRange(fd, location->offset, static_cast<size_t>(location->length), outFd)) {
+                return false;
+            }
+            exported = {location->mimeType, location->pictureType, location->length};
+            return true;
+        }
+
+        // Otherwise decode the pictures and write the chosen one
+        const FileRef f(path, stream, false, AudioProperties::Average, stats, fd);
+        if (f.isNull()) {
+            return false;
+        }
+
+        List<VariantMap> pictureList;
+        {
+            PhaseTimer timer(stats, Phase::Pictures);
+            pictureList = f.complexProperties("PICTURE");
+        }
+        auto picture = std::find_if(pictureList.begin(), pictureList.end(), [&](const auto &p) {
+            return p["pictureType"].toString() == pictureType;
+        });
+        if (picture == pictureList.end()) {
+            picture = pictureList.begin();
+        }
+        if (picture == pictureList.end()) {
+            return false;
+        }
+
+        PhaseTimer timer(stats, Phase::Pictures);
+        const ByteVector data = (*picture)["data"].toByteVector();
+        if (data.isEmpty() || !writeFully(outFd, data.data(), data.size())) {
+            return false;
+        }
+        exported = {(*picture)["mimeType"].toString(), (*picture)["pictureType"].toString(), data.size()};
+        return true;
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,33 @@
+#ifndef TAGLIB_EXT_PICTURE_EXPORT_H
+#define TAGLIB_EXT_PICTURE_EXPORT_H
+
+#include "stats.h"
+#include "tiostream.h"
+#include "tstring.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! The picture written by exportPicture().
+
+    struct ExportedPicture {
+        String mimeType;
+        String pictureType;
+        offset_t size{0};
+    };
+
+    /*!
+     * Writes the data of the first picture of type \a pictureType, or of the first
+     * picture if there is none of that type, to the current offset of \a outFd.
+     * \a stream reads the file open as \a fd.  Pictures stored as is are copied from
+     * \a fd with copyRange(), others are decoded through a FileRef and written.
+     *
+     * Returns \c false if the file has no pictures or writing failed.
+     */
+    bool exportPicture(FileName path, IOStream *stream, int fd, int outFd, const String &pictureType,
+                       ExportedPicture &exported, ParseStats *stats = nullptr);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_PICTURE_EXPORT_H
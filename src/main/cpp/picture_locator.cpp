@@ -0,0 +1,288 @@
+#include "picture_locator.h"
+
+#include <algorithm>
+
+#include "flac_index.h"
+#include "mp4_index.h"
+
+namespace TagLibExt {
+    namespace {
+
+        // The names TagLib uses for the picture types of ID3v2 and FLAC
+        const char *const pictureTypeNames[] = {
+                "Other", "File Icon", "Other File Icon", "Front Cover", "Back Cover",
+                "Leaflet Page", "Media", "Lead Artist", "Artist", "Conductor", "Band",
+                "Composer", "Lyricist", "Recording Location", "During Recording",
+                "During Performance", "Movie Screen Capture", "Coloured Fish", "Illustration",
+                "Band Logo", "Publisher Logo"
+        };
+
+        // Limit of the picture headers read while looking for the start of the data
+        constexpr unsigned int maxPictureHeaderSize = 64 * 1024;
+
+        ByteVector readAt(IOStream *stream, offset_t offset, size_t length) {
+            stream->seek(offset);
+            return stream->readBlock(length);
+        }
+
+        unsigned int syncSafeInteger(const ByteVector &data, unsigned int offset) {
+            unsigned int value = 0;
+            for (unsigned int i = 0; i < 4; i++) {
+                value = (value << 7) | (static_cast<unsigned char>(data[offset + i]) & 0x7f);
+            }
+            return value;
+        }
+
+        // Total size of the ID3v2 tag starting with header, 0 if there is none
+        offset_t id3v2TagSize(const ByteVector &header) {
+            if (header.size() < 10 || !header.startsWith("ID3")) {
+                return 0;
+            }
+            const bool hasFooter = static_cast<unsigned char>(header[5]) & 0x10;
+            return 10 + static_cast<offset_t>(syncSafeInteger(header, 6)) + (hasFooter ? 10 : 0);
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // ID3v2
+        ////////////////////////////////////////////////////////////////////////////////
+
+        // Locates the picture data in an APIC frame body: encoding, MIME type, picture
+        // type and description precede it.
+        bool locateAttachedPicture(IOStream *stream, offset_t begin, offset_t end,
+                                   std::vector<PictureLocation> &pictures) {
+            const auto headerSize = static_cast<unsigned int>(
+                    std::min<offset_t>(end - begin, maxPictureHeaderSize));
+            const ByteVector header = readAt(stream, begin, headerSize);
+            if (header.size() < 4) {
+                return false;
+            }
+
+            const int mimeEnd = header.find(ByteVector('\0'), 1);
+            if (mimeEnd < 0 || static_cast<unsigned int>(mimeEnd) + 2 >= header.size()) {
+                return false;
+            }
+            const unsigned char encoding = header[0];
+            const auto descriptionBegin = static_cast<unsigned int>(mimeEnd) + 2;
+
+            // Latin1 and UTF-8 descriptions end with a single zero, UTF-16 ones with an aligned zero unit
+            int descriptionEnd;
+            unsigned int terminatorSize;
+            if (encoding == 1 || encoding == 2) {
+                descriptionEnd = -1;
+                for (unsigned int i = descriptionBegin; i + 1 < header.size(); i += 2) {
+                    if (header[i] == '\0' && header[i + 1] == '\0') {
+                        descriptionEnd = static_cast<int>(i);
+                        break;
+                    }
+                }
+                terminatorSize = 2;
+            } else {
+                descriptionEnd = header.find(ByteVector('\0'), descriptionBegin);
+                terminatorSize = 1;
+            }
+            if (descriptionEnd < 0) {
+                return false;
+            }
+
+            PictureLocation location;
+            location.offset = begin + descriptionEnd + terminatorSize;
+            location.length = end - location.offset;
+            location.mimeType = String(header.mid(1, mimeEnd - 1), String::Latin1);
+            location.pictureType = pictureTypeName(static_cast<unsigned char>(header[mimeEnd + 1]));
+            pictures.push_back(location);
+            return true;
+        }
+
+        bool locateId3v2(IOStream *stream, std::vector<PictureLocation> &pictures) {
+            const ByteVector header = readAt(stream, 0, 10);
+            const offset_t tagSize = id3v2TagSize(header);
+            const unsigned int version = tagSize > 0 ? static_cast<unsigned char>(header[3]) : 0;
+            const auto tagFlags = static_cast<unsigned char>(header[5]);
+
+            // Version 2.2 frames and unsynchronised tags are left to TagLib.
+            if ((version != 3 && version != 4) || (tagFlags & 0x80)) {
+                return false;
+            }
+
+            offset_t position = 10;
+            const offset_t end = 10 + static_cast<offset_t>(syncSafeInteger(header, 6));
+            if (tagFlags & 0x40) {
+                const ByteVector extendedHeader = readAt(stream, position, 4);
+                if (extendedHeader.size() < 4) {
+                    return false;
+                }
+                position += version == 4 ? syncSafeInteger(extendedHeader, 0) : 4 + extendedHeader.toUInt();
+            }
+
+            bool complete = true;
+            while (position + 10 <= end) {
+                const ByteVector frameHeader = readAt(stream, position, 10);
+                if (frameHeader.size() < 10 || frameHeader[0] == '\0') {
+                    break;
+                }
+                const unsigned int frameSize = version == 4 ? syncSafeInteger(frameHeader, 4)
+                                                            : frameHeader.toUInt(4U);
+                const auto frameFlags = static_cast<unsigned char>(frameHeader[9]);
+                offset_t frameBegin = position + 10;
+                const offset_t frameEnd = frameBegin + frameSize;
+                if (frameEnd > end) {
+                    break;
+                }
+
+                if (frameHeader.startsWith("APIC")) {
+                    bool contiguous;
+                    if (version == 4) {
+                        // Compressed, encrypted or unsynchronised
+                        contiguous = !(frameFlags & 0x0e);
+                        frameBegin += (frameFlags & 0x40 ? 1 : 0) + (frameFlags & 0x01 ? 4 : 0);
+                    } else {
+                        contiguous = !(frameFlags & 0xc0);
+                        frameBegin += frameFlags & 0x20 ? 1 : 0;
+                    }
+                    if (!contiguous || frameBegin >= frameEnd ||
+                        !locateAttachedPicture(stream, frameBegin, frameEnd, pictures)) {
+                        complete = false;
+                    }
+                }
+                position = frameEnd;
+            }
+            return complete;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // FLAC
+        ////////////////////////////////////////////////////////////////////////////////
+
+        bool locateFlacPicture(IOStream *stream, offset_t begin, offset_t end,
+                               std::vector<PictureLocation> &pictures) {
+            // Picture type and MIME type length, then MIME type and description length,
+            // then description, dimensions and data length.
+            const ByteVector typeAndMimeLength = readAt(stream, begin, 8);
+            if (typeAndMimeLength.size() < 8) {
+                return false;
+            }
+            const unsigned int mimeLength = typeAndMimeLength.toUInt(4U);
+            if (mimeLength > maxPictureHeaderSize || begin + 8 + mimeLength + 4 > end) {
+                return false;
+            }
+            const ByteVector mimeAndDescriptionLength = readAt(stream, begin + 8, mimeLength + 4);
+            const unsigned int descriptionLength = mimeAndDescriptionLength.toUInt(mimeLength);
+            const offset_t descriptionBegin = begin + 8 + mimeLength + 4;
+            if (descriptionLength > maxPictureHeaderSize || descriptionBegin + descriptionLength + 20 > end) {
+                return false;
+            }
+            const ByteVector dataLength = readAt(stream, descriptionBegin + descriptionLength + 16, 4);
+            if (dataLength.size() < 4) {
+                return false;
+            }
+
+            PictureLocation location;
+            location.offset = descriptionBegin + descriptionLength + 20;
+            location.length = dataLength.toUInt();
+            if (location.offset + location.length > end) {
+                return false;
+            }
+            location.mimeType = String(mimeAndDescriptionLength.mid(0, mimeLength), String::Latin1);
+            location.pictureType = pictureTypeName(typeAndMimeLength.toUInt());
+            pictures.push_back(location);
+            return true;
+        }
+
+        bool locateFlac(IOStream *stream, offset_t flacStart, std::vector<PictureLocation> &pictures) {
+            FlacBlockIndex index;
+            if (!index.build(stream, flacStart)) {
+                return false;
+            }
+            for (const auto &block: index.blocks()) {
+                if (block.type == FlacBlockIndex::Picture &&
+                    !locateFlacPicture(stream, block.offset, block.offset + block.length, pictures)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        // MP4
+        ////////////////////////////////////////////////////////////////////////////////
+
+        bool locateMp4(FileName path, IOStream *stream, int fd, std::vector<PictureLocation> &pictures) {
+            const std::shared_ptr<const Mp4AtomIndex> index = mp4AtomIndex(path, stream, fd);
+            if (!index) {
+                return false;
+            }
+            const Mp4Atom *covr = index->find("moov/udta/meta/ilst/covr");
+            if (!covr) {
+                return true;
+            }
+
+            for (const Mp4Atom *data: index->children(covr)) {
+                if (data->name != "data" || data->length < data->headerLength + 8) {
+                    continue;
+                }
+
+                // The type is the low 24 bits of the flags, the image follows the locale.
+                const offset_t flagsOffset = data->offset + data->headerLength;
+                ByteVector flags;
+                if (!index->cachedBytes(flagsOffset, 4, flags)) {
+                    flags = readAt(stream, flagsOffset, 4);
+                }
+                const unsigned int type = flags.size() == 4 ? flags.toUInt(1U, 3U) : ~0U;
+                const char *format = nullptr;
+                switch (type) {
+                    case 0:
+                        format = "";
+                        break;
+                    case 12:
+                        format = "gif";
+                        break;
+                    case 13:
+                        format = "jpeg";
+                        break;
+                    case 14:
+                        format = "png";
+                        break;
+                    case 27:
+                        format = "bmp";
+                        break;
+                    default:
+                        break;
+                }
+                if (format) {
+                    PictureLocation location;
+                    location.offset = flagsOffset + 8;
+                    location.length = data->offset + data->length - location.offset;
+                    location.mimeType = String("image/") + format;
+                    pictures.push_back(location);
+                }
+            }
+            return true;
+        }
+
+    }
+
+    String pictureTypeName(unsigned int type) {
+        return type < std::size(pictureTypeNames) ? pictureTypeNames[type] : "Other";
+    }
+
+    bool locatePictures(FileName path, IOStream *stream, int fd, std::vector<PictureLocation> &pictures) {
+        const ByteVector header = readAt(stream, 0, 12);
+        if (header.size() < 12) {
+            return false;
+        }
+        if (header.startsWith("fLaC")) {
+            return locateFlac(stream, 0, pictures);
+        }
+        if (header.containsAt("ftyp", 4)) {
+            return locateMp4(path, stream, fd, pictures);
+        }
+        if (const offset_t tagSize = id3v2TagSize(header); tagSize > 0) {
+            if (readAt(stream, tagSize, 4) == "fLaC") {
+                return locateFlac(stream, tagSize, pictures);
+            }
+            return locateId3v2(stream, pictures);
+        }
+        return false;
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,46 @@
+#ifndef TAGLIB_EXT_PICTURE_LOCATOR_H
+#define TAGLIB_EXT_PICTURE_LOCATOR_H
+
+#include <vector>
+
+#include "tiostream.h"
+#include "tstring.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! Where the data of an embedded picture is stored in a file.
+
+    struct PictureLocation {
+        //! Offset of the first byte of the picture data
+        offset_t offset{0};
+        //! Length of the picture data in bytes
+        offset_t length{0};
+        //! Values as reported by TagLib in the "mimeType" and "pictureType" of the PICTURE properties
+        String mimeType;
+        String pictureType;
+    };
+
+    //! Returns the name TagLib uses for the ID3v2 and FLAC picture \a type, e.g. "Front Cover".
+    String pictureTypeName(unsigned int type);
+
+    /*!
+     * Finds the pictures whose data is stored as plain, contiguous bytes in the
+     * file of \a stream, reading only the headers around them: PICTURE blocks of
+     * FLAC, covr items of MP4 and APIC frames of a leading ID3v2.3/2.4 tag.  The
+     * pictures are listed in the order of FileRef::complexProperties("PICTURE").
+     *
+     * Returns \c false if the format is not understood or if a picture is stored
+     * in a way that cannot be copied as is, e.g. an unsynchronised or compressed
+     * ID3v2 frame; \a pictures is incomplete then and the caller has to decode the
+     * pictures with TagLib instead.
+     *
+     * MP4 files are looked up in the atom index of the file open as \a fd, or at
+     * \a path if \a fd is -1, see mp4AtomIndex().
+     */
+    bool locatePictures(FileName path, IOStream *stream, int fd, std::vector<PictureLocation> &pictures);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_PICTURE_LOCATOR_H
@@ -0,0 +1,121 @@
+#include "property_keys.h"
+
+namespace TagLibExt {
+    namespace {
+        // Compares key with name like strcmp(), without converting key.
+        int compare(const String &key, const char *name) {
+            const unsigned int length = key.size();
+            for (unsigned int i = 0; i < length; i++) {
+                const auto c = static_cast<unsigned char>(name[i]);
+                if (c == '\0' || static_cast<unsigned int>(key[i]) > c) {
+                    return 1;
+                }
+                if (static_cast<unsigned int>(key[i]) < c) {
+                    return -1;
+                }
+            }
+            return name[length] == '\0' ? 0 : -1;
+        }
+    }
+
+    const PropertyKey standardPropertyKeys[StandardPropertyKeyCount] = {
+            {"ACOUSTID_FINGERPRINT",       false},
+            {"ACOUSTID_ID",                false},
+            {"ALBUM",                      true},
+            {"ALBUMARTIST",                true},
+            {"ALBUMARTISTS",               true},
+            {"ALBUMARTISTSORT",            true},
+            {"ALBUMSORT",                  true},
+            {"ARRANGER",                   false},
+            {"ARTIST",                     true},
+            {"ARTISTS",                    true},
+            {"ARTISTSORT",                 true},
+            {"ASIN",                       false},
+            {"BARCODE",                    true},
+            {"BPM",                        false},
+            {"CATALOGNUMBER",              true},
+            {"COMMENT",                    false},
+            {"COMPILATION",                true},
+            {"COMPOSER",                   true},
+            {"COMPOSERSORT",               true},
+            {"CONDUCTOR",                  true},
+            {"COPYRIGHT",                  true},
+            {"DATE",                       true},
+            {"DISCNUMBER",                 false},
+            {"DISCSUBTITLE",               false},
+            {"DISCTOTAL",                  true},
+            {"DJMIXER",                    false},
+            {"ENCODEDBY",                  true},
+            {"ENCODING",                   true},
+            {"ENGINEER",                   false},
+            {"GENRE",                      true},
+            {"GROUPING",                   false},
+            {"INITIALKEY",                 false},
+            {"ISRC",                       false},
+            {"LABEL",                      true},
+            {"LANGUAGE",                   true},
+            {"LYRICIST",                   true},
+            {"LYRICS",                     false},
+            {"MEDIA",                      true},
+            {"MIXER",                      false},
+            {"MOOD",                       true},
+            {"MOVEMENTCOUNT",              false},
+            {"MOVEMENTNAME",               false},
+            {"MOVEMENTNUMBER",             false},
+            {"MUSICBRAINZ_ALBUMARTISTID",  true},
+            {"MUSICBRAINZ_ALBUMID",        true},
+            {"MUSICBRAINZ_ARTISTID",       true},
+            {"MUSICBRAINZ_RELEASEGROUPID", true},
+            {"MUSICBRAINZ_RELEASETRACKID", false},
+            {"MUSICBRAINZ_TRACKID",        false},
+            {"MUSICBRAINZ_WORKID",         false},
+            {"MUSICIP_PUID",               false},
+            {"ORIGINALALBUM",              false},
+            {"ORIGINALARTIST",             false},
+            {"ORIGINALDATE",               true},
+            {"ORIGINALFILENAME",           false},
+            {"ORIGINALLYRICIST",           false},
+            {"PERFORMER",                  false},
+            {"PODCAST",                    false},
+            {"PODCASTCATEGORY",            false},
+            {"PODCASTDESC",                false},
+            {"PODCASTID",                  false},
+            {"PODCASTURL",                 false},
+            {"PRODUCER",                   false},
+            {"RELEASECOUNTRY",             true},
+            {"RELEASEDATE",                true},
+            {"RELEASESTATUS",              true},
+            {"RELEASETYPE",                true},
+            {"REMIXER",                    false},
+            {"REPLAYGAIN_ALBUM_GAIN",      true},
+            {"REPLAYGAIN_ALBUM_PEAK",      true},
+            {"REPLAYGAIN_TRACK_GAIN",      false},
+            {"REPLAYGAIN_TRACK_PEAK",      false},
+            {"SHOWWORKMOVEMENT",           false},
+            {"SUBTITLE",                   false},
+            {"TITLE",                      false},
+            {"TITLESORT",                  false},
+            {"TRACKNUMBER",                false},
+            {"TRACKTOTAL",                 true},
+            {"WORK",                       false},
+    };
+
+    int findStandardPropertyKey(const String &key) {
+        int low = 0;
+        int high = static_cast<int>(StandardPropertyKeyCount) - 1;
+        while (low <= high) {
+            const int middle = (low + high) / 2;
+            const int order = compare(key, standardPropertyKeys[middle].name);
+            if (order == 0) {
+                return middle;
+            }
+            if (order < 0) {
+                high = middle - 1;
+            } else {
+                low = middle + 1;
+            }
+        }
+        return -1;
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,30 @@
+#ifndef TAGLIB_EXT_PROPERTY_KEYS_H
+#define TAGLIB_EXT_PROPERTY_KEYS_H
+
+#include <cstddef>
+
+#include "tstring.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! A property key of TagLib's unified PropertyMap naming.
+
+    struct PropertyKey {
+        const char *name;
+        //! Whether the values are usually shared by many tracks, e.g. ALBUM or GENRE
+        bool sharedValues;
+    };
+
+    constexpr size_t StandardPropertyKeyCount = 79;
+
+    //! The standard property keys TagLib maps the tags of all formats to, sorted by name.
+    extern const PropertyKey standardPropertyKeys[StandardPropertyKeyCount];
+
+    //! Returns the index of \a key in standardPropertyKeys, -1 if it is not a standard key.
+    int findStandardPropertyKey(const String &key);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_PROPERTY_KEYS_H
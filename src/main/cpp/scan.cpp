@@ -0,0 +1,207 @@
+#include "scan.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_features.h"
+
+#if defined(TAGLIB_EXT_AVX2)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace TagLibExt {
+    namespace {
+        bool isCapturePattern(const char *p) {
+            return std::memcmp(p, "OggS", 4) == 0;
+        }
+
+        bool isFrameSync(const char *p) {
+            return static_cast<unsigned char>(p[0]) == 0xFF && (static_cast<unsigned char>(p[1]) & 0xE0) == 0xE0;
+        }
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+        // Packs the lanes of a comparison result, all bits set or clear, into a bit mask.
+        uint32_t movemask(uint8x16_t matches) {
+            static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+            matches = vandq_u8(matches, vld1q_u8(bits));
+            return vaddv_u8(vget_low_u8(matches)) | static_cast<uint32_t>(vaddv_u8(vget_high_u8(matches))) << 8;
+        }
+#endif
+
+        // Bit i of the result is set if block[i] is 'O'.
+        uint32_t matchBlockScalar(const char *block) {
+            uint32_t mask = 0;
+            for (int i = 0; i < 16; i++) {
+                mask |= static_cast<uint32_t>(block[i] == 'O') << i;
+            }
+            return mask;
+        }
+
+        // Bit i of the result is set if a frame sync starts at block[i]; reads 17 bytes.
+        uint32_t syncBlockScalar(const char *block) {
+            uint32_t mask = 0;
+            for (int i = 0; i < 16; i++) {
+                mask |= static_cast<uint32_t>(isFrameSync(block + i)) << i;
+            }
+            return mask;
+        }
+
+#if defined(TAGLIB_EXT_VECTOR128)
+        uint32_t matchBlock128(const char *block) {
+#if defined(__SSE2__)
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('O'))));
+#else
+            const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t *>(block));
+            return movemask(vceqq_u8(bytes, vdupq_n_u8('O')));
+#endif
+        }
+
+        uint32_t syncBlock128(const char *block) {
+#if defined(__SSE2__)
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+            const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 1));
+            const __m128i high = _mm_set1_epi8(static_cast<char>(0xE0));
+            const __m128i matches = _mm_and_si128(
+                    _mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(0xFF))),
+                    _mm_cmpeq_epi8(_mm_and_si128(next, high), high));
+            return static_cast<uint32_t>(_mm_movemask_epi8(matches));
+#else
+            const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t *>(block));
+            const uint8x16_t next = vld1q_u8(reinterpret_cast<const uint8_t *>(block + 1));
+            const uint8x16_t high = vdupq_n_u8(0xE0);
+            return movemask(vandq_u8(vceqq_u8(bytes, vdupq_n_u8(0xFF)), vceqq_u8(vandq_u8(next, high), high)));
+#endif
+        }
+#endif
+
+#if defined(TAGLIB_EXT_AVX2)
+        // Like the 16 byte blocks, 32 bytes at a time; syncBlockAvx2() reads 33 bytes.
+        TAGLIB_EXT_TARGET_AVX2 uint32_t matchBlockAvx2(const char *block) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+            return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('O'))));
+        }
+
+        TAGLIB_EXT_TARGET_AVX2 uint32_t syncBlockAvx2(const char *block) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+            const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 1));
+            const __m256i high = _mm256_set1_epi8(static_cast<char>(0xE0));
+            const __m256i matches = _mm256_and_si256(
+                    _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(static_cast<char>(0xFF))),
+                    _mm256_cmpeq_epi8(_mm256_and_si256(next, high), high));
+            return static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+        }
+#endif
+
+        // The scans are inlined into one function per kernel set, so that the blocks
+        // of the AVX2 set are compiled for AVX2 too.
+
+        template<int BlockSize, uint32_t (*matchBlock)(const char *)>
+        [[gnu::always_inline]] inline const char *findLastCapturePatternIn(const char *begin, const char *end) {
+            if (end - begin < 4) {
+                return nullptr;
+            }
+            // Candidates are the positions up to last; blocks are scanned downwards.
+            const char *last = end - 4;
+            const char *block = last + 1;
+            while (block - begin >= BlockSize) {
+                block -= BlockSize;
+                uint32_t mask = matchBlock(block);
+                while (mask) {
+                    const int bit = 31 - __builtin_clz(mask);
+                    const char *candidate = block + bit;
+                    if (isCapturePattern(candidate)) {
+                        return candidate;
+                    }
+                    mask &= ~(1U << bit);
+                }
+            }
+            for (const char *candidate = block - 1; candidate >= begin; candidate--) {
+                if (isCapturePattern(candidate)) {
+                    return candidate;
+                }
+            }
+            return nullptr;
+        }
+
+        template<int BlockSize, uint32_t (*syncBlock)(const char *)>
+        [[gnu::always_inline]] inline const char *findFrameSyncIn(const char *begin, const char *end) {
+            const char *block = begin;
+            while (end - block > BlockSize) {
+                if (const uint32_t mask = syncBlock(block)) {
+                    return block + __builtin_ctz(mask);
+                }
+                block += BlockSize;
+            }
+            for (const char *candidate = block; end - candidate >= 2; candidate++) {
+                if (isFrameSync(candidate)) {
+                    return candidate;
+                }
+            }
+            return nullptr;
+        }
+
+        const char *findLastCapturePatternScalar(const char *begin, const char *end) {
+            return findLastCapturePatternIn<16, matchBlockScalar>(begin, end);
+        }
+
+        const char *findFrameSyncScalar(const char *begin, const char *end) {
+            return findFrameSyncIn<16, syncBlockScalar>(begin, end);
+        }
+
+#if defined(TAGLIB_EXT_VECTOR128)
+        const char *findLastCapturePattern128(const char *begin, const char *end) {
+            return findLastCapturePatternIn<16, matchBlock128>(begin, end);
+        }
+
+        const char *findFrameSync128(const char *begin, const char *end) {
+            return findFrameSyncIn<16, syncBlock128>(begin, end);
+        }
+#endif
+
+#if defined(TAGLIB_EXT_AVX2)
+        TAGLIB_EXT_TARGET_AVX2 const char *findLastCapturePatternAvx2(const char *begin, const char *end) {
+            return findLastCapturePatternIn<32, matchBlockAvx2>(begin, end);
+        }
+
+        TAGLIB_EXT_TARGET_AVX2 const char *findFrameSyncAvx2(const char *begin, const char *end) {
+            return findFrameSyncIn<32, syncBlockAvx2>(begin, end);
+        }
+#endif
+    }
+
+    const char *findLastCapturePattern(const char *begin, const char *end) {
+        switch (kernelSet()) {
+#if defined(TAGLIB_EXT_AVX2)
+            case KernelSet::Avx2:
+                return findLastCapturePatternAvx2(begin, end);
+#endif
+#if defined(TAGLIB_EXT_VECTOR128)
+            case KernelSet::Vector128:
+                return findLastCapturePattern128(begin, end);
+#endif
+            default:
+                return findLastCapturePatternScalar(begin, end);
+        }
+    }
+
+    const char *findFrameSync(const char *begin, const char *end) {
+        switch (kernelSet()) {
+#if defined(TAGLIB_EXT_AVX2)
+            case KernelSet::Avx2:
+                return findFrameSyncAvx2(begin, end);
+#endif
+#if defined(TAGLIB_EXT_VECTOR128)
+            case KernelSet::Vector128:
+                return findFrameSync128(begin, end);
+#endif
+            default:
+                return findFrameSyncScalar(begin, end);
+        }
+    }
+
+} // namespace TagLibExt
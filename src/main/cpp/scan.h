@@ -0,0 +1,26 @@
+#ifndef TAGLIB_EXT_SCAN_H
+#define TAGLIB_EXT_SCAN_H
+
+#include <cstddef>
+
+namespace TagLibExt {
+
+    /*!
+     * Returns the last occurrence of the Ogg capture pattern "OggS" that lies
+     * entirely within [\a begin, \a end), or a null pointer.  The bytes are
+     * compared 16 at a time with SSE2 or AArch64 NEON, or 32 at a time with AVX2,
+     * depending on kernelSet().
+     */
+    const char *findLastCapturePattern(const char *begin, const char *end);
+
+    /*!
+     * Returns the first MPEG audio frame sync, 11 set bits starting on a byte
+     * boundary, that lies entirely within [\a begin, \a end), or a null pointer.
+     * The bytes are tested in blocks like in findLastCapturePattern(); the
+     * frame header following the sync is left to the caller to validate.
+     */
+    const char *findFrameSync(const char *begin, const char *end);
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_SCAN_H
@@ -0,0 +1,204 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+namespace TagLibExt {
+
+    namespace {
+        std::atomic<bool> collectionEnabled{false};
+
+        thread_local ParseStats lastStats;
+        thread_local bool hasLastStats = false;
+
+        std::mutex aggregateMutex;
+        std::vector<ParseStats> aggregate;
+
+        void addToAggregate(const ParseStats &stats) {
+            std::lock_guard<std::mutex> lock(aggregateMutex);
+            for (auto &entry: aggregate) {
+                if (std::strcmp(entry.format, stats.format) == 0) {
+                    entry += stats;
+                    return;
+                }
+            }
+            aggregate.push_back(stats);
+        }
+    }
+
+    ParseStats &ParseStats::operator+=(const ParseStats &other) {
+        calls += other.calls;
+        bytesRead += other.bytesRead;
+        bytesWritten += other.bytesWritten;
+        readCalls += other.readCalls;
+        writeCalls += other.writeCalls;
+        seekCalls += other.seekCalls;
+        detectionAttempts += other.detectionAttempts;
+        for (size_t i = 0; i < nanos.size(); i++) {
+            nanos[i] += other.nanos[i];
+        }
+        allocations += other.allocations;
+        allocatedBytes += other.allocatedBytes;
+        peakLiveBytes = std::max(peakLiveBytes, other.peakLiveBytes);
+        return *this;
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// CountingIOStream
+////////////////////////////////////////////////////////////////////////////////
+
+    CountingIOStream::CountingIOStream(IOStream *stream, ParseStats *stats) :
+            stream(stream), stats(stats) {
+    }
+
+    FileName CountingIOStream::name() const {
+        return stream->name();
+    }
+
+    ByteVector CountingIOStream::readBlock(size_t length) {
+        ByteVector data = stream->readBlock(length);
+        stats->readCalls++;
+        stats->bytesRead += data.size();
+        return data;
+    }
+
+    void CountingIOStream::writeBlock(const ByteVector &data) {
+        stats->writeCalls++;
+        stats->bytesWritten += data.size();
+        stream->writeBlock(data);
+    }
+
+    void CountingIOStream::insert(const ByteVector &data, offset_t start, size_t replace) {
+        stats->writeCalls++;
+        stats->bytesWritten += data.size();
+        stream->insert(data, start, replace);
+    }
+
+    void CountingIOStream::removeBlock(offset_t start, size_t length) {
+        stats->writeCalls++;
+        stream->removeBlock(start, length);
+    }
+
+    bool CountingIOStream::readOnly() const {
+        return stream->readOnly();
+    }
+
+    bool CountingIOStream::isOpen() const {
+        return stream->isOpen();
+    }
+
+    void CountingIOStream::seek(offset_t offset, Position p) {
+        stats->seekCalls++;
+        stream->seek(offset, p);
+    }
+
+    void CountingIOStream::clear() {
+        stream->clear();
+    }
+
+    offset_t CountingIOStream::tell() const {
+        return stream->tell();
+    }
+
+    offset_t CountingIOStream::length() {
+        return stream->length();
+    }
+
+    void CountingIOStream::truncate(offset_t length) {
+        stats->writeCalls++;
+        stream->truncate(length);
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// PhaseTimer
+////////////////////////////////////////////////////////////////////////////////
+
+    PhaseTimer::PhaseTimer(ParseStats *stats, Phase phase) :
+            stats(stats), phase(phase) {
+        if (stats) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    void PhaseTimer::setPhase(Phase value) {
+        phase = value;
+    }
+
+    PhaseTimer::~PhaseTimer() {
+        if (stats) {
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            stats->phaseNanos(phase) += static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+
+////////////////////////////////////////////////////////////////////////////////
+// StatsCollector
+////////////////////////////////////////////////////////////////////////////////
+
+    StatsCollector::StatsCollector() :
+            enabled(statsEnabled()) {
+        stats.calls = 1;
+        if (enabled) {
+            resetThreadPeakLiveBytes();
+            allocationsStart = threadAllocationCounters();
+        }
+    }
+
+    StatsCollector::~StatsCollector() {
+        if (!enabled) {
+            return;
+        }
+        counting.reset();
+        const AllocationCounters allocationsEnd = threadAllocationCounters();
+        stats.allocations = allocationsEnd.allocations - allocationsStart.allocations;
+        stats.allocatedBytes = allocationsEnd.bytes - allocationsStart.bytes;
+        stats.peakLiveBytes = static_cast<uint64_t>(
+                std::max<int64_t>(0, allocationsEnd.peakLiveBytes - allocationsStart.liveBytes));
+
+        lastStats = stats;
+        hasLastStats = true;
+        addToAggregate(stats);
+    }
+
+    ParseStats *StatsCollector::get() {
+        return enabled ? &stats : nullptr;
+    }
+
+    IOStream *StatsCollector::wrap(IOStream *stream) {
+        if (!enabled) {
+            return stream;
+        }
+        counting = std::make_unique<CountingIOStream>(stream, &stats);
+        return counting.get();
+    }
+
+    void setStatsEnabled(bool value) {
+        collectionEnabled.store(value, std::memory_order_relaxed);
+    }
+
+    bool statsEnabled() {
+        return collectionEnabled.load(std::memory_order_relaxed);
+    }
+
+    bool lastCallStats(ParseStats &stats) {
+        if (!hasLastStats) {
+            return false;
+        }
+        stats = lastStats;
+        return true;
+    }
+
+    std::vector<ParseStats> aggregatedStats() {
+        std::lock_guard<std::mutex> lock(aggregateMutex);
+        return aggregate;
+    }
+
+    void resetAggregatedStats() {
+        std::lock_guard<std::mutex> lock(aggregateMutex);
+        aggregate.clear();
+    }
+
+} // namespace TagLibExt
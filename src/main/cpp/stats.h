@@ -0,0 +1,166 @@
+#ifndef TAGLIB_EXT_STATS_H
+#define TAGLIB_EXT_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "allocstats.h"
+#include "tiostream.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    //! The phases of a native call that are timed separately.
+
+    enum class Phase {
+        //! Probing formats that turned out not to match the file
+        Detect,
+        //! Constructing the File of the detected format (tags and audio properties)
+        Parse,
+        //! Exporting the PropertyMap
+        Properties,
+        //! Exporting the complex PICTURE properties
+        Pictures,
+        //! Converting native values to and from JNI objects
+        Conversion,
+        //! Writing the file back
+        Save,
+        Count
+    };
+
+    //! I/O and timing counters of one native call, or of many calls aggregated.
+
+    struct ParseStats {
+        //! Number of calls folded into these counters
+        uint64_t calls{0};
+        uint64_t bytesRead{0};
+        uint64_t bytesWritten{0};
+        uint64_t readCalls{0};
+        uint64_t writeCalls{0};
+        uint64_t seekCalls{0};
+        //! Number of formats tried before one matched (or none did)
+        uint64_t detectionAttempts{0};
+        //! Name of the detected format, empty if no format matched
+        const char *format{""};
+        std::array<uint64_t, static_cast<size_t>(Phase::Count)> nanos{};
+        //! Heap allocations, only counted if allocationStatsAvailable()
+        uint64_t allocations{0};
+        uint64_t allocatedBytes{0};
+        //! Highest amount of live heap memory allocated by a call; the maximum when aggregated
+        uint64_t peakLiveBytes{0};
+
+        uint64_t &phaseNanos(Phase phase) {
+            return nanos[static_cast<size_t>(phase)];
+        }
+
+        [[nodiscard]] uint64_t phaseNanos(Phase phase) const {
+            return nanos[static_cast<size_t>(phase)];
+        }
+
+        ParseStats &operator+=(const ParseStats &other);
+    };
+
+    //! An IOStream that forwards to another stream and counts the I/O going through it.
+
+    class CountingIOStream : public IOStream {
+    public:
+        CountingIOStream(IOStream *stream, ParseStats *stats);
+
+        FileName name() const override;
+
+        ByteVector readBlock(size_t length) override;
+
+        void writeBlock(const ByteVector &data) override;
+
+        void insert(const ByteVector &data, offset_t start = 0, size_t replace = 0) override;
+
+        void removeBlock(offset_t start = 0, size_t length = 0) override;
+
+        bool readOnly() const override;
+
+        bool isOpen() const override;
+
+        void seek(offset_t offset, Position p = Beginning) override;
+
+        void clear() override;
+
+        offset_t tell() const override;
+
+        offset_t length() override;
+
+        void truncate(offset_t length) override;
+
+    private:
+        IOStream *stream;
+        ParseStats *stats;
+    };
+
+    //! Adds the time between construction and destruction to a phase of \a stats, if any.
+
+    class PhaseTimer {
+    public:
+        PhaseTimer(ParseStats *stats, Phase phase);
+
+        ~PhaseTimer();
+
+        PhaseTimer(const PhaseTimer &) = delete;
+
+        PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+        //! Accounts the elapsed time to \a phase instead of the phase given on construction.
+        void setPhase(Phase phase);
+
+    private:
+        ParseStats *stats;
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /*!
+     * Collects the stats of one native call.  When collection is disabled this
+     * is a no-op: get() returns a null pointer and wrap() returns the stream as is.
+     * On destruction the stats are published as the calling thread's last call
+     * stats and folded into the per-format aggregate.  The allocations made on the
+     * calling thread during the lifetime of the collector are counted, so it is the
+     * first object constructed in a call, before the arena scope and the file lock.
+     */
+    class StatsCollector {
+    public:
+        StatsCollector();
+
+        ~StatsCollector();
+
+        StatsCollector(const StatsCollector &) = delete;
+
+        StatsCollector &operator=(const StatsCollector &) = delete;
+
+        [[nodiscard]] ParseStats *get();
+
+        IOStream *wrap(IOStream *stream);
+
+    private:
+        bool enabled;
+        ParseStats stats;
+        AllocationCounters allocationsStart;
+        std::unique_ptr<CountingIOStream> counting;
+    };
+
+    void setStatsEnabled(bool enabled);
+
+    bool statsEnabled();
+
+    //! Returns the stats of the last call made on this thread, or \c false if there is none.
+    bool lastCallStats(ParseStats &stats);
+
+    //! Returns the aggregated stats, one entry per detected format.
+    std::vector<ParseStats> aggregatedStats();
+
+    void resetAggregatedStats();
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_STATS_H
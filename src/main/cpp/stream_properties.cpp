@@ -0,0 +1,38 @@
+#include "stream_properties.h"
+
+namespace TagLibExt {
+
+    StreamProperties::StreamProperties(int lengthInMilliseconds, int bitrate, int sampleRate, int channels,
+                                       bool lengthEstimated, double lengthConfidence) :
+            AudioProperties(Average),
+            length(lengthInMilliseconds), bitrateValue(bitrate), sampleRateValue(sampleRate),
+            channelsValue(channels), estimated(lengthEstimated), confidence(lengthConfidence) {
+    }
+
+    StreamProperties::~StreamProperties() = default;
+
+    int StreamProperties::lengthInMilliseconds() const {
+        return length;
+    }
+
+    int StreamProperties::bitrate() const {
+        return bitrateValue;
+    }
+
+    int StreamProperties::sampleRate() const {
+        return sampleRateValue;
+    }
+
+    int StreamProperties::channels() const {
+        return channelsValue;
+    }
+
+    bool StreamProperties::isLengthEstimated() const {
+        return estimated;
+    }
+
+    double StreamProperties::lengthConfidence() const {
+        return estimated ? confidence : 1.0;
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,66 @@
+#ifndef TAGLIB_EXT_STREAM_PROPERTIES_H
+#define TAGLIB_EXT_STREAM_PROPERTIES_H
+
+#include "audioproperties.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    /*!
+     * Audio properties computed by the extension layer in place of TagLib's, for
+     * formats where TagLib may read far into the file to find the length.  The
+     * length may then be an estimate, which is flagged, along with how reliable
+     * it is where that can be told.
+     */
+    class StreamProperties : public AudioProperties {
+    public:
+        StreamProperties(int lengthInMilliseconds, int bitrate, int sampleRate, int channels, bool lengthEstimated,
+                         double lengthConfidence = 0.0);
+
+        ~StreamProperties() override;
+
+        int lengthInMilliseconds() const override;
+
+        int bitrate() const override;
+
+        int sampleRate() const override;
+
+        int channels() const override;
+
+        //! Whether the length was estimated instead of computed from the end of the stream.
+        [[nodiscard]] bool isLengthEstimated() const;
+
+        /*!
+         * How reliable the length is, from 0 to 1: 1 if it is exact, and for an
+         * estimate, 1 minus the relative error it has with 95% probability, or 0
+         * if that is not known.
+         */
+        [[nodiscard]] double lengthConfidence() const;
+
+    private:
+        int length;
+        int bitrateValue;
+        int sampleRateValue;
+        int channelsValue;
+        bool estimated;
+        double confidence;
+    };
+
+    /*!
+     * Implemented by the File subclasses that compute their StreamProperties in
+     * place of TagLib's.  They cannot return them from audioProperties(), whose
+     * return type is the properties class of the format, so FileRef asks for them
+     * through this interface instead.
+     */
+    class StreamPropertiesSource {
+    public:
+        virtual ~StreamPropertiesSource() = default;
+
+        //! The properties computed for the file, or a null pointer if TagLib's are used.
+        [[nodiscard]] virtual StreamProperties *streamProperties() const = 0;
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_STREAM_PROPERTIES_H
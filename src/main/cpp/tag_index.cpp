@@ -0,0 +1,330 @@
+#include "tag_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cwctype>
+
+namespace TagLibExt {
+    namespace {
+
+        std::string fold(const String &str) {
+            std::wstring lower;
+            lower.reserve(str.size());
+            for (const wchar_t c: str) {
+                lower.push_back(static_cast<wchar_t>(std::towlower(static_cast<wint_t>(c))));
+            }
+            return String(lower).to8Bit(true);
+        }
+
+        // Bytes of multibyte UTF-8 sequences count as letters
+        bool isWordByte(char c) {
+            const auto b = static_cast<unsigned char>(c);
+            return b >= 0x80 || std::isalnum(b);
+        }
+
+        uint32_t trigram(const char *p) {
+            return static_cast<uint32_t>(static_cast<unsigned char>(p[0])) << 16 |
+                   static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 8 |
+                   static_cast<uint32_t>(static_cast<unsigned char>(p[2]));
+        }
+
+        // Heap bytes of a string, beyond the small string buffer
+        size_t heapBytes(const std::string &str) {
+            return str.size() < 16 ? 0 : str.capacity() + 1;
+        }
+
+        // Rough size of an unordered_map node and bucket holding an entry of type T
+        template<class T>
+        size_t hashEntryBytes() {
+            return sizeof(T) + 2 * sizeof(void *) + sizeof(size_t);
+        }
+
+    } // namespace
+
+    TagIndex::TagIndex(const StringList &fields) {
+        for (const String &field: fields) {
+            columns.emplace_back();
+            columns.back().name = field;
+        }
+    }
+
+    int TagIndex::fieldIndex(const String &field) const {
+        for (size_t i = 0; i < columns.size(); i++) {
+            if (columns[i].name == field) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    uint32_t TagIndex::add(const PropertyMap &properties) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Column &column: columns) {
+            const auto values = properties.find(column.name);
+            if (values != properties.end() && !values->second.isEmpty()) {
+                const uint32_t code = encode(column, values->second.front());
+                column.codes.push_back(code);
+                column.previousRows.push_back(column.lastRows[code]);
+                column.lastRows[code] = rows;
+            } else {
+                column.codes.push_back(NoRow);
+                column.previousRows.push_back(NoRow);
+            }
+        }
+        return rows++;
+    }
+
+    bool TagIndex::remove(uint32_t row) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (row >= rows) {
+            return false;
+        }
+        // The row stays in the chain of its code, where the code no longer matches
+        for (Column &column: columns) {
+            column.codes[row] = NoRow;
+        }
+        return true;
+    }
+
+    size_t TagIndex::rowCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return rows;
+    }
+
+    size_t TagIndex::memoryUsage() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = sizeof(TagIndex);
+        for (const Column &column: columns) {
+            bytes += sizeof(Column) + column.valueBytes +
+                     (column.codes.capacity() + column.previousRows.capacity() + column.lastRows.capacity()) *
+                     sizeof(uint32_t) +
+                     column.codeOf.size() * hashEntryBytes<std::pair<std::string_view, uint32_t>>() +
+                     column.words.capacity() * sizeof(WordStart) +
+                     column.trigrams.size() * hashEntryBytes<std::pair<uint32_t, std::vector<uint32_t>>>();
+            for (const auto &codes: column.trigrams) {
+                bytes += codes.second.capacity() * sizeof(uint32_t);
+            }
+        }
+        return bytes;
+    }
+
+    std::vector<uint32_t> TagIndex::prefixSearch(int field, const String &prefix, size_t limit) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (field < 0 || static_cast<size_t>(field) >= columns.size()) {
+            return {};
+        }
+        const Column &column = columns[field];
+        return rowsWithCodes(column, prefixCodes(column, fold(prefix)), limit);
+    }
+
+    std::vector<uint32_t> TagIndex::search(int field, const String &text, size_t limit) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (field < 0 || static_cast<size_t>(field) >= columns.size()) {
+            return {};
+        }
+        const Column &column = columns[field];
+        return rowsWithCodes(column, substringCodes(column, fold(text)), limit);
+    }
+
+    std::vector<uint32_t> TagIndex::groups(int field, int withinField, uint32_t withinRow) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (field < 0 || static_cast<size_t>(field) >= columns.size()) {
+            return {};
+        }
+        const Column &column = columns[field];
+        const bool within = withinField >= 0;
+        uint32_t withinCode = NoRow;
+        if (within) {
+            if (static_cast<size_t>(withinField) >= columns.size() || withinRow >= rows) {
+                return {};
+            }
+            withinCode = columns[withinField].codes[withinRow];
+            if (withinCode == NoRow) {
+                return {};
+            }
+        }
+
+        // The first row of each value stands for its group
+        std::vector<uint32_t> firstRows(column.values.size(), NoRow);
+        std::vector<uint32_t> codes;
+        const auto addRow = [&](uint32_t row) {
+            const uint32_t code = column.codes[row];
+            if (code != NoRow) {
+                if (firstRows[code] == NoRow) {
+                    codes.push_back(code);
+                }
+                firstRows[code] = std::min(firstRows[code], row);
+            }
+        };
+        if (within) {
+            for (const uint32_t row: rowsWithCodes(columns[withinField], {withinCode}, SIZE_MAX)) {
+                addRow(row);
+            }
+        } else {
+            for (uint32_t row = 0; row < rows; row++) {
+                addRow(row);
+            }
+        }
+        std::sort(codes.begin(), codes.end(), [&](uint32_t a, uint32_t b) {
+            const int order = column.folded[a].compare(column.folded[b]);
+            return order != 0 ? order < 0 : column.values[a] < column.values[b];
+        });
+        for (uint32_t &code: codes) {
+            code = firstRows[code];
+        }
+        return codes;
+    }
+
+    std::vector<uint32_t> TagIndex::groupRows(int field, uint32_t row) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (field < 0 || static_cast<size_t>(field) >= columns.size() || row >= rows) {
+            return {};
+        }
+        const Column &column = columns[field];
+        const uint32_t code = column.codes[row];
+        if (code == NoRow) {
+            return {};
+        }
+        return rowsWithCodes(column, {code}, SIZE_MAX);
+    }
+
+    bool TagIndex::value(int field, uint32_t row, std::string &value) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (field < 0 || static_cast<size_t>(field) >= columns.size() || row >= rows) {
+            return false;
+        }
+        const Column &column = columns[field];
+        const uint32_t code = column.codes[row];
+        if (code == NoRow) {
+            return false;
+        }
+        value = column.values[code];
+        return true;
+    }
+
+    uint32_t TagIndex::encode(Column &column, const String &value) {
+        const std::string utf8 = value.to8Bit(true);
+        if (const auto code = column.codeOf.find(utf8); code != column.codeOf.end()) {
+            return code->second;
+        }
+
+        const auto code = static_cast<uint32_t>(column.values.size());
+        column.lastRows.push_back(NoRow);
+        column.values.push_back(utf8);
+        column.folded.push_back(fold(value));
+        column.codeOf.emplace(column.values.back(), code);
+        const std::string &folded = column.folded.back();
+        column.valueBytes += 2 * sizeof(std::string) + heapBytes(column.values.back()) + heapBytes(folded);
+
+        for (size_t i = 0; i < folded.size(); i++) {
+            if (isWordByte(folded[i]) && (i == 0 || !isWordByte(folded[i - 1]))) {
+                column.words.push_back({code, static_cast<uint32_t>(i)});
+            }
+        }
+        for (size_t i = 0; i + 3 <= folded.size(); i++) {
+            std::vector<uint32_t> &codes = column.trigrams[trigram(folded.data() + i)];
+            if (codes.empty() || codes.back() != code) {
+                codes.push_back(code);
+            }
+        }
+        return code;
+    }
+
+    void TagIndex::sortWords(const Column &column) {
+        if (column.sortedWords == column.words.size()) {
+            return;
+        }
+        // Words are added unsorted and merged into the sorted ones on the next query
+        const auto less = [&](const WordStart &a, const WordStart &b) {
+            return std::string_view(column.folded[a.code]).substr(a.offset) <
+                   std::string_view(column.folded[b.code]).substr(b.offset);
+        };
+        const auto sortedEnd = column.words.begin() + static_cast<std::ptrdiff_t>(column.sortedWords);
+        std::sort(sortedEnd, column.words.end(), less);
+        std::inplace_merge(column.words.begin(), sortedEnd, column.words.end(), less);
+        column.sortedWords = column.words.size();
+    }
+
+    std::vector<uint32_t> TagIndex::prefixCodes(const Column &column, const std::string &prefix) {
+        sortWords(column);
+        std::vector<uint32_t> codes;
+        std::vector<bool> listed(column.values.size());
+        auto word = std::lower_bound(column.words.begin(), column.words.end(), prefix,
+                                     [&](const WordStart &w, const std::string &p) {
+                                         return std::string_view(column.folded[w.code]).substr(w.offset) < p;
+                                     });
+        for (; word != column.words.end(); ++word) {
+            if (std::string_view(column.folded[word->code]).substr(word->offset, prefix.size()) != prefix) {
+                break;
+            }
+            // A value with several words starting with the prefix is listed once
+            if (!listed[word->code]) {
+                listed[word->code] = true;
+                codes.push_back(word->code);
+            }
+        }
+        return codes;
+    }
+
+    std::vector<uint32_t> TagIndex::substringCodes(const Column &column, const std::string &text) {
+        if (text.size() < 3) {
+            return prefixCodes(column, text);
+        }
+
+        // The values containing the rarest trigram of the text are the candidates
+        const std::vector<uint32_t> *candidates = nullptr;
+        for (size_t i = 0; i + 3 <= text.size(); i++) {
+            const auto codes = column.trigrams.find(trigram(text.data() + i));
+            if (codes == column.trigrams.end()) {
+                return {};
+            }
+            if (!candidates || codes->second.size() < candidates->size()) {
+                candidates = &codes->second;
+            }
+        }
+        std::vector<uint32_t> codes;
+        for (const uint32_t code: *candidates) {
+            if (column.folded[code].find(text) != std::string::npos) {
+                codes.push_back(code);
+            }
+        }
+        return codes;
+    }
+
+    std::vector<uint32_t> TagIndex::rowsWithCodes(const Column &column, const std::vector<uint32_t> &codes,
+                                                  size_t limit) {
+        std::vector<uint32_t> rows;
+        if (codes.empty() || limit == 0) {
+            return rows;
+        }
+
+        // Few values are followed through their chains, many are matched in one pass over the column
+        if (codes.size() < column.codes.size() / 64) {
+            for (const uint32_t code: codes) {
+                for (uint32_t row = column.lastRows[code]; row != NoRow; row = column.previousRows[row]) {
+                    if (column.codes[row] == code) {
+                        rows.push_back(row);
+                    }
+                }
+            }
+            std::sort(rows.begin(), rows.end());
+            if (rows.size() > limit) {
+                rows.resize(limit);
+            }
+            return rows;
+        }
+
+        std::vector<bool> matches(column.values.size());
+        for (const uint32_t code: codes) {
+            matches[code] = true;
+        }
+        for (uint32_t row = 0; row < column.codes.size() && rows.size() < limit; row++) {
+            const uint32_t code = column.codes[row];
+            if (code != NoRow && matches[code]) {
+                rows.push_back(row);
+            }
+        }
+        return rows;
+    }
+
+} // namespace TagLibExt
@@ -0,0 +1,121 @@
+#ifndef TAGLIB_EXT_TAG_INDEX_H
+#define TAGLIB_EXT_TAG_INDEX_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "tpropertymap.h"
+
+using namespace TagLib;
+
+namespace TagLibExt {
+
+    /*!
+     * An in-memory index of selected properties of the tracks of a library, for
+     * browsing and search as you type without holding the tags in Java objects.
+     *
+     * Each field is a column of 32-bit codes, one per row, into a dictionary of
+     * the distinct values of the field, so that an artist is stored once however
+     * many tracks it has.  Only the first value of a property is indexed.  Values
+     * are matched case insensitively: prefix searches look up the starts of the
+     * words of a value in a sorted word index, and substring searches narrow the
+     * values down by their trigrams.  The rows of a value are chained, so that
+     * queries matching few values do not scan the columns.  Queries return row
+     * ids, in row order for searches and in value order for groups.
+     *
+     * All methods are thread safe.
+     */
+
+    class TagIndex {
+    public:
+        static constexpr uint32_t NoRow = UINT32_MAX;
+
+        //! Creates an index of the properties named \a fields, e.g. "ARTIST", "ALBUM" and "TITLE".
+        explicit TagIndex(const StringList &fields);
+
+        //! Returns the position of \a field among the fields of the index, or -1.
+        int fieldIndex(const String &field) const;
+
+        //! Adds a row with the values of the indexed fields in \a properties and returns its id.
+        uint32_t add(const PropertyMap &properties);
+
+        //! Clears the values of \a row, which is not returned by queries anymore.
+        bool remove(uint32_t row);
+
+        //! Returns the number of rows added, including the removed ones.
+        size_t rowCount() const;
+
+        //! Returns an estimate of the number of bytes used by the index.
+        size_t memoryUsage() const;
+
+        //! Returns up to \a limit rows with a word of \a field starting with \a prefix.
+        std::vector<uint32_t> prefixSearch(int field, const String &prefix, size_t limit = SIZE_MAX) const;
+
+        /*!
+         * Returns up to \a limit rows whose \a field contains \a text, or with a word
+         * starting with \a text if it is shorter than a trigram.
+         */
+        std::vector<uint32_t> search(int field, const String &text, size_t limit = SIZE_MAX) const;
+
+        /*!
+         * Returns one row per distinct value of \a field, ordered by value, e.g. the
+         * albums of the library.  If \a withinField is not -1 only the rows sharing
+         * its value with \a withinRow are grouped, e.g. the albums of an artist.
+         */
+        std::vector<uint32_t> groups(int field, int withinField = -1, uint32_t withinRow = NoRow) const;
+
+        //! Returns the rows with the same value of \a field as \a row, e.g. the tracks of an album.
+        std::vector<uint32_t> groupRows(int field, uint32_t row) const;
+
+        //! Sets \a value to the value of \a field in \a row, as UTF-8.  Returns \c false if there is none.
+        bool value(int field, uint32_t row, std::string &value) const;
+
+    private:
+        struct WordStart {
+            uint32_t code;
+            uint32_t offset;
+        };
+
+        struct Column {
+            String name;
+            //! Dictionary code of the value of each row, NoRow if there is none
+            std::vector<uint32_t> codes;
+            //! The rows of each code as a chain from its last row to its first, for queries with few matches
+            std::vector<uint32_t> lastRows;
+            std::vector<uint32_t> previousRows;
+            //! Distinct values as UTF-8, and case folded, by code; deques keep them in place for codeOf
+            std::deque<std::string> values;
+            std::deque<std::string> folded;
+            std::unordered_map<std::string_view, uint32_t> codeOf;
+            //! Word starts of the folded values, sorted up to sortedWords
+            mutable std::vector<WordStart> words;
+            mutable size_t sortedWords{0};
+            //! Codes of the values containing each trigram, in ascending order
+            std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+            size_t valueBytes{0};
+        };
+
+        static uint32_t encode(Column &column, const String &value);
+
+        static void sortWords(const Column &column);
+
+        static std::vector<uint32_t> prefixCodes(const Column &column, const std::string &prefix);
+
+        static std::vector<uint32_t> substringCodes(const Column &column, const std::string &text);
+
+        static std::vector<uint32_t> rowsWithCodes(const Column &column, const std::vector<uint32_t> &codes,
+                                                   size_t limit);
+
+        mutable std::mutex mutex;
+        std::vector<Column> columns;
+        uint32_t rows{0};
+    };
+
+} // namespace TagLibExt
+
+#endif //TAGLIB_EXT_TAG_INDEX_H
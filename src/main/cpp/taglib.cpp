@@ -9,21 +9,22 @@ Java_com_kyant_taglib_TagLib_getAudioProperties(
         jint fd,
         jint read_style
 ) {
-    char *path = getRealPathFromFd(fd);
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
     if (path == nullptr) {
         return nullptr;
     }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Read);
     const auto stream = std::make_unique<TagLib::FileStream>(fd, true);
     const auto style = static_cast<TagLib::AudioProperties::ReadStyle>(read_style);
-    const TagLibExt::FileRef f(path, stream.get(), true, style);
+    const TagLibExt::FileRef f(path, stats.wrap(stream.get()), true, style, stats.get(), fd);
 
     if (f.isNull()) {
-        free(path);
         return nullptr;
     }
 
-    jobject audioProperties = getAudioProperties(env, f);
-    free(path);
+    jobject audioProperties = getAudioProperties(env, f, stats.get());
     return audioProperties;
 }
 
@@ -34,22 +35,25 @@ Java_com_kyant_taglib_TagLib_getMetadata(
         jint fd,
         jboolean read_pictures
 ) {
-    char *path = getRealPathFromFd(fd);
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
     if (path == nullptr) {
         return nullptr;
     }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Read);
     const auto stream = std::make_unique<TagLib::FileStream>(fd, true);
-    const TagLibExt::FileRef f(path, stream.get(), false);
+    const TagLibExt::FileRef f(path, stats.wrap(stream.get()), false, TagLib::AudioProperties::Average,
+                               stats.get(), fd);
 
     if (f.isNull()) {
-        free(path);
         return nullptr;
     }
 
-    jobject propertiesMap = getPropertyMap(env, f);
+    jobject propertiesMap = getPropertyMap(env, f, stats.get());
     jobjectArray pictures;
     if (read_pictures) {
-        pictures = getPictures(env, f);
+        pictures = getPictures(env, f, stats.get());
     } else {
         pictures = emptyPictureArray(env);
     }
@@ -58,7 +62,6 @@ Java_com_kyant_taglib_TagLib_getMetadata(
             metadataClass, metadataConstructor,
             propertiesMap, pictures
     );
-    free(path);
     return metadata;
 }
 
@@ -69,45 +72,37 @@ Java_com_kyant_taglib_TagLib_getMetadataPropertyValues(
         jint fd,
         jstring property_name
 ) {
-    const char *propertyName = env->GetStringUTFChars(property_name, nullptr);
-    if (propertyName == nullptr) {
-        return nullptr;
-    }
-
-    char *path = getRealPathFromFd(fd);
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
     if (path == nullptr) {
-        env->ReleaseStringUTFChars(property_name, propertyName);
         return nullptr;
     }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Read);
     const auto stream = std::make_unique<TagLib::FileStream>(fd, true);
-    const TagLibExt::FileRef f(path, stream.get(), false);
+    const TagLibExt::FileRef f(path, stats.wrap(stream.get()), false, TagLib::AudioProperties::Average,
+                               stats.get(), fd);
 
     if (f.isNull()) {
-        free(path);
         return nullptr;
     }
 
-    const auto propertyMap = f.properties();
-    const auto valueList = propertyMap.find(TagLib::String(propertyName));
+    const String propertyName = JniStringToString(env, property_name);
+    PropertyMap propertyMap;
+    {
+        TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Properties);
+        TagLibExt::PropertyKeyScope key(propertyName);
+        propertyMap = f.properties();
+    }
+    TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Conversion);
+    const auto valueList = propertyMap.find(propertyName);
     if (valueList == propertyMap.end()) {
-        env->ReleaseStringUTFChars(property_name, propertyName);
-        free(path);
         return env->NewObjectArray(0, stringClass, nullptr);
     }
 
-    jobjectArray result = env->NewObjectArray(static_cast<jsize>(valueList->second.size()),
-                                              stringClass, nullptr);
-    int i = 0;
-    for (const auto &value: valueList->second) {
-        jstring jValue = env->NewStringUTF(value.toCString(true));
-        env->SetObjectArrayElement(result, i, jValue);
-        env->DeleteLocalRef(jValue);
-        i++;
-    }
-
-    env->ReleaseStringUTFChars(property_name, propertyName);
-    free(path);
-    return result;
+    const int keyIndex = TagLibExt::findStandardPropertyKey(propertyName);
+    return StringListToJniStringArray(env, valueList->second,
+                                      keyIndex >= 0 && TagLibExt::standardPropertyKeys[keyIndex].sharedValues);
 }
 
 JNIEXPORT jobjectArray JNICALL
@@ -116,23 +111,77 @@ Java_com_kyant_taglib_TagLib_getPictures(
         jclass,
         jint fd
 ) {
-    char *path = getRealPathFromFd(fd);
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
     if (path == nullptr) {
         return nullptr;
     }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Read);
     const auto stream = std::make_unique<TagLib::FileStream>(fd, true);
-    const TagLibExt::FileRef f(path, stream.get(), false);
+    const TagLibExt::FileRef f(path, stats.wrap(stream.get()), false, TagLib::AudioProperties::Average,
+                               stats.get(), fd);
 
     if (f.isNull()) {
-        free(path);
         return emptyPictureArray(env);
     }
 
-    jobjectArray pictures = getPictures(env, f);
-    free(path);
+    jobjectArray pictures = getPictures(env, f, stats.get());
     return pictures;
 }
 
+JNIEXPORT jobject JNICALL
+Java_com_kyant_taglib_TagLib_exportPicture(
+        JNIEnv *env,
+        jclass,
+        jint fd,
+        jint output_fd,
+        jstring picture_type
+) {
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
+    if (path == nullptr) {
+        return nullptr;
+    }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Read);
+    const auto stream = std::make_unique<TagLib::FileStream>(fd, true);
+    const TagLib::String pictureType = JniStringToString(env, picture_type);
+
+    TagLibExt::ExportedPicture exported;
+    if (!TagLibExt::exportPicture(path, stats.wrap(stream.get()), fd, output_fd, pictureType, exported,
+                                  stats.get())) {
+        return nullptr;
+    }
+    return newJniExportedPicture(env, exported);
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_kyant_taglib_TagLib_getAudioHash(
+        JNIEnv *env,
+        jclass,
+        jint fd,
+        jint threads
+) {
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
+    if (path == nullptr) {
+        return nullptr;
+    }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Read);
+    const auto stream = std::make_unique<TagLib::FileStream>(fd, true);
+
+    uint64_t hash;
+    const auto threadCount = static_cast<unsigned int>(threads > 0 ? threads : 0);
+    if (!TagLibExt::audioHash(path, stats.wrap(stream.get()), fd, threadCount, hash, stats.get())) {
+        return nullptr;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    return env->NewStringUTF(hex);
+}
+
 JNIEXPORT jboolean JNICALL
 Java_com_kyant_taglib_TagLib_savePropertyMap(
         JNIEnv *env,
@@ -140,22 +189,29 @@ Java_com_kyant_taglib_TagLib_savePropertyMap(
         jint fd,
         jobject property_map
 ) {
-    char *path = getRealPathFromFd(fd);
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
     if (path == nullptr) {
         return false;
     }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Write);
     const auto stream = std::make_unique<TagLib::FileStream>(fd, false);
-    TagLibExt::FileRef f(path, stream.get(), false);
+    TagLibExt::FileRef f(path, stats.wrap(stream.get()), false, TagLib::AudioProperties::Average,
+                         stats.get(), fd);
 
     if (f.isNull()) {
-        free(path);
         return false;
     }
 
-    const PropertyMap propertyMap = JniHashMapToPropertyMap(env, property_map);
+    PropertyMap propertyMap;
+    {
+        TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Conversion);
+        propertyMap = JniHashMapToPropertyMap(env, property_map);
+    }
+    TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Save);
     f.setProperties(propertyMap);
     const bool success = f.save();
-    free(path);
     return success;
 }
 
@@ -166,22 +222,384 @@ Java_com_kyant_taglib_TagLib_savePictures(
         jint fd,
         jobjectArray pictures
 ) {
-    char *path = getRealPathFromFd(fd);
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
     if (path == nullptr) {
         return false;
     }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Write);
     const auto stream = std::make_unique<TagLib::FileStream>(fd, false);
-    TagLibExt::FileRef f(path, stream.get(), false);
+    TagLibExt::FileRef f(path, stats.wrap(stream.get()), false, TagLib::AudioProperties::Average,
+                         stats.get(), fd);
 
     if (f.isNull()) {
-        free(path);
         return false;
     }
 
-    auto pictureList = JniPictureArrayToPictureList(env, pictures);
+    TagLib::List<TagLib::VariantMap> pictureList;
+    {
+        TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Conversion);
+        pictureList = JniPictureArrayToPictureList(env, pictures);
+    }
+    TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Save);
     f.setComplexProperties("PICTURE", pictureList);
     const bool success = f.save();
-    free(path);
     return success;
 }
+
+JNIEXPORT jboolean JNICALL
+Java_com_kyant_taglib_TagLib_savePictureSources(
+        JNIEnv *env,
+        jclass,
+        jint fd,
+        jobjectArray picture_sources
+) {
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
+    if (path == nullptr) {
+        return false;
+    }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Write);
+    const auto stream = std::make_unique<TagLib::FileStream>(fd, false);
+    TagLibExt::FileRef f(path, stats.wrap(stream.get()), false, TagLib::AudioProperties::Average,
+                         stats.get(), fd);
+
+    if (f.isNull()) {
+        return false;
+    }
+
+    TagLib::List<TagLib::VariantMap> pictureList;
+    {
+        TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Conversion);
+        if (!JniPictureSourceArrayToPictureList(env, picture_sources, pictureList)) {
+            return false;
+        }
+    }
+    TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Save);
+    f.setComplexProperties("PICTURE", pictureList);
+    return f.save();
+}
+
+JNIEXPORT void JNICALL
+Java_com_kyant_taglib_TagLib_setStatsEnabled(
+        JNIEnv *,
+        jclass,
+        jboolean enabled
+) {
+    TagLibExt::setStatsEnabled(enabled);
+}
+
+JNIEXPORT void JNICALL
+Java_com_kyant_taglib_TagLib_setValueInterningEnabled(
+        JNIEnv *env,
+        jclass,
+        jboolean enabled
+) {
+    setValueInterningEnabled(env, enabled);
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_kyant_taglib_TagLib_getFormats(
+        JNIEnv *env,
+        jclass
+) {
+    const auto order = TagLibExt::detectionOrder();
+    StringList names;
+    for (const auto format: *order) {
+        names.append(format->name);
+    }
+    return StringListToJniStringArray(env, names);
+}
+
+JNIEXPORT void JNICALL
+Java_com_kyant_taglib_TagLib_setDetectionOrder(
+        JNIEnv *env,
+        jclass,
+        jobjectArray formats
+) {
+    TagLibExt::setDetectionOrder(JniStringArrayToStringList(env, formats));
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_kyant_taglib_LibraryWatcher_create(
+        JNIEnv *,
+        jclass,
+        jint quiet_millis,
+        jint max_delay_millis
+) {
+    auto watcher = std::make_unique<TagLibExt::LibraryWatcher>(quiet_millis, max_delay_millis);
+    if (!watcher->isValid()) {
+        return 0;
+    }
+    return reinterpret_cast<jlong>(watcher.release());
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_kyant_taglib_LibraryWatcher_addRoot(
+        JNIEnv *env,
+        jclass,
+        jlong handle,
+        jstring path
+) {
+    TagLibExt::ArenaScope scratch;
+    auto *watcher = reinterpret_cast<TagLibExt::LibraryWatcher *>(handle);
+    return watcher->addRoot(JniStringToString(env, path).to8Bit(true));
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_kyant_taglib_LibraryWatcher_waitForChanges(
+        JNIEnv *env,
+        jclass,
+        jlong handle,
+        jint timeout_millis
+) {
+    TagLibExt::ArenaScope scratch;
+    auto *watcher = reinterpret_cast<TagLibExt::LibraryWatcher *>(handle);
+    std::vector<TagLibExt::LibraryChange> changes;
+    watcher->waitForChanges(timeout_millis, changes);
+    return LibraryChangesToJniLibraryChangeArray(env, changes);
+}
+
+JNIEXPORT void JNICALL
+Java_com_kyant_taglib_LibraryWatcher_wakeUp(
+        JNIEnv *,
+        jclass,
+        jlong handle
+) {
+    reinterpret_cast<TagLibExt::LibraryWatcher *>(handle)->wakeUp();
+}
+
+JNIEXPORT void JNICALL
+Java_com_kyant_taglib_LibraryWatcher_destroy(
+        JNIEnv *,
+        jclass,
+        jlong handle
+) {
+    delete reinterpret_cast<TagLibExt::LibraryWatcher *>(handle);
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_kyant_taglib_TagIndex_create(
+        JNIEnv *env,
+        jclass,
+        jobjectArray fields
+) {
+    TagLibExt::ArenaScope scratch;
+    return reinterpret_cast<jlong>(new TagLibExt::TagIndex(JniStringArrayToStringList(env, fields)));
+}
+
+JNIEXPORT jint JNICALL
+Java_com_kyant_taglib_TagIndex_add(
+        JNIEnv *,
+        jclass,
+        jlong handle,
+        jint fd
+) {
+    TagLibExt::StatsCollector stats;
+    TagLibExt::ArenaScope scratch;
+    const char *path = getRealPathFromFd(fd);
+    if (path == nullptr) {
+        return -1;
+    }
+    const TagLibExt::FileLock lock(fd, TagLibExt::FileLock::Mode::Read);
+    const auto stream = std::make_unique<TagLib::FileStream>(fd, true);
+    const TagLibExt::FileRef f(path, stats.wrap(stream.get()), false, TagLib::AudioProperties::Average,
+                               stats.get(), fd);
+
+    if (f.isNull()) {
+        return -1;
+    }
+
+    PropertyMap propertyMap;
+    {
+        TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Properties);
+        propertyMap = f.properties();
+    }
+    TagLibExt::PhaseTimer timer(stats.get(), TagLibExt::Phase::Conversion);
+    return static_cast<jint>(reinterpret_cast<TagLibExt::TagIndex *>(handle)->add(propertyMap));
+}
+
+JNIEXPORT jint JNICALL
+Java_com_kyant_taglib_TagIndex_addProperties(
+        JNIEnv *env,
+        jclass,
+        jlong handle,
+        jobject property_map
+) {
+    TagLibExt::ArenaScope scratch;
+    const PropertyMap propertyMap = JniHashMapToPropertyMap(env, property_map);
+    return static_cast<jint>(reinterpret_cast<TagLibExt::TagIndex *>(handle)->add(propertyMap));
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_kyant_taglib_TagIndex_remove(
+        JNIEnv *,
+        jclass,
+        jlong handle,
+        jint row
+) {
+    return reinterpret_cast<TagLibExt::TagIndex *>(handle)->remove(static_cast<uint32_t>(row));
+}
+
+JNIEXPORT jint JNICALL
+Java_com_kyant_taglib_TagIndex_size(
+        JNIEnv *,
+        jclass,
+        jlong handle
+) {
+    return static_cast<jint>(reinterpret_cast<TagLibExt::TagIndex *>(handle)->rowCount());
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_kyant_taglib_TagIndex_memoryUsage(
+        JNIEnv *,
+        jclass,
+        jlong handle
+) {
+    return static_cast<jlong>(reinterpret_cast<TagLibExt::TagIndex *>(handle)->memoryUsage());
+}
+
+JNIEXPORT jintArray JNICALL
+Java_com_kyant_taglib_TagIndex_prefixSearch(
+        JNIEnv *env,
+        jclass,
+        jlong handle,
+        jstring field,
+        jstring prefix,
+        jint limit
+) {
+    TagLibExt::ArenaScope scratch;
+    const auto *index = reinterpret_cast<TagLibExt::TagIndex *>(handle);
+    const int fieldIndex = index->fieldIndex(JniStringToString(env, field));
+    const auto rows = index->prefixSearch(fieldIndex, JniStringToString(env, prefix),
+                                          static_cast<size_t>(std::max(limit, 0)));
+    return RowsToJniIntArray(env, rows);
+}
+
+JNIEXPORT jintArray JNICALL
+Java_com_kyant_taglib_TagIndex_search(
+        JNIEnv *env,
+        jclass,
+        jlong handle,
+        jstring field,
+        jstring text,
+        jint limit
+) {
+    TagLibExt::ArenaScope scratch;
+    const auto *index = reinterpret_cast<TagLibExt::TagIndex *>(handle);
+    const int fieldIndex = index->fieldIndex(JniStringToString(env, field));
+    const auto rows = index->search(fieldIndex, JniStringToString(env, text), static_cast<size_t>(std::max(limit, 0)));
+    return RowsToJniIntArray(env, rows);
+}
+
+JNIEXPORT jintArray JNICALL
+Java_com_kyant_taglib_TagIndex_groups(
+        JNIEnv *env,
+        jclass,
+        jlong handle,
+        jstring field,
+        jstring within_field,
+        jint within_row
+) {
+    TagLibExt::ArenaScope scratch;
+    const auto *index = reinterpret_cast<TagLibExt::TagIndex *>(handle);
+    const int fieldIndex = index->fieldIndex(JniStringToString(env, field));
+    if (within_field == nullptr) {
+        return RowsToJniIntArray(env, index->groups(fieldIndex));
+    }
+    const int withinFieldIndex = index->fieldIndex(JniStringToString(env, within_field));
+    if (withinFieldIndex < 0) {
+        return env->NewIntArray(0);
+    }
+    return RowsToJniIntArray(env, index->groups(fieldIndex, withinFieldIndex, static_cast<uint32_t>(within_row)));
+}
+
+JNIEXPORT jintArray JNICALL
+Java_com_kyant_taglib_TagIndex_groupRows(
+        JNIEnv *env,
+        jclass,
+        jlong handle,
+        jstring field,
+        jint row
+) {
+    TagLibExt::ArenaScope scratch;
+    const auto *index = reinterpret_cast<TagLibExt::TagIndex *>(handle);
+    const int fieldIndex = index->fieldIndex(JniStringToString(env, field));
+    return RowsToJniIntArray(env, index->groupRows(fieldIndex, static_cast<uint32_t>(row)));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_kyant_taglib_TagIndex_getValue(
+        JNIEnv *env,
+        jclass,
+        jlong handle,
+        jstring field,
+        jint row
+) {
+    TagLibExt::ArenaScope scratch;
+    const auto *index = reinterpret_cast<TagLibExt::TagIndex *>(handle);
+    const int fieldIndex = index->fieldIndex(JniStringToString(env, field));
+    std::string value;
+    if (!index->value(fieldIndex, static_cast<uint32_t>(row), value)) {
+        return nullptr;
+    }
+    return StringToJniString(env, TagLib::String(value, TagLib::String::UTF8));
+}
+
+JNIEXPORT void JNICALL
+Java_com_kyant_taglib_TagIndex_destroy(
+        JNIEnv *,
+        jclass,
+        jlong handle
+) {
+    delete reinterpret_cast<TagLibExt::TagIndex *>(handle);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_kyant_taglib_TagLib_isAllocationStatsAvailable(
+        JNIEnv *,
+        jclass
+) {
+    return TagLibExt::allocationStatsAvailable();
+}
+
+JNIEXPORT jobject JNICALL
+Java_com_kyant_taglib_TagLib_getLastStats(
+        JNIEnv *env,
+        jclass
+) {
+    TagLibExt::ParseStats stats;
+    if (!TagLibExt::lastCallStats(stats)) {
+        return nullptr;
+    }
+    return ParseStatsToJniParseStats(env, stats);
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_com_kyant_taglib_TagLib_getAggregatedStats(
+        JNIEnv *env,
+        jclass
+) {
+    const std::vector<TagLibExt::ParseStats> statsList = TagLibExt::aggregatedStats();
+    jobjectArray array = env->NewObjectArray(static_cast<jsize>(statsList.size()),
+                                             parseStatsClass, nullptr);
+    int i = 0;
+    for (const auto &stats: statsList) {
+        jobject parseStats = ParseStatsToJniParseStats(env, stats);
+        env->SetObjectArrayElement(array, i, parseStats);
+        env->DeleteLocalRef(parseStats);
+        i++;
+    }
+    return array;
+}
+
+JNIEXPORT void JNICALL
+Java_com_kyant_taglib_TagLib_resetAggregatedStats(
+        JNIEnv *,
+        jclass
+) {
+    TagLibExt::resetAggregatedStats();
+}
 }
@@ -0,0 +1,166 @@
+/*
+ * Host test of file_lock.h: reads and saves the same file on several threads
+ * the way the JNI functions do, and checks that every read sees a whole tag
+ * written by one of the saves and the unchanged audio, that the file ends up
+ * with the tag of the last save, and that the stats count every call.
+ *
+ * Usage: taglib_concurrency_test [DIRECTORY]
+ */
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "arena.h"
+#include "corpus.h"
+#include "file_lock.h"
+#include "fileref_ext.h"
+#include "stats.h"
+#include "test_support.h"
+#include "tfilestream.h"
+#include "tpropertymap.h"
+
+namespace TagLibExt::Test {
+    namespace {
+
+        constexpr int readers = 4;
+        constexpr int writers = 2;
+        constexpr int readsPerThread = 50;
+        constexpr int savesPerThread = 10;
+
+        /*
+         * The COMMENT repeats the TITLE a number of times that depends on it, so
+         * the tag changes size between saves and a read of half a tag shows.
+         */
+        std::string commentOf(const std::string &title) {
+            std::string comment;
+            for (size_t i = 0; i <= title.size() * 16 % 97; i++) {
+                comment += title;
+            }
+            return comment;
+        }
+
+        struct Snapshot {
+            bool ok{false};
+            std::string title;
+            std::string comment;
+            int milliseconds{-1};
+        };
+
+        Snapshot readSnapshot(const std::string &path) {
+            StatsCollector stats;
+            ArenaScope scratch;
+            const FileLock lock(path.c_str(), FileLock::Mode::Read);
+            FileStream stream(path.c_str(), true);
+            const FileRef f(path.c_str(), stats.wrap(&stream), true, AudioProperties::Average, stats.get());
+            Snapshot snapshot;
+            if (f.isNull() || !f.audioProperties()) {
+                return snapshot;
+            }
+            const PropertyMap properties = f.properties();
+            const StringList title = properties["TITLE"];
+            const StringList comment = properties["COMMENT"];
+            snapshot.ok = title.size() == 1 && comment.size() == 1;
+            if (snapshot.ok) {
+                snapshot.title = title.front().to8Bit(true);
+                snapshot.comment = comment.front().to8Bit(true);
+            }
+            snapshot.milliseconds = f.audioProperties()->lengthInMilliseconds();
+            return snapshot;
+        }
+
+        //! Saves \a title and calls \a saved with the lock still held.
+        template<typename Saved>
+        bool save(const std::string &path, const std::string &title, Saved saved) {
+            StatsCollector stats;
+            ArenaScope scratch;
+            const FileLock lock(path.c_str(), FileLock::Mode::Write);
+            FileStream stream(path.c_str(), false);
+            FileRef f(path.c_str(), stats.wrap(&stream), false, AudioProperties::Average, stats.get());
+            if (f.isNull()) {
+                return false;
+            }
+            PropertyMap properties = f.properties();
+            properties.replace("TITLE", StringList(String(title, String::UTF8)));
+            properties.replace("COMMENT", StringList(String(commentOf(title), String::UTF8)));
+            f.setProperties(properties);
+            if (!f.save()) {
+                return false;
+            }
+            saved();
+            return true;
+        }
+
+        uint64_t aggregatedCalls() {
+            uint64_t calls = 0;
+            for (const ParseStats &entry: aggregatedStats()) {
+                calls += entry.calls;
+            }
+            return calls;
+        }
+
+        void testKind(const std::string &directory, const std::string &kind, const char *extension) {
+            const std::string path = directory + "/concurrency_test." + extension;
+            if (!Benchmark::writeAudioFile(path, kind, 10, 1)) {
+                check(false, kind, "could not write the file");
+                return;
+            }
+            std::mutex lastSavedMutex;
+            std::string lastSaved = "start";
+            check(save(path, lastSaved, [] {}), kind, "first save failed");
+            const Snapshot first = readSnapshot(path);
+            check(first.ok && first.title == lastSaved && first.milliseconds > 0, kind, "first read failed");
+
+            resetAggregatedStats();
+            std::vector<std::thread> threads;
+            for (int t = 0; t < writers; t++) {
+                threads.emplace_back([&, t] {
+                    for (int i = 0; i < savesPerThread; i++) {
+                        // Titles of several lengths, so that the tag grows and shrinks
+                        const std::string title = "w" + std::to_string(t) + "-" + std::to_string(i) +
+                                                  std::string(static_cast<size_t>(i * 37 % 200), 'x');
+                        check(save(path, title, [&] {
+                            std::lock_guard<std::mutex> lock(lastSavedMutex);
+                            lastSaved = title;
+                        }), kind, "save failed");
+                    }
+                });
+            }
+            for (int t = 0; t < readers; t++) {
+                threads.emplace_back([&] {
+                    for (int i = 0; i < readsPerThread; i++) {
+                        const Snapshot snapshot = readSnapshot(path);
+                        check(snapshot.ok, kind, "read failed");
+                        check(snapshot.comment == commentOf(snapshot.title), kind, "tag read half written");
+                        check(snapshot.title == "start" || snapshot.title.compare(0, 1, "w") == 0, kind,
+                              "title not written by a save");
+                        check(snapshot.milliseconds == first.milliseconds, kind, "audio changed");
+                    }
+                });
+            }
+            for (std::thread &thread: threads) {
+                thread.join();
+            }
+
+            const Snapshot last = readSnapshot(path);
+            check(last.ok && last.title == lastSaved, kind, "not the tag of the last save");
+            check(aggregatedCalls() == static_cast<uint64_t>(writers * savesPerThread + readers * readsPerThread + 1),
+                  kind, "calls missing from the stats");
+            std::remove(path.c_str());
+        }
+    }
+} // namespace TagLibExt::Test
+
+int main(int argc, char **argv) {
+    using namespace TagLibExt::Test;
+
+    return runTest(argc, argv, [](const std::string &directory) {
+        TagLibExt::setStatsEnabled(true);
+        testKind(directory, "mp3-cbr", "mp3");
+        testKind(directory, "flac", "flac");
+        testKind(directory, "mp4", "m4a");
+        testKind(directory, "ogg-vorbis", "ogg");
+    });
+}
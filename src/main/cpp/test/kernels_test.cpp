@@ -0,0 +1,166 @@
+/*
+ * Host test of the kernel sets of cpu_features.h: forces each set the CPU
+ * supports and compares the scan, hash and UTF-16 conversion kernels with
+ * reference implementations on random inputs.
+ *
+ * Usage: taglib_kernels_test [--seed N]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "convert.h"
+#include "cpu_features.h"
+#include "hash.h"
+#include "scan.h"
+
+namespace TagLibExt::Test {
+    namespace {
+
+        int failures = 0;
+
+        void check(bool condition, const char *kernel, KernelSet set, size_t length, size_t position) {
+            if (!condition) {
+                std::fprintf(stderr, "%s with %s: wrong result for length %zu, position %zu\n", kernel,
+                             kernelSetName(set), length, position);
+                failures++;
+            }
+        }
+
+        const char *referenceLastCapturePattern(const char *begin, const char *end) {
+            for (const char *p = end - 4; p >= begin; p--) {
+                if (std::memcmp(p, "OggS", 4) == 0) {
+                    return p;
+                }
+            }
+            return nullptr;
+        }
+
+        const char *referenceFrameSync(const char *begin, const char *end) {
+            for (const char *p = begin; p + 2 <= end; p++) {
+                if (static_cast<unsigned char>(p[0]) == 0xFF && (static_cast<unsigned char>(p[1]) & 0xE0) == 0xE0) {
+                    return p;
+                }
+            }
+            return nullptr;
+        }
+
+        // Buffers of every length up to a few blocks, at every alignment, with the
+        // patterns planted at random positions, including straddling block boundaries.
+        void testScan(KernelSet set, std::mt19937 &random) {
+            std::vector<char> buffer(512);
+            for (size_t length = 0; length <= 200; length++) {
+                for (size_t offset = 0; offset < 32; offset += 7) {
+                    for (int round = 0; round < 4; round++) {
+                        // Mostly bytes that start a pattern, so that false candidates are common
+                        for (char &c: buffer) {
+                            const uint32_t r = random() % 8;
+                            c = r == 0 ? 'O' : r == 1 ? static_cast<char>(0xFF) : static_cast<char>(random());
+                        }
+                        const size_t position = length > 0 ? random() % length : 0;
+                        char *data = buffer.data() + offset;
+                        if (round % 2 == 0 && position + 4 <= length) {
+                            std::memcpy(data + position, "OggS", 4);
+                        }
+                        if (round % 2 == 0 && position + 2 <= length) {
+                            data[position] = static_cast<char>(0xFF);
+                            data[position + 1] = static_cast<char>(0xE0 | (random() & 0x1F));
+                        }
+                        check(findLastCapturePattern(data, data + length) ==
+                              referenceLastCapturePattern(data, data + length),
+                              "findLastCapturePattern", set, length, position);
+                        check(findFrameSync(data, data + length) == referenceFrameSync(data, data + length),
+                              "findFrameSync", set, length, position);
+                    }
+                }
+            }
+        }
+
+        // The hashes are compared with the scalar set, split between update() calls in random ways.
+        void testHash(KernelSet set, std::mt19937 &random) {
+            std::vector<char> data(3 * 1024 * 1024 + 77);
+            for (char &c: data) {
+                c = static_cast<char>(random());
+            }
+            const size_t lengths[] = {0, 1, 7, 63, 64, 65, 1023, 1024, 1025, 4096 + 100, 1024 * 1024, data.size()};
+            for (const size_t length: lengths) {
+                setKernelSet(KernelSet::Scalar);
+                StripeHash scalarStripe;
+                scalarStripe.update(data.data(), length);
+                ChunkedHash scalarChunked;
+                scalarChunked.update(data.data(), length);
+                setKernelSet(set);
+
+                StripeHash stripe;
+                ChunkedHash chunked;
+                for (size_t offset = 0; offset < length;) {
+                    const size_t n = std::min<size_t>(length - offset, random() % 3000 + 1);
+                    stripe.update(data.data() + offset, n);
+                    chunked.update(data.data() + offset, n);
+                    offset += n;
+                }
+                check(stripe.digest() == scalarStripe.digest(), "StripeHash", set, length, 0);
+                check(chunked.digest() == scalarChunked.digest(), "ChunkedHash", set, length, 0);
+            }
+        }
+
+        // Strings of every length up to a few blocks, with code units from every range, surrogates
+        // included, but not zero, which ends the string built by fromUtf16().
+        void testConvert(KernelSet set, std::mt19937 &random) {
+            Arena arena;
+            for (size_t length = 0; length <= 100; length++) {
+                std::vector<uint16_t> units(length);
+                for (uint16_t &unit: units) {
+                    const uint32_t r = random() % 4;
+                    unit = static_cast<uint16_t>(r == 0 ? 1 + random() % 0x7F : r == 1 ? 0xD800 + random() % 0x800
+                                                                                       : 1 + random() % 0xFFFF);
+                }
+                const String str = fromUtf16(units.data(), length, arena);
+                check(str.size() == length, "fromUtf16", set, length, 0);
+                const wchar_t *wide = str.toCWString();
+                for (size_t i = 0; i < length && i < str.size(); i++) {
+                    check(static_cast<uint32_t>(wide[i]) == units[i], "fromUtf16", set, length, i);
+                }
+                const Utf16View view = toUtf16(str, arena);
+                check(view.length == length && std::equal(units.begin(), units.end(), view.data),
+                      "toUtf16", set, length, 0);
+                arena.reset();
+            }
+        }
+    }
+} // namespace TagLibExt::Test
+
+int main(int argc, char **argv) {
+    using namespace TagLibExt;
+    using namespace TagLibExt::Test;
+
+    std::mt19937::result_type seed = std::random_device()();
+    if (argc == 3 && std::strcmp(argv[1], "--seed") == 0) {
+        seed = static_cast<std::mt19937::result_type>(std::strtoul(argv[2], nullptr, 10));
+    } else if (argc != 1) {
+        std::fprintf(stderr, "Usage: %s [--seed N]\n", argv[0]);
+        return 2;
+    }
+    std::printf("Seed %lu, default kernel set %s\n", static_cast<unsigned long>(seed), kernelSetName(kernelSet()));
+
+    for (int i = 0; i < static_cast<int>(KernelSet::Count); i++) {
+        const auto set = static_cast<KernelSet>(i);
+        if (!setKernelSet(set)) {
+            std::printf("%s: not supported, skipped\n", kernelSetName(set));
+            continue;
+        }
+        std::mt19937 random(seed);
+        const int before = failures;
+        testScan(set, random);
+        testHash(set, random);
+        testConvert(set, random);
+        std::printf("%s: %s\n", kernelSetName(set), failures == before ? "passed" : "FAILED");
+    }
+    return failures == 0 ? 0 : 1;
+}
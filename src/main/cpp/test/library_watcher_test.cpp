@@ -0,0 +1,144 @@
+/*
+ * Host test of library_watcher.h: watches a directory made with mkdtemp() and
+ * checks that repeated writes of a file are coalesced into one change, that
+ * files without the extension of a format are ignored, that the removal of a
+ * directory stands for the changes below it, that a directory moved within the
+ * tree is reported and still watched, and that wakeUp() ends a wait.
+ *
+ * Usage: taglib_library_watcher_test [DIRECTORY]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "corpus.h"
+#include "library_watcher.h"
+#include "test_support.h"
+
+namespace TagLibExt::Test {
+    namespace {
+
+        constexpr int timeoutMillis = 5000;
+
+        bool writeTrack(const std::string &path) {
+            return Benchmark::writeAudioFile(path, "mp3-cbr", 2, 1);
+        }
+
+        bool writeText(const std::string &path) {
+            FILE *file = std::fopen(path.c_str(), "w");
+            return file && std::fputs("notes\n", file) >= 0 && std::fclose(file) == 0;
+        }
+
+        std::vector<LibraryChange> nextBatch(LibraryWatcher &watcher) {
+            std::vector<LibraryChange> changes;
+            watcher.waitForChanges(timeoutMillis, changes);
+            return changes;
+        }
+
+        bool isChange(const LibraryChange &change, LibraryChange::Type type, const std::string &path,
+                      bool directory) {
+            return change.type == type && change.path == path && change.directory == directory;
+        }
+
+        void testCoalescing(LibraryWatcher &watcher, const std::string &root) {
+            const std::string name = "coalescing";
+            const std::string album = root + "/album";
+            check(mkdir(album.c_str(), 0755) == 0, name, "could not create the directory");
+            for (int i = 0; i < 3; i++) {
+                check(writeTrack(album + "/track.mp3"), name, "could not write the track");
+            }
+            check(writeText(album + "/notes.txt") && writeText(album + "/README"), name,
+                  "could not write the other files");
+
+            const std::vector<LibraryChange> changes = nextBatch(watcher);
+            check(changes.size() == 1, name, "not one change for the track alone");
+            if (!changes.empty()) {
+                check(isChange(changes[0], LibraryChange::Type::Changed, album + "/track.mp3", false), name,
+                      "wrong change");
+                check(changes[0].lengthInMilliseconds > 0, name, "track not parsed");
+            }
+        }
+
+        void testMove(LibraryWatcher &watcher, const std::string &root) {
+            const std::string name = "moved directory";
+            const std::string from = root + "/album";
+            const std::string to = root + "/moved";
+            check(std::rename(from.c_str(), to.c_str()) == 0, name, "could not move the directory");
+
+            const std::vector<LibraryChange> changes = nextBatch(watcher);
+            check(changes.size() == 2, name, "not two changes");
+            if (changes.size() == 2) {
+                check(isChange(changes[0], LibraryChange::Type::Removed, from, true), name, "old path not removed");
+                check(isChange(changes[1], LibraryChange::Type::Changed, to + "/track.mp3", false), name,
+                      "track not found at the new path");
+            }
+
+            // The directory is watched at its new path
+            check(writeTrack(to + "/second.mp3"), name, "could not write the track");
+            const std::vector<LibraryChange> written = nextBatch(watcher);
+            check(written.size() == 1 &&
+                  isChange(written[0], LibraryChange::Type::Changed, to + "/second.mp3", false), name,
+                  "write at the new path not reported");
+        }
+
+        void testRemoval(LibraryWatcher &watcher, const std::string &root) {
+            const std::string name = "removed directory";
+            const std::string album = root + "/moved";
+
+            // Written and removed before the batch is reported
+            check(writeTrack(album + "/third.mp3"), name, "could not write the track");
+            for (const char *file: {"track.mp3", "second.mp3", "third.mp3", "notes.txt", "README"}) {
+                check(unlink((album + "/" + file).c_str()) == 0, name, "could not remove a file");
+            }
+            check(rmdir(album.c_str()) == 0, name, "could not remove the directory");
+
+            const std::vector<LibraryChange> changes = nextBatch(watcher);
+            check(changes.size() == 1 && isChange(changes[0], LibraryChange::Type::Removed, album, true), name,
+                  "not one removal for the directory");
+        }
+
+        void testWakeUp(LibraryWatcher &watcher) {
+            const std::string name = "wakeUp";
+            std::vector<LibraryChange> changes;
+            std::thread thread([&] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                watcher.wakeUp();
+            });
+            check(!watcher.waitForChanges(-1, changes) && changes.empty(), name, "wait not ended");
+            thread.join();
+
+            // A wakeUp() before the wait ends it at once
+            watcher.wakeUp();
+            const auto start = std::chrono::steady_clock::now();
+            check(!watcher.waitForChanges(timeoutMillis, changes) &&
+                  std::chrono::steady_clock::now() - start < std::chrono::milliseconds(timeoutMillis), name,
+                  "earlier wakeUp() lost");
+        }
+    }
+} // namespace TagLibExt::Test
+
+int main(int argc, char **argv) {
+    using namespace TagLibExt::Test;
+
+    return runTest(argc, argv, [](const std::string &directory) {
+        std::string root = directory + "/library_watcher_test_XXXXXX";
+        if (!mkdtemp(root.data())) {
+            check(false, "setup", "could not create the directory");
+            return;
+        }
+        {
+            TagLibExt::LibraryWatcher watcher(100);
+            check(watcher.isValid() && watcher.addRoot(root), "setup", "could not watch the directory");
+            testCoalescing(watcher, root);
+            testMove(watcher, root);
+            testRemoval(watcher, root);
+            testWakeUp(watcher);
+        }
+        rmdir(root.c_str());
+    });
+}
@@ -0,0 +1,278 @@
+/*
+ * Host test of mkv_index.h: writes Matroska files with Tags that only a walk
+ * over the Clusters finds, after the last Cluster or between two of them, and
+ * checks that the read only path of FileRef finds them like Matroska::File, and
+ * that the Clusters are not read when the SeekHead lists the Tags.
+ *
+ * Usage: taglib_matroska_test [DIRECTORY]
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "fileref_ext.h"
+#include "mkv_index.h"
+#include "stats.h"
+#include "test_support.h"
+#include "tfilestream.h"
+#include "tpropertymap.h"
+
+namespace TagLibExt::Test {
+    namespace {
+
+        // Elements with an 8 byte size, master elements patched by end().
+        class EbmlWriter {
+        public:
+            std::vector<uint8_t> data;
+
+            void id(uint32_t value) {
+                for (int shift = 24; shift >= 0; shift -= 8) {
+                    if (value >> shift || shift == 0)
+                        data.push_back(static_cast<uint8_t>(value >> shift));
+                }
+            }
+
+            void size(uint64_t value) {
+                data.push_back(0x01);
+                for (int shift = 48; shift >= 0; shift -= 8) {
+                    data.push_back(static_cast<uint8_t>(value >> shift));
+                }
+            }
+
+            void begin(uint32_t elementId) {
+                id(elementId);
+                masters.push_back(data.size());
+                size(0);
+            }
+
+            void end() {
+                const size_t start = masters.back();
+                masters.pop_back();
+                const uint64_t value = data.size() - start - 8;
+                for (int i = 0; i < 7; i++) {
+                    data[start + 7 - i] = static_cast<uint8_t>(value >> (8 * i));
+                }
+            }
+
+            void uinteger(uint32_t elementId, uint64_t value) {
+                id(elementId);
+                size(8);
+                for (int shift = 56; shift >= 0; shift -= 8) {
+                    data.push_back(static_cast<uint8_t>(value >> shift));
+                }
+            }
+
+            void string(uint32_t elementId, const char *value) {
+                id(elementId);
+                size(std::strlen(value));
+                data.insert(data.end(), value, value + std::strlen(value));
+            }
+
+            void binary(uint32_t elementId, size_t length, uint8_t fill) {
+                id(elementId);
+                size(length);
+                data.insert(data.end(), length, fill);
+            }
+
+        private:
+            std::vector<size_t> masters;
+        };
+
+        void tags(EbmlWriter &e, const char *title) {
+            e.begin(MkvSegmentIndex::Tags);
+            e.begin(0x7373);
+            e.begin(0x63C0);
+            e.uinteger(0x68CA, 50);
+            e.end();
+            e.begin(0x67C8);
+            e.string(0x45A3, "TITLE");
+            e.string(0x4487, title);
+            e.end();
+            e.end();
+            e.end();
+        }
+
+        void patch(EbmlWriter &e, size_t offset, uint64_t value) {
+            for (int j = 0; j < 8; j++) {
+                e.data[offset + 7 - j] = static_cast<uint8_t>(value >> (8 * j));
+            }
+        }
+
+        /*
+         * A segment with a SeekHead pointing to Info and Tracks only, four Clusters
+         * and Tags after the Cluster tagsAfter, 0 for before the first one.  If
+         * indexed, the SeekHead also points to the Tags and the Cues, which come
+         * before many Clusters, as muxers writing the index at the front do.
+         * Returns the offset of the Tags.
+         */
+        size_t writeFile(const std::string &path, int tagsAfter, const char *title, bool indexed = false) {
+            EbmlWriter e;
+            e.begin(MkvSegmentIndex::EBMLHeader);
+            e.uinteger(0x4286, 1);
+            e.string(0x4282, "matroska");
+            e.uinteger(0x4287, 4);
+            e.uinteger(0x4285, 2);
+            e.end();
+
+            e.begin(MkvSegmentIndex::Segment);
+            const size_t segmentBegin = e.data.size();
+            e.begin(MkvSegmentIndex::SeekHead);
+            std::vector<uint32_t> targets = {MkvSegmentIndex::Info, MkvSegmentIndex::Tracks};
+            if (indexed) {
+                targets.insert(targets.end(), {MkvSegmentIndex::Tags, MkvSegmentIndex::Cues});
+            }
+            std::vector<size_t> positions;
+            for (const uint32_t target: targets) {
+                e.begin(MkvSegmentIndex::Seek);
+                e.id(MkvSegmentIndex::SeekID);
+                e.size(4);
+                for (int shift = 24; shift >= 0; shift -= 8) {
+                    e.data.push_back(static_cast<uint8_t>(target >> shift));
+                }
+                e.uinteger(MkvSegmentIndex::SeekPosition, 0);
+                positions.push_back(e.data.size() - 8);
+                e.end();
+            }
+            e.end();
+
+            patch(e, positions[0], e.data.size() - segmentBegin);
+            e.begin(MkvSegmentIndex::Info);
+            e.uinteger(0x2AD7B1, 1000000);
+            e.string(0x4D80, "taglib test");
+            e.end();
+
+            patch(e, positions[1], e.data.size() - segmentBegin);
+            e.begin(MkvSegmentIndex::Tracks);
+            e.begin(0xAE);
+            e.uinteger(0xD7, 1);
+            e.uinteger(0x83, 2);
+            e.string(0x86, "A_PCM/INT/LIT");
+            e.end();
+            e.end();
+
+            size_t clusterPosition = 0;
+            if (indexed) {
+                patch(e, positions[3], e.data.size() - segmentBegin);
+                e.begin(MkvSegmentIndex::Cues);
+                e.begin(0xBB);
+                e.uinteger(0xB3, 0);
+                e.begin(0xB7);
+                e.uinteger(0xF7, 1);
+                e.uinteger(0xF1, 0);
+                clusterPosition = e.data.size() - 8;
+                e.end();
+                e.end();
+                e.end();
+            }
+
+            const int clusters = indexed ? 64 : 4;
+            size_t tagsOffset = 0;
+            for (int cluster = 0; cluster <= clusters; cluster++) {
+                if (cluster == tagsAfter) {
+                    tagsOffset = e.data.size();
+                    if (indexed) {
+                        patch(e, positions[2], tagsOffset - segmentBegin);
+                    }
+                    tags(e, title);
+                }
+                if (cluster == 0 && indexed) {
+                    patch(e, clusterPosition, e.data.size() - segmentBegin);
+                }
+                if (cluster < clusters) {
+                    e.begin(MkvSegmentIndex::Cluster);
+                    e.uinteger(0xE7, cluster * 1000);
+                    e.binary(0xA3, indexed ? 4 * 1024 : 64 * 1024, 0x55);
+                    e.end();
+                }
+            }
+            e.end();
+
+            FILE *file = std::fopen(path.c_str(), "wb");
+            if (!file) {
+                return 0;
+            }
+            const bool ok = std::fwrite(e.data.data(), 1, e.data.size(), file) == e.data.size();
+            return std::fclose(file) == 0 && ok ? tagsOffset : 0;
+        }
+
+        void testTrailingTags(const std::string &directory, int tagsAfter) {
+            const std::string name = "tags after cluster " + std::to_string(tagsAfter);
+            const std::string path = directory + "/matroska_test_" + std::to_string(tagsAfter) + ".mka";
+            const size_t tagsOffset = writeFile(path, tagsAfter, "Found");
+            check(tagsOffset > 0, name, "could not write the file");
+            if (tagsOffset == 0) {
+                return;
+            }
+
+            {
+                FileStream stream(path.c_str(), true);
+                MkvSegmentIndex index;
+                check(index.build(&stream), name, "no index built");
+                bool found = false;
+                for (const auto &element: index.elements()) {
+                    found = found || (element.id == MkvSegmentIndex::Tags &&
+                                      element.offset == static_cast<offset_t>(tagsOffset));
+                }
+                check(found, name, "Tags not in the index");
+                for (const auto &range: index.hidden()) {
+                    check(range.offset + range.length <= static_cast<offset_t>(tagsOffset) ||
+                          range.offset >= static_cast<offset_t>(tagsOffset), name, "Tags hidden");
+                }
+            }
+
+            FileStream stream(path.c_str(), true);
+            const FileRef f(path.c_str(), &stream, false);
+            const StringList title = f.isNull() ? StringList() : f.properties()["TITLE"];
+            check(title.size() == 1 && title.front() == "Found", name, "TITLE not read");
+            std::remove(path.c_str());
+        }
+
+        /*
+         * With the Tags and Cues listed in the SeekHead before the first Cluster,
+         * the index is built from the start of the file alone, without stepping
+         * over the Clusters.
+         */
+        void testIndexedTags(const std::string &directory) {
+            const std::string name = "indexed tags";
+            const std::string path = directory + "/matroska_test_indexed.mka";
+            const size_t tagsOffset = writeFile(path, 0, "Indexed", true);
+            check(tagsOffset > 0, name, "could not write the file");
+            if (tagsOffset == 0) {
+                return;
+            }
+
+            {
+                ParseStats stats;
+                FileStream stream(path.c_str(), true);
+                CountingIOStream counting(&stream, &stats);
+                MkvSegmentIndex index;
+                check(index.build(&counting), name, "no index built");
+                bool found = false;
+                for (const auto &element: index.elements()) {
+                    found = found || (element.id == MkvSegmentIndex::Tags &&
+                                      element.offset == static_cast<offset_t>(tagsOffset));
+                }
+                check(found, name, "Tags not in the index");
+                check(stats.readCalls <= 2, name, "Clusters read");
+            }
+
+            FileStream stream(path.c_str(), true);
+            const FileRef f(path.c_str(), &stream, false);
+            const StringList title = f.isNull() ? StringList() : f.properties()["TITLE"];
+            check(title.size() == 1 && title.front() == "Indexed", name, "TITLE not read");
+            std::remove(path.c_str());
+        }
+    }
+} // namespace TagLibExt::Test
+
+int main(int argc, char **argv) {
+    using namespace TagLibExt::Test;
+
+    return runTest(argc, argv, [](const std::string &directory) {
+        testTrailingTags(directory, 4);
+        testTrailingTags(directory, 2);
+        testIndexedTags(directory);
+    });
+}
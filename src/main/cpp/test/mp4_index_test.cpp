@@ -0,0 +1,81 @@
+/*
+ * Host test of mp4_index.h: replaces an MP4 file with another of the same size
+ * while it is open, as a save by renaming over it does, and checks that the
+ * atom index cached for the open file is not served for the new one.
+ *
+ * Usage: taglib_mp4_index_test [DIRECTORY]
+ */
+
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+#include "corpus.h"
+#include "fileref_ext.h"
+#include "test_support.h"
+#include "tfilestream.h"
+#include "tpropertymap.h"
+
+namespace TagLibExt::Test {
+    namespace {
+
+        bool writeTagged(const std::string &path, const char *title) {
+            if (!Benchmark::writeAudioFile(path, "mp4", 10, 1)) {
+                return false;
+            }
+            FileStream stream(path.c_str(), false);
+            FileRef f(path.c_str(), &stream, false);
+            if (f.isNull()) {
+                return false;
+            }
+            PropertyMap properties;
+            properties.replace("TITLE", StringList(title));
+            f.setProperties(properties);
+            return f.save();
+        }
+
+        // Reads the title the way the JNI functions do, through a descriptor.
+        std::string readTitle(const std::string &path, int fd) {
+            FileStream stream(fd, true);
+            const FileRef f(path.c_str(), &stream, false, AudioProperties::Average, nullptr, fd);
+            const StringList title = f.isNull() ? StringList() : f.properties()["TITLE"];
+            return title.size() == 1 ? title.front().to8Bit(true) : std::string();
+        }
+
+        void testReplaced(const std::string &directory) {
+            const std::string name = "replaced file";
+            const std::string path = directory + "/mp4_index_test.m4a";
+            const std::string replacement = directory + "/mp4_index_test_new.m4a";
+            if (!writeTagged(path, "Old") || !writeTagged(replacement, "New")) {
+                check(false, name, "could not write the files");
+                return;
+            }
+
+            // The old file stays open while the new one takes its path
+            const int oldFd = open(path.c_str(), O_RDONLY);
+            check(oldFd >= 0 && std::rename(replacement.c_str(), path.c_str()) == 0, name, "could not replace");
+            if (oldFd >= 0) {
+                check(readTitle(path, oldFd) == "Old", name, "wrong title of the open file");
+                close(oldFd);
+            }
+
+            const int newFd = open(path.c_str(), O_RDONLY);
+            check(newFd >= 0, name, "could not open the new file");
+            if (newFd >= 0) {
+                check(readTitle(path, newFd) == "New", name, "index of the old file served for the new one");
+                close(newFd);
+            }
+            std::remove(path.c_str());
+            std::remove(replacement.c_str());
+        }
+    }
+} // namespace TagLibExt::Test
+
+int main(int argc, char **argv) {
+    using namespace TagLibExt::Test;
+
+    return runTest(argc, argv, [](const std::string &directory) {
+        testReplaced(directory);
+    });
+}
@@ -0,0 +1,104 @@
+/*
+ * Host test of mpeg_length.h: reads generated MP3 files without a Xing header
+ * with each read style and checks the sampled length of a VBR stream against
+ * the length the Accurate walk finds and the confidence it is given, also when
+ * the stream starts and ends with silence at the lowest bitrate, and that CBR
+ * streams are told apart with two reads.
+ *
+ * Usage: taglib_mpeg_length_test [DIRECTORY]
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "corpus.h"
+#include "fileref_ext.h"
+#include "stats.h"
+#include "stream_properties.h"
+#include "test_support.h"
+#include "tfilestream.h"
+
+namespace TagLibExt::Test {
+    namespace {
+
+        struct Length {
+            int milliseconds{-1};
+            bool estimated{false};
+            double confidence{1.0};
+            uint64_t bytesRead{0};
+        };
+
+        Length readLength(const std::string &path, AudioProperties::ReadStyle style) {
+            FileStream file(path.c_str(), true);
+            ParseStats stats;
+            CountingIOStream stream(&file, &stats);
+            const FileRef f(path.c_str(), &stream, true, style);
+            Length length;
+            if (const AudioProperties *properties = f.audioProperties()) {
+                length.milliseconds = properties->lengthInMilliseconds();
+            }
+            if (const auto properties = dynamic_cast<const StreamProperties *>(f.audioProperties())) {
+                length.estimated = properties->isLengthEstimated();
+                length.confidence = properties->lengthConfidence();
+            }
+            length.bytesRead = stats.bytesRead;
+            return length;
+        }
+
+        void testVbr(const std::string &directory, const std::string &kind, double duration) {
+            const std::string name = kind + ", " + std::to_string(static_cast<int>(duration)) + " s";
+            const std::string path = directory + "/mpeg_length_test_vbr.mp3";
+            if (!Benchmark::writeAudioFile(path, kind, duration, 1)) {
+                check(false, name, "could not write the file");
+                return;
+            }
+
+            const Length accurate = readLength(path, AudioProperties::Accurate);
+            check(std::abs(accurate.milliseconds - duration * 1000) < 100 && !accurate.estimated &&
+                  accurate.confidence == 1.0, name, "wrong Accurate length");
+
+            // The estimate is within its 95% bound of the walked length
+            const Length average = readLength(path, AudioProperties::Average);
+            const double error = std::abs(average.milliseconds - accurate.milliseconds) /
+                                 static_cast<double>(accurate.milliseconds);
+            check(average.estimated, name, "Average length not flagged as estimated");
+            check(average.confidence > 0.5 && average.confidence < 1.0, name, "wrong confidence");
+            check(error <= 1.0 - average.confidence, name, "Average length beyond its confidence");
+            check(average.bytesRead < accurate.bytesRead / 2, name, "Average read not sampled");
+            std::remove(path.c_str());
+        }
+
+        void testCbr(const std::string &directory) {
+            const std::string name = "CBR";
+            const std::string path = directory + "/mpeg_length_test_cbr.mp3";
+            if (!Benchmark::writeAudioFile(path, "mp3-cbr", 60, 1)) {
+                check(false, name, "could not write the file");
+                return;
+            }
+
+            // TagLib's length is kept, at the cost of reading two ranges of frames
+            const Length accurate = readLength(path, AudioProperties::Accurate);
+            const Length average = readLength(path, AudioProperties::Average);
+            const Length fast = readLength(path, AudioProperties::Fast);
+            check(!accurate.estimated && !average.estimated, name, "length flagged as estimated");
+            check(average.milliseconds == fast.milliseconds, name, "TagLib's length not kept");
+            check(std::abs(average.milliseconds - accurate.milliseconds) < accurate.milliseconds / 100, name,
+                  "wrong Average length");
+            check(average.bytesRead <= fast.bytesRead + 24 * 1024, name, "CBR stream sampled");
+            std::remove(path.c_str());
+        }
+    }
+} // namespace TagLibExt::Test
+
+int main(int argc, char **argv) {
+    using namespace TagLibExt::Test;
+
+    return runTest(argc, argv, [](const std::string &directory) {
+        for (const double duration: {30.0, 60.0, 300.0}) {
+            testVbr(directory, "mp3-vbr", duration);
+            testVbr(directory, "mp3-vbr-silence", duration);
+        }
+        testCbr(directory);
+    });
+}
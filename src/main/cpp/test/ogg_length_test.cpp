@@ -0,0 +1,91 @@
+/*
+ * Host test of ogg_length.h: appends junk of several lengths to generated
+ * Vorbis and Opus files and checks that the Accurate read style still finds
+ * the exact length, and that the other styles find the same length past junk
+ * out of reach of the bounded search, flagged as estimated.
+ *
+ * Usage: taglib_ogg_length_test [DIRECTORY]
+ */
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "corpus.h"
+#include "fileref_ext.h"
+#include "stream_properties.h"
+#include "test_support.h"
+#include "tfilestream.h"
+
+namespace TagLibExt::Test {
+    namespace {
+
+        bool appendJunk(const std::string &path, size_t length) {
+            FILE *file = std::fopen(path.c_str(), "ab");
+            if (!file) {
+                return false;
+            }
+            std::mt19937 random(static_cast<std::mt19937::result_type>(length));
+            std::vector<char> junk(length);
+            for (char &c: junk) {
+                c = static_cast<char>(random());
+            }
+            const bool ok = std::fwrite(junk.data(), 1, junk.size(), file) == junk.size();
+            return std::fclose(file) == 0 && ok;
+        }
+
+        struct Length {
+            int milliseconds{-1};
+            bool estimated{false};
+        };
+
+        Length readLength(const std::string &path, AudioProperties::ReadStyle style) {
+            FileStream stream(path.c_str(), true);
+            const FileRef f(path.c_str(), &stream, true, style);
+            Length length;
+            if (const auto properties = dynamic_cast<const StreamProperties *>(f.audioProperties())) {
+                length.milliseconds = properties->lengthInMilliseconds();
+                length.estimated = properties->isLengthEstimated();
+            }
+            return length;
+        }
+
+        void testJunk(const std::string &directory, const std::string &kind, const char *extension) {
+            const std::string path = directory + "/ogg_length_test." + extension;
+            if (!Benchmark::writeAudioFile(path, kind, 20, 1)) {
+                check(false, kind, "could not write the file");
+                return;
+            }
+            const Length clean = readLength(path, AudioProperties::Accurate);
+            check(clean.milliseconds > 19000 && !clean.estimated, kind, "wrong length without junk");
+            check(readLength(path, AudioProperties::Average).milliseconds == clean.milliseconds, kind,
+                  "wrong Average length without junk");
+
+            // Within the search window, then past it
+            size_t total = 0;
+            for (const size_t junk: {size_t{4096}, size_t{256 * 1024}, size_t{2 * 1024 * 1024}}) {
+                const std::string name = kind + " with " + std::to_string(junk) + " bytes of junk";
+                check(appendJunk(path, junk - total), name, "could not append junk");
+                total = junk;
+
+                const Length accurate = readLength(path, AudioProperties::Accurate);
+                check(accurate.milliseconds == clean.milliseconds && !accurate.estimated, name,
+                      "wrong Accurate length");
+                const Length average = readLength(path, AudioProperties::Average);
+                check(average.milliseconds == clean.milliseconds, name, "wrong Average length");
+                check(average.estimated == (junk > 128 * 1024), name, "wrong estimated flag");
+            }
+            std::remove(path.c_str());
+        }
+    }
+} // namespace TagLibExt::Test
+
+int main(int argc, char **argv) {
+    using namespace TagLibExt::Test;
+
+    return runTest(argc, argv, [](const std::string &directory) {
+        testJunk(directory, "ogg-vorbis", "ogg");
+        testJunk(directory, "opus", "opus");
+    });
+}
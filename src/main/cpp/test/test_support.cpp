@@ -0,0 +1,28 @@
+#include "test_support.h"
+
+#include <atomic>
+#include <cstdio>
+
+namespace TagLibExt::Test {
+    namespace {
+        std::atomic<int> failures{0};
+    }
+
+    void check(bool condition, const std::string &name, const char *what) {
+        if (!condition) {
+            std::fprintf(stderr, "%s: %s\n", name.c_str(), what);
+            failures++;
+        }
+    }
+
+    int runTest(int argc, char **argv, const std::function<void(const std::string &directory)> &cases) {
+        if (argc > 2) {
+            std::fprintf(stderr, "Usage: %s [DIRECTORY]\n", argv[0]);
+            return 2;
+        }
+        cases(argc == 2 ? argv[1] : ".");
+        std::printf("%s\n", failures == 0 ? "passed" : "FAILED");
+        return failures == 0 ? 0 : 1;
+    }
+
+} // namespace TagLibExt::Test
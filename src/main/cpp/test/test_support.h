@@ -0,0 +1,25 @@
+#ifndef TAGLIB_EXT_TEST_SUPPORT_H
+#define TAGLIB_EXT_TEST_SUPPORT_H
+
+#include <functional>
+#include <string>
+
+namespace TagLibExt::Test {
+
+    /*!
+     * Reports \a what on stderr for the case \a name and counts a failure unless
+     * \a condition holds.  Can be called from any thread.
+     */
+    void check(bool condition, const std::string &name, const char *what);
+
+    /*!
+     * Runs the host test whose cases are \a cases, with the directory for their
+     * scratch files given as the only argument, or the current directory.  Prints
+     * "passed" or "FAILED" and returns the exit status of the test, 2 for wrong
+     * arguments, 1 if a check failed.
+     */
+    int runTest(int argc, char **argv, const std::function<void(const std::string &directory)> &cases);
+
+} // namespace TagLibExt::Test
+
+#endif //TAGLIB_EXT_TEST_SUPPORT_H
@@ -0,0 +1,682 @@
+#include "utils.h"
+
+#include <atomic>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// The classes and methods are looked up in JNI_OnLoad() and released in JNI_OnUnload(), and only read in
+// between, so the JNI functions can use them from any thread.
+
+jclass stringClass = nullptr;
+
+jclass metadataClass = nullptr;
+jmethodID metadataConstructor = nullptr;
+
+jclass parseStatsClass = nullptr;
+
+namespace {
+    jmethodID stringIntern = nullptr;
+
+    // The standard property keys as interned Java strings, indexed like TagLibExt::standardPropertyKeys
+    jstring propertyKeyStrings[TagLibExt::StandardPropertyKeyCount] = {};
+
+    // Values of the properties with shared values returned while value interning is enabled, as global refs
+    constexpr size_t maxInternedValues = 4096;
+    constexpr unsigned int maxInternedValueLength = 256;
+    std::atomic<bool> valueInterningEnabled{false};
+    std::mutex internedValuesMutex;
+    std::map<TagLib::String, jstring> internedValues;
+
+    jclass hashMapClass = nullptr;
+    jmethodID hashMapInit = nullptr;
+    jmethodID hashMapPut = nullptr;
+
+    jclass audioPropertiesClass = nullptr;
+    jmethodID audioPropertiesConstructor = nullptr;
+
+    jclass pictureClass = nullptr;
+    jmethodID pictureConstructor = nullptr;
+    jmethodID pictureGetData = nullptr;
+    jmethodID pictureGetDescription = nullptr;
+    jmethodID pictureGetPictureType = nullptr;
+    jmethodID pictureGetMimeType = nullptr;
+
+    jclass exportedPictureClass = nullptr;
+    jmethodID exportedPictureConstructor = nullptr;
+
+    jclass pictureSourceClass = nullptr;
+    jmethodID pictureSourceGetBuffer = nullptr;
+    jmethodID pictureSourceGetFd = nullptr;
+    jmethodID pictureSourceGetOffset = nullptr;
+    jmethodID pictureSourceGetLength = nullptr;
+    jmethodID pictureSourceGetDescription = nullptr;
+    jmethodID pictureSourceGetPictureType = nullptr;
+    jmethodID pictureSourceGetMimeType = nullptr;
+
+    jmethodID bufferLimit = nullptr;
+
+    jmethodID parseStatsConstructor = nullptr;
+
+    jclass libraryChangeClass = nullptr;
+    jmethodID libraryChangeConstructor = nullptr;
+
+    // The LibraryChangeType constants, indexed like TagLibExt::LibraryChange::Type
+    jobject libraryChangeTypes[3] = {};
+
+    jclass entrySetClass = nullptr;
+    jmethodID iteratorMethod = nullptr;
+    jmethodID entrySetMethod = nullptr;
+
+    jclass iteratorClass = nullptr;
+    jmethodID hasNextMethod = nullptr;
+    jmethodID nextMethod = nullptr;
+
+    jclass mapEntryClass = nullptr;
+    jmethodID getKeyMethod = nullptr;
+    jmethodID getValueMethod = nullptr;
+
+    // Releases the interned values, if any
+    void clearInternedValues(JNIEnv *env) {
+        std::lock_guard<std::mutex> lock(internedValuesMutex);
+        for (const auto &value: internedValues) {
+            env->DeleteGlobalRef(value.second);
+        }
+        internedValues.clear();
+    }
+
+    // Returns a local reference to the interned Java string of str, interning it if there is room, or nullptr
+    // if it is not interned.  The reference is taken under the lock, as the global one may be released by
+    // clearInternedValues() on another thread as soon as it is released.
+    jstring internedValueString(JNIEnv *env, const TagLib::String &str) {
+        if (str.size() > maxInternedValueLength) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(internedValuesMutex);
+        if (const auto value = internedValues.find(str); value != internedValues.end()) {
+            return reinterpret_cast<jstring>(env->NewLocalRef(value->second));
+        }
+        if (!valueInterningEnabled || internedValues.size() >= maxInternedValues) {
+            return nullptr;
+        }
+        jstring jStr = StringToJniString(env, str);
+        internedValues[str] = reinterpret_cast<jstring>(env->NewGlobalRef(jStr));
+        return jStr;
+    }
+}
+
+extern "C" JNIEXPORT jint JNI_OnLoad(JavaVM *vm, void *) {
+    JNIEnv *env;
+    if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK) {
+        return JNI_ERR;
+    }
+
+    jclass _stringClass = env->FindClass("java/lang/String");
+    stringClass = reinterpret_cast<jclass>(env->NewGlobalRef(_stringClass));
+    env->DeleteLocalRef(_stringClass);
+    stringIntern = env->GetMethodID(stringClass, "intern", "()Ljava/lang/String;");
+
+    for (size_t i = 0; i < TagLibExt::StandardPropertyKeyCount; i++) {
+        jstring key = env->NewStringUTF(TagLibExt::standardPropertyKeys[i].name);
+        jobject internedKey = env->CallObjectMethod(key, stringIntern);
+        propertyKeyStrings[i] = reinterpret_cast<jstring>(env->NewGlobalRef(internedKey));
+        env->DeleteLocalRef(internedKey);
+        env->DeleteLocalRef(key);
+    }
+
+    jclass _hashMapClass = env->FindClass("java/util/HashMap");
+    hashMapClass = reinterpret_cast<jclass>(env->NewGlobalRef(_hashMapClass));
+    env->DeleteLocalRef(_hashMapClass);
+    hashMapInit = env->GetMethodID(hashMapClass, "<init>", "(I)V");
+    hashMapPut = env->GetMethodID(hashMapClass, "put",
+                                  "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;");
+
+    jclass _metadataClass = env->FindClass("com/kyant/taglib/Metadata");
+    metadataClass = reinterpret_cast<jclass>(env->NewGlobalRef(_metadataClass));
+    env->DeleteLocalRef(_metadataClass);
+    metadataConstructor = env->GetMethodID(metadataClass, "<init>",
+                                           "(Ljava/util/HashMap;[Lcom/kyant/taglib/Picture;)V");
+
+    jclass _audioPropertiesClass = env->FindClass("com/kyant/taglib/AudioProperties");
+    audioPropertiesClass = reinterpret_cast<jclass>(env->NewGlobalRef(_audioPropertiesClass));
+    env->DeleteLocalRef(_audioPropertiesClass);
+    audioPropertiesConstructor = env->GetMethodID(audioPropertiesClass, "<init>", "(IIIIZF)V");
+
+    jclass _pictureClass = env->FindClass("com/kyant/taglib/Picture");
+    pictureClass = reinterpret_cast<jclass>(env->NewGlobalRef(_pictureClass));
+    env->DeleteLocalRef(_pictureClass);
+    pictureConstructor = env->GetMethodID(pictureClass, "<init>",
+                                          "([BLjava/lang/String;Ljava/lang/String;Ljava/lang/String;)V");
+    pictureGetData = env->GetMethodID(pictureClass, "getData", "()[B");
+    pictureGetDescription = env->GetMethodID(pictureClass, "getDescription", "()Ljava/lang/String;");
+    pictureGetPictureType = env->GetMethodID(pictureClass, "getPictureType", "()Ljava/lang/String;");
+    pictureGetMimeType = env->GetMethodID(pictureClass, "getMimeType", "()Ljava/lang/String;");
+
+    jclass _exportedPictureClass = env->FindClass("com/kyant/taglib/ExportedPicture");
+    exportedPictureClass = reinterpret_cast<jclass>(env->NewGlobalRef(_exportedPictureClass));
+    env->DeleteLocalRef(_exportedPictureClass);
+    exportedPictureConstructor = env->GetMethodID(exportedPictureClass, "<init>",
+                                                  "(Ljava/lang/String;Ljava/lang/String;J)V");
+
+    jclass _pictureSourceClass = env->FindClass("com/kyant/taglib/PictureSource");
+    pictureSourceClass = reinterpret_cast<jclass>(env->NewGlobalRef(_pictureSourceClass));
+    env->DeleteLocalRef(_pictureSourceClass);
+    pictureSourceGetBuffer = env->GetMethodID(pictureSourceClass, "getBuffer", "()Ljava/nio/ByteBuffer;");
+    pictureSourceGetFd = env->GetMethodID(pictureSourceClass, "getFd", "()I");
+    pictureSourceGetOffset = env->GetMethodID(pictureSourceClass, "getOffset", "()J");
+    pictureSourceGetLength = env->GetMethodID(pictureSourceClass, "getLength", "()J");
+    pictureSourceGetDescription = env->GetMethodID(pictureSourceClass, "getDescription", "()Ljava/lang/String;");
+    pictureSourceGetPictureType = env->GetMethodID(pictureSourceClass, "getPictureType", "()Ljava/lang/String;");
+    pictureSourceGetMimeType = env->GetMethodID(pictureSourceClass, "getMimeType", "()Ljava/lang/String;");
+
+    jclass bufferClass = env->FindClass("java/nio/Buffer");
+    bufferLimit = env->GetMethodID(bufferClass, "limit", "()I");
+    env->DeleteLocalRef(bufferClass);
+
+    jclass _parseStatsClass = env->FindClass("com/kyant/taglib/ParseStats");
+    parseStatsClass = reinterpret_cast<jclass>(env->NewGlobalRef(_parseStatsClass));
+    env->DeleteLocalRef(_parseStatsClass);
+    parseStatsConstructor = env->GetMethodID(parseStatsClass, "<init>",
+                                             "(JLjava/lang/String;JJJJJJJJJJJJJJJ)V");
+
+    jclass _libraryChangeClass = env->FindClass("com/kyant/taglib/LibraryChange");
+    libraryChangeClass = reinterpret_cast<jclass>(env->NewGlobalRef(_libraryChangeClass));
+    env->DeleteLocalRef(_libraryChangeClass);
+    libraryChangeConstructor = env->GetMethodID(libraryChangeClass, "<init>",
+                                                "(Lcom/kyant/taglib/LibraryChangeType;Ljava/lang/String;Z"
+                                                "Ljava/util/HashMap;I)V");
+
+    jclass libraryChangeTypeClass = env->FindClass("com/kyant/taglib/LibraryChangeType");
+    const char *const libraryChangeTypeNames[] = {"Changed", "Removed", "Overflow"};
+    for (size_t i = 0; i < 3; i++) {
+        jfieldID field = env->GetStaticFieldID(libraryChangeTypeClass, libraryChangeTypeNames[i],
+                                               "Lcom/kyant/taglib/LibraryChangeType;");
+        jobject type = env->GetStaticObjectField(libraryChangeTypeClass, field);
+        libraryChangeTypes[i] = env->NewGlobalRef(type);
+        env->DeleteLocalRef(type);
+    }
+    env->DeleteLocalRef(libraryChangeTypeClass);
+
+    jclass _entrySetClass = env->FindClass("java/util/Set");
+    entrySetClass = reinterpret_cast<jclass>(env->NewGlobalRef(_entrySetClass));
+    env->DeleteLocalRef(_entrySetClass);
+    iteratorMethod = env->GetMethodID(entrySetClass, "iterator", "()Ljava/util/Iterator;");
+    entrySetMethod = env->GetMethodID(hashMapClass, "entrySet", "()Ljava/util/Set;");
+
+    jclass _iteratorClass = env->FindClass("java/util/Iterator");
+    iteratorClass = reinterpret_cast<jclass>(env->NewGlobalRef(_iteratorClass));
+    env->DeleteLocalRef(_iteratorClass);
+    hasNextMethod = env->GetMethodID(iteratorClass, "hasNext", "()Z");
+    nextMethod = env->GetMethodID(iteratorClass, "next", "()Ljava/lang/Object;");
+
+    jclass _mapEntryClass = env->FindClass("java/util/Map$Entry");
+    mapEntryClass = reinterpret_cast<jclass>(env->NewGlobalRef(_mapEntryClass));
+    env->DeleteLocalRef(_mapEntryClass);
+    getKeyMethod = env->GetMethodID(mapEntryClass, "getKey", "()Ljava/lang/Object;");
+    getValueMethod = env->GetMethodID(mapEntryClass, "getValue", "()Ljava/lang/Object;");
+
+    return JNI_VERSION_1_6;
+}
+
+extern "C" JNIEXPORT void JNI_OnUnload(JavaVM *vm, void *) {
+    JNIEnv *env;
+    if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK) {
+        return;
+    }
+
+    env->DeleteGlobalRef(stringClass);
+    for (jstring &key: propertyKeyStrings) {
+        env->DeleteGlobalRef(key);
+        key = nullptr;
+    }
+    clearInternedValues(env);
+    env->DeleteGlobalRef(hashMapClass);
+    env->DeleteGlobalRef(metadataClass);
+    env->DeleteGlobalRef(audioPropertiesClass);
+    env->DeleteGlobalRef(pictureClass);
+    env->DeleteGlobalRef(exportedPictureClass);
+    env->DeleteGlobalRef(pictureSourceClass);
+    env->DeleteGlobalRef(parseStatsClass);
+    env->DeleteGlobalRef(libraryChangeClass);
+    for (jobject &type: libraryChangeTypes) {
+        env->DeleteGlobalRef(type);
+        type = nullptr;
+    }
+    env->DeleteGlobalRef(entrySetClass);
+    env->DeleteGlobalRef(iteratorClass);
+    env->DeleteGlobalRef(mapEntryClass);
+
+    stringClass = nullptr;
+    stringIntern = nullptr;
+    hashMapClass = nullptr;
+    hashMapInit = nullptr;
+    hashMapPut = nullptr;
+    metadataClass = nullptr;
+    metadataConstructor = nullptr;
+    audioPropertiesClass = nullptr;
+    audioPropertiesConstructor = nullptr;
+    pictureClass = nullptr;
+    pictureConstructor = nullptr;
+    pictureGetData = nullptr;
+    pictureGetDescription = nullptr;
+    pictureGetPictureType = nullptr;
+    pictureGetMimeType = nullptr;
+    exportedPictureClass = nullptr;
+    exportedPictureConstructor = nullptr;
+    pictureSourceClass = nullptr;
+    pictureSourceGetBuffer = nullptr;
+    pictureSourceGetFd = nullptr;
+    pictureSourceGetOffset = nullptr;
+    pictureSourceGetLength = nullptr;
+    pictureSourceGetDescription = nullptr;
+    pictureSourceGetPictureType = nullptr;
+    pictureSourceGetMimeType = nullptr;
+    bufferLimit = nullptr;
+    parseStatsClass = nullptr;
+    parseStatsConstructor = nullptr;
+    libraryChangeClass = nullptr;
+    libraryChangeConstructor = nullptr;
+    entrySetClass = nullptr;
+    iteratorMethod = nullptr;
+    entrySetMethod = nullptr;
+    iteratorClass = nullptr;
+    hasNextMethod = nullptr;
+    nextMethod = nullptr;
+    mapEntryClass = nullptr;
+    getKeyMethod = nullptr;
+    getValueMethod = nullptr;
+}
+
+void setValueInterningEnabled(JNIEnv *env, bool enabled) {
+    valueInterningEnabled = enabled;
+    if (!enabled) {
+        clearInternedValues(env);
+    }
+}
+
+// Helper function to convert C++ String to JNI String, using the thread arena for the UTF-16 copy
+jstring StringToJniString(JNIEnv *env, const TagLib::String &str) {
+    const TagLibExt::Utf16View utf16 = TagLibExt::toUtf16(str, TagLibExt::threadArena());
+    return env->NewString(reinterpret_cast<const jchar *>(utf16.data), static_cast<jsize>(utf16.length));
+}
+
+// Helper function to convert JNI String to C++ String, using the thread arena for the UTF-16 copy
+TagLib::String JniStringToString(JNIEnv *env, jstring jStr) {
+    TagLibExt::Arena &arena = TagLibExt::threadArena();
+    const jsize length = env->GetStringLength(jStr);
+    auto *chars = arena.allocate<uint16_t>(length);
+    env->GetStringRegion(jStr, 0, length, reinterpret_cast<jchar *>(chars));
+    return TagLibExt::fromUtf16(chars, length, arena);
+}
+
+// Helper function to convert C++ StringList to JNI String array, sharing the interned strings of the values
+// if internValues is true and value interning is enabled
+jobjectArray StringListToJniStringArray(JNIEnv *env, const TagLib::StringList &stringList,
+                                        bool internValues) {
+    internValues = internValues && valueInterningEnabled;
+    jobjectArray array = env->NewObjectArray(static_cast<jsize>(stringList.size()),
+                                             stringClass, nullptr);
+    int i = 0;
+    for (const auto &str: stringList) {
+        jstring jStr = internValues ? internedValueString(env, str) : nullptr;
+        if (jStr == nullptr) {
+            jStr = StringToJniString(env, str);
+        }
+        env->SetObjectArrayElement(array, i, jStr);
+        env->DeleteLocalRef(jStr);
+        i++;
+    }
+    return array;
+}
+
+// Helper function to convert C++ PropertyMap to JNI HashMap, with the interned strings of the standard keys
+jobject PropertyMapToJniHashMap(JNIEnv *env, const TagLib::PropertyMap &propertyMap) {
+    jobject hashMap = env->NewObject(hashMapClass, hashMapInit, static_cast<jint>(propertyMap.size()));
+
+    for (const auto &property: propertyMap) {
+        const TagLib::StringList &valueList = property.second;
+        const int keyIndex = TagLibExt::findStandardPropertyKey(property.first);
+        const bool sharedValues = keyIndex >= 0 && TagLibExt::standardPropertyKeys[keyIndex].sharedValues;
+
+        jobjectArray valueArray = StringListToJniStringArray(env, valueList, sharedValues);
+
+        if (keyIndex >= 0) {
+            env->CallObjectMethod(hashMap, hashMapPut, propertyKeyStrings[keyIndex], valueArray);
+        } else {
+            jstring jKey = StringToJniString(env, property.first);
+            env->CallObjectMethod(hashMap, hashMapPut, jKey, valueArray);
+            env->DeleteLocalRef(jKey);
+        }
+
+        env->DeleteLocalRef(valueArray);
+    }
+
+    return hashMap;
+}
+
+// Helper function to convert JNI String array to C++ StringList
+TagLib::StringList JniStringArrayToStringList(JNIEnv *env, jobjectArray stringArray) {
+    TagLib::StringList stringList;
+
+    const jsize arrayLength = env->GetArrayLength(stringArray);
+    for (int i = 0; i < arrayLength; ++i) {
+        auto jStr = reinterpret_cast<jstring>(env->GetObjectArrayElement(stringArray, i));
+        stringList.append(JniStringToString(env, jStr));
+        env->DeleteLocalRef(jStr);
+    }
+
+    return stringList;
+}
+
+// Helper function to convert JNI HashMap to C++ PropertyMap
+TagLib::PropertyMap JniHashMapToPropertyMap(JNIEnv *env, jobject hashMap) {
+    TagLib::PropertyMap propertyMap;
+
+    jobject entrySet = env->CallObjectMethod(hashMap, entrySetMethod);
+    jobject iterator = env->CallObjectMethod(entrySet, iteratorMethod);
+
+    while (env->CallBooleanMethod(iterator, hasNextMethod)) {
+        jobject entry = env->CallObjectMethod(iterator, nextMethod);
+        jobject key = env->CallObjectMethod(entry, getKeyMethod);
+        jobject value = env->CallObjectMethod(entry, getValueMethod);
+
+        const StringList valueList = JniStringArrayToStringList(env, reinterpret_cast<jobjectArray>(value));
+
+        propertyMap[JniStringToString(env, reinterpret_cast<jstring>(key))] = valueList;
+
+        env->DeleteLocalRef(entry);
+        env->DeleteLocalRef(key);
+        env->DeleteLocalRef(value);
+    }
+
+    return propertyMap;
+}
+
+// Helper function to convert C++ PictureList to JNI Picture array
+jobjectArray PictureListToJniPictureArray(
+        JNIEnv *env,
+        const TagLib::List<TagLib::Map<TagLib::String, TagLib::Variant>> &pictureList
+) {
+    jobjectArray array = env->NewObjectArray(static_cast<jsize>(pictureList.size()),
+                                             pictureClass, nullptr);
+    int i = 0;
+    for (const auto &picture: pictureList) {
+        const ByteVector pictureData = picture["data"].toByteVector();
+        if (pictureData.isEmpty()) {
+            continue;
+        }
+
+        jbyteArray bytes = env->NewByteArray(static_cast<jint>(pictureData.size()));
+        jstring jDescription = StringToJniString(env, picture["description"].toString());
+        jstring jPictureType = StringToJniString(env, picture["pictureType"].toString());
+        jstring jMimeType = StringToJniString(env, picture["mimeType"].toString());
+
+        env->SetByteArrayRegion(
+                bytes,
+                0,
+                static_cast<jint>(pictureData.size()),
+                reinterpret_cast<const jbyte *>(pictureData.data())
+        );
+        jobject pictureObject = env->NewObject(
+                pictureClass, pictureConstructor,
+                bytes, jDescription, jPictureType, jMimeType);
+        env->DeleteLocalRef(bytes);
+        env->DeleteLocalRef(jDescription);
+        env->DeleteLocalRef(jPictureType);
+        env->DeleteLocalRef(jMimeType);
+        env->SetObjectArrayElement(array, i, pictureObject);
+        env->DeleteLocalRef(pictureObject);
+        i++;
+    }
+    return array;
+}
+
+// Helper function to build a picture from its data and the JNI strings describing it
+TagLib::VariantMap JniPictureToPicture(JNIEnv *env, const TagLib::ByteVector &data,
+                                       jstring description, jstring pictureType, jstring mimeType) {
+    TagLib::VariantMap picture;
+    picture["data"] = data;
+    picture["description"] = JniStringToString(env, description);
+    picture["pictureType"] = JniStringToString(env, pictureType);
+    picture["mimeType"] = JniStringToString(env, mimeType);
+    return picture;
+}
+
+// Helper function to convert JNI Picture array to C++ PictureList
+TagLib::List<TagLib::Map<TagLib::String, TagLib::Variant>>
+JniPictureArrayToPictureList(JNIEnv *env, jobjectArray pictures) {
+    TagLib::List<TagLib::Map<TagLib::String, TagLib::Variant>> pictureList;
+
+    const jsize pictureCount = env->GetArrayLength(pictures);
+    for (int i = 0; i < pictureCount; i++) {
+        jobject pictureObject = env->GetObjectArrayElement(pictures, i);
+        const auto bytes = reinterpret_cast<jbyteArray>(env->CallObjectMethod(pictureObject,
+                                                                              pictureGetData));
+        const auto description = reinterpret_cast<jstring>(env->CallObjectMethod(pictureObject,
+                                                                                 pictureGetDescription));
+        const auto pictureType = reinterpret_cast<jstring>(env->CallObjectMethod(pictureObject,
+                                                                                 pictureGetPictureType));
+        const auto mimeType = reinterpret_cast<jstring>(env->CallObjectMethod(pictureObject,
+                                                                              pictureGetMimeType));
+
+        // Copy the array straight into the ByteVector, GetByteArrayElements may copy it first
+        const jsize pictureDataSize = env->GetArrayLength(bytes);
+        TagLib::ByteVector pictureData(static_cast<unsigned int>(pictureDataSize));
+        env->GetByteArrayRegion(bytes, 0, pictureDataSize, reinterpret_cast<jbyte *>(pictureData.data()));
+
+        pictureList.append(JniPictureToPicture(env, pictureData, description, pictureType, mimeType));
+
+        env->DeleteLocalRef(bytes);
+        env->DeleteLocalRef(description);
+        env->DeleteLocalRef(pictureType);
+        env->DeleteLocalRef(mimeType);
+        env->DeleteLocalRef(pictureObject);
+    }
+
+    return pictureList;
+}
+
+// Helper function to read the data of a JNI PictureSource, copying it exactly once into the result
+bool JniPictureSourceToByteVector(JNIEnv *env, jobject pictureSource, TagLib::ByteVector &data) {
+    const jlong offset = env->CallLongMethod(pictureSource, pictureSourceGetOffset);
+    const jlong length = env->CallLongMethod(pictureSource, pictureSourceGetLength);
+    if (offset < 0 || length < 0 || length > std::numeric_limits<unsigned int>::max()) {
+        return false;
+    }
+
+    // The range is checked against the file or buffer before anything is allocated, so that a wrong
+    // length fails the call instead of throwing std::bad_alloc through the JNI frame.
+    jobject buffer = env->CallObjectMethod(pictureSource, pictureSourceGetBuffer);
+    if (buffer == nullptr) {
+        const jint fd = env->CallIntMethod(pictureSource, pictureSourceGetFd);
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || offset > st.st_size || length > st.st_size - offset) {
+            return false;
+        }
+        data = TagLib::ByteVector(static_cast<unsigned int>(length));
+        return TagLibExt::readFully(fd, offset, data.data(), static_cast<size_t>(length));
+    }
+
+    // Bytes past the limit of the buffer are not picture data, even if within its capacity
+    const auto *address = static_cast<const char *>(env->GetDirectBufferAddress(buffer));
+    const jint limit = env->CallIntMethod(buffer, bufferLimit);
+    env->DeleteLocalRef(buffer);
+    if (address == nullptr || offset > limit || length > limit - offset) {
+        return false;
+    }
+    data = TagLib::ByteVector(address + offset, static_cast<unsigned int>(length));
+    return true;
+}
+
+// Helper function to convert JNI PictureSource array to C++ PictureList
+bool JniPictureSourceArrayToPictureList(
+        JNIEnv *env,
+        jobjectArray pictureSources,
+        TagLib::List<TagLib::Map<TagLib::String, TagLib::Variant>> &pictureList
+) {
+    const jsize pictureCount = env->GetArrayLength(pictureSources);
+    for (int i = 0; i < pictureCount; i++) {
+        jobject pictureSource = env->GetObjectArrayElement(pictureSources, i);
+        TagLib::ByteVector pictureData;
+        if (!JniPictureSourceToByteVector(env, pictureSource, pictureData)) {
+            env->DeleteLocalRef(pictureSource);
+            return false;
+        }
+
+        const auto description = reinterpret_cast<jstring>(env->CallObjectMethod(pictureSource,
+                                                                                 pictureSourceGetDescription));
+        const auto pictureType = reinterpret_cast<jstring>(env->CallObjectMethod(pictureSource,
+                                                                                 pictureSourceGetPictureType));
+        const auto mimeType = reinterpret_cast<jstring>(env->CallObjectMethod(pictureSource,
+                                                                              pictureSourceGetMimeType));
+
+        pictureList.append(JniPictureToPicture(env, pictureData, description, pictureType, mimeType));
+
+        env->DeleteLocalRef(description);
+        env->DeleteLocalRef(pictureType);
+        env->DeleteLocalRef(mimeType);
+        env->DeleteLocalRef(pictureSource);
+    }
+
+    return true;
+}
+
+jobject getAudioProperties(JNIEnv *env, const TagLibExt::FileRef &f,
+                           TagLibExt::ParseStats *stats) {
+    TagLibExt::PhaseTimer timer(stats, TagLibExt::Phase::Conversion);
+    const AudioProperties *audioProperties = f.audioProperties();
+    if (audioProperties) {
+        const jint duration = static_cast<jint>(audioProperties->lengthInMilliseconds());
+        const jint bitrate = static_cast<jint>(audioProperties->bitrate());
+        const jint sampleRate = static_cast<jint>(audioProperties->sampleRate());
+        const jint channels = static_cast<jint>(audioProperties->channels());
+        const auto *streamProperties = dynamic_cast<const TagLibExt::StreamProperties *>(audioProperties);
+        const jboolean lengthEstimated = streamProperties && streamProperties->isLengthEstimated();
+        const jfloat lengthConfidence = streamProperties ? static_cast<jfloat>(streamProperties->lengthConfidence())
+                                                         : 1.0f;
+        return env->NewObject(
+                audioPropertiesClass, audioPropertiesConstructor,
+                duration, bitrate, sampleRate, channels, lengthEstimated, lengthConfidence);
+    }
+    return env->NewObject(audioPropertiesClass, audioPropertiesConstructor, 0, 0, 0, 0, JNI_FALSE, 1.0f);
+}
+
+jobject getPropertyMap(JNIEnv *env, const TagLibExt::FileRef &f,
+                       TagLibExt::ParseStats *stats) {
+    PropertyMap propertyMap;
+    {
+        TagLibExt::PhaseTimer timer(stats, TagLibExt::Phase::Properties);
+        propertyMap = f.properties();
+    }
+    TagLibExt::PhaseTimer timer(stats, TagLibExt::Phase::Conversion);
+    return PropertyMapToJniHashMap(env, propertyMap);
+}
+
+jobjectArray getPictures(JNIEnv *env, const TagLibExt::FileRef &f,
+                         TagLibExt::ParseStats *stats) {
+    TagLib::List<TagLib::VariantMap> pictureList;
+    {
+        TagLibExt::PhaseTimer timer(stats, TagLibExt::Phase::Pictures);
+        pictureList = f.complexProperties("PICTURE");
+    }
+    TagLibExt::PhaseTimer timer(stats, TagLibExt::Phase::Conversion);
+    return PictureListToJniPictureArray(env, pictureList);
+}
+
+// Helper function to convert C++ ExportedPicture to JNI ExportedPicture
+jobject newJniExportedPicture(JNIEnv *env, const TagLibExt::ExportedPicture &exported) {
+    jstring jMimeType = StringToJniString(env, exported.mimeType);
+    jstring jPictureType = StringToJniString(env, exported.pictureType);
+    jobject exportedPicture = env->NewObject(
+            exportedPictureClass, exportedPictureConstructor,
+            jMimeType, jPictureType, static_cast<jlong>(exported.size));
+    env->DeleteLocalRef(jMimeType);
+    env->DeleteLocalRef(jPictureType);
+    return exportedPicture;
+}
+
+jobjectArray emptyPictureArray(JNIEnv *env) {
+    return env->NewObjectArray(0, pictureClass, nullptr);
+}
+
+// Helper function to convert C++ ParseStats to JNI ParseStats
+jobject ParseStatsToJniParseStats(JNIEnv *env, const TagLibExt::ParseStats &stats) {
+    using TagLibExt::Phase;
+
+    jstring jFormat = env->NewStringUTF(stats.format);
+    jobject parseStats = env->NewObject(
+            parseStatsClass, parseStatsConstructor,
+            static_cast<jlong>(stats.calls),
+            jFormat,
+            static_cast<jlong>(stats.detectionAttempts),
+            static_cast<jlong>(stats.bytesRead),
+            static_cast<jlong>(stats.bytesWritten),
+            static_cast<jlong>(stats.readCalls),
+            static_cast<jlong>(stats.writeCalls),
+            static_cast<jlong>(stats.seekCalls),
+            static_cast<jlong>(stats.phaseNanos(Phase::Detect)),
+            static_cast<jlong>(stats.phaseNanos(Phase::Parse)),
+            static_cast<jlong>(stats.phaseNanos(Phase::Properties)),
+            static_cast<jlong>(stats.phaseNanos(Phase::Pictures)),
+            static_cast<jlong>(stats.phaseNanos(Phase::Conversion)),
+            static_cast<jlong>(stats.phaseNanos(Phase::Save)),
+            static_cast<jlong>(stats.allocations),
+            static_cast<jlong>(stats.allocatedBytes),
+            static_cast<jlong>(stats.peakLiveBytes));
+    env->DeleteLocalRef(jFormat);
+    return parseStats;
+}
+
+// Helper function to convert C++ LibraryChanges to a JNI LibraryChange array
+jobjectArray LibraryChangesToJniLibraryChangeArray(JNIEnv *env,
+                                                   const std::vector<TagLibExt::LibraryChange> &changes) {
+    jobjectArray array = env->NewObjectArray(static_cast<jsize>(changes.size()), libraryChangeClass, nullptr);
+    int i = 0;
+    for (const auto &change: changes) {
+        jstring jPath = StringToJniString(env, TagLib::String(change.path, TagLib::String::UTF8));
+        jobject propertyMap = change.type == TagLibExt::LibraryChange::Type::Changed
+                              ? PropertyMapToJniHashMap(env, change.properties)
+                              : nullptr;
+        jobject libraryChange = env->NewObject(
+                libraryChangeClass, libraryChangeConstructor,
+                libraryChangeTypes[static_cast<size_t>(change.type)], jPath,
+                static_cast<jboolean>(change.directory), propertyMap,
+                static_cast<jint>(change.lengthInMilliseconds));
+        env->SetObjectArrayElement(array, i, libraryChange);
+        env->DeleteLocalRef(libraryChange);
+        env->DeleteLocalRef(propertyMap);
+        env->DeleteLocalRef(jPath);
+        i++;
+    }
+    return array;
+}
+
+// Helper function to convert TagIndex row ids to a JNI int array
+jintArray RowsToJniIntArray(JNIEnv *env, const std::vector<uint32_t> &rows) {
+    jintArray array = env->NewIntArray(static_cast<jsize>(rows.size()));
+    env->SetIntArrayRegion(array, 0, static_cast<jsize>(rows.size()), reinterpret_cast<const jint *>(rows.data()));
+    return array;
+}
+
+// Returns the path of fd, allocated from the thread arena
+const char *getRealPathFromFd(const int fd) {
+    char path[22];
+    if (snprintf(path, sizeof(path), "/proc/self/fd/%d", fd) < 0) {
+        return nullptr;
+    }
+
+    TagLibExt::Arena &arena = TagLibExt::threadArena();
+    for (size_t size = 256;; size *= 2) {
+        char *link = arena.allocate<char>(size);
+        const ssize_t bytesRead = readlink(path, link, size);
+        if (bytesRead < 0) {
+            return nullptr;
+        }
+        if (static_cast<size_t>(bytesRead) < size) {
+            link[bytesRead] = '\0';
+            return link;
+        }
+    }
+}
@@ -7,10 +7,18 @@ package com.kyant.taglib
  * @property bitrate Bitrate in kbps
  * @property sampleRate Sample rate in Hz
  * @property channels Number of channels
+ * @property isLengthEstimated Whether [length] is an estimate. This is the case for Ogg Vorbis and Opus
+ * files whose last page is not near the end of the file, e.g. because of trailing junk, and for VBR MP3
+ * files without a Xing or VBRI header, whose length is estimated from a sample of their frames, unless
+ * they are read with [AudioPropertiesReadStyle.Accurate]
+ * @property lengthConfidence How reliable [length] is, from 0 to 1: 1 if it is exact, and for an estimate,
+ * 1 minus the relative error it has with 95% probability, or 0 if that is not known
  */
 public data class AudioProperties(
     val length: Int,
     val bitrate: Int,
     val sampleRate: Int,
     val channels: Int,
+    val isLengthEstimated: Boolean = false,
+    val lengthConfidence: Float = 1f,
 )
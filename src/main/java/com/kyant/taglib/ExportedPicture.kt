@@ -0,0 +1,15 @@
+package com.kyant.taglib
+
+/**
+ * ExportedPicture describes a picture written to a file descriptor by [TagLib.exportPicture].
+ *
+ * @param mimeType String with image format, e.g. "image/jpeg"
+ * @param pictureType String with type as specified for ID3v2, e.g. "Front Cover", empty if the format has no
+ * picture types
+ * @param size Number of bytes written
+ */
+public data class ExportedPicture(
+    val mimeType: String,
+    val pictureType: String,
+    val size: Long,
+)
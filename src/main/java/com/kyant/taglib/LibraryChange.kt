@@ -0,0 +1,32 @@
+package com.kyant.taglib
+
+/**
+ * LibraryChange is a change below a root watched by [LibraryWatcher].
+ *
+ * @param type What changed
+ * @param path Path of the file or directory, or of the root for [LibraryChangeType.Overflow]
+ * @param isDirectory Whether [path] is a directory; a removed directory stands for everything below it
+ * @param propertyMap Tags of a changed file, null for other changes
+ * @param length Length of a changed file in milliseconds, read with [AudioPropertiesReadStyle.Fast]
+ */
+public data class LibraryChange(
+    val type: LibraryChangeType,
+    val path: String,
+    val isDirectory: Boolean,
+    val propertyMap: PropertyMap?,
+    val length: Int,
+)
+
+/**
+ * The type of a [LibraryChange].
+ */
+public enum class LibraryChangeType {
+    /** The file was added or written, and parsed again */
+    Changed,
+
+    /** The file or directory was deleted or moved away */
+    Removed,
+
+    /** Events were lost, the root has to be scanned again */
+    Overflow,
+}
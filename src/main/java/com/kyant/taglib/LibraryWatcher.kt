@@ -0,0 +1,118 @@
+package com.kyant.taglib
+
+import java.io.Closeable
+import java.util.concurrent.locks.ReentrantReadWriteLock
+import kotlin.concurrent.read
+import kotlin.concurrent.write
+
+/**
+ * LibraryWatcher watches directory trees with inotify and parses the audio files written, copied or
+ * moved into them, so that a library only has to be scanned once instead of periodically.
+ *
+ * Events are coalesced until none arrived for [quietMillis], or for at most [maxDelayMillis] after
+ * the first one, so that copying an album yields one batch with one change per file. Files are picked
+ * up once closed after writing. Files without the extension of a format the library was built with,
+ * see [TagLib.getFormats], are ignored. A watcher waiting for changes uses no CPU.
+ *
+ * Call [waitForChanges] from a background thread. [addRoot] and [waitForChanges] must be called from one
+ * thread at a time, [wakeUp] and [close] from any thread: [close] makes a [waitForChanges] in progress
+ * return and waits for it. [wakeUp] does nothing once the watcher is closed, the other methods throw
+ * [IllegalStateException].
+ *
+ * @param quietMillis Time without events after which a batch is reported
+ * @param maxDelayMillis Maximum time a batch is held back while events keep arriving
+ */
+public class LibraryWatcher(
+    quietMillis: Int = 500,
+    maxDelayMillis: Int = 5000,
+) : Closeable {
+
+    private var handle: Long = create(quietMillis, maxDelayMillis)
+
+    // Held for reading by the calls using the handle, for writing by close(), so that a wakeUp() from
+    // another thread never uses a destroyed watcher.
+    private val lock = ReentrantReadWriteLock()
+
+    // Set by close() before it wakes up a waiting thread, so that the thread does not wait again while
+    // close() waits for the write lock.
+    @Volatile
+    private var closing = false
+
+    init {
+        check(handle != 0L) { "inotify is not available" }
+    }
+
+    /**
+     * Watch [path] and every directory below it. Files already there are not reported.
+     *
+     * @param path Path of a directory
+     *
+     * @return true if the directory is watched, false if it is not a directory or the inotify watch
+     * limit was reached
+     */
+    public fun addRoot(path: String): Boolean = lock.read {
+        addRoot(checkedHandle(), path)
+    }
+
+    /**
+     * Wait for the next batch of changes.
+     *
+     * @param timeoutMillis Maximum time to wait, or -1 to wait until there are changes or [wakeUp]
+     * is called
+     *
+     * @return The changes, empty if the timeout expired or [wakeUp] was called first
+     */
+    public fun waitForChanges(timeoutMillis: Int = -1): Array<LibraryChange> = lock.read {
+        val handle = checkedHandle()
+        if (closing) emptyArray() else waitForChanges(handle, timeoutMillis)
+    }
+
+    /**
+     * Make a [waitForChanges] call on another thread return. Can be called from any thread, also
+     * while or after the watcher is closed.
+     */
+    public fun wakeUp(): Unit = lock.read {
+        if (handle != 0L) {
+            wakeUp(handle)
+        }
+    }
+
+    override fun close() {
+        // A waitForChanges() on another thread holds the read lock until it returns, and a queued
+        // write lock would keep a later wakeUp() from ever taking it, so wake the thread up first.
+        closing = true
+        wakeUp()
+        lock.write {
+            if (handle != 0L) {
+                destroy(handle)
+                handle = 0L
+            }
+        }
+    }
+
+    private fun checkedHandle(): Long {
+        check(handle != 0L) { "LibraryWatcher is closed" }
+        return handle
+    }
+
+    private companion object {
+        init {
+            System.loadLibrary("taglib")
+        }
+
+        @JvmStatic
+        private external fun create(quietMillis: Int, maxDelayMillis: Int): Long
+
+        @JvmStatic
+        private external fun addRoot(handle: Long, path: String): Boolean
+
+        @JvmStatic
+        private external fun waitForChanges(handle: Long, timeoutMillis: Int): Array<LibraryChange>
+
+        @JvmStatic
+        private external fun wakeUp(handle: Long)
+
+        @JvmStatic
+        private external fun destroy(handle: Long)
+    }
+}
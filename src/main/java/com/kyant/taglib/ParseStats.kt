@@ -0,0 +1,75 @@
+package com.kyant.taglib
+
+/**
+ * ParseStats contains I/O and timing counters of native calls, collected when enabled with
+ * [TagLib.setStatsEnabled].
+ *
+ * @property calls Number of calls these counters were collected from
+ * @property format Detected format, e.g. "MPEG", "FLAC", "MP4", empty if no format matched
+ * @property detectionAttempts Number of formats tried during detection
+ * @property bytesRead Bytes read from the file
+ * @property bytesWritten Bytes written to the file
+ * @property readCalls Number of read calls on the file
+ * @property writeCalls Number of write calls on the file
+ * @property seekCalls Number of seek calls on the file
+ * @property detectNanos Time spent probing formats that did not match, in nanoseconds
+ * @property parseNanos Time spent parsing the file of the detected format, in nanoseconds
+ * @property propertiesNanos Time spent exporting the property map, in nanoseconds
+ * @property picturesNanos Time spent exporting the pictures, in nanoseconds
+ * @property conversionNanos Time spent converting values to and from Java objects, in nanoseconds
+ * @property saveNanos Time spent saving the file, in nanoseconds
+ * @property allocations Number of native heap allocations, only counted if
+ * [TagLib.isAllocationStatsAvailable]
+ * @property allocatedBytes Total bytes of the native heap allocations
+ * @property peakLiveBytes Highest amount of native heap memory in use by a single call
+ */
+public data class ParseStats(
+    val calls: Long,
+    val format: String,
+    val detectionAttempts: Long,
+    val bytesRead: Long,
+    val bytesWritten: Long,
+    val readCalls: Long,
+    val writeCalls: Long,
+    val seekCalls: Long,
+    val detectNanos: Long,
+    val parseNanos: Long,
+    val propertiesNanos: Long,
+    val picturesNanos: Long,
+    val conversionNanos: Long,
+    val saveNanos: Long,
+    val allocations: Long,
+    val allocatedBytes: Long,
+    val peakLiveBytes: Long,
+) {
+
+    /**
+     * Total time of all phases in nanoseconds.
+     */
+    public val totalNanos: Long
+        get() = detectNanos + parseNanos + propertiesNanos + picturesNanos + conversionNanos + saveNanos
+
+    /**
+     * Adds the counters of [other] to these. The format is kept only if both are of the same format,
+     * and the peak live bytes is the higher of both.
+     */
+    public operator fun plus(other: ParseStats): ParseStats = ParseStats(
+        calls = calls + other.calls,
+        format = if (format == other.format) format else "",
+        detectionAttempts = detectionAttempts + other.detectionAttempts,
+        bytesRead = bytesRead + other.bytesRead,
+        bytesWritten = bytesWritten + other.bytesWritten,
+        readCalls = readCalls + other.readCalls,
+        writeCalls = writeCalls + other.writeCalls,
+        seekCalls = seekCalls + other.seekCalls,
+        detectNanos = detectNanos + other.detectNanos,
+        parseNanos = parseNanos + other.parseNanos,
+        propertiesNanos = propertiesNanos + other.propertiesNanos,
+        picturesNanos = picturesNanos + other.picturesNanos,
+        conversionNanos = conversionNanos + other.conversionNanos,
+        saveNanos = saveNanos + other.saveNanos,
+        allocations = allocations + other.allocations,
+        allocatedBytes = allocatedBytes + other.allocatedBytes,
+        peakLiveBytes = maxOf(peakLiveBytes, other.peakLiveBytes),
+    )
+}
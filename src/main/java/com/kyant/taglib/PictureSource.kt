@@ -0,0 +1,87 @@
+package com.kyant.taglib
+
+import java.nio.ByteBuffer
+
+/**
+ * PictureSource describes a picture to save whose data is read natively, so that it is never copied
+ * into a Java byte array. Create one with [fromBuffer] or [fromFd] and save it with
+ * [TagLib.savePictureSources].
+ *
+ * @param buffer Direct buffer holding the picture data, or null if the data is read from [fd]
+ * @param fd File descriptor to read the picture data from, or -1 if the data is in [buffer]
+ * @param offset Offset of the picture data in [buffer] or [fd]
+ * @param length Length of the picture data in bytes
+ * @param description String with description
+ * @param pictureType String with type as specified for ID3v2, e.g. "Front Cover", "Back Cover", "Band"
+ * @param mimeType String with image format, e.g. "image/jpeg"
+ */
+public class PictureSource private constructor(
+    public val buffer: ByteBuffer?,
+    public val fd: Int,
+    public val offset: Long,
+    public val length: Long,
+    public val description: String,
+    public val pictureType: String,
+    public val mimeType: String,
+) {
+
+    override fun toString(): String {
+        return "PictureSource(" +
+                (if (buffer != null) "buffer" else "fd=$fd") + "[$offset, +$length], " +
+                "description=$description, " +
+                "pictureType=$pictureType, " +
+                "mimeType=$mimeType)"
+    }
+
+    public companion object {
+        /**
+         * Picture data in the remaining bytes of a direct [buffer]. The position of the buffer is not
+         * changed, so the same buffer can be saved to several files.
+         */
+        @JvmStatic
+        public fun fromBuffer(
+            buffer: ByteBuffer,
+            description: String,
+            pictureType: String,
+            mimeType: String,
+        ): PictureSource {
+            require(buffer.isDirect) { "buffer must be a direct ByteBuffer" }
+            return PictureSource(
+                buffer = buffer,
+                fd = -1,
+                offset = buffer.position().toLong(),
+                length = buffer.remaining().toLong(),
+                description = description,
+                pictureType = pictureType,
+                mimeType = mimeType,
+            )
+        }
+
+        /**
+         * Picture data in the range [offset, offset + length) of the file behind [fd]. The file is read
+         * with positional reads, so the file offset of [fd] is not changed and the caller keeps ownership
+         * of [fd].
+         */
+        @JvmStatic
+        public fun fromFd(
+            fd: Int,
+            offset: Long,
+            length: Long,
+            description: String,
+            pictureType: String,
+            mimeType: String,
+        ): PictureSource {
+            require(fd >= 0) { "fd must be a valid file descriptor" }
+            require(offset >= 0 && length >= 0) { "offset and length must not be negative" }
+            return PictureSource(
+                buffer = null,
+                fd = fd,
+                offset = offset,
+                length = length,
+                description = description,
+                pictureType = pictureType,
+                mimeType = mimeType,
+            )
+        }
+    }
+}
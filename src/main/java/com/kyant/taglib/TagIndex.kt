@@ -0,0 +1,195 @@
+package com.kyant.taglib
+
+import java.io.Closeable
+import java.util.concurrent.locks.ReentrantReadWriteLock
+import kotlin.concurrent.read
+import kotlin.concurrent.write
+
+/**
+ * TagIndex keeps selected properties of the tracks of a library in native memory, for browsing and
+ * search as you type without holding the tags in Java objects.
+ *
+ * Each field is stored as a column of codes into a dictionary of its distinct values, so that an
+ * artist takes the same space however many tracks it has. Only the first value of a property is
+ * indexed. Values are matched case insensitively. Queries return row ids, the values returned by
+ * [add], and [getValue] returns the value of a row to display.
+ *
+ * All methods can be called from any thread, [close] included: it waits for the calls in progress,
+ * and the calls after it throw [IllegalStateException].
+ *
+ * @param fields Names of the properties to index, e.g. "ARTIST", "ALBUM", "TITLE"
+ */
+public class TagIndex(fields: Array<String>) : Closeable {
+
+    private var handle: Long = create(fields)
+
+    // Held for reading by the calls using the handle, which the native index serializes itself, and for
+    // writing by close(), so that no call uses a destroyed index.
+    private val lock = ReentrantReadWriteLock()
+
+    /**
+     * The number of rows added, including the removed ones.
+     */
+    public val size: Int
+        get() = lock.read { size(checkedHandle()) }
+
+    /**
+     * An estimate of the native memory used by the index, in bytes.
+     */
+    public val memoryUsage: Long
+        get() = lock.read { memoryUsage(checkedHandle()) }
+
+    /**
+     * Read the properties of a file and add them as a row, e.g. while scanning the library.
+     *
+     * @param fd File descriptor
+     *
+     * @return The row id, or -1 if the file could not be read
+     */
+    public fun add(fd: Int): Int = lock.read { add(checkedHandle(), fd) }
+
+    /**
+     * Add properties already read as a row, e.g. the [Metadata.propertyMap] returned by
+     * [TagLib.getMetadata] while scanning the library, so that the file is not parsed again.
+     *
+     * @param propertyMap Properties of the track
+     *
+     * @return The row id
+     */
+    public fun add(propertyMap: PropertyMap): Int = lock.read { addProperties(checkedHandle(), propertyMap) }
+
+    /**
+     * Remove a row, e.g. for a [LibraryChange] of a file that was changed or removed. The row id is
+     * not reused.
+     *
+     * @param row Row id
+     *
+     * @return false if there is no such row
+     */
+    public fun remove(row: Int): Boolean = lock.read { remove(checkedHandle(), row) }
+
+    /**
+     * Find the rows with a word of [field] starting with [prefix].
+     *
+     * @param field Property name, one of the indexed fields
+     * @param prefix Start of a word, e.g. "beat" matches "The Beatles"
+     * @param limit Maximum number of rows to return
+     *
+     * @return The row ids, in ascending order
+     */
+    public fun prefixSearch(
+        field: String,
+        prefix: String,
+        limit: Int = Int.MAX_VALUE,
+    ): IntArray = lock.read { prefixSearch(checkedHandle(), field, prefix, limit) }
+
+    /**
+     * Find the rows whose [field] contains [text], or with a word starting with [text] if it is
+     * shorter than three bytes.
+     *
+     * @param field Property name, one of the indexed fields
+     * @param text Text to find
+     * @param limit Maximum number of rows to return
+     *
+     * @return The row ids, in ascending order
+     */
+    public fun search(
+        field: String,
+        text: String,
+        limit: Int = Int.MAX_VALUE,
+    ): IntArray = lock.read { search(checkedHandle(), field, text, limit) }
+
+    /**
+     * Group the rows by the value of [field], e.g. to list the albums of the library, or with
+     * [withinField] and [withinRow] the albums of the artist of a row.
+     *
+     * @param field Property name, one of the indexed fields
+     * @param withinField Property name, to group only the rows sharing its value with [withinRow]
+     * @param withinRow Row id, used with [withinField]
+     *
+     * @return One row id per group, ordered by the value of [field]
+     */
+    public fun groups(
+        field: String,
+        withinField: String? = null,
+        withinRow: Int = -1,
+    ): IntArray = lock.read { groups(checkedHandle(), field, withinField, withinRow) }
+
+    /**
+     * Find the rows with the same value of [field] as [row], e.g. the tracks of an album.
+     *
+     * @param field Property name, one of the indexed fields
+     * @param row Row id
+     *
+     * @return The row ids, in ascending order
+     */
+    public fun groupRows(field: String, row: Int): IntArray = lock.read {
+        groupRows(checkedHandle(), field, row)
+    }
+
+    /**
+     * Get the value of [field] in [row].
+     *
+     * @param field Property name, one of the indexed fields
+     * @param row Row id
+     *
+     * @return The value, or null if the row has none
+     */
+    public fun getValue(field: String, row: Int): String? = lock.read {
+        getValue(checkedHandle(), field, row)
+    }
+
+    override fun close(): Unit = lock.write {
+        if (handle != 0L) {
+            destroy(handle)
+            handle = 0L
+        }
+    }
+
+    private fun checkedHandle(): Long {
+        check(handle != 0L) { "TagIndex is closed" }
+        return handle
+    }
+
+    private companion object {
+        init {
+            System.loadLibrary("taglib")
+        }
+
+        @JvmStatic
+        private external fun create(fields: Array<String>): Long
+
+        @JvmStatic
+        private external fun add(handle: Long, fd: Int): Int
+
+        @JvmStatic
+        private external fun addProperties(handle: Long, propertyMap: PropertyMap): Int
+
+        @JvmStatic
+        private external fun remove(handle: Long, row: Int): Boolean
+
+        @JvmStatic
+        private external fun size(handle: Long): Int
+
+        @JvmStatic
+        private external fun memoryUsage(handle: Long): Long
+
+        @JvmStatic
+        private external fun prefixSearch(handle: Long, field: String, prefix: String, limit: Int): IntArray
+
+        @JvmStatic
+        private external fun search(handle: Long, field: String, text: String, limit: Int): IntArray
+
+        @JvmStatic
+        private external fun groups(handle: Long, field: String, withinField: String?, withinRow: Int): IntArray
+
+        @JvmStatic
+        private external fun groupRows(handle: Long, field: String, row: Int): IntArray
+
+        @JvmStatic
+        private external fun getValue(handle: Long, field: String, row: Int): String?
+
+        @JvmStatic
+        private external fun destroy(handle: Long)
+    }
+}
@@ -2,6 +2,10 @@ package com.kyant.taglib
 
 /**
  * An object that provides access to the native TagLib library.
+ *
+ * All functions can be called from any thread concurrently. Reads of different files run in parallel,
+ * and a save of a file waits for the reads and saves of the same file in this process to finish, and
+ * keeps them waiting until it is done.
  */
 public object TagLib {
 
@@ -67,6 +71,45 @@ public object TagLib {
             ?: pictures.firstOrNull()
     }
 
+    /**
+     * Write the data of a picture to another file descriptor, e.g. to fill a cover cache, without
+     * passing it through the Java heap. When the picture is stored as is in the file (FLAC pictures,
+     * MP4 cover art and most ID3v2 pictures), it is copied by the kernel from the file to [outputFd];
+     * otherwise it is decoded natively and written with a single write.
+     *
+     * @param fd File descriptor of the audio file
+     * @param outputFd File descriptor to write the picture to, at its current offset. It is not closed.
+     * @param pictureType Type of the picture to export. The first picture is exported if there is no
+     * picture of this type.
+     *
+     * @return The exported picture, or null if the file has no pictures or writing failed
+     */
+    @JvmStatic
+    public external fun exportPicture(
+        fd: Int,
+        outputFd: Int,
+        pictureType: String = "Front Cover",
+    ): ExportedPicture?
+
+    /**
+     * Get a hash of the audio data of a file, which stays the same when its tags or pictures are
+     * edited, e.g. to find duplicates or to recognize a file after it was retagged. The tags (ID3v2,
+     * ID3v1, APE, Vorbis comments, MP4 `ilst`, RIFF `INFO` and the like) are left out and the rest is
+     * read at storage speed, in chunks hashed in parallel by up to [threads] threads. The hash does
+     * not depend on the number of threads.
+     *
+     * @param fd File descriptor
+     * @param threads Maximum number of threads to hash with, 0 for one per CPU core
+     *
+     * @return The hash as 16 hexadecimal digits, or null if the format is not supported or the file
+     * cannot be read
+     */
+    @JvmStatic
+    public external fun getAudioHash(
+        fd: Int,
+        threads: Int = 1,
+    ): String?
+
     /**
      * Save metadata by file descriptor.
      *
@@ -94,4 +137,91 @@ public object TagLib {
         fd: Int,
         pictures: Array<Picture>,
     ): Boolean
+
+    /**
+     * Save pictures by file descriptor, reading their data natively from direct buffers or file
+     * ranges. Unlike [savePictures], the picture data never lives on the Java heap and is copied
+     * at most once before it is written into the tag.
+     *
+     * @param fd File descriptor
+     * @param pictures Pictures to save
+     *
+     * @return Whether the operation was successful, false if a picture source could not be read
+     */
+    @JvmStatic
+    public external fun savePictureSources(
+        fd: Int,
+        pictures: Array<PictureSource>,
+    ): Boolean
+
+    /**
+     * Enable or disable collecting [ParseStats] of native calls. Disabled by default.
+     *
+     * @param enabled Whether to collect stats
+     */
+    @JvmStatic
+    public external fun setStatsEnabled(enabled: Boolean)
+
+    /**
+     * Enable or disable interning of property values that are usually shared by many tracks, such as
+     * ALBUM, ARTIST, ALBUMARTIST, GENRE and DATE. While enabled, such a value is returned as the same
+     * [String] instance by every call, which saves creating it again for each track of an album
+     * during a library scan. Disabling releases the interned values. Disabled by default.
+     *
+     * Standard property keys such as TITLE are always returned as interned strings.
+     *
+     * @param enabled Whether to intern shared values
+     */
+    @JvmStatic
+    public external fun setValueInterningEnabled(enabled: Boolean)
+
+    /**
+     * Get the formats the native library was built with, in the order they are tried when a file
+     * is opened. The names are those of [ParseStats.format], e.g. "MPEG" or "Ogg Vorbis". Formats
+     * can be left out of the build with the Gradle property `taglib.formats`, e.g.
+     * `-Ptaglib.formats=MPEG,FLAC,MP4`.
+     *
+     * @return The format names in detection order
+     */
+    @JvmStatic
+    public external fun getFormats(): Array<String>
+
+    /**
+     * Set the order in which formats are tried when a file is opened: the formats in [formats]
+     * first, in that order, then the others in their default order. Putting the most common formats
+     * of a library first makes opening files with a wrong or missing extension faster. Unknown
+     * names are ignored.
+     *
+     * @param formats Format names, as returned by [getFormats]
+     */
+    @JvmStatic
+    public external fun setDetectionOrder(formats: Array<String>)
+
+    /**
+     * Whether the native library was built with allocation accounting, i.e. with the Gradle property
+     * `taglib.allocStats=ON`. Otherwise the allocation counters of [ParseStats] are always zero.
+     */
+    @JvmStatic
+    public external fun isAllocationStatsAvailable(): Boolean
+
+    /**
+     * Get the stats of the last call made on the current thread while collecting was enabled.
+     *
+     * @return The stats, or null if no call has been collected on this thread
+     */
+    @JvmStatic
+    public external fun getLastStats(): ParseStats?
+
+    /**
+     * Get the stats of all calls collected since the last [resetAggregatedStats], one entry per
+     * detected format. Sum them with [ParseStats.plus] to get the totals of a batch.
+     */
+    @JvmStatic
+    public external fun getAggregatedStats(): Array<ParseStats>
+
+    /**
+     * Reset the aggregated stats, e.g. before starting a new batch.
+     */
+    @JvmStatic
+    public external fun resetAggregatedStats()
 }